@@ -0,0 +1,1013 @@
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+#include "cgen/cgen.h"
+#include "ir/prim.h"
+#include "utils/buf.h"
+#include "utils/map.h"
+#include "utils/vec.h"
+#include "utils/format.h"
+
+#define OUTPUT_BUF_SIZE 4096
+
+MAP(index_map, node_t, size_t)
+
+struct output {
+    struct format_buf* head;
+    struct format_out out;
+};
+
+VEC(buf_vec, struct format_buf*)
+
+struct emitter {
+    struct log* log;
+    struct output types;
+    struct output decls;
+    struct buf_vec funs;
+    struct index_map type_indices;
+    struct index_map fun_indices;
+    size_t type_count;
+    size_t fun_count;
+};
+
+struct fun_emitter {
+    struct emitter* emitter;
+    struct format_out* out;
+    struct index_map locals;
+    size_t local_count;
+};
+
+// Access path to the part of a value that a pattern matches against
+struct path {
+    const struct path* parent;
+    enum {
+        PATH_ROOT,
+        PATH_FIELD,
+        PATH_CASE
+    } tag;
+    size_t index;
+};
+
+static const char prelude[] =
+    "#include <math.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "static inline void noname_bot(void) {\n"
+    "    fputs(\"error: the program evaluated to bottom\\n\", stderr);\n"
+    "    exit(EXIT_FAILURE);\n"
+    "}\n"
+    "\n"
+    "static inline void* noname_alloc(size_t size) {\n"
+    "    static char* ptr = NULL;\n"
+    "    static size_t avail = 0;\n"
+    "    size = (size + 15) & ~(size_t)15;\n"
+    "    if (size > avail) {\n"
+    "        avail = size > 1024 * 1024 ? size : 1024 * 1024;\n"
+    "        if (!(ptr = malloc(avail)))\n"
+    "            abort();\n"
+    "    }\n"
+    "    void* res = ptr;\n"
+    "    ptr += size;\n"
+    "    avail -= size;\n"
+    "    return res;\n"
+    "}\n"
+    "\n"
+    // Integer primitives, with the same semantics as in the IR (see `ir/prim.h`)
+    "static inline uintmax_t noname_mask(uintmax_t a, unsigned w) {\n"
+    "    return w >= 64 ? a : a & ((UINTMAX_C(1) << w) - 1);\n"
+    "}\n"
+    "\n"
+    "static inline intmax_t noname_sext(uintmax_t a, unsigned w) {\n"
+    "    uintmax_t sign = UINTMAX_C(1) << (w - 1);\n"
+    "    return w >= 64 ? (intmax_t)a : (intmax_t)((a ^ sign) - sign);\n"
+    "}\n"
+    "\n"
+    "static inline uintmax_t noname_add(uintmax_t a, uintmax_t b, unsigned w, int s) { (void)s; return noname_mask(a + b, w); }\n"
+    "static inline uintmax_t noname_sub(uintmax_t a, uintmax_t b, unsigned w, int s) { return !s && b > a ? 0 : noname_mask(a - b, w); }\n"
+    "static inline uintmax_t noname_mul(uintmax_t a, uintmax_t b, unsigned w, int s) { (void)s; return noname_mask(a * b, w); }\n"
+    "static inline uintmax_t noname_and(uintmax_t a, uintmax_t b, unsigned w, int s) { (void)w, (void)s; return a & b; }\n"
+    "static inline uintmax_t noname_or (uintmax_t a, uintmax_t b, unsigned w, int s) { (void)w, (void)s; return a | b; }\n"
+    "static inline uintmax_t noname_xor(uintmax_t a, uintmax_t b, unsigned w, int s) { (void)w, (void)s; return a ^ b; }\n"
+    "static inline uintmax_t noname_shl(uintmax_t a, uintmax_t b, unsigned w, int s) { (void)s; return b >= w ? 0 : noname_mask(a << b, w); }\n"
+    "static inline uintmax_t noname_eq (uintmax_t a, uintmax_t b, unsigned w, int s) { (void)w, (void)s; return a == b; }\n"
+    "static inline uintmax_t noname_ne (uintmax_t a, uintmax_t b, unsigned w, int s) { (void)w, (void)s; return a != b; }\n"
+    "static inline uintmax_t noname_lt (uintmax_t a, uintmax_t b, unsigned w, int s) { return s ? noname_sext(a, w) <  noname_sext(b, w) : a <  b; }\n"
+    "static inline uintmax_t noname_le (uintmax_t a, uintmax_t b, unsigned w, int s) { return s ? noname_sext(a, w) <= noname_sext(b, w) : a <= b; }\n"
+    "static inline uintmax_t noname_gt (uintmax_t a, uintmax_t b, unsigned w, int s) { return noname_lt(b, a, w, s); }\n"
+    "static inline uintmax_t noname_ge (uintmax_t a, uintmax_t b, unsigned w, int s) { return noname_le(b, a, w, s); }\n"
+    "static inline uintmax_t noname_neg(uintmax_t a, uintmax_t b, unsigned w, int s) { (void)b; return s ? noname_mask(-a, w) : 0; }\n"
+    "static inline uintmax_t noname_not(uintmax_t a, uintmax_t b, unsigned w, int s) { (void)b, (void)s; return noname_mask(~a, w); }\n"
+    "\n"
+    "static inline uintmax_t noname_div(uintmax_t a, uintmax_t b, unsigned w, int s) {\n"
+    "    if (b == 0) return 0;\n"
+    "    if (!s) return a / b;\n"
+    "    if (noname_sext(b, w) == -1) return noname_mask(-a, w);\n"
+    "    return noname_mask((uintmax_t)(noname_sext(a, w) / noname_sext(b, w)), w);\n"
+    "}\n"
+    "\n"
+    "static inline uintmax_t noname_rem(uintmax_t a, uintmax_t b, unsigned w, int s) {\n"
+    "    if (b == 0) return a;\n"
+    "    if (!s) return a % b;\n"
+    "    if (noname_sext(b, w) == -1) return 0;\n"
+    "    return noname_mask((uintmax_t)(noname_sext(a, w) % noname_sext(b, w)), w);\n"
+    "}\n"
+    "\n"
+    "static inline uintmax_t noname_shr(uintmax_t a, uintmax_t b, unsigned w, int s) {\n"
+    "    if (!s) return b >= w ? 0 : a >> b;\n"
+    "    intmax_t x = noname_sext(a, w);\n"
+    "    return noname_mask((uintmax_t)(b >= w ? (x < 0 ? -1 : 0) : x >> b), w);\n"
+    "}\n"
+    "\n"
+    "static inline uintmax_t noname_sconv(uintmax_t a, unsigned from, unsigned to, int to_nat) {\n"
+    "    intmax_t x = noname_sext(a, from);\n"
+    "    return to_nat && x < 0 ? 0 : noname_mask((uintmax_t)x, to);\n"
+    "}\n"
+    "\n"
+    "static inline uintmax_t noname_ftoi(double d, unsigned w) {\n"
+    "    uintmax_t max = (UINTMAX_C(1) << (w - 1)) - 1;\n"
+    "    double limit = (double)(UINTMAX_C(1) << (w - 1));\n"
+    "    if (d != d) return 0;\n"
+    "    if (d >= limit) return max;\n"
+    "    if (d <= -limit) return noname_mask(max + 1, w);\n"
+    "    return noname_mask((uintmax_t)(intmax_t)d, w);\n"
+    "}\n"
+    "\n"
+    "static inline uintmax_t noname_ftou(double d) {\n"
+    "    if (d != d || d <= 0) return 0;\n"
+    "    if (d >= 18446744073709551616.0) return UINTMAX_MAX;\n"
+    "    return (uintmax_t)d;\n"
+    "}\n"
+    "\n";
+
+static size_t emit_exp(struct fun_emitter*, node_t);
+
+// Helpers -------------------------------------------------------------------------
+
+static inline struct output new_output(void) {
+    struct format_buf* head = xmalloc(sizeof(struct format_buf));
+    *head = (struct format_buf) { .data = xmalloc(OUTPUT_BUF_SIZE), .cap = OUTPUT_BUF_SIZE };
+    return (struct output) {
+        .head = head,
+        .out = { .buf = head, .tab = "    " }
+    };
+}
+
+static inline void emit_indent(struct format_out* out) {
+    for (size_t i = 0, n = out->indent; i < n; ++i)
+        format(out, "%0:s", FORMAT_ARGS({ .s = out->tab }));
+}
+
+static inline bool is_type_level(node_t node) {
+    return
+        node->tag == NODE_UNI ||
+        node->type->tag == NODE_UNI ||
+        node->type->type->tag == NODE_UNI;
+}
+
+static inline size_t find_elem_index(node_t type, label_t label) {
+    size_t index = find_label_in_node(reduce_node(type), label);
+    assert(index != SIZE_MAX);
+    return index;
+}
+
+static inline void unsupported(struct emitter* emitter, node_t node, const char* msg) {
+    log_error(emitter->log, &node->loc,
+        "%0:s are not supported by the C backend", FORMAT_ARGS({ .s = msg }));
+}
+
+// Types ---------------------------------------------------------------------------
+
+static size_t emit_type(struct emitter*, node_t);
+
+static inline void emit_printer_header(struct emitter* emitter, size_t index) {
+    format(&emitter->types.out,
+        "static inline void print_t%0:u(t%0:u v) {\n",
+        FORMAT_ARGS({ .u = index }));
+}
+
+static inline void emit_type_string(struct emitter* emitter, node_t type) {
+    // Types are printed in the source language, so that the output of
+    // the generated program matches that of the pretty printer.
+    format(&emitter->types.out, "%0:e", FORMAT_ARGS({ .n = type }));
+}
+
+static inline bool is_sized_type(node_t type, unsigned tag) {
+    return
+        type->tag == NODE_APP &&
+        type->app.left->tag == tag &&
+        type->app.right->tag == NODE_LIT;
+}
+
+static inline size_t get_int_bitwidth(node_t type) {
+    uintmax_t bitwidth = type->app.right->lit.int_val;
+    return bitwidth <= 8 ? 8 : bitwidth <= 16 ? 16 : bitwidth <= 32 ? 32 : 64;
+}
+
+static size_t emit_prod_type(struct emitter* emitter, node_t prod) {
+    size_t* field_types = new_buf(size_t, prod->prod.arg_count);
+    for (size_t i = 0, n = prod->prod.arg_count; i < n; ++i)
+        field_types[i] = emit_type(emitter, prod->prod.args[i]);
+    size_t index = emitter->type_count++;
+    struct format_out* out = &emitter->types.out;
+    format(out, "typedef struct {\n", NULL);
+    for (size_t i = 0, n = prod->prod.arg_count; i < n; ++i)
+        format(out, "    t%0:u f%1:u;\n", FORMAT_ARGS({ .u = field_types[i] }, { .u = i }));
+    if (prod->prod.arg_count == 0)
+        format(out, "    char unused;\n", NULL);
+    format(out, "} t%0:u;\n", FORMAT_ARGS({ .u = index }));
+
+    emit_printer_header(emitter, index);
+    format(out, "    fputs(\"{ \", stdout);\n", NULL);
+    for (size_t i = 0, n = prod->prod.arg_count; i < n; ++i) {
+        format(out,
+            "    fputs(\"%0:s%1:s = \", stdout);\n"
+            "    print_t%2:u(v.f%3:u);\n",
+            FORMAT_ARGS(
+                { .s = i > 0 ? ", " : "" },
+                { .s = prod->prod.labels[i]->name },
+                { .u = field_types[i] },
+                { .u = i }));
+    }
+    format(out, "    fputs(\" }\", stdout);\n}\n", NULL);
+    free_buf(field_types);
+    return index;
+}
+
+static size_t emit_sum_type(struct emitter* emitter, node_t sum) {
+    size_t* case_types = new_buf(size_t, sum->sum.arg_count);
+    for (size_t i = 0, n = sum->sum.arg_count; i < n; ++i)
+        case_types[i] = emit_type(emitter, sum->sum.args[i]);
+    size_t index = emitter->type_count++;
+    struct format_out* out = &emitter->types.out;
+    format(out, "typedef struct {\n    unsigned tag;\n    union {\n", NULL);
+    for (size_t i = 0, n = sum->sum.arg_count; i < n; ++i)
+        format(out, "        t%0:u c%1:u;\n", FORMAT_ARGS({ .u = case_types[i] }, { .u = i }));
+    if (sum->sum.arg_count == 0)
+        format(out, "        char unused;\n", NULL);
+    format(out, "    } as;\n} t%0:u;\n", FORMAT_ARGS({ .u = index }));
+
+    emit_printer_header(emitter, index);
+    format(out, "    switch (v.tag) {\n", NULL);
+    for (size_t i = 0, n = sum->sum.arg_count; i < n; ++i) {
+        format(out, "        case %0:u:\n            fputs(\"(inj ", FORMAT_ARGS({ .u = i }));
+        emit_type_string(emitter, sum);
+        format(out,
+            " %0:s \", stdout);\n"
+            "            print_t%1:u(v.as.c%2:u);\n"
+            "            break;\n",
+            FORMAT_ARGS({ .s = sum->sum.labels[i]->name }, { .u = case_types[i] }, { .u = i }));
+    }
+    format(out, "    }\n    fputs(\")\", stdout);\n}\n", NULL);
+    free_buf(case_types);
+    return index;
+}
+
+static size_t emit_arrow_type(struct emitter* emitter, node_t arrow) {
+    if (!is_unbound_var(arrow->arrow.var) && contains_var(arrow->arrow.codom->free_vars, arrow->arrow.var)) {
+        unsupported(emitter, arrow, "dependent or polymorphic functions");
+        return SIZE_MAX;
+    }
+    size_t arg_type = emit_type(emitter, arrow->arrow.var->type);
+    size_t res_type = emit_type(emitter, arrow->arrow.codom);
+    size_t index = emitter->type_count++;
+    format(&emitter->types.out,
+        "struct t%0:u_closure;\n"
+        "typedef struct t%0:u_closure* t%0:u;\n"
+        "struct t%0:u_closure {\n"
+        "    t%1:u (*fn)(t%0:u, t%2:u);\n"
+        "};\n",
+        FORMAT_ARGS({ .u = index }, { .u = res_type }, { .u = arg_type }));
+    emit_printer_header(emitter, index);
+    format(&emitter->types.out, "    (void)v;\n    fputs(\"<closure>\", stdout);\n}\n", NULL);
+    return index;
+}
+
+static size_t emit_array_type(struct emitter* emitter, node_t array) {
+    // Arrays are stored contiguously, and their dimension is known statically
+    uintmax_t dim;
+    if (!get_array_dim(array, &dim)) {
+        unsupported(emitter, array, "arrays with a dimension that is not constant");
+        return SIZE_MAX;
+    }
+    size_t elem_type = emit_type(emitter, array->array.elem);
+    size_t index = emitter->type_count++;
+    struct format_out* out = &emitter->types.out;
+    format(out, "typedef t%0:u* t%1:u;\n", FORMAT_ARGS({ .u = elem_type }, { .u = index }));
+    emit_printer_header(emitter, index);
+    if (dim == 0) {
+        format(out, "    (void)v;\n    fputs(\"[]\", stdout);\n}\n", NULL);
+        return index;
+    }
+    format(out,
+        "    fputs(\"[\", stdout);\n"
+        "    for (size_t i = 0; i < %0:u; ++i) {\n"
+        "        if (i > 0)\n"
+        "            fputs(\", \", stdout);\n"
+        "        print_t%1:u(v[i]);\n"
+        "    }\n"
+        "    fputs(\"]\", stdout);\n"
+        "}\n",
+        FORMAT_ARGS({ .u = dim }, { .u = elem_type }));
+    return index;
+}
+
+static size_t emit_scalar_type(struct emitter* emitter, node_t type, const char* c_type, const char* fmt, const char* cast) {
+    size_t index = emitter->type_count++;
+    struct format_out* out = &emitter->types.out;
+    format(out, "typedef %0:s t%1:u;\n", FORMAT_ARGS({ .s = c_type }, { .u = index }));
+    emit_printer_header(emitter, index);
+    if (type->tag == NODE_NAT) {
+        format(out, "    printf(\"%0:s\", (%1:s)v);\n}\n", FORMAT_ARGS({ .s = fmt }, { .s = cast }));
+        return index;
+    }
+    format(out, "    printf(\"(%0:s : ", FORMAT_ARGS({ .s = fmt }));
+    emit_type_string(emitter, type);
+    format(out, ")\", (%0:s)v);\n}\n", FORMAT_ARGS({ .s = cast }));
+    return index;
+}
+
+static size_t emit_type(struct emitter* emitter, node_t type) {
+    type = reduce_node(type);
+    size_t* found = find_in_index_map(&emitter->type_indices, type);
+    if (found)
+        return *found;
+
+    // Types are numbered after their components, so that they are declared in order
+    size_t index = SIZE_MAX;
+    switch (type->tag) {
+        case NODE_NAT:
+            index = emit_scalar_type(emitter, type, "uintmax_t", "%ju", "uintmax_t");
+            break;
+        case NODE_TOP:
+            index = emitter->type_count++;
+            format(&emitter->types.out, "typedef unsigned char t%0:u;\n", FORMAT_ARGS({ .u = index }));
+            emit_printer_header(emitter, index);
+            format(&emitter->types.out, "    (void)v;\n    fputs(\"<top>\", stdout);\n}\n", NULL);
+            break;
+        case NODE_PROD:  index = emit_prod_type(emitter, type);  break;
+        case NODE_SUM:   index = emit_sum_type(emitter, type);   break;
+        case NODE_ARROW: index = emit_arrow_type(emitter, type); break;
+        case NODE_ARRAY: index = emit_array_type(emitter, type); break;
+        case NODE_APP:
+            if (is_sized_type(type, NODE_INT)) {
+                // Integers are stored as their lowest bits, like literals
+                char c_type[16];
+                snprintf(c_type, sizeof(c_type), "uint%zu_t", get_int_bitwidth(type));
+                index = emit_scalar_type(emitter, type, c_type, "%ju", "uintmax_t");
+                break;
+            } else if (is_sized_type(type, NODE_FLOAT)) {
+                index = emit_scalar_type(emitter, type,
+                    type->app.right->lit.int_val <= 32 ? "float" : "double", "%a", "double");
+                break;
+            }
+            // fallthrough
+        default:
+            unsupported(emitter, type, "types of this kind");
+            return SIZE_MAX;
+    }
+    insert_in_index_map(&emitter->type_indices, type, index);
+    return index;
+}
+
+// Functions -----------------------------------------------------------------------
+
+static inline struct fun_emitter new_fun_emitter(struct emitter* emitter, struct format_out* out) {
+    return (struct fun_emitter) {
+        .emitter = emitter,
+        .out = out,
+        .locals = new_index_map()
+    };
+}
+
+static inline size_t begin_local(struct fun_emitter* fun_emitter, node_t type) {
+    size_t local = fun_emitter->local_count++;
+    emit_indent(fun_emitter->out);
+    format(fun_emitter->out, "t%0:u v%1:u",
+        FORMAT_ARGS({ .u = emit_type(fun_emitter->emitter, type) }, { .u = local }));
+    return local;
+}
+
+static inline void emit_line(struct fun_emitter* fun_emitter, const char* fmt, const union format_arg* args) {
+    emit_indent(fun_emitter->out);
+    format(fun_emitter->out, fmt, args);
+    format(fun_emitter->out, "\n", NULL);
+}
+
+static void emit_fun(struct fun_emitter* parent, node_t abs, size_t index, struct node_vec* captures) {
+    // The function is lifted to the top level, and its free variables are passed in the environment
+    struct emitter* emitter = parent->emitter;
+    size_t type = emit_type(emitter, abs->type);
+    size_t arg_type = emit_type(emitter, abs->abs.var->type);
+    size_t res_type = emit_type(emitter, abs->abs.body->type);
+
+    for (size_t i = 0, n = abs->free_vars->count; i < n; ++i) {
+        node_t var = abs->free_vars->vars[i];
+        if (find_in_index_map(&parent->locals, var))
+            push_to_node_vec(captures, var);
+    }
+
+    struct format_out* decls = &emitter->decls.out;
+    format(decls, "struct env%0:u {\n    struct t%1:u_closure base;\n",
+        FORMAT_ARGS({ .u = index }, { .u = type }));
+    for (size_t i = 0; i < captures->size; ++i) {
+        format(decls, "    t%0:u c%1:u;\n",
+            FORMAT_ARGS({ .u = emit_type(emitter, captures->elems[i]->type) }, { .u = i }));
+    }
+    format(decls,
+        "};\n"
+        "static t%0:u fun%1:u(t%2:u, t%3:u);\n",
+        FORMAT_ARGS({ .u = res_type }, { .u = index }, { .u = type }, { .u = arg_type }));
+    if (captures->size == 0) {
+        format(decls, "static struct env%0:u closure%0:u = { { fun%0:u } };\n",
+            FORMAT_ARGS({ .u = index }));
+    }
+
+    struct output output = new_output();
+    struct fun_emitter fun_emitter = new_fun_emitter(emitter, &output.out);
+    size_t arg = fun_emitter.local_count++;
+    if (!is_unbound_var(abs->abs.var))
+        insert_in_index_map(&fun_emitter.locals, abs->abs.var, arg);
+    format(fun_emitter.out,
+        "static t%0:u fun%1:u(t%2:u self, t%3:u v%4:u) {\n",
+        FORMAT_ARGS({ .u = res_type }, { .u = index }, { .u = type }, { .u = arg_type }, { .u = arg }));
+    fun_emitter.out->indent++;
+    if (captures->size == 0)
+        emit_line(&fun_emitter, "(void)self;", NULL);
+    for (size_t i = 0; i < captures->size; ++i) {
+        size_t local = begin_local(&fun_emitter, captures->elems[i]->type);
+        format(fun_emitter.out, " = ((struct env%0:u*)self)->c%1:u;\n", FORMAT_ARGS({ .u = index }, { .u = i }));
+        insert_in_index_map(&fun_emitter.locals, captures->elems[i], local);
+    }
+    size_t res = emit_exp(&fun_emitter, abs->abs.body);
+    emit_line(&fun_emitter, "return v%0:u;", FORMAT_ARGS({ .u = res }));
+    fun_emitter.out->indent--;
+    format(fun_emitter.out, "}\n\n", NULL);
+    free_index_map(&fun_emitter.locals);
+    push_to_buf_vec(&emitter->funs, output.head);
+}
+
+static size_t emit_closure(struct fun_emitter* fun_emitter, node_t abs, size_t fun_index, struct node_vec* captures) {
+    // Captured variables are stored separately, to allow recursive closures
+    emit_fun(fun_emitter, abs, fun_index, captures);
+    size_t local = begin_local(fun_emitter, abs->type);
+    if (captures->size == 0) {
+        format(fun_emitter->out, " = &closure%0:u.base;\n", FORMAT_ARGS({ .u = fun_index }));
+        return local;
+    }
+    format(fun_emitter->out, " = noname_alloc(sizeof(struct env%0:u));\n", FORMAT_ARGS({ .u = fun_index }));
+    emit_line(fun_emitter, "v%0:u->fn = fun%1:u;", FORMAT_ARGS({ .u = local }, { .u = fun_index }));
+    return local;
+}
+
+static void emit_captures(struct fun_emitter* fun_emitter, size_t local, size_t fun_index, const struct node_vec* captures) {
+    for (size_t i = 0; i < captures->size; ++i) {
+        emit_line(fun_emitter, "((struct env%0:u*)v%1:u)->c%2:u = v%3:u;",
+            FORMAT_ARGS(
+                { .u = fun_index },
+                { .u = local },
+                { .u = i },
+                { .u = *find_in_index_map(&fun_emitter->locals, captures->elems[i]) }));
+    }
+}
+
+static size_t emit_abs(struct fun_emitter* fun_emitter, node_t abs, size_t* fun_index) {
+    struct node_vec captures = new_node_vec();
+    *fun_index = fun_emitter->emitter->fun_count++;
+    size_t local = emit_closure(fun_emitter, abs, *fun_index, &captures);
+    emit_captures(fun_emitter, local, *fun_index, &captures);
+    free_node_vec(&captures);
+    return local;
+}
+
+// Patterns ------------------------------------------------------------------------
+
+static void emit_path(struct format_out* out, const struct path* path) {
+    switch (path->tag) {
+        case PATH_ROOT:
+            format(out, "v%0:u", FORMAT_ARGS({ .u = path->index }));
+            break;
+        case PATH_FIELD:
+            emit_path(out, path->parent);
+            format(out, ".f%0:u", FORMAT_ARGS({ .u = path->index }));
+            break;
+        case PATH_CASE:
+            emit_path(out, path->parent);
+            format(out, ".as.c%0:u", FORMAT_ARGS({ .u = path->index }));
+            break;
+    }
+}
+
+static void emit_lit(struct fun_emitter* fun_emitter, node_t lit) {
+    size_t type = emit_type(fun_emitter->emitter, lit->type);
+    if (lit->lit.tag == LIT_FLOAT && !isfinite(lit->lit.float_val)) {
+        // Infinities and NaNs have no literal syntax in C
+        format(fun_emitter->out, "(t%0:u)%1:s%2:s", FORMAT_ARGS(
+            { .u = type },
+            { .s = signbit(lit->lit.float_val) ? "-" : "" },
+            { .s = isnan(lit->lit.float_val) ? "NAN" : "INFINITY" }));
+    } else if (lit->lit.tag == LIT_FLOAT)
+        format(fun_emitter->out, "(t%0:u)%1:hd", FORMAT_ARGS({ .u = type }, { .d = lit->lit.float_val }));
+    else
+        format(fun_emitter->out, "(t%0:u)UINTMAX_C(%1:u)", FORMAT_ARGS({ .u = type }, { .u = lit->lit.int_val }));
+}
+
+static void emit_pat_tests(struct fun_emitter* fun_emitter, node_t pat, const struct path* path, bool* is_first) {
+    switch (pat->tag) {
+        case NODE_LIT:
+            format(fun_emitter->out, *is_first ? "" : " && ", NULL);
+            emit_path(fun_emitter->out, path);
+            format(fun_emitter->out, " == ", NULL);
+            emit_lit(fun_emitter, pat);
+            *is_first = false;
+            break;
+        case NODE_INJ: {
+            size_t index = find_elem_index(pat->type, pat->inj.label);
+            format(fun_emitter->out, *is_first ? "" : " && ", NULL);
+            emit_path(fun_emitter->out, path);
+            format(fun_emitter->out, ".tag == %0:u", FORMAT_ARGS({ .u = index }));
+            *is_first = false;
+            emit_pat_tests(fun_emitter, pat->inj.arg,
+                &(struct path) { .parent = path, .tag = PATH_CASE, .index = index }, is_first);
+            break;
+        }
+        case NODE_RECORD:
+            for (size_t i = 0, n = pat->record.arg_count; i < n; ++i) {
+                size_t index = find_elem_index(pat->type, pat->record.labels[i]);
+                emit_pat_tests(fun_emitter, pat->record.args[i],
+                    &(struct path) { .parent = path, .tag = PATH_FIELD, .index = index }, is_first);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void emit_pat_bindings(struct fun_emitter* fun_emitter, node_t pat, const struct path* path) {
+    switch (pat->tag) {
+        case NODE_VAR:
+            if (!is_unbound_var(pat)) {
+                size_t local = begin_local(fun_emitter, pat->type);
+                format(fun_emitter->out, " = ", NULL);
+                emit_path(fun_emitter->out, path);
+                format(fun_emitter->out, ";\n", NULL);
+                insert_in_index_map(&fun_emitter->locals, pat, local);
+            }
+            break;
+        case NODE_INJ:
+            emit_pat_bindings(fun_emitter, pat->inj.arg, &(struct path) {
+                .parent = path,
+                .tag = PATH_CASE,
+                .index = find_elem_index(pat->type, pat->inj.label)
+            });
+            break;
+        case NODE_RECORD:
+            for (size_t i = 0, n = pat->record.arg_count; i < n; ++i) {
+                emit_pat_bindings(fun_emitter, pat->record.args[i], &(struct path) {
+                    .parent = path,
+                    .tag = PATH_FIELD,
+                    .index = find_elem_index(pat->type, pat->record.labels[i])
+                });
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Expressions ---------------------------------------------------------------------
+
+static size_t emit_match(struct fun_emitter* fun_emitter, node_t match) {
+    size_t arg = emit_exp(fun_emitter, match->match.arg);
+    size_t res = begin_local(fun_emitter, match->type);
+    format(fun_emitter->out, ";\n", NULL);
+    const struct path root = { .tag = PATH_ROOT, .index = arg };
+    for (size_t i = 0, n = match->match.pat_count; i < n; ++i) {
+        if (i == 0)
+            emit_indent(fun_emitter->out);
+        format(fun_emitter->out, i == 0 ? "if (" : " else if (", NULL);
+        bool is_first = true;
+        emit_pat_tests(fun_emitter, match->match.pats[i], &root, &is_first);
+        format(fun_emitter->out, is_first ? "1) {\n" : ") {\n", NULL);
+        fun_emitter->out->indent++;
+        emit_pat_bindings(fun_emitter, match->match.pats[i], &root);
+        size_t val = emit_exp(fun_emitter, match->match.vals[i]);
+        emit_line(fun_emitter, "v%0:u = v%1:u;", FORMAT_ARGS({ .u = res }, { .u = val }));
+        fun_emitter->out->indent--;
+        emit_indent(fun_emitter->out);
+        format(fun_emitter->out, "}", NULL);
+    }
+    format(fun_emitter->out, " else\n", NULL);
+    fun_emitter->out->indent++;
+    emit_line(fun_emitter, "noname_bot();", NULL);
+    fun_emitter->out->indent--;
+    return res;
+}
+
+static inline const char* get_int_prim_helper(enum prim_op op) {
+    switch (op) {
+        case PRIM_ADD: return "add";
+        case PRIM_SUB: return "sub";
+        case PRIM_MUL: return "mul";
+        case PRIM_DIV: return "div";
+        case PRIM_REM: return "rem";
+        case PRIM_AND: return "and";
+        case PRIM_OR:  return "or";
+        case PRIM_XOR: return "xor";
+        case PRIM_SHL: return "shl";
+        case PRIM_SHR: return "shr";
+        case PRIM_EQ:  return "eq";
+        case PRIM_NE:  return "ne";
+        case PRIM_LT:  return "lt";
+        case PRIM_GT:  return "gt";
+        case PRIM_LE:  return "le";
+        case PRIM_GE:  return "ge";
+        case PRIM_NEG: return "neg";
+        case PRIM_NOT: return "not";
+        default:
+            assert(false && "invalid integer primitive");
+            return NULL;
+    }
+}
+
+static void emit_conv(struct format_out* out, struct num_type from, struct num_type to, size_t arg) {
+    if (to.tag == NUM_FLOAT) {
+        // The conversion to single precision (if any) happens on assignment
+        format(out, from.tag == NUM_INT ? " = (double)noname_sext(v%0:u, %1:u);\n" : " = (double)v%0:u;\n",
+            FORMAT_ARGS({ .u = arg }, { .u = from.bitwidth }));
+    } else if (from.tag == NUM_FLOAT) {
+        format(out, to.tag == NUM_INT ? " = noname_ftoi(v%0:u, %1:u);\n" : " = noname_ftou(v%0:u);\n",
+            FORMAT_ARGS({ .u = arg }, { .u = to.bitwidth }));
+    } else if (from.tag == NUM_INT) {
+        format(out, " = noname_sconv(v%0:u, %1:u, %2:u, %3:u);\n",
+            FORMAT_ARGS({ .u = arg }, { .u = from.bitwidth }, { .u = to.bitwidth }, { .u = to.tag == NUM_NAT }));
+    } else
+        format(out, " = noname_mask(v%0:u, %1:u);\n", FORMAT_ARGS({ .u = arg }, { .u = to.bitwidth }));
+}
+
+static size_t emit_prim(struct fun_emitter* fun_emitter, node_t prim) {
+    struct num_type arg_type, res_type;
+    bool ok =
+        get_num_type(reduce_node(prim->prim.args[0]->type), &arg_type) &&
+        get_num_type(reduce_node(prim->type), &res_type);
+    assert(ok); (void)ok;
+    size_t args[2] = { 0 };
+    for (size_t i = 0, n = prim->prim.arg_count; i < n; ++i)
+        args[i] = emit_exp(fun_emitter, prim->prim.args[i]);
+    size_t local = begin_local(fun_emitter, prim->type);
+    struct format_out* out = fun_emitter->out;
+    if (prim->prim.op == PRIM_CONV)
+        emit_conv(out, arg_type, res_type, args[0]);
+    else if (arg_type.tag == NUM_FLOAT) {
+        // Floating-point primitives map directly to C operators
+        if (prim->prim.arg_count == 1)
+            format(out, " = -v%0:u;\n", FORMAT_ARGS({ .u = args[0] }));
+        else {
+            format(out, " = v%0:u %1:s v%2:u;\n",
+                FORMAT_ARGS({ .u = args[0] }, { .s = get_prim_symbol(prim->prim.op) }, { .u = args[1] }));
+        }
+    } else {
+        format(out, " = noname_%0:s(v%1:u, %2:s%3:u, %4:u, %5:u);\n",
+            FORMAT_ARGS(
+                { .s = get_int_prim_helper(prim->prim.op) },
+                { .u = args[0] },
+                { .s = prim->prim.arg_count == 1 ? "" : "v" },
+                { .u = args[1] },
+                { .u = arg_type.bitwidth },
+                { .u = arg_type.tag == NUM_INT }));
+    }
+    return local;
+}
+
+static void emit_letrec(struct fun_emitter* fun_emitter, node_t letrec) {
+    // All closures are allocated before their environments are filled,
+    // so that mutually recursive functions can refer to each other.
+    struct emitter* emitter = fun_emitter->emitter;
+    size_t var_count = letrec->letrec.var_count;
+    for (size_t i = 0; i < var_count; ++i) {
+        if (letrec->letrec.vals[i]->tag != NODE_ABS) {
+            unsupported(emitter, letrec->letrec.vals[i], "recursive values that are not functions");
+            return;
+        }
+    }
+    size_t* locals = new_buf(size_t, var_count);
+    size_t first_fun = emitter->fun_count;
+    emitter->fun_count += var_count;
+    for (size_t i = 0; i < var_count; ++i) {
+        insert_in_index_map(&fun_emitter->locals, letrec->letrec.vars[i], SIZE_MAX);
+        insert_in_index_map(&emitter->fun_indices, letrec->letrec.vars[i], first_fun + i);
+    }
+    struct node_vec* captures = new_buf(struct node_vec, var_count);
+    for (size_t i = 0; i < var_count; ++i) {
+        captures[i] = new_node_vec();
+        locals[i] = emit_closure(fun_emitter, letrec->letrec.vals[i], first_fun + i, &captures[i]);
+        *find_in_index_map(&fun_emitter->locals, letrec->letrec.vars[i]) = locals[i];
+    }
+    for (size_t i = 0; i < var_count; ++i) {
+        emit_captures(fun_emitter, locals[i], first_fun + i, &captures[i]);
+        free_node_vec(&captures[i]);
+    }
+    free_buf(captures);
+    free_buf(locals);
+}
+
+static void emit_call(struct fun_emitter* fun_emitter, const size_t* fun_index, size_t fn, size_t arg, const char* suffix) {
+    // Calls to known functions are direct
+    if (fun_index) {
+        format(fun_emitter->out, " = fun%0:u(v%1:u, v%2:u%3:s);\n",
+            FORMAT_ARGS({ .u = *fun_index }, { .u = fn }, { .u = arg }, { .s = suffix }));
+    } else {
+        format(fun_emitter->out, " = v%0:u->fn(v%0:u, v%1:u%2:s);\n",
+            FORMAT_ARGS({ .u = fn }, { .u = arg }, { .s = suffix }));
+    }
+}
+
+static inline uintmax_t get_dim(node_t val) {
+    // Non-constant dimensions are reported when the array type is emitted
+    uintmax_t dim = 0;
+    get_array_dim(reduce_node(val->type), &dim);
+    return dim;
+}
+
+static inline void emit_bounds_check(struct fun_emitter* fun_emitter, size_t index, uintmax_t dim) {
+    emit_line(fun_emitter, "if (v%0:u >= %1:u)", FORMAT_ARGS({ .u = index }, { .u = dim }));
+    fun_emitter->out->indent++;
+    emit_line(fun_emitter, "noname_bot();", NULL);
+    fun_emitter->out->indent--;
+}
+
+static size_t emit_array_op(struct fun_emitter* fun_emitter, node_t node) {
+    struct emitter* emitter = fun_emitter->emitter;
+    struct format_out* out = fun_emitter->out;
+    size_t local = SIZE_MAX;
+    switch (node->tag) {
+        case NODE_ELEMS: {
+            size_t* args = new_buf(size_t, node->elems.arg_count);
+            for (size_t i = 0, n = node->elems.arg_count; i < n; ++i)
+                args[i] = emit_exp(fun_emitter, node->elems.args[i]);
+            local = begin_local(fun_emitter, node->type);
+            format(out, " = noname_alloc(sizeof(t%0:u) * %1:u);\n", FORMAT_ARGS(
+                { .u = emit_type(emitter, node->type->array.elem) },
+                { .u = node->elems.arg_count }));
+            for (size_t i = 0, n = node->elems.arg_count; i < n; ++i)
+                emit_line(fun_emitter, "v%0:u[%1:u] = v%2:u;", FORMAT_ARGS({ .u = local }, { .u = i }, { .u = args[i] }));
+            free_buf(args);
+            return local;
+        }
+        case NODE_INDEX: {
+            size_t val = emit_exp(fun_emitter, node->index.val);
+            size_t index = emit_exp(fun_emitter, node->index.index);
+            emit_bounds_check(fun_emitter, index, get_dim(node->index.val));
+            local = begin_local(fun_emitter, node->type);
+            format(out, " = v%0:u[v%1:u];\n", FORMAT_ARGS({ .u = val }, { .u = index }));
+            return local;
+        }
+        case NODE_UPDATE: {
+            // Updates copy the array, since other references to it may still be live
+            size_t val = emit_exp(fun_emitter, node->update.val);
+            size_t index = emit_exp(fun_emitter, node->update.index);
+            size_t elem = emit_exp(fun_emitter, node->update.elem);
+            uintmax_t dim = get_dim(node->update.val);
+            size_t elem_type = emit_type(emitter, node->update.elem->type);
+            emit_bounds_check(fun_emitter, index, dim);
+            local = begin_local(fun_emitter, node->type);
+            format(out, " = noname_alloc(sizeof(t%0:u) * %1:u);\n", FORMAT_ARGS({ .u = elem_type }, { .u = dim }));
+            emit_line(fun_emitter, "memcpy(v%0:u, v%1:u, sizeof(t%2:u) * %3:u);",
+                FORMAT_ARGS({ .u = local }, { .u = val }, { .u = elem_type }, { .u = dim }));
+            emit_line(fun_emitter, "v%0:u[v%1:u] = v%2:u;", FORMAT_ARGS({ .u = local }, { .u = index }, { .u = elem }));
+            return local;
+        }
+        case NODE_MAP:
+        case NODE_FOLD: {
+            bool is_map = node->tag == NODE_MAP;
+            size_t fn = emit_exp(fun_emitter, node->map.fn);
+            size_t init = is_map ? SIZE_MAX : emit_exp(fun_emitter, node->fold.init);
+            size_t val = emit_exp(fun_emitter, node->map.val);
+            size_t* fun_index = node->map.fn->tag == NODE_VAR
+                ? find_in_index_map(&emitter->fun_indices, node->map.fn) : NULL;
+            uintmax_t dim = get_dim(node->map.val);
+            local = begin_local(fun_emitter, node->type);
+            if (is_map) {
+                format(out, " = noname_alloc(sizeof(t%0:u) * %1:u);\n", FORMAT_ARGS(
+                    { .u = emit_type(emitter, reduce_node(node->type)->array.elem) }, { .u = dim }));
+            } else
+                format(out, " = v%0:u;\n", FORMAT_ARGS({ .u = init }));
+            if (dim == 0)
+                return local;
+            emit_line(fun_emitter, "for (size_t i = 0; i < %0:u; ++i) {", FORMAT_ARGS({ .u = dim }));
+            out->indent++;
+            if (is_map) {
+                emit_indent(out);
+                format(out, "v%0:u[i]", FORMAT_ARGS({ .u = local }));
+                emit_call(fun_emitter, fun_index, fn, val, "[i]");
+            } else {
+                // The function is curried, so each step makes two calls
+                size_t step = begin_local(fun_emitter, reduce_node(node->fold.fn->type)->arrow.codom);
+                emit_call(fun_emitter, fun_index, fn, local, "");
+                emit_indent(out);
+                format(out, "v%0:u", FORMAT_ARGS({ .u = local }));
+                emit_call(fun_emitter, NULL, step, val, "[i]");
+            }
+            out->indent--;
+            emit_line(fun_emitter, "}", NULL);
+            return local;
+        }
+        default:
+            assert(false && "invalid array operation");
+            return SIZE_MAX;
+    }
+}
+
+static size_t emit_exp(struct fun_emitter* fun_emitter, node_t node) {
+    struct emitter* emitter = fun_emitter->emitter;
+    if (is_type_level(node)) {
+        unsupported(emitter, node, "type-level expressions");
+        return SIZE_MAX;
+    }
+    size_t local = SIZE_MAX;
+    switch (node->tag) {
+        case NODE_VAR: {
+            size_t* found = find_in_index_map(&fun_emitter->locals, node);
+            if (!found) {
+                unsupported(emitter, node, "free variables");
+                return SIZE_MAX;
+            }
+            return *found;
+        }
+        case NODE_LIT:
+            local = begin_local(fun_emitter, node->type);
+            format(fun_emitter->out, " = ", NULL);
+            emit_lit(fun_emitter, node);
+            format(fun_emitter->out, ";\n", NULL);
+            return local;
+        case NODE_TOP:
+            local = begin_local(fun_emitter, node->type);
+            format(fun_emitter->out, " = 0;\n", NULL);
+            return local;
+        case NODE_BOT:
+            local = begin_local(fun_emitter, node->type);
+            format(fun_emitter->out, " = { 0 };\n", NULL);
+            emit_line(fun_emitter, "noname_bot();", NULL);
+            return local;
+        case NODE_ABS: {
+            size_t fun_index;
+            return emit_abs(fun_emitter, node, &fun_index);
+        }
+        case NODE_APP: {
+            size_t left  = emit_exp(fun_emitter, node->app.left);
+            size_t right = emit_exp(fun_emitter, node->app.right);
+            size_t* fun_index = node->app.left->tag == NODE_VAR
+                ? find_in_index_map(&emitter->fun_indices, node->app.left) : NULL;
+            local = begin_local(fun_emitter, node->type);
+            emit_call(fun_emitter, fun_index, left, right, "");
+            return local;
+        }
+        case NODE_LET:
+            for (size_t i = 0, n = node->let.var_count; i < n; ++i) {
+                node_t val = node->let.vals[i];
+                size_t fun_index;
+                size_t* known_fun = val->tag == NODE_VAR ? find_in_index_map(&emitter->fun_indices, val) : NULL;
+                if (val->tag == NODE_ABS) {
+                    local = emit_abs(fun_emitter, val, &fun_index);
+                    known_fun = &fun_index;
+                } else
+                    local = emit_exp(fun_emitter, val);
+                insert_in_index_map(&fun_emitter->locals, node->let.vars[i], local);
+                if (known_fun)
+                    insert_in_index_map(&emitter->fun_indices, node->let.vars[i], *known_fun);
+            }
+            return emit_exp(fun_emitter, node->let.body);
+        case NODE_LETREC:
+            emit_letrec(fun_emitter, node);
+            return emit_exp(fun_emitter, node->letrec.body);
+        case NODE_MATCH:
+            return emit_match(fun_emitter, node);
+        case NODE_RECORD: {
+            size_t* args = new_buf(size_t, node->record.arg_count);
+            for (size_t i = 0, n = node->record.arg_count; i < n; ++i)
+                args[i] = emit_exp(fun_emitter, node->record.args[i]);
+            local = begin_local(fun_emitter, node->type);
+            format(fun_emitter->out, " = {", NULL);
+            for (size_t i = 0, n = node->record.arg_count; i < n; ++i) {
+                format(fun_emitter->out, "%0:s .f%1:u = v%2:u", FORMAT_ARGS(
+                    { .s = i > 0 ? "," : "" },
+                    { .u = find_elem_index(node->type, node->record.labels[i]) },
+                    { .u = args[i] }));
+            }
+            format(fun_emitter->out, node->record.arg_count > 0 ? " };\n" : " 0 };\n", NULL);
+            free_buf(args);
+            return local;
+        }
+        case NODE_INJ: {
+            size_t arg = emit_exp(fun_emitter, node->inj.arg);
+            size_t index = find_elem_index(node->type, node->inj.label);
+            local = begin_local(fun_emitter, node->type);
+            format(fun_emitter->out, " = { .tag = %0:u, .as.c%0:u = v%1:u };\n",
+                FORMAT_ARGS({ .u = index }, { .u = arg }));
+            return local;
+        }
+        case NODE_EXT: {
+            size_t val = emit_exp(fun_emitter, node->ext.val);
+            size_t index = find_elem_index(node->ext.val->type, node->ext.label);
+            if (reduce_node(node->ext.val->type)->tag == NODE_SUM) {
+                emit_line(fun_emitter, "if (v%0:u.tag != %1:u)", FORMAT_ARGS({ .u = val }, { .u = index }));
+                fun_emitter->out->indent++;
+                emit_line(fun_emitter, "noname_bot();", NULL);
+                fun_emitter->out->indent--;
+                local = begin_local(fun_emitter, node->type);
+                format(fun_emitter->out, " = v%0:u.as.c%1:u;\n", FORMAT_ARGS({ .u = val }, { .u = index }));
+            } else {
+                local = begin_local(fun_emitter, node->type);
+                format(fun_emitter->out, " = v%0:u.f%1:u;\n", FORMAT_ARGS({ .u = val }, { .u = index }));
+            }
+            return local;
+        }
+        case NODE_INS: {
+            size_t val = emit_exp(fun_emitter, node->ins.val);
+            size_t* elems = new_buf(size_t, node->ins.elem_count);
+            for (size_t i = 0, n = node->ins.elem_count; i < n; ++i)
+                elems[i] = emit_exp(fun_emitter, node->ins.elems[i]);
+            local = begin_local(fun_emitter, node->type);
+            if (reduce_node(node->type)->tag == NODE_SUM) {
+                format(fun_emitter->out, " = { .tag = %0:u, .as.c%0:u = v%1:u };\n",
+                    FORMAT_ARGS({ .u = find_elem_index(node->type, node->ins.labels[0]) }, { .u = elems[0] }));
+            } else {
+                format(fun_emitter->out, " = v%0:u;\n", FORMAT_ARGS({ .u = val }));
+                for (size_t i = 0, n = node->ins.elem_count; i < n; ++i) {
+                    emit_line(fun_emitter, "v%0:u.f%1:u = v%2:u;", FORMAT_ARGS(
+                        { .u = local },
+                        { .u = find_elem_index(node->type, node->ins.labels[i]) },
+                        { .u = elems[i] }));
+                }
+            }
+            free_buf(elems);
+            return local;
+        }
+        case NODE_PRIM:
+            return emit_prim(fun_emitter, node);
+        case NODE_ELEMS:
+        case NODE_INDEX:
+        case NODE_UPDATE:
+        case NODE_MAP:
+        case NODE_FOLD:
+            return emit_array_op(fun_emitter, node);
+        default:
+            unsupported(emitter, node, "expressions of this kind");
+            return SIZE_MAX;
+    }
+}
+
+bool emit_c(node_t node, FILE* fp, struct log* log) {
+    struct emitter emitter = {
+        .log = log,
+        .types = new_output(),
+        .decls = new_output(),
+        .funs = new_buf_vec(),
+        .type_indices = new_index_map(),
+        .fun_indices = new_index_map()
+    };
+    size_t errors = log->errors;
+
+    struct output main_output = new_output();
+    struct fun_emitter fun_emitter = new_fun_emitter(&emitter, &main_output.out);
+    size_t res_type = emit_type(&emitter, node->type);
+    format(fun_emitter.out, "static t%0:u noname_main(void) {\n", FORMAT_ARGS({ .u = res_type }));
+    fun_emitter.out->indent++;
+    size_t res = emit_exp(&fun_emitter, node);
+    emit_line(&fun_emitter, "return v%0:u;", FORMAT_ARGS({ .u = res }));
+    fun_emitter.out->indent--;
+    format(fun_emitter.out,
+        "}\n\n"
+        "int main(void) {\n"
+        "    print_t%0:u(noname_main());\n"
+        "    putchar('\\n');\n"
+        "    return 0;\n"
+        "}\n",
+        FORMAT_ARGS({ .u = res_type }));
+    free_index_map(&fun_emitter.locals);
+
+    bool ok = log->errors == errors;
+    if (ok) {
+        fputs(prelude, fp);
+        dump_format_buf(emitter.types.head, fp);
+        fputs("\n", fp);
+        dump_format_buf(emitter.decls.head, fp);
+        fputs("\n", fp);
+        for (size_t i = 0; i < emitter.funs.size; ++i)
+            dump_format_buf(emitter.funs.elems[i], fp);
+        dump_format_buf(main_output.head, fp);
+    }
+
+    for (size_t i = 0; i < emitter.funs.size; ++i)
+        free_format_buf(emitter.funs.elems[i]);
+    free_format_buf(main_output.head);
+    free_format_buf(emitter.types.head);
+    free_format_buf(emitter.decls.head);
+    free_buf_vec(&emitter.funs);
+    free_index_map(&emitter.type_indices);
+    free_index_map(&emitter.fun_indices);
+    return ok;
+}
@@ -0,0 +1,21 @@
+#ifndef CGEN_CGEN_H
+#define CGEN_CGEN_H
+
+#include <stdio.h>
+
+#include "ir/node.h"
+#include "utils/log.h"
+
+/*
+ * The C backend translates closed, monomorphic expressions into a standalone C11
+ * program that prints the value of the expression. Records become structures,
+ * injections become tagged unions, and every abstraction is lifted to a top-level
+ * function that takes its closure environment as first argument. The generated
+ * code is strict: Let-bound values are computed even when they are not used.
+ */
+
+// Writes the program to the given file.
+// Returns false and reports an error if some construct is not supported.
+bool emit_c(node_t, FILE*, struct log*);
+
+#endif
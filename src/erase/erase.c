@@ -0,0 +1,339 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include "utils/utils.h"
+#include "utils/arena.h"
+#include "utils/map.h"
+#include "ir/operands.h"
+#include "erase/erase.h"
+#include "erase/term.h"
+
+MAP(term_map, node_t, const struct term*)
+MAP(var_ids, node_t, size_t)
+
+struct eraser {
+    arena_t arena;
+    struct term_map terms;
+    struct var_ids var_ids;
+    bool ok;
+};
+
+static const struct term unit_term = { .tag = TERM_UNIT };
+
+static const struct term* erase_term(struct eraser*, node_t);
+
+// Helpers -------------------------------------------------------------------------
+
+static inline bool is_erased(node_t node) {
+    // Types, and type constructors such as `Int`, whose type is a kind
+    return is_type_node(node) || node->type->type->tag == NODE_UNI;
+}
+
+static bool is_data_type(node_t type) {
+    struct num_type num_type;
+    type = reduce_type(type);
+    switch (type->tag) {
+        case NODE_SUM:
+        case NODE_PROD:
+            for (size_t i = 0, n = type->prod.arg_count; i < n; ++i) {
+                if (!is_data_type(type->prod.args[i]))
+                    return false;
+            }
+            return true;
+        case NODE_ARRAY:
+            return is_data_type(type->array.elem);
+        default:
+            return get_num_type(type, &num_type);
+    }
+}
+
+static inline void* alloc_erased(struct eraser* eraser, size_t size) {
+    return alloc_from_arena(&eraser->arena, size);
+}
+
+static inline struct term* new_term(struct eraser* eraser, enum term_tag tag) {
+    struct term* term = alloc_erased(eraser, sizeof(struct term));
+    term->tag = tag;
+    return term;
+}
+
+static inline size_t get_var_id(struct eraser* eraser, node_t var) {
+    if (is_unbound_var(var))
+        return NO_VAR;
+    const size_t* id = find_in_var_ids(&eraser->var_ids, var);
+    if (id)
+        return *id;
+    size_t new_id = eraser->var_ids.htable.size;
+    insert_in_var_ids(&eraser->var_ids, var, new_id);
+    return new_id;
+}
+
+static inline size_t get_label_index(struct eraser* eraser, node_t type, label_t label) {
+    // Labels are resolved using the static type, which must be a record or a sum
+    type = reduce_type(type);
+    size_t index = type->tag == NODE_PROD || type->tag == NODE_SUM ? find_label_in_node(type, label) : SIZE_MAX;
+    if (index == SIZE_MAX)
+        eraser->ok = false;
+    return index;
+}
+
+static inline const struct term** erase_terms(struct eraser* eraser, const node_t* nodes, size_t count) {
+    const struct term** terms = alloc_erased(eraser, sizeof(struct term*) * count);
+    for (size_t i = 0; i < count; ++i)
+        terms[i] = erase_term(eraser, nodes[i]);
+    return terms;
+}
+
+// Patterns ------------------------------------------------------------------------
+
+static const struct pat* erase_pat(struct eraser* eraser, node_t pat) {
+    struct pat* res = alloc_erased(eraser, sizeof(struct pat));
+    switch (pat->tag) {
+        case NODE_VAR:
+            res->tag = PAT_VAR;
+            res->var = get_var_id(eraser, pat);
+            break;
+        case NODE_LIT:
+            res->tag = PAT_LIT;
+            res->lit = pat->lit;
+            break;
+        case NODE_RECORD: {
+            size_t arg_count = pat->record.arg_count;
+            const struct pat** args = alloc_erased(eraser, sizeof(struct pat*) * arg_count);
+            size_t* indices = alloc_erased(eraser, sizeof(size_t) * arg_count);
+            for (size_t i = 0; i < arg_count; ++i) {
+                args[i] = erase_pat(eraser, pat->record.args[i]);
+                indices[i] = get_label_index(eraser, pat->type, pat->record.labels[i]);
+            }
+            res->tag = PAT_RECORD;
+            res->record.args = args;
+            res->record.indices = indices;
+            res->record.arg_count = arg_count;
+            break;
+        }
+        case NODE_INJ:
+            res->tag = PAT_INJ;
+            res->inj.index = get_label_index(eraser, pat->type, pat->inj.label);
+            res->inj.arg = erase_pat(eraser, pat->inj.arg);
+            break;
+        default:
+            eraser->ok = false;
+            res->tag = PAT_VAR;
+            res->var = NO_VAR;
+            break;
+    }
+    return res;
+}
+
+// Terms ---------------------------------------------------------------------------
+
+static const struct term* erase_abs(struct eraser* eraser, node_t abs) {
+    // Type abstractions disappear, along with the corresponding applications
+    if (is_erased(abs->abs.var))
+        return erase_term(eraser, abs->abs.body);
+
+    // Closures only capture the variables they use
+    size_t* captures = alloc_erased(eraser, sizeof(size_t) * abs->free_vars->count);
+    size_t capture_count = 0;
+    for (size_t i = 0, n = abs->free_vars->count; i < n; ++i) {
+        if (!is_erased(abs->free_vars->vars[i]))
+            captures[capture_count++] = get_var_id(eraser, abs->free_vars->vars[i]);
+    }
+    struct term* term = new_term(eraser, TERM_ABS);
+    term->abs.var = get_var_id(eraser, abs->abs.var);
+    term->abs.body = erase_term(eraser, abs->abs.body);
+    term->abs.captures = captures;
+    term->abs.capture_count = capture_count;
+    term->abs.origin = abs;
+    return term;
+}
+
+static const struct term* erase_let_or_letrec(struct eraser* eraser, node_t let) {
+    // Type definitions are removed
+    size_t var_count = 0;
+    size_t* vars = alloc_erased(eraser, sizeof(size_t) * let->let.var_count);
+    const struct term** vals = alloc_erased(eraser, sizeof(struct term*) * let->let.var_count);
+    for (size_t i = 0, n = let->let.var_count; i < n; ++i) {
+        if (is_erased(let->let.vars[i]))
+            continue;
+        vars[var_count] = get_var_id(eraser, let->let.vars[i]);
+        vals[var_count] = erase_term(eraser, let->let.vals[i]);
+        var_count++;
+    }
+    if (var_count == 0)
+        return erase_term(eraser, let->let.body);
+    struct term* term = new_term(eraser, let->tag == NODE_LET ? TERM_LET : TERM_LETREC);
+    term->let.vars = vars;
+    term->let.vals = vals;
+    term->let.var_count = var_count;
+    term->let.body = erase_term(eraser, let->let.body);
+    return term;
+}
+
+static const struct term* erase_match(struct eraser* eraser, node_t match) {
+    size_t pat_count = match->match.pat_count;
+    const struct pat** pats = alloc_erased(eraser, sizeof(struct pat*) * pat_count);
+    for (size_t i = 0; i < pat_count; ++i)
+        pats[i] = erase_pat(eraser, match->match.pats[i]);
+    struct term* term = new_term(eraser, TERM_MATCH);
+    term->match.pats = pats;
+    term->match.vals = erase_terms(eraser, match->match.vals, pat_count);
+    term->match.pat_count = pat_count;
+    term->match.arg = erase_term(eraser, match->match.arg);
+    return term;
+}
+
+static const struct term* erase_record(struct eraser* eraser, node_t record) {
+    // Fields are stored in the order of the record type
+    size_t arg_count = record->record.arg_count;
+    const struct term** args = alloc_erased(eraser, sizeof(struct term*) * arg_count);
+    for (size_t i = 0; i < arg_count; ++i) {
+        size_t index = get_label_index(eraser, record->type, record->record.labels[i]);
+        if (index < arg_count)
+            args[index] = erase_term(eraser, record->record.args[i]);
+    }
+    struct term* term = new_term(eraser, TERM_RECORD);
+    term->record.args = args;
+    term->record.arg_count = arg_count;
+    return term;
+}
+
+static const struct term* erase_ins(struct eraser* eraser, node_t ins) {
+    // Insertions into sums build injections
+    if (ins->type->tag == NODE_SUM) {
+        struct term* term = new_term(eraser, TERM_INJ);
+        term->inj.index = get_label_index(eraser, ins->type, ins->ins.labels[0]);
+        term->inj.arg = erase_term(eraser, ins->ins.elems[0]);
+        return term;
+    }
+    size_t elem_count = ins->ins.elem_count;
+    size_t* indices = alloc_erased(eraser, sizeof(size_t) * elem_count);
+    for (size_t i = 0; i < elem_count; ++i)
+        indices[i] = get_label_index(eraser, ins->ins.val->type, ins->ins.labels[i]);
+    struct term* term = new_term(eraser, TERM_INS);
+    term->ins.val = erase_term(eraser, ins->ins.val);
+    term->ins.elems = erase_terms(eraser, ins->ins.elems, elem_count);
+    term->ins.indices = indices;
+    term->ins.elem_count = elem_count;
+    return term;
+}
+
+static const struct term* erase_prim(struct eraser* eraser, node_t prim) {
+    struct term* term = new_term(eraser, TERM_PRIM);
+    if (!get_num_type(reduce_type(prim->prim.args[0]->type), &term->prim.arg_type) ||
+        !get_num_type(reduce_type(prim->type), &term->prim.res_type))
+        eraser->ok = false;
+    term->prim.op = prim->prim.op;
+    term->prim.args = erase_terms(eraser, prim->prim.args, prim->prim.arg_count);
+    term->prim.arg_count = prim->prim.arg_count;
+    return term;
+}
+
+static const struct term* erase_uncached(struct eraser* eraser, node_t node) {
+    if (is_erased(node))
+        return &unit_term;
+    struct term* term = NULL;
+    switch (node->tag) {
+        case NODE_VAR:
+            term = new_term(eraser, TERM_VAR);
+            term->var = get_var_id(eraser, node);
+            return term;
+        case NODE_LIT:
+            term = new_term(eraser, TERM_LIT);
+            term->lit = node->lit;
+            return term;
+        case NODE_BOT:
+            return new_term(eraser, TERM_BOT);
+        case NODE_ABS:
+            return erase_abs(eraser, node);
+        case NODE_APP:
+            if (is_erased(node->app.right))
+                return erase_term(eraser, node->app.left);
+            term = new_term(eraser, TERM_APP);
+            term->app.left = erase_term(eraser, node->app.left);
+            term->app.right = erase_term(eraser, node->app.right);
+            return term;
+        case NODE_LET:
+        case NODE_LETREC:
+            return erase_let_or_letrec(eraser, node);
+        case NODE_MATCH:
+            return erase_match(eraser, node);
+        case NODE_RECORD:
+            return erase_record(eraser, node);
+        case NODE_INJ:
+            term = new_term(eraser, TERM_INJ);
+            term->inj.index = get_label_index(eraser, node->type, node->inj.label);
+            term->inj.arg = erase_term(eraser, node->inj.arg);
+            return term;
+        case NODE_EXT:
+            term = new_term(eraser, TERM_EXT);
+            term->ext.index = get_label_index(eraser, node->ext.val->type, node->ext.label);
+            term->ext.val = erase_term(eraser, node->ext.val);
+            return term;
+        case NODE_INS:
+            return erase_ins(eraser, node);
+        case NODE_PRIM:
+            return erase_prim(eraser, node);
+        case NODE_ELEMS:
+            term = new_term(eraser, TERM_ELEMS);
+            term->elems.args = erase_terms(eraser, node->elems.args, node->elems.arg_count);
+            term->elems.arg_count = node->elems.arg_count;
+            return term;
+        case NODE_INDEX:
+        case NODE_UPDATE:
+            term = new_term(eraser, node->tag == NODE_INDEX ? TERM_INDEX : TERM_UPDATE);
+            term->index.val = erase_term(eraser, node->index.val);
+            term->index.index = erase_term(eraser, node->index.index);
+            term->index.elem = node->tag == NODE_UPDATE ? erase_term(eraser, node->update.elem) : NULL;
+            return term;
+        case NODE_MAP:
+        case NODE_FOLD:
+            term = new_term(eraser, node->tag == NODE_MAP ? TERM_MAP : TERM_FOLD);
+            term->map.fn = erase_term(eraser, node->map.fn);
+            term->map.val = erase_term(eraser, node->map.val);
+            term->map.init = node->tag == NODE_FOLD ? erase_term(eraser, node->fold.init) : NULL;
+            return term;
+        default:
+            // Other constants (e.g. top values) have no untyped counterpart
+            eraser->ok = false;
+            return &unit_term;
+    }
+}
+
+static const struct term* erase_term(struct eraser* eraser, node_t node) {
+    // Terms do not depend on their context, which preserves the sharing of the IR
+    const struct term** found = find_in_term_map(&eraser->terms, node);
+    if (found)
+        return *found;
+    const struct term* term = erase_uncached(eraser, node);
+    insert_in_term_map(&eraser->terms, node, term);
+    return term;
+}
+
+struct erased_program* erase_program(node_t node) {
+    if (node->free_vars->count > 0 || !is_data_type(node->type))
+        return NULL;
+    struct eraser eraser = {
+        .arena = new_arena(),
+        .terms = new_term_map(),
+        .var_ids = new_var_ids(),
+        .ok = true
+    };
+    const struct term* root = erase_term(&eraser, node);
+    free_term_map(&eraser.terms);
+    free_var_ids(&eraser.var_ids);
+    if (!eraser.ok) {
+        free_arena(eraser.arena);
+        return NULL;
+    }
+    struct erased_program* program = xmalloc(sizeof(struct erased_program));
+    program->arena = eraser.arena;
+    program->root = root;
+    program->type = node->type;
+    return program;
+}
+
+void free_erased_program(struct erased_program* program) {
+    free_arena(program->arena);
+    free(program);
+}
@@ -0,0 +1,25 @@
+#ifndef ERASE_ERASE_H
+#define ERASE_ERASE_H
+
+#include "ir/node.h"
+
+/*
+ * Type-erased execution. Programs are lowered to untyped terms, which a call-by-need
+ * machine evaluates without building any IR node: Applications do not compute the
+ * type of their result, and records do not need a product type. The result is then
+ * read back into the module using the type of the original program. Only closed
+ * programs that produce data (numbers, and records, injections, and arrays of data)
+ * can be erased, and the types that erasure relies on (the types of records and
+ * injections, and the number types of primitives) must be known statically.
+ */
+
+struct erased_program;
+
+// Returns NULL if the given program cannot be erased.
+struct erased_program* erase_program(node_t);
+void free_erased_program(struct erased_program*);
+
+// Evaluates the program, and reads back the result into the module of the original program.
+node_t run_erased_program(const struct erased_program*);
+
+#endif
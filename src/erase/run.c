@@ -0,0 +1,505 @@
+#include <assert.h>
+#include <string.h>
+
+#include "utils/utils.h"
+#include "utils/arena.h"
+#include "utils/buf.h"
+#include "utils/vec.h"
+#include "ir/profile.h"
+#include "erase/erase.h"
+#include "erase/term.h"
+
+struct thunk;
+
+struct env {
+    size_t var;
+    struct thunk* thunk;
+    const struct env* next;
+};
+
+struct value {
+    enum {
+        VALUE_UNIT,
+        VALUE_LIT,
+        VALUE_BOT,
+        VALUE_CLOSURE,
+        VALUE_RECORD,
+        VALUE_INJ,
+        VALUE_ARRAY
+    } tag;
+    union {
+        struct lit lit;
+        struct {
+            const struct term* abs;
+            const struct env* env;
+        } closure;
+        struct {
+            struct thunk** args;
+            size_t arg_count;
+        } record, array;
+        struct {
+            size_t index;
+            struct thunk* arg;
+        } inj;
+    };
+};
+
+struct thunk {
+    const struct term* term;
+    const struct env* env;
+    const struct value* value;
+    bool is_forced;
+};
+
+VEC(thunk_vec, struct thunk*)
+
+struct machine {
+    mod_t mod;
+    arena_t arena;
+    struct profile* profile;
+};
+
+static const struct value unit_value = { .tag = VALUE_UNIT };
+static const struct value bot_value  = { .tag = VALUE_BOT };
+
+static const struct value* eval(struct machine*, const struct term*, const struct env*);
+
+// Environments and thunks ---------------------------------------------------------
+
+static inline const struct env* extend_env(struct machine* machine, const struct env* env, size_t var, struct thunk* thunk) {
+    struct env* new_env = alloc_from_arena(&machine->arena, sizeof(struct env));
+    new_env->var = var;
+    new_env->thunk = thunk;
+    new_env->next = env;
+    return new_env;
+}
+
+static inline struct thunk* find_in_env(const struct env* env, size_t var) {
+    for (; env; env = env->next) {
+        if (env->var == var)
+            return env->thunk;
+    }
+    assert(false && "unbound variable in erased program");
+    return NULL;
+}
+
+static inline struct thunk* new_thunk(struct machine* machine, const struct term* term, const struct env* env) {
+    struct thunk* thunk = alloc_from_arena(&machine->arena, sizeof(struct thunk));
+    thunk->term = term;
+    thunk->env = env;
+    thunk->value = NULL;
+    thunk->is_forced = false;
+    return thunk;
+}
+
+static inline struct thunk* new_value_thunk(struct machine* machine, const struct value* value) {
+    struct thunk* thunk = new_thunk(machine, NULL, NULL);
+    thunk->value = value;
+    thunk->is_forced = true;
+    return thunk;
+}
+
+static const struct value* force(struct machine* machine, struct thunk* thunk) {
+    if (thunk->value)
+        return thunk->value;
+    if (thunk->is_forced) {
+        // The thunk depends on its own value: This computation does not terminate
+        return &bot_value;
+    }
+    thunk->is_forced = true;
+    thunk->value = eval(machine, thunk->term, thunk->env);
+    return thunk->value;
+}
+
+// Read back -----------------------------------------------------------------------
+
+static node_t read_back(struct machine* machine, const struct value* value, node_t type) {
+    // Values are read back using the type of the program, which only contains data
+    if (value->tag == VALUE_BOT)
+        return new_bot(machine->mod, type, NULL);
+    node_t reduced_type = reduce_type(type);
+    switch (value->tag) {
+        case VALUE_LIT:
+            return new_lit(machine->mod, type, &value->lit, NULL);
+        case VALUE_RECORD: {
+            assert(reduced_type->tag == NODE_PROD);
+            node_t* args = new_buf(node_t, value->record.arg_count);
+            for (size_t i = 0, n = value->record.arg_count; i < n; ++i)
+                args[i] = read_back(machine, force(machine, value->record.args[i]), reduced_type->prod.args[i]);
+            node_t record = new_record(machine->mod, args, reduced_type->prod.labels, value->record.arg_count, NULL);
+            free_buf(args);
+            return record;
+        }
+        case VALUE_INJ: {
+            assert(reduced_type->tag == NODE_SUM);
+            node_t arg = read_back(machine, force(machine, value->inj.arg), reduced_type->sum.args[value->inj.index]);
+            return new_inj(machine->mod, type, reduced_type->sum.labels[value->inj.index], arg, NULL);
+        }
+        case VALUE_ARRAY: {
+            assert(reduced_type->tag == NODE_ARRAY);
+            node_t* elems = new_buf(node_t, value->array.arg_count);
+            for (size_t i = 0, n = value->array.arg_count; i < n; ++i)
+                elems[i] = read_back(machine, force(machine, value->array.args[i]), reduced_type->array.elem);
+            node_t array = new_elems(machine->mod, reduced_type->array.elem, elems, value->array.arg_count, NULL);
+            free_buf(elems);
+            return array;
+        }
+        default:
+            assert(false && "invalid value for a data type");
+            return NULL;
+    }
+}
+
+// Pattern matching ----------------------------------------------------------------
+
+static inline bool is_same_lit(const struct lit* lit, const struct lit* other) {
+    // Floating-point literals are hash-consed, and thus compared bitwise
+    return lit->tag == other->tag && (lit->tag == LIT_FLOAT
+        ? !memcmp(&lit->float_val, &other->float_val, sizeof(double))
+        : lit->int_val == other->int_val);
+}
+
+enum match_res {
+    NO_MATCH, MATCH, BOT_MATCH
+};
+
+static enum match_res match_pat(struct machine* machine, const struct pat* pat, struct thunk* thunk, const struct env** env) {
+    if (pat->tag == PAT_VAR) {
+        if (pat->var != NO_VAR)
+            *env = extend_env(machine, *env, pat->var, thunk);
+        return MATCH;
+    }
+    // Matching on the bottom value produces the bottom value
+    const struct value* value = force(machine, thunk);
+    if (value->tag == VALUE_BOT)
+        return BOT_MATCH;
+    switch (pat->tag) {
+        case PAT_LIT:
+            assert(value->tag == VALUE_LIT);
+            return is_same_lit(&value->lit, &pat->lit) ? MATCH : NO_MATCH;
+        case PAT_RECORD:
+            assert(value->tag == VALUE_RECORD);
+            for (size_t i = 0, n = pat->record.arg_count; i < n; ++i) {
+                enum match_res match_res = match_pat(machine,
+                    pat->record.args[i], value->record.args[pat->record.indices[i]], env);
+                if (match_res != MATCH)
+                    return match_res;
+            }
+            return MATCH;
+        case PAT_INJ:
+            assert(value->tag == VALUE_INJ);
+            if (value->inj.index != pat->inj.index)
+                return NO_MATCH;
+            return match_pat(machine, pat->inj.arg, value->inj.arg, env);
+        default:
+            assert(false && "invalid pattern");
+            return BOT_MATCH;
+    }
+}
+
+// Evaluation ----------------------------------------------------------------------
+
+static inline const struct value* new_value(struct machine* machine, const struct value* value) {
+    struct value* copy = alloc_from_arena(&machine->arena, sizeof(struct value));
+    memcpy(copy, value, sizeof(struct value));
+    return copy;
+}
+
+static inline const struct value* new_closure(struct machine* machine, const struct term* abs, const struct env* env) {
+    // Closures only capture the variables they use, which keeps environments short
+    const struct env* captured = NULL;
+    for (size_t i = 0, n = abs->abs.capture_count; i < n; ++i)
+        captured = extend_env(machine, captured, abs->abs.captures[i], find_in_env(env, abs->abs.captures[i]));
+    return new_value(machine, &(struct value) {
+        .tag = VALUE_CLOSURE,
+        .closure = { .abs = abs, .env = captured }
+    });
+}
+
+static inline struct thunk** new_thunks(struct machine* machine, const struct term** terms, size_t count, const struct env* env) {
+    struct thunk** thunks = alloc_from_arena(&machine->arena, sizeof(struct thunk*) * count);
+    for (size_t i = 0; i < count; ++i)
+        thunks[i] = new_thunk(machine, terms[i], env);
+    return thunks;
+}
+
+static inline struct thunk** copy_thunks(struct machine* machine, struct thunk** thunks, size_t count) {
+    struct thunk** copy = alloc_from_arena(&machine->arena, sizeof(struct thunk*) * count);
+    memcpy(copy, thunks, sizeof(struct thunk*) * count);
+    return copy;
+}
+
+static inline struct thunk* apply_closure_lazily(struct machine* machine, const struct value* closure, struct thunk* arg) {
+    const struct term* abs = closure->closure.abs;
+    const struct env* env = closure->closure.env;
+    if (machine->profile)
+        enter_profiled_fn(machine->profile, abs->abs.origin);
+    if (abs->abs.var != NO_VAR)
+        env = extend_env(machine, env, abs->abs.var, arg);
+    return new_thunk(machine, abs->abs.body, env);
+}
+
+static inline const struct value* apply_value(struct machine* machine, const struct value* fn, struct thunk* arg) {
+    if (fn->tag != VALUE_CLOSURE)
+        return &bot_value;
+    return force(machine, apply_closure_lazily(machine, fn, arg));
+}
+
+static const struct value* eval_array_op(struct machine* machine, const struct term* term, const struct env* env) {
+    const struct value* val = eval(machine, term->tag == TERM_MAP || term->tag == TERM_FOLD ? term->map.val : term->index.val, env);
+    if (val->tag != VALUE_ARRAY)
+        return &bot_value;
+    if (term->tag == TERM_INDEX || term->tag == TERM_UPDATE) {
+        // Out-of-bounds accesses produce the bottom value
+        const struct value* index = eval(machine, term->index.index, env);
+        if (index->tag != VALUE_LIT || index->lit.int_val >= val->array.arg_count)
+            return &bot_value;
+        size_t i = index->lit.int_val;
+        if (term->tag == TERM_INDEX)
+            return force(machine, val->array.args[i]);
+        struct thunk** elems = copy_thunks(machine, val->array.args, val->array.arg_count);
+        elems[i] = new_thunk(machine, term->update.elem, env);
+        return new_value(machine, &(struct value) {
+            .tag = VALUE_ARRAY,
+            .array = { .args = elems, .arg_count = val->array.arg_count }
+        });
+    }
+
+    const struct value* fn = eval(machine, term->map.fn, env);
+    if (fn->tag != VALUE_CLOSURE)
+        return &bot_value;
+    if (term->tag == TERM_MAP) {
+        // Elements of the result are computed lazily, when they are needed
+        struct thunk** elems = alloc_from_arena(&machine->arena, sizeof(struct thunk*) * val->array.arg_count);
+        for (size_t i = 0, n = val->array.arg_count; i < n; ++i)
+            elems[i] = apply_closure_lazily(machine, fn, val->array.args[i]);
+        return new_value(machine, &(struct value) {
+            .tag = VALUE_ARRAY,
+            .array = { .args = elems, .arg_count = val->array.arg_count }
+        });
+    }
+    // The accumulator is forced at every step, so that long arrays do not build long chains of thunks
+    struct thunk* acc = new_thunk(machine, term->fold.init, env);
+    for (size_t i = 0, n = val->array.arg_count; i < n; ++i) {
+        const struct value* step = apply_value(machine, fn, acc);
+        acc = new_value_thunk(machine, apply_value(machine, step, val->array.args[i]));
+    }
+    return force(machine, acc);
+}
+
+static inline const struct value* new_prim_value(struct machine* machine, const struct term* term, const struct lit* args) {
+    return new_value(machine, &(struct value) {
+        .tag = VALUE_LIT,
+        .lit = eval_prim(term->prim.op, term->prim.arg_type, term->prim.res_type, args)
+    });
+}
+
+static const struct value* eval_prim_term(struct machine* machine, const struct term* term, const struct env* env) {
+    // Operands are evaluated eagerly, and the bottom value is propagated
+    struct lit args[2];
+    assert(term->prim.arg_count <= ARRAY_SIZE(args));
+    for (size_t i = 0, n = term->prim.arg_count; i < n; ++i) {
+        const struct value* arg = eval(machine, term->prim.args[i], env);
+        if (arg->tag != VALUE_LIT)
+            return &bot_value;
+        args[i] = arg->lit;
+    }
+    return new_prim_value(machine, term, args);
+}
+
+static const struct value* eval_if_cheap(struct machine* machine, const struct term* term, const struct env* env) {
+    // Returns the value of a literal, or of a primitive whose operands are known literals.
+    // Those values are computed without forcing any thunk, and thus always terminate.
+    switch (term->tag) {
+        case TERM_LIT:
+            return new_value(machine, &(struct value) { .tag = VALUE_LIT, .lit = term->lit });
+        case TERM_VAR: {
+            struct thunk* thunk = find_in_env(env, term->var);
+            if (thunk->value)
+                return thunk->value->tag == VALUE_LIT ? thunk->value : NULL;
+            return !thunk->is_forced && thunk->term->tag == TERM_LIT
+                ? eval_if_cheap(machine, thunk->term, thunk->env) : NULL;
+        }
+        case TERM_PRIM: {
+            struct lit args[2];
+            assert(term->prim.arg_count <= ARRAY_SIZE(args));
+            for (size_t i = 0, n = term->prim.arg_count; i < n; ++i) {
+                const struct value* arg = eval_if_cheap(machine, term->prim.args[i], env);
+                if (!arg)
+                    return NULL;
+                args[i] = arg->lit;
+            }
+            return new_prim_value(machine, term, args);
+        }
+        default:
+            return NULL;
+    }
+}
+
+static inline struct thunk* new_arg_thunk(struct machine* machine, const struct term* term, const struct env* env) {
+    // Arguments such as `acc + n` are computed right away when their operands are known,
+    // so that accumulators do not build long chains of thunks.
+    const struct value* value = term->tag == TERM_PRIM ? eval_if_cheap(machine, term, env) : NULL;
+    return value ? new_value_thunk(machine, value) : new_thunk(machine, term, env);
+}
+
+static inline const struct value* enter_thunk(
+    struct machine* machine, struct thunk* thunk, struct thunk_vec* updates,
+    const struct term** term, const struct env** env)
+{
+    // Thunks forced in tail position are evaluated by the caller's loop, and updated
+    // once their value is known. Returns NULL if the thunk has to be evaluated.
+    if (thunk->value || thunk->is_forced)
+        return force(machine, thunk);
+    thunk->is_forced = true;
+    push_to_thunk_vec(updates, thunk);
+    *term = thunk->term;
+    *env = thunk->env;
+    return NULL;
+}
+
+static const struct value* eval_loop(
+    struct machine* machine, const struct term* term, const struct env* env, struct thunk_vec* updates)
+{
+    // Terms in tail position (the body of functions, let-expressions, and match cases)
+    // are evaluated in a loop, so that tail calls do not consume stack space.
+    while (true) {
+        switch (term->tag) {
+            case TERM_UNIT:
+                return &unit_value;
+            case TERM_LIT:
+                return new_value(machine, &(struct value) { .tag = VALUE_LIT, .lit = term->lit });
+            case TERM_BOT:
+                return &bot_value;
+            case TERM_VAR: {
+                const struct value* value = enter_thunk(machine, find_in_env(env, term->var), updates, &term, &env);
+                if (value)
+                    return value;
+                continue;
+            }
+            case TERM_ABS:
+                return new_closure(machine, term, env);
+            case TERM_APP: {
+                const struct value* left = eval(machine, term->app.left, env);
+                if (left->tag != VALUE_CLOSURE)
+                    return &bot_value;
+                const struct term* abs = left->closure.abs;
+                const struct env* new_env = left->closure.env;
+                if (machine->profile)
+                    enter_profiled_fn(machine->profile, abs->abs.origin);
+                if (abs->abs.var != NO_VAR)
+                    new_env = extend_env(machine, new_env, abs->abs.var, new_arg_thunk(machine, term->app.right, env));
+                term = abs->abs.body;
+                env = new_env;
+                continue;
+            }
+            case TERM_LET: {
+                const struct env* new_env = env;
+                for (size_t i = 0, n = term->let.var_count; i < n; ++i)
+                    new_env = extend_env(machine, new_env, term->let.vars[i], new_arg_thunk(machine, term->let.vals[i], env));
+                term = term->let.body;
+                env = new_env;
+                continue;
+            }
+            case TERM_LETREC: {
+                struct thunk** thunks = new_buf(struct thunk*, term->letrec.var_count);
+                for (size_t i = 0, n = term->letrec.var_count; i < n; ++i) {
+                    thunks[i] = new_thunk(machine, term->letrec.vals[i], NULL);
+                    env = extend_env(machine, env, term->letrec.vars[i], thunks[i]);
+                }
+                for (size_t i = 0, n = term->letrec.var_count; i < n; ++i)
+                    thunks[i]->env = env;
+                free_buf(thunks);
+                term = term->letrec.body;
+                continue;
+            }
+            case TERM_MATCH: {
+                struct thunk* arg = new_thunk(machine, term->match.arg, env);
+                size_t i = 0;
+                const struct env* new_env = env;
+                enum match_res match_res = NO_MATCH;
+                for (size_t n = term->match.pat_count; i < n; ++i) {
+                    new_env = env;
+                    if ((match_res = match_pat(machine, term->match.pats[i], arg, &new_env)) != NO_MATCH)
+                        break;
+                }
+                if (match_res != MATCH)
+                    return &bot_value;
+                term = term->match.vals[i];
+                env = new_env;
+                continue;
+            }
+            case TERM_RECORD:
+            case TERM_ELEMS:
+                return new_value(machine, &(struct value) {
+                    .tag = term->tag == TERM_RECORD ? VALUE_RECORD : VALUE_ARRAY,
+                    .record = {
+                        .args = new_thunks(machine, term->record.args, term->record.arg_count, env),
+                        .arg_count = term->record.arg_count
+                    }
+                });
+            case TERM_INJ:
+                return new_value(machine, &(struct value) {
+                    .tag = VALUE_INJ,
+                    .inj = { .index = term->inj.index, .arg = new_thunk(machine, term->inj.arg, env) }
+                });
+            case TERM_EXT: {
+                const struct value* val = eval(machine, term->ext.val, env);
+                struct thunk* field = NULL;
+                if (val->tag == VALUE_RECORD)
+                    field = val->record.args[term->ext.index];
+                else if (val->tag == VALUE_INJ && val->inj.index == term->ext.index)
+                    field = val->inj.arg;
+                if (!field)
+                    return &bot_value;
+                const struct value* value = enter_thunk(machine, field, updates, &term, &env);
+                if (value)
+                    return value;
+                continue;
+            }
+            case TERM_INS: {
+                const struct value* val = eval(machine, term->ins.val, env);
+                if (val->tag != VALUE_RECORD)
+                    return &bot_value;
+                struct thunk** args = copy_thunks(machine, val->record.args, val->record.arg_count);
+                for (size_t i = 0, n = term->ins.elem_count; i < n; ++i)
+                    args[term->ins.indices[i]] = new_thunk(machine, term->ins.elems[i], env);
+                return new_value(machine, &(struct value) {
+                    .tag = VALUE_RECORD,
+                    .record = { .args = args, .arg_count = val->record.arg_count }
+                });
+            }
+            case TERM_PRIM:
+                return eval_prim_term(machine, term, env);
+            case TERM_INDEX:
+            case TERM_UPDATE:
+            case TERM_MAP:
+            case TERM_FOLD:
+                return eval_array_op(machine, term, env);
+            default:
+                assert(false && "invalid term");
+                return &bot_value;
+        }
+    }
+}
+
+static const struct value* eval(struct machine* machine, const struct term* term, const struct env* env) {
+    struct thunk* updates_buf[8];
+    struct thunk_vec updates = new_thunk_vec_on_stack(ARRAY_SIZE(updates_buf), updates_buf);
+    const struct value* value = eval_loop(machine, term, env, &updates);
+    for (size_t i = 0; i < updates.size; ++i)
+        updates.elems[i]->value = value;
+    free_thunk_vec(&updates);
+    return value;
+}
+
+node_t run_erased_program(const struct erased_program* program) {
+    struct machine machine = {
+        .mod = get_mod(program->type),
+        .arena = new_arena(),
+        .profile = get_mod_profile(get_mod(program->type))
+    };
+    node_t res = read_back(&machine, eval(&machine, program->root, NULL), program->type);
+    free_arena(machine.arena);
+    return res;
+}
@@ -0,0 +1,135 @@
+#ifndef ERASE_TERM_H
+#define ERASE_TERM_H
+
+#include "ir/node.h"
+#include "ir/prim.h"
+#include "utils/arena.h"
+
+/*
+ * Untyped terms, obtained by erasing the types of an IR program. Variables are
+ * identified by numbers, and the labels of records and injections are replaced by
+ * their index in the (static) type of the expression. Primitives keep the number
+ * types of their operands and result, which are needed to evaluate them. Type-level
+ * expressions are replaced by a unit term, and type abstractions and applications
+ * are removed.
+ */
+
+#define NO_VAR SIZE_MAX
+
+enum term_tag {
+    TERM_UNIT,
+    TERM_LIT,
+    TERM_BOT,
+    TERM_VAR,
+    TERM_ABS,
+    TERM_APP,
+    TERM_LET,
+    TERM_LETREC,
+    TERM_MATCH,
+    TERM_RECORD,
+    TERM_INJ,
+    TERM_EXT,
+    TERM_INS,
+    TERM_PRIM,
+    TERM_ELEMS,
+    TERM_INDEX,
+    TERM_UPDATE,
+    TERM_MAP,
+    TERM_FOLD
+};
+
+struct pat {
+    enum {
+        PAT_VAR,
+        PAT_LIT,
+        PAT_RECORD,
+        PAT_INJ
+    } tag;
+    union {
+        size_t var; // NO_VAR for patterns that bind nothing
+        struct lit lit;
+        struct {
+            const struct pat** args;
+            const size_t* indices;
+            size_t arg_count;
+        } record;
+        struct {
+            size_t index;
+            const struct pat* arg;
+        } inj;
+    };
+};
+
+struct term {
+    enum term_tag tag;
+    union {
+        struct lit lit;
+        size_t var;
+        struct {
+            size_t var; // NO_VAR if the argument is not used
+            const struct term* body;
+            const size_t* captures;
+            size_t capture_count;
+            node_t origin; // Original abstraction, for profiling only
+        } abs;
+        struct {
+            const struct term* left;
+            const struct term* right;
+        } app;
+        struct {
+            const size_t* vars;
+            const struct term** vals;
+            size_t var_count;
+            const struct term* body;
+        } let, letrec;
+        struct {
+            const struct pat** pats;
+            const struct term** vals;
+            size_t pat_count;
+            const struct term* arg;
+        } match;
+        struct {
+            const struct term** args;
+            size_t arg_count;
+        } record, elems;
+        struct {
+            size_t index;
+            const struct term* arg;
+        } inj;
+        struct {
+            size_t index;
+            const struct term* val;
+        } ext;
+        struct {
+            const struct term* val;
+            const struct term** elems;
+            const size_t* indices;
+            size_t elem_count;
+        } ins;
+        struct {
+            enum prim_op op;
+            struct num_type arg_type;
+            struct num_type res_type;
+            const struct term** args;
+            size_t arg_count;
+        } prim;
+        struct {
+            const struct term* val;
+            const struct term* index;
+            const struct term* elem;
+        } index, update;
+        struct {
+            const struct term* fn;
+            const struct term* val;
+            const struct term* init;
+        } map, fold;
+    };
+};
+
+struct erased_program {
+    arena_t arena;
+    const struct term* root;
+    node_t type;
+};
+
+#endif
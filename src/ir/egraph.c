@@ -0,0 +1,279 @@
+#include <assert.h>
+#include <string.h>
+
+#include "utils/utils.h"
+#include "utils/buf.h"
+#include "utils/map.h"
+#include "utils/vec.h"
+#include "ir/egraph.h"
+#include "ir/prim.h"
+#include "ir/operands.h"
+
+VEC(index_vec, size_t)
+MAP(node_indices, node_t, size_t)
+
+// E-nodes are identified by their index. Classes are represented with a union-find
+// structure, and the members of a class form a circular list.
+struct egraph {
+    mod_t mod;
+    const struct egraph_options* options;
+    struct node_vec nodes;
+    struct node_indices indices;
+    struct index_vec parents;
+    struct index_vec next_members;
+};
+
+// Classes -------------------------------------------------------------------------
+
+static inline size_t find_class(struct egraph* egraph, size_t i) {
+    while (egraph->parents.elems[i] != i) {
+        egraph->parents.elems[i] = egraph->parents.elems[egraph->parents.elems[i]];
+        i = egraph->parents.elems[i];
+    }
+    return i;
+}
+
+static size_t add_node(struct egraph* egraph, node_t node) {
+    const size_t* found = find_in_node_indices(&egraph->indices, node);
+    if (found)
+        return *found;
+    for (size_t i = 0, n = get_operand_count(node); i < n; ++i)
+        add_node(egraph, get_operand(node, i));
+    size_t index = egraph->nodes.size;
+    push_to_node_vec(&egraph->nodes, node);
+    push_to_index_vec(&egraph->parents, index);
+    push_to_index_vec(&egraph->next_members, index);
+    insert_in_node_indices(&egraph->indices, node, index);
+    return index;
+}
+
+static inline size_t find_node_class(struct egraph* egraph, node_t node) {
+    const size_t* index = find_in_node_indices(&egraph->indices, node);
+    assert(index);
+    return find_class(egraph, *index);
+}
+
+static inline bool merge_classes(struct egraph* egraph, size_t i, size_t j) {
+    i = find_class(egraph, i);
+    j = find_class(egraph, j);
+    if (i == j)
+        return false;
+    egraph->parents.elems[j] = i;
+    size_t next = egraph->next_members.elems[i];
+    egraph->next_members.elems[i] = egraph->next_members.elems[j];
+    egraph->next_members.elems[j] = next;
+    return true;
+}
+
+static inline void get_members(struct egraph* egraph, size_t i, struct node_vec* members) {
+    clear_node_vec(members);
+    size_t j = i;
+    do {
+        push_to_node_vec(members, egraph->nodes.elems[j]);
+        j = egraph->next_members.elems[j];
+    } while (j != i);
+}
+
+static inline bool add_equal_node(struct egraph* egraph, size_t i, node_t node) {
+    // Only nodes of the same type can be used interchangeably
+    if (node->type != egraph->nodes.elems[i]->type || egraph->nodes.size >= egraph->options->max_nodes)
+        return false;
+    return merge_classes(egraph, i, add_node(egraph, node));
+}
+
+// Rewrites ------------------------------------------------------------------------
+
+static inline bool is_assoc_prim(node_t node) {
+    if (node->tag != NODE_PRIM)
+        return false;
+    switch (node->prim.op) {
+        case PRIM_ADD:
+        case PRIM_MUL:
+        case PRIM_AND:
+        case PRIM_OR:
+        case PRIM_XOR: {
+            // Floating-point operations are not associative
+            struct num_type num_type;
+            return get_num_type(reduce_type(node->type), &num_type) && num_type.tag != NUM_FLOAT;
+        }
+        default:
+            return false;
+    }
+}
+
+static inline node_t new_assoc_prim(mod_t mod, node_t prim, node_t left, node_t right) {
+    node_t args[] = { left, right };
+    return new_prim(mod, prim->prim.op, prim->type, args, 2, &prim->loc);
+}
+
+static bool rewrite_node(struct egraph* egraph, size_t i, struct node_vec* members) {
+    node_t node = egraph->nodes.elems[i];
+    mod_t mod = egraph->mod;
+    bool changed = false;
+
+    // Rebuild the node with every alternative for one operand at a time: The rewrites
+    // of `simplify_node` apply to the result, and congruent nodes end up in the same class.
+    size_t operand_count = get_operand_count(node);
+    node_t* operands = new_buf(node_t, operand_count);
+    for (size_t j = 0; j < operand_count; ++j)
+        operands[j] = get_operand(node, j);
+    for (size_t j = 0; j < operand_count; ++j) {
+        get_members(egraph, find_node_class(egraph, operands[j]), members);
+        node_t operand = operands[j];
+        for (size_t k = 0; k < members->size; ++k) {
+            if (members->elems[k] == operand)
+                continue;
+            operands[j] = members->elems[k];
+            changed |= add_equal_node(egraph, i, rebuild_with_operands(mod, node, operands));
+        }
+        operands[j] = operand;
+    }
+    free_buf(operands);
+
+    switch (node->tag) {
+        case NODE_APP:
+            // Beta-reduction, for every abstraction in the class of the callee
+            get_members(egraph, find_node_class(egraph, node->app.left), members);
+            for (size_t j = 0; j < members->size; ++j) {
+                node_t abs = members->elems[j];
+                if (abs->tag != NODE_ABS)
+                    continue;
+                node_t res = is_unbound_var(abs->abs.var)
+                    ? abs->abs.body : replace_var(abs->abs.body, abs->abs.var, node->app.right);
+                changed |= add_equal_node(egraph, i, res);
+            }
+            break;
+        case NODE_LET:
+            // Inlining of every binding
+            changed |= add_equal_node(egraph, i,
+                replace_vars(node->let.body, node->let.vars, node->let.vals, node->let.var_count));
+            break;
+        case NODE_PRIM:
+            if (!is_assoc_prim(node))
+                break;
+            // Commutativity: a + b => b + a
+            changed |= add_equal_node(egraph, i, new_assoc_prim(mod, node, node->prim.args[1], node->prim.args[0]));
+            // Associativity: (a + b) + c => a + (b + c)
+            get_members(egraph, find_node_class(egraph, node->prim.args[0]), members);
+            for (size_t j = 0; j < members->size; ++j) {
+                node_t left = members->elems[j];
+                if (left->tag != NODE_PRIM || left->prim.op != node->prim.op || left->type != node->type)
+                    continue;
+                node_t right = new_assoc_prim(mod, node, left->prim.args[1], node->prim.args[1]);
+                changed |= add_equal_node(egraph, i, new_assoc_prim(mod, node, left->prim.args[0], right));
+            }
+            break;
+        default:
+            break;
+    }
+    return changed;
+}
+
+// Extraction ----------------------------------------------------------------------
+
+static inline size_t get_node_cost(enum egraph_cost cost, node_t node) {
+    if (cost == EGRAPH_COST_SIZE)
+        return 1;
+    switch (node->tag) {
+        case NODE_APP:    return 8;
+        case NODE_MAP:
+        case NODE_FOLD:   return 8;
+        case NODE_LETREC: return 4 + node->letrec.var_count;
+        case NODE_MATCH:  return 4;
+        case NODE_LET:    return 1 + node->let.var_count;
+        case NODE_INDEX:
+        case NODE_UPDATE:
+        case NODE_INS:
+        case NODE_ABS:    return 2;
+        default:          return 1;
+    }
+}
+
+static inline size_t add_costs(size_t cost1, size_t cost2) {
+    return cost1 > SIZE_MAX - cost2 ? SIZE_MAX : cost1 + cost2;
+}
+
+static void compute_best_nodes(struct egraph* egraph, size_t* best_costs, size_t* best_nodes) {
+    // Iterate until a fix point is reached, since classes may contain cycles
+    for (size_t i = 0, n = egraph->nodes.size; i < n; ++i)
+        best_costs[i] = SIZE_MAX;
+    bool todo;
+    do {
+        todo = false;
+        for (size_t i = 0, n = egraph->nodes.size; i < n; ++i) {
+            node_t node = egraph->nodes.elems[i];
+            size_t cost = get_node_cost(egraph->options->cost, node);
+            for (size_t j = 0, m = get_operand_count(node); j < m && cost != SIZE_MAX; ++j)
+                cost = add_costs(cost, best_costs[find_node_class(egraph, get_operand(node, j))]);
+            size_t class = find_class(egraph, i);
+            if (cost < best_costs[class]) {
+                best_costs[class] = cost;
+                best_nodes[class] = i;
+                todo = true;
+            }
+        }
+    } while (todo);
+}
+
+static node_t extract_class(struct egraph* egraph, size_t class, const size_t* best_nodes, node_t* extracted) {
+    if (extracted[class])
+        return extracted[class];
+    node_t node = egraph->nodes.elems[best_nodes[class]];
+    size_t operand_count = get_operand_count(node);
+    if (operand_count > 0) {
+        node_t* operands = new_buf(node_t, operand_count);
+        bool changed = false;
+        for (size_t i = 0; i < operand_count; ++i) {
+            node_t operand = get_operand(node, i);
+            operands[i] = extract_class(egraph, find_node_class(egraph, operand), best_nodes, extracted);
+            changed |= operands[i] != operand;
+        }
+        if (changed)
+            node = rebuild_with_operands(egraph->mod, node, operands);
+        free_buf(operands);
+    }
+    return extracted[class] = node;
+}
+
+// Saturation ----------------------------------------------------------------------
+
+node_t saturate_node(node_t node, const struct egraph_options* options) {
+    struct egraph egraph = {
+        .mod = get_mod(node),
+        .options = options,
+        .nodes = new_node_vec(),
+        .indices = new_node_indices(),
+        .parents = new_index_vec(),
+        .next_members = new_index_vec()
+    };
+    size_t root = add_node(&egraph, node);
+
+    struct node_vec members = new_node_vec();
+    for (size_t iter = 0; iter < options->max_iters; ++iter) {
+        // Nodes that are added during an iteration are only rewritten in the next one
+        bool changed = false;
+        for (size_t i = 0, n = egraph.nodes.size; i < n && egraph.nodes.size < options->max_nodes; ++i)
+            changed |= rewrite_node(&egraph, i, &members);
+        if (!changed)
+            break;
+    }
+    free_node_vec(&members);
+
+    size_t* best_costs = new_buf(size_t, egraph.nodes.size);
+    size_t* best_nodes = new_buf(size_t, egraph.nodes.size);
+    node_t* extracted = new_buf(node_t, egraph.nodes.size);
+    memset(extracted, 0, sizeof(node_t) * egraph.nodes.size);
+    compute_best_nodes(&egraph, best_costs, best_nodes);
+    node_t res = extract_class(&egraph, find_class(&egraph, root), best_nodes, extracted);
+    free_buf(best_costs);
+    free_buf(best_nodes);
+    free_buf(extracted);
+
+    free_node_vec(&egraph.nodes);
+    free_node_indices(&egraph.indices);
+    free_index_vec(&egraph.parents);
+    free_index_vec(&egraph.next_members);
+
+    // Rebuilding nodes may change the type of dependent applications
+    return res->type == node->type ? res : node;
+}
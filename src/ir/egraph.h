@@ -0,0 +1,36 @@
+#ifndef IR_EGRAPH_H
+#define IR_EGRAPH_H
+
+#include "ir/node.h"
+
+/*
+ * Optimizer based on equality saturation. The e-nodes are the hash-consed nodes of
+ * the module, grouped in classes of nodes that are known to be equal. Rewrites are
+ * applied to every node, using every member of the classes of its operands, until
+ * no new equality is found or a limit is reached. The rewrites are those of
+ * `simplify_node`, which run when the alternatives are built, as well as rewrites
+ * that are not always profitable on their own: Beta-reduction, inlining of
+ * let-expressions, and reassociation of integer primitives. The result is obtained
+ * by picking the cheapest member of each class, according to a cost model.
+ */
+
+enum egraph_cost {
+    EGRAPH_COST_SIZE,   // Number of nodes
+    EGRAPH_COST_EVAL    // Number of nodes, weighted by an estimate of their evaluation cost
+};
+
+struct egraph_options {
+    enum egraph_cost cost;
+    size_t max_iters;
+    size_t max_nodes;
+};
+
+#define DEFAULT_EGRAPH_OPTIONS ((struct egraph_options) { \
+    .cost = EGRAPH_COST_EVAL, \
+    .max_iters = 8, \
+    .max_nodes = 10000 \
+})
+
+node_t saturate_node(node_t, const struct egraph_options*);
+
+#endif
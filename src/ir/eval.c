@@ -0,0 +1,696 @@
+#include <assert.h>
+#include <string.h>
+
+#include "utils/utils.h"
+#include "utils/arena.h"
+#include "utils/buf.h"
+#include "utils/vec.h"
+#include "ir/eval.h"
+#include "ir/prim.h"
+#include "ir/profile.h"
+
+struct thunk;
+
+struct env {
+    node_t var;
+    struct thunk* thunk;
+    const struct env* next;
+};
+
+struct value {
+    enum {
+        VALUE_NODE,
+        VALUE_LIT,
+        VALUE_CLOSURE,
+        VALUE_RECORD,
+        VALUE_INJ,
+        VALUE_ARRAY
+    } tag;
+    union {
+        node_t node;
+        struct {
+            struct lit val;
+            node_t type;
+        } lit;
+        struct {
+            node_t abs;
+            const struct env* env;
+        } closure;
+        struct {
+            struct thunk** args;
+            node_t layout; // Record node that gives the labels of the fields
+            size_t arg_count;
+        } record;
+        struct {
+            node_t type;
+            const struct env* env;
+            label_t label;
+            struct thunk* arg;
+        } inj;
+        struct {
+            struct thunk** elems;
+            size_t elem_count;
+            node_t elem_type;
+            const struct env* env;
+        } array;
+    };
+};
+
+struct thunk {
+    node_t node;
+    const struct env* env;
+    const struct value* value;
+    bool is_forced;
+
+    // Variable bound to this thunk, if it comes from a letrec-expression,
+    // as well as the state required to read back recursive values.
+    node_t var;
+    node_t read_back;
+    bool is_reading_back;
+    bool is_recursive;
+};
+
+VEC(thunk_vec, struct thunk*)
+
+struct machine {
+    mod_t mod;
+    arena_t arena;
+    struct profile* profile;
+};
+
+static const struct value* eval(struct machine*, node_t, const struct env*);
+static node_t read_back(struct machine*, const struct value*, bool);
+
+// Environments and thunks ---------------------------------------------------------
+
+static inline const struct env* extend_env(struct machine* machine, const struct env* env, node_t var, struct thunk* thunk) {
+    struct env* new_env = alloc_from_arena(&machine->arena, sizeof(struct env));
+    new_env->var = var;
+    new_env->thunk = thunk;
+    new_env->next = env;
+    return new_env;
+}
+
+static inline struct thunk* find_in_env(const struct env* env, node_t var) {
+    for (; env; env = env->next) {
+        if (env->var == var)
+            return env->thunk;
+    }
+    return NULL;
+}
+
+static inline struct thunk* new_thunk(struct machine* machine, node_t node, const struct env* env) {
+    struct thunk* thunk = alloc_from_arena(&machine->arena, sizeof(struct thunk));
+    thunk->node = node;
+    thunk->env = env;
+    thunk->value = NULL;
+    thunk->is_forced = false;
+    thunk->var = NULL;
+    thunk->read_back = NULL;
+    thunk->is_reading_back = false;
+    thunk->is_recursive = false;
+    return thunk;
+}
+
+static inline const struct value* new_node_value(struct machine* machine, node_t node) {
+    struct value* value = alloc_from_arena(&machine->arena, sizeof(struct value));
+    value->tag = VALUE_NODE;
+    value->node = node;
+    return value;
+}
+
+static inline const struct value* new_lit_value(struct machine* machine, const struct lit* lit, node_t type) {
+    struct value* value = alloc_from_arena(&machine->arena, sizeof(struct value));
+    value->tag = VALUE_LIT;
+    value->lit.val = *lit;
+    value->lit.type = type;
+    return value;
+}
+
+static inline struct thunk* new_forced_thunk(struct machine* machine, node_t node) {
+    struct thunk* thunk = new_thunk(machine, node, NULL);
+    thunk->value = new_node_value(machine, node);
+    thunk->is_forced = true;
+    return thunk;
+}
+
+static inline struct thunk* new_value_thunk(struct machine* machine, const struct value* value) {
+    struct thunk* thunk = new_thunk(machine, NULL, NULL);
+    thunk->value = value;
+    thunk->is_forced = true;
+    return thunk;
+}
+
+static node_t subst_env(struct machine*, node_t, const struct env*);
+
+static const struct value* force(struct machine* machine, struct thunk* thunk) {
+    if (thunk->value)
+        return thunk->value;
+    if (thunk->is_forced) {
+        // The thunk depends on its own value: This computation does not terminate
+        return new_node_value(machine,
+            new_bot(machine->mod, subst_env(machine, thunk->node->type, thunk->env), &thunk->node->loc));
+    }
+    thunk->is_forced = true;
+    thunk->value = eval(machine, thunk->node, thunk->env);
+    return thunk->value;
+}
+
+// Read back -----------------------------------------------------------------------
+
+static node_t read_back_thunk(struct machine* machine, struct thunk* thunk) {
+    if (thunk->read_back)
+        return thunk->read_back;
+    if (thunk->is_reading_back) {
+        // Recursive values are read back as letrec-expressions
+        assert(thunk->var);
+        thunk->is_recursive = true;
+        return thunk->var;
+    }
+    thunk->is_reading_back = true;
+    node_t node = thunk->value
+        ? read_back(machine, thunk->value, false)
+        : subst_env(machine, thunk->node, thunk->env);
+    if (thunk->is_recursive)
+        node = new_letrec(machine->mod, &thunk->var, &node, 1, thunk->var, &node->loc);
+    thunk->is_reading_back = false;
+    thunk->read_back = node;
+    return node;
+}
+
+static node_t subst_env(struct machine* machine, node_t node, const struct env* env) {
+    // Replaces the variables bound in the environment by their (read back) value
+    if (!env || node->free_vars->count == 0)
+        return node;
+    vars_t free_vars = node->free_vars;
+    node_t* vars = new_buf(node_t, free_vars->count);
+    node_t* vals = new_buf(node_t, free_vars->count);
+    size_t var_count = 0;
+    for (size_t i = 0, n = free_vars->count; i < n; ++i) {
+        struct thunk* thunk = find_in_env(env, free_vars->vars[i]);
+        if (!thunk)
+            continue;
+        vars[var_count] = free_vars->vars[i];
+        vals[var_count] = read_back_thunk(machine, thunk);
+        var_count++;
+    }
+    node_t res = replace_vars(node, vars, vals, var_count);
+    free_buf(vars);
+    free_buf(vals);
+    return res;
+}
+
+static node_t read_back(struct machine* machine, const struct value* value, bool deep) {
+    switch (value->tag) {
+        case VALUE_NODE:
+            return value->node;
+        case VALUE_LIT:
+            return new_lit(machine->mod, value->lit.type, &value->lit.val, NULL);
+        case VALUE_CLOSURE:
+            return subst_env(machine, value->closure.abs, value->closure.env);
+        case VALUE_RECORD: {
+            node_t* args = new_buf(node_t, value->record.arg_count);
+            for (size_t i = 0, n = value->record.arg_count; i < n; ++i) {
+                args[i] = deep
+                    ? read_back(machine, force(machine, value->record.args[i]), true)
+                    : read_back_thunk(machine, value->record.args[i]);
+            }
+            node_t record = new_record(machine->mod, args, value->record.layout->record.labels, value->record.arg_count, NULL);
+            free_buf(args);
+            return record;
+        }
+        case VALUE_INJ: {
+            node_t arg = deep
+                ? read_back(machine, force(machine, value->inj.arg), true)
+                : read_back_thunk(machine, value->inj.arg);
+            node_t type = subst_env(machine, value->inj.type, value->inj.env);
+            return new_inj(machine->mod, type, value->inj.label, arg, NULL);
+        }
+        case VALUE_ARRAY: {
+            node_t* elems = new_buf(node_t, value->array.elem_count);
+            for (size_t i = 0, n = value->array.elem_count; i < n; ++i) {
+                elems[i] = deep
+                    ? read_back(machine, force(machine, value->array.elems[i]), true)
+                    : read_back_thunk(machine, value->array.elems[i]);
+            }
+            node_t elem_type = subst_env(machine, value->array.elem_type, value->array.env);
+            node_t array = new_elems(machine->mod, elem_type, elems, value->array.elem_count, NULL);
+            free_buf(elems);
+            return array;
+        }
+        default:
+            assert(false && "invalid value tag");
+            return NULL;
+    }
+}
+
+// Pattern matching ----------------------------------------------------------------
+
+enum match_res {
+    NO_MATCH, MATCH, MAY_MATCH
+};
+
+static inline bool is_same_lit(const struct lit* lit, const struct lit* other) {
+    // Floating-point literals are hash-consed, and thus compared bitwise
+    return lit->tag == other->tag && (lit->tag == LIT_FLOAT
+        ? !memcmp(&lit->float_val, &other->float_val, sizeof(double))
+        : lit->int_val == other->int_val);
+}
+
+static enum match_res match_pat(struct machine* machine, node_t pat, struct thunk* thunk, const struct env** env) {
+    switch (pat->tag) {
+        case NODE_VAR:
+            if (!is_unbound_var(pat))
+                *env = extend_env(machine, *env, pat, thunk);
+            return MATCH;
+        case NODE_LIT: {
+            const struct value* value = force(machine, thunk);
+            if (value->tag == VALUE_LIT)
+                return is_same_lit(&value->lit.val, &pat->lit) ? MATCH : NO_MATCH;
+            if (value->tag != VALUE_NODE || value->node->tag != NODE_LIT)
+                return MAY_MATCH;
+            return value->node == pat ? MATCH : NO_MATCH;
+        }
+        case NODE_RECORD: {
+            const struct value* value = force(machine, thunk);
+            for (size_t i = 0, n = pat->record.arg_count; i < n; ++i) {
+                struct thunk* arg = NULL;
+                if (value->tag == VALUE_RECORD) {
+                    size_t index = find_label_in_node(value->record.layout, pat->record.labels[i]);
+                    assert(index != SIZE_MAX);
+                    arg = value->record.args[index];
+                } else if (value->tag == VALUE_NODE && is_trivial_pat(pat->record.args[i])) {
+                    // The record is not known, but the pattern always matches
+                    arg = new_forced_thunk(machine,
+                        new_ext(machine->mod, value->node, pat->record.labels[i], &pat->record.args[i]->loc));
+                } else
+                    return MAY_MATCH;
+                enum match_res match_res = match_pat(machine, pat->record.args[i], arg, env);
+                if (match_res != MATCH)
+                    return match_res;
+            }
+            return MATCH;
+        }
+        case NODE_INJ: {
+            const struct value* value = force(machine, thunk);
+            if (value->tag != VALUE_INJ)
+                return MAY_MATCH;
+            if (value->inj.label != pat->inj.label)
+                return NO_MATCH;
+            return match_pat(machine, pat->inj.arg, value->inj.arg, env);
+        }
+        default:
+            assert(false && "invalid pattern");
+            return MAY_MATCH;
+    }
+}
+
+// Evaluation ----------------------------------------------------------------------
+
+static inline const struct env* capture_env(struct machine* machine, node_t node, const struct env* env) {
+    // Closures only capture the variables they use, which keeps environments short
+    const struct env* captured = NULL;
+    for (size_t i = 0, n = node->free_vars->count; i < n; ++i) {
+        struct thunk* thunk = find_in_env(env, node->free_vars->vars[i]);
+        if (thunk)
+            captured = extend_env(machine, captured, node->free_vars->vars[i], thunk);
+    }
+    return captured;
+}
+
+static inline const struct value* new_closure(struct machine* machine, node_t abs, const struct env* env) {
+    struct value* value = alloc_from_arena(&machine->arena, sizeof(struct value));
+    value->tag = VALUE_CLOSURE;
+    value->closure.abs = abs;
+    value->closure.env = capture_env(machine, abs, env);
+    return value;
+}
+
+static inline const struct value* new_record_value(
+    struct machine* machine, struct thunk** args, node_t layout, size_t arg_count)
+{
+    struct value* value = alloc_from_arena(&machine->arena, sizeof(struct value));
+    value->tag = VALUE_RECORD;
+    value->record.args = args;
+    value->record.layout = layout;
+    value->record.arg_count = arg_count;
+    return value;
+}
+
+static inline const struct value* new_inj_value(
+    struct machine* machine, node_t type, const struct env* env, label_t label, struct thunk* arg)
+{
+    struct value* value = alloc_from_arena(&machine->arena, sizeof(struct value));
+    value->tag = VALUE_INJ;
+    value->inj.type = type;
+    value->inj.env = env;
+    value->inj.label = label;
+    value->inj.arg = arg;
+    return value;
+}
+
+static inline const struct value* new_array_value(
+    struct machine* machine, struct thunk** elems, size_t elem_count, node_t elem_type, const struct env* env)
+{
+    struct value* value = alloc_from_arena(&machine->arena, sizeof(struct value));
+    value->tag = VALUE_ARRAY;
+    value->array.elems = elems;
+    value->array.elem_count = elem_count;
+    value->array.elem_type = elem_type;
+    value->array.env = env;
+    return value;
+}
+
+static inline struct thunk* apply_closure_lazily(struct machine* machine, const struct value* closure, struct thunk* arg) {
+    node_t abs = closure->closure.abs;
+    const struct env* env = closure->closure.env;
+    if (machine->profile)
+        enter_profiled_fn(machine->profile, abs);
+    if (!is_unbound_var(abs->abs.var))
+        env = extend_env(machine, env, abs->abs.var, arg);
+    return new_thunk(machine, abs->abs.body, env);
+}
+
+static inline const struct value* apply_value(struct machine* machine, const struct value* fn, struct thunk* arg, const struct loc* loc) {
+    if (fn->tag == VALUE_CLOSURE)
+        return force(machine, apply_closure_lazily(machine, fn, arg));
+    return new_node_value(machine, new_app(machine->mod, read_back(machine, fn, false), read_back_thunk(machine, arg), loc));
+}
+
+static inline const struct lit* get_lit(const struct value* value) {
+    if (value->tag == VALUE_LIT)
+        return &value->lit.val;
+    return value->tag == VALUE_NODE && value->node->tag == NODE_LIT ? &value->node->lit : NULL;
+}
+
+static inline bool get_index(const struct value* value, size_t count, size_t* index) {
+    const struct lit* lit = get_lit(value);
+    if (!lit)
+        return false;
+    *index = lit->int_val < count ? lit->int_val : count;
+    return true;
+}
+
+static const struct value* eval_prim_on_values(
+    struct machine* machine, node_t node, const struct env* env, const struct value** vals)
+{
+    // Literal operands are computed on directly, without building any intermediate term
+    struct lit lits[2];
+    assert(node->prim.arg_count <= ARRAY_SIZE(lits));
+    bool is_folded = true;
+    for (size_t i = 0, n = node->prim.arg_count; i < n && is_folded; ++i) {
+        const struct lit* lit = get_lit(vals[i]);
+        if (lit)
+            lits[i] = *lit;
+        is_folded = lit != NULL;
+    }
+    node_t type = subst_env(machine, node->type, env);
+    struct num_type arg_type, res_type;
+    if (is_folded &&
+        get_num_type(reduce_type(subst_env(machine, node->prim.args[0]->type, env)), &arg_type) &&
+        get_num_type(reduce_type(type), &res_type))
+    {
+        struct lit res = eval_prim(node->prim.op, arg_type, res_type, lits);
+        return new_lit_value(machine, &res, type);
+    }
+    node_t args[2];
+    for (size_t i = 0, n = node->prim.arg_count; i < n; ++i)
+        args[i] = read_back(machine, vals[i], false);
+    return new_node_value(machine, new_prim(machine->mod, node->prim.op, type, args, node->prim.arg_count, &node->loc));
+}
+
+static const struct value* eval_if_cheap(struct machine* machine, node_t node, const struct env* env) {
+    // Returns the value of a literal, or of a primitive whose operands are known literals.
+    // Those values are computed without forcing any thunk, and thus always terminate.
+    switch (node->tag) {
+        case NODE_LIT:
+            return new_lit_value(machine, &node->lit, subst_env(machine, node->type, env));
+        case NODE_VAR: {
+            struct thunk* thunk = find_in_env(env, node);
+            if (!thunk)
+                return NULL;
+            if (thunk->value)
+                return get_lit(thunk->value) ? thunk->value : NULL;
+            return !thunk->is_forced && thunk->node->tag == NODE_LIT
+                ? eval_if_cheap(machine, thunk->node, thunk->env) : NULL;
+        }
+        case NODE_PRIM: {
+            const struct value* vals[2];
+            assert(node->prim.arg_count <= ARRAY_SIZE(vals));
+            for (size_t i = 0, n = node->prim.arg_count; i < n; ++i) {
+                if (!(vals[i] = eval_if_cheap(machine, node->prim.args[i], env)))
+                    return NULL;
+            }
+            return eval_prim_on_values(machine, node, env, vals);
+        }
+        default:
+            return NULL;
+    }
+}
+
+static inline struct thunk* new_arg_thunk(struct machine* machine, node_t node, const struct env* env) {
+    // Arguments such as `acc + n` are computed right away when their operands are known,
+    // so that accumulators do not build long chains of thunks.
+    const struct value* value = node->tag == NODE_PRIM ? eval_if_cheap(machine, node, env) : NULL;
+    return value ? new_value_thunk(machine, value) : new_thunk(machine, node, env);
+}
+
+static const struct value* eval_array_op(struct machine* machine, node_t node, const struct env* env) {
+    const struct value* val = eval(machine, node->tag == NODE_MAP || node->tag == NODE_FOLD ? node->map.val : node->index.val, env);
+    if (node->tag == NODE_INDEX || node->tag == NODE_UPDATE) {
+        const struct value* index = eval(machine, node->index.index, env);
+        size_t i;
+        if (val->tag != VALUE_ARRAY || !get_index(index, val->array.elem_count, &i)) {
+            node_t val_node = read_back(machine, val, false);
+            node_t index_node = read_back(machine, index, false);
+            return new_node_value(machine, node->tag == NODE_INDEX
+                ? new_index(machine->mod, val_node, index_node, &node->loc)
+                : new_update(machine->mod, val_node, index_node, subst_env(machine, node->update.elem, env), &node->loc));
+        }
+        // Out-of-bounds accesses produce the bottom value
+        if (i == val->array.elem_count)
+            return new_node_value(machine, new_bot(machine->mod, subst_env(machine, node->type, env), &node->loc));
+        if (node->tag == NODE_INDEX)
+            return force(machine, val->array.elems[i]);
+        struct thunk** elems = alloc_from_arena(&machine->arena, sizeof(struct thunk*) * val->array.elem_count);
+        memcpy(elems, val->array.elems, sizeof(struct thunk*) * val->array.elem_count);
+        elems[i] = new_thunk(machine, node->update.elem, env);
+        return new_array_value(machine, elems, val->array.elem_count, val->array.elem_type, val->array.env);
+    }
+
+    const struct value* fn = eval(machine, node->map.fn, env);
+    if (val->tag != VALUE_ARRAY || fn->tag != VALUE_CLOSURE) {
+        node_t fn_node = read_back(machine, fn, false);
+        node_t val_node = read_back(machine, val, false);
+        return new_node_value(machine, node->tag == NODE_MAP
+            ? new_map(machine->mod, fn_node, val_node, &node->loc)
+            : new_fold(machine->mod, fn_node, subst_env(machine, node->fold.init, env), val_node, &node->loc));
+    }
+    if (node->tag == NODE_MAP) {
+        // Elements of the result are computed lazily, when they are needed
+        struct thunk** elems = alloc_from_arena(&machine->arena, sizeof(struct thunk*) * val->array.elem_count);
+        for (size_t i = 0, n = val->array.elem_count; i < n; ++i)
+            elems[i] = apply_closure_lazily(machine, fn, val->array.elems[i]);
+        return new_array_value(machine, elems, val->array.elem_count, node->type->array.elem, env);
+    }
+    // The accumulator is forced at every step, so that long arrays do not build long chains of thunks
+    struct thunk* acc = new_thunk(machine, node->fold.init, env);
+    for (size_t i = 0, n = val->array.elem_count; i < n; ++i) {
+        const struct value* step = apply_value(machine, fn, acc, &node->loc);
+        acc = new_value_thunk(machine, apply_value(machine, step, val->array.elems[i], &node->loc));
+    }
+    return force(machine, acc);
+}
+
+static inline const struct value* enter_thunk(
+    struct machine* machine, struct thunk* thunk, struct thunk_vec* updates, node_t* node, const struct env** env)
+{
+    // Thunks forced in tail position are evaluated by the caller's loop, and updated
+    // once their value is known. Returns NULL if the thunk has to be evaluated.
+    if (thunk->value || thunk->is_forced)
+        return force(machine, thunk);
+    thunk->is_forced = true;
+    push_to_thunk_vec(updates, thunk);
+    *node = thunk->node;
+    *env = thunk->env;
+    return NULL;
+}
+
+static const struct value* eval_loop(struct machine* machine, node_t node, const struct env* env, struct thunk_vec* updates) {
+    // Expressions in tail position (the body of functions, let-expressions, and match cases)
+    // are evaluated in a loop, so that tail calls do not consume stack space.
+    while (true) {
+        switch (node->tag) {
+            case NODE_VAR: {
+                struct thunk* thunk = find_in_env(env, node);
+                if (!thunk)
+                    return new_node_value(machine, node);
+                const struct value* value = enter_thunk(machine, thunk, updates, &node, &env);
+                if (value)
+                    return value;
+                continue;
+            }
+            case NODE_ABS:
+                return new_closure(machine, node, env);
+            case NODE_APP: {
+                const struct value* left = eval(machine, node->app.left, env);
+                if (left->tag != VALUE_CLOSURE) {
+                    return new_node_value(machine, new_app(machine->mod,
+                        read_back(machine, left, false),
+                        subst_env(machine, node->app.right, env), &node->loc));
+                }
+                node_t abs = left->closure.abs;
+                const struct env* new_env = left->closure.env;
+                if (machine->profile)
+                    enter_profiled_fn(machine->profile, abs);
+                if (!is_unbound_var(abs->abs.var))
+                    new_env = extend_env(machine, new_env, abs->abs.var, new_arg_thunk(machine, node->app.right, env));
+                node = abs->abs.body;
+                env = new_env;
+                continue;
+            }
+            case NODE_LET: {
+                const struct env* new_env = env;
+                for (size_t i = 0, n = node->let.var_count; i < n; ++i)
+                    new_env = extend_env(machine, new_env, node->let.vars[i], new_arg_thunk(machine, node->let.vals[i], env));
+                node = node->let.body;
+                env = new_env;
+                continue;
+            }
+            case NODE_LETREC: {
+                struct thunk** thunks = new_buf(struct thunk*, node->letrec.var_count);
+                for (size_t i = 0, n = node->letrec.var_count; i < n; ++i) {
+                    thunks[i] = new_thunk(machine, node->letrec.vals[i], NULL);
+                    thunks[i]->var = node->letrec.vars[i];
+                    env = extend_env(machine, env, node->letrec.vars[i], thunks[i]);
+                }
+                for (size_t i = 0, n = node->letrec.var_count; i < n; ++i)
+                    thunks[i]->env = env;
+                free_buf(thunks);
+                node = node->letrec.body;
+                continue;
+            }
+            case NODE_MATCH: {
+                struct thunk* arg = new_thunk(machine, node->match.arg, env);
+                size_t i = 0;
+                const struct env* new_env = env;
+                enum match_res match_res = NO_MATCH;
+                for (size_t n = node->match.pat_count; i < n; ++i) {
+                    new_env = env;
+                    if ((match_res = match_pat(machine, node->match.pats[i], arg, &new_env)) != NO_MATCH)
+                        break;
+                }
+                if (match_res == NO_MATCH)
+                    return new_node_value(machine, new_bot(machine->mod, subst_env(machine, node->type, env), &node->loc));
+                if (match_res == MAY_MATCH)
+                    return new_node_value(machine, subst_env(machine, node, env));
+                node = node->match.vals[i];
+                env = new_env;
+                continue;
+            }
+            case NODE_RECORD: {
+                struct thunk** args = alloc_from_arena(&machine->arena, sizeof(struct thunk*) * node->record.arg_count);
+                for (size_t i = 0, n = node->record.arg_count; i < n; ++i)
+                    args[i] = new_thunk(machine, node->record.args[i], env);
+                return new_record_value(machine, args, node, node->record.arg_count);
+            }
+            case NODE_INJ:
+                return new_inj_value(machine, node->type, env, node->inj.label, new_thunk(machine, node->inj.arg, env));
+            case NODE_EXT: {
+                const struct value* val = eval(machine, node->ext.val, env);
+                if (val->tag == VALUE_RECORD) {
+                    size_t index = find_label_in_node(val->record.layout, node->ext.label);
+                    assert(index != SIZE_MAX);
+                    const struct value* value = enter_thunk(machine, val->record.args[index], updates, &node, &env);
+                    if (value)
+                        return value;
+                    continue;
+                } else if (val->tag == VALUE_INJ) {
+                    if (val->inj.label != node->ext.label)
+                        return new_node_value(machine, new_bot(machine->mod, subst_env(machine, node->type, env), &node->loc));
+                    const struct value* value = enter_thunk(machine, val->inj.arg, updates, &node, &env);
+                    if (value)
+                        return value;
+                    continue;
+                }
+                return new_node_value(machine,
+                    new_ext(machine->mod, read_back(machine, val, false), node->ext.label, &node->loc));
+            }
+            case NODE_INS: {
+                if (node->type->tag == NODE_SUM)
+                    return new_inj_value(machine, node->type, env, node->ins.labels[0], new_thunk(machine, node->ins.elems[0], env));
+                const struct value* val = eval(machine, node->ins.val, env);
+                if (val->tag == VALUE_RECORD) {
+                    struct thunk** args = alloc_from_arena(&machine->arena, sizeof(struct thunk*) * val->record.arg_count);
+                    memcpy(args, val->record.args, sizeof(struct thunk*) * val->record.arg_count);
+                    for (size_t i = 0, n = node->ins.elem_count; i < n; ++i) {
+                        size_t index = find_label_in_node(val->record.layout, node->ins.labels[i]);
+                        assert(index != SIZE_MAX);
+                        args[index] = new_thunk(machine, node->ins.elems[i], env);
+                    }
+                    return new_record_value(machine, args, val->record.layout, val->record.arg_count);
+                }
+                node_t* elems = new_buf(node_t, node->ins.elem_count);
+                for (size_t i = 0, n = node->ins.elem_count; i < n; ++i)
+                    elems[i] = subst_env(machine, node->ins.elems[i], env);
+                node_t ins = new_ins(machine->mod, read_back(machine, val, false),
+                    elems, node->ins.labels, node->ins.elem_count, &node->loc);
+                free_buf(elems);
+                return new_node_value(machine, ins);
+            }
+            case NODE_PRIM: {
+                // Operands are evaluated eagerly
+                const struct value* vals[2];
+                assert(node->prim.arg_count <= ARRAY_SIZE(vals));
+                for (size_t i = 0, n = node->prim.arg_count; i < n; ++i)
+                    vals[i] = eval(machine, node->prim.args[i], env);
+                return eval_prim_on_values(machine, node, env, vals);
+            }
+            case NODE_ELEMS: {
+                struct thunk** elems = alloc_from_arena(&machine->arena, sizeof(struct thunk*) * node->elems.arg_count);
+                for (size_t i = 0, n = node->elems.arg_count; i < n; ++i)
+                    elems[i] = new_thunk(machine, node->elems.args[i], env);
+                return new_array_value(machine, elems, node->elems.arg_count, node->type->array.elem, env);
+            }
+            case NODE_INDEX:
+            case NODE_UPDATE:
+            case NODE_MAP:
+            case NODE_FOLD:
+                return eval_array_op(machine, node, env);
+            case NODE_LIT:
+                return new_lit_value(machine, &node->lit, subst_env(machine, node->type, env));
+            default:
+                // Types and constants are evaluated by substitution
+                return new_node_value(machine, subst_env(machine, node, env));
+        }
+    }
+}
+
+static const struct value* eval(struct machine* machine, node_t node, const struct env* env) {
+    struct thunk* updates_buf[8];
+    struct thunk_vec updates = new_thunk_vec_on_stack(ARRAY_SIZE(updates_buf), updates_buf);
+    const struct value* value = eval_loop(machine, node, env, &updates);
+    for (size_t i = 0; i < updates.size; ++i)
+        updates.elems[i]->value = value;
+    free_thunk_vec(&updates);
+    return value;
+}
+
+static node_t eval_and_read_back(node_t node, bool deep) {
+    struct machine machine = {
+        .mod = get_mod(node),
+        .arena = new_arena(),
+        .profile = get_mod_profile(get_mod(node))
+    };
+    node_t res = read_back(&machine, eval(&machine, node, NULL), deep);
+    free_arena(machine.arena);
+    return res;
+}
+
+node_t eval_node(node_t node) {
+    return eval_and_read_back(node, true);
+}
+
+node_t eval_node_to_whnf(node_t node) {
+    return eval_and_read_back(node, false);
+}
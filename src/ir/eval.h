@@ -0,0 +1,21 @@
+#ifndef IR_EVAL_H
+#define IR_EVAL_H
+
+#include "ir/node.h"
+
+/*
+ * Call-by-need evaluator based on an abstract machine with environments.
+ * Unlike `reduce_node`, which performs substitutions and builds a hash-consed
+ * node for every intermediate term, this machine represents intermediate
+ * states with closures and shared thunks. IR nodes are only built when reading
+ * back the final value, or when evaluation gets stuck (e.g. on a free variable).
+ * Data (records and injections) is read back completely, while functions are read
+ * back by substituting their environment, without reducing under binders.
+ */
+
+node_t eval_node(node_t);
+// Only evaluates the node until its head is known: The operands of the result are
+// read back as they are, without being evaluated.
+node_t eval_node_to_whnf(node_t);
+
+#endif
@@ -0,0 +1,274 @@
+
+#include "utils/utils.h"
+#include "utils/buf.h"
+#include "utils/map.h"
+#include "utils/vec.h"
+#include "ir/float_lets.h"
+#include "ir/operands.h"
+
+VEC(index_vec, size_t)
+
+struct floater {
+    mod_t mod;
+    bool is_strict;
+    node_t (*float_node)(const struct floater*, node_t);
+    struct node_map floated;
+};
+
+// Float-out -----------------------------------------------------------------------
+
+struct let_levels {
+    struct node_vec vars, vals;
+    struct index_vec ends;
+};
+
+static inline struct let_levels new_let_levels(void) {
+    return (struct let_levels) {
+        .vars = new_node_vec(),
+        .vals = new_node_vec(),
+        .ends = new_index_vec()
+    };
+}
+
+static inline void free_let_levels(struct let_levels* levels) {
+    free_node_vec(&levels->vars);
+    free_node_vec(&levels->vals);
+    free_index_vec(&levels->ends);
+}
+
+static inline node_t wrap_in_let_levels(mod_t mod, const struct let_levels* levels, node_t body, const struct loc* loc) {
+    for (size_t i = levels->ends.size; i-- > 0;) {
+        size_t begin = i > 0 ? levels->ends.elems[i - 1] : 0, end = levels->ends.elems[i];
+        if (begin != end)
+            body = new_let(mod, levels->vars.elems + begin, levels->vals.elems + begin, end - begin, body, loc);
+    }
+    return body;
+}
+
+static bool is_cheap_value(node_t node) {
+    // Values that are computed in constant time, and that always terminate
+    if (is_type_node(node))
+        return true;
+    switch (node->tag) {
+        case NODE_VAR:
+        case NODE_LIT:
+        case NODE_ABS:
+            return true;
+        case NODE_RECORD:
+        case NODE_INJ:
+        case NODE_ELEMS:
+            for (size_t i = 0, n = get_operand_count(node); i < n; ++i) {
+                if (!is_cheap_value(get_operand(node, i)))
+                    return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+static node_t split_lets(
+    const struct floater* floater, node_t node, vars_t staying,
+    struct let_levels* out, struct let_levels* in)
+{
+    // A binding stays if its value uses one of the given variables, or another binding
+    // that stays. Let-expressions are kept as separate levels, since the values of a
+    // level may use the previous ones. Under strict evaluation, bindings that are not
+    // cheap values stay as well: Once floated out, they would be computed even if the
+    // function is never applied, which may not terminate.
+    mod_t mod = floater->mod;
+    for (; node->tag == NODE_LET; node = node->let.body) {
+        vars_t staying_level = new_vars(mod, NULL, 0);
+        for (size_t i = 0, n = node->let.var_count; i < n; ++i) {
+            bool stays =
+                contains_vars(node->let.vals[i]->free_vars, staying) ||
+                (floater->is_strict && !is_cheap_value(node->let.vals[i]));
+            struct let_levels* levels = stays ? in : out;
+            push_to_node_vec(&levels->vars, node->let.vars[i]);
+            push_to_node_vec(&levels->vals, node->let.vals[i]);
+            if (levels == in)
+                staying_level = union_vars(mod, staying_level, node->let.vars[i]->free_vars);
+        }
+        staying = union_vars(mod, staying, staying_level);
+        push_to_index_vec(&out->ends, out->vars.size);
+        push_to_index_vec(&in->ends, in->vars.size);
+    }
+    return node;
+}
+
+static node_t float_out_of_abs(const struct floater* floater, node_t abs) {
+    if (abs->abs.body->tag != NODE_LET)
+        return abs;
+    mod_t mod = floater->mod;
+    struct let_levels out = new_let_levels();
+    struct let_levels in = new_let_levels();
+    node_t body = split_lets(floater, abs->abs.body, abs->abs.var->free_vars, &out, &in);
+    node_t res = abs;
+    if (out.vars.size > 0) {
+        body = wrap_in_let_levels(mod, &in, body, &abs->abs.body->loc);
+        res = new_abs(mod, abs->abs.var, body, &abs->loc);
+        res = wrap_in_let_levels(mod, &out, res, &abs->abs.body->loc);
+    }
+    free_let_levels(&out);
+    free_let_levels(&in);
+    return res;
+}
+
+static node_t float_out_of_letrec(const struct floater* floater, node_t letrec) {
+    // Bindings at the top of recursive values go out of the letrec-expression when
+    // they do not use the functions it defines. Recursive values must stay functions
+    // (the virtual machine only supports those), so a value is only changed when all
+    // its bindings can go out.
+    mod_t mod = floater->mod;
+    size_t var_count = letrec->letrec.var_count;
+    vars_t staying = new_vars(mod, letrec->letrec.vars, var_count);
+    struct let_levels out = new_let_levels();
+    node_t* vals = new_buf(node_t, var_count);
+    bool has_changed = false;
+    for (size_t i = 0; i < var_count; ++i) {
+        vals[i] = letrec->letrec.vals[i];
+        if (vals[i]->tag != NODE_LET)
+            continue;
+        struct let_levels in = new_let_levels();
+        size_t out_count = out.vars.size;
+        node_t abs = split_lets(floater, vals[i], staying, &out, &in);
+        if (abs->tag == NODE_ABS && in.vars.size == 0) {
+            vals[i] = abs;
+            has_changed = true;
+        } else {
+            out.vars.size = out.vals.size = out_count;
+            out.ends.size -= in.ends.size;
+        }
+        free_let_levels(&in);
+    }
+    node_t res = letrec;
+    if (has_changed) {
+        res = new_letrec(mod, letrec->letrec.vars, vals, var_count, letrec->letrec.body, &letrec->loc);
+        res = wrap_in_let_levels(mod, &out, res, &letrec->loc);
+    }
+    free_let_levels(&out);
+    free_buf(vals);
+    return res;
+}
+
+static node_t float_out(const struct floater* floater, node_t node) {
+    switch (node->tag) {
+        case NODE_ABS:    return float_out_of_abs(floater, node);
+        case NODE_LETREC: return float_out_of_letrec(floater, node);
+        default:          return node;
+    }
+}
+
+// Float-in ------------------------------------------------------------------------
+
+static node_t float_into_match(mod_t mod, node_t let) {
+    node_t match = let->let.body;
+    if (match->tag != NODE_MATCH)
+        return let;
+
+    // Find the only case that uses each binding, if any
+    size_t var_count = let->let.var_count, pat_count = match->match.pat_count;
+    size_t* targets = new_buf(size_t, var_count);
+    bool has_moved = false;
+    for (size_t i = 0; i < var_count; ++i) {
+        node_t var = let->let.vars[i];
+        targets[i] = SIZE_MAX;
+        if (contains_var(match->match.arg->free_vars, var))
+            continue;
+        for (size_t j = 0; j < pat_count; ++j) {
+            if (!contains_var(match->match.vals[j]->free_vars, var))
+                continue;
+            if (targets[i] != SIZE_MAX) {
+                targets[i] = SIZE_MAX;
+                break;
+            }
+            targets[i] = j;
+        }
+        has_moved |= targets[i] != SIZE_MAX;
+    }
+
+    node_t res = let;
+    if (has_moved) {
+        node_t* vars = new_buf(node_t, var_count);
+        node_t* vals = new_buf(node_t, var_count);
+        node_t* cases = new_buf(node_t, pat_count);
+        for (size_t j = 0; j < pat_count; ++j) {
+            size_t count = 0;
+            for (size_t i = 0; i < var_count; ++i) {
+                if (targets[i] == j) {
+                    vars[count] = let->let.vars[i];
+                    vals[count] = let->let.vals[i];
+                    count++;
+                }
+            }
+            // Bindings may go further down, into the nested match expressions of the case
+            cases[j] = count > 0
+                ? float_into_match(mod, new_let(mod, vars, vals, count, match->match.vals[j], &let->loc))
+                : match->match.vals[j];
+        }
+        size_t count = 0;
+        for (size_t i = 0; i < var_count; ++i) {
+            if (targets[i] == SIZE_MAX) {
+                vars[count] = let->let.vars[i];
+                vals[count] = let->let.vals[i];
+                count++;
+            }
+        }
+        res = new_match(mod, match->match.pats, cases, pat_count, match->match.arg, &match->loc);
+        if (count > 0)
+            res = new_let(mod, vars, vals, count, res, &let->loc);
+        free_buf(vars);
+        free_buf(vals);
+        free_buf(cases);
+    }
+    free_buf(targets);
+    return res;
+}
+
+static node_t float_in(const struct floater* floater, node_t node) {
+    return node->tag == NODE_LET ? float_into_match(floater->mod, node) : node;
+}
+
+// Traversal -----------------------------------------------------------------------
+
+static node_t float_node(struct floater* floater, node_t node) {
+    // Operands are transformed first, so that bindings float through several levels at once
+    if (is_type_node(node))
+        return node;
+    node_t* found = find_in_node_map(&floater->floated, node);
+    if (found)
+        return *found;
+
+    node_t res = node;
+    size_t operand_count = get_operand_count(node);
+    if (operand_count > 0) {
+        bool has_changed = false;
+        node_t* operands = new_buf(node_t, operand_count);
+        for (size_t i = 0; i < operand_count; ++i) {
+            operands[i] = float_node(floater, get_operand(node, i));
+            has_changed |= operands[i] != get_operand(node, i);
+        }
+        if (has_changed)
+            res = rebuild_with_operands(floater->mod, node, operands);
+        free_buf(operands);
+    }
+    res = floater->float_node(floater, res);
+    insert_in_node_map(&floater->floated, node, res);
+    return res;
+}
+
+static node_t float_all(node_t node, bool is_strict, node_t (*float_fn)(const struct floater*, node_t)) {
+    struct floater floater = {
+        .mod = get_mod(node),
+        .is_strict = is_strict,
+        .float_node = float_fn,
+        .floated = new_node_map()
+    };
+    node = float_node(&floater, node);
+    free_node_map(&floater.floated);
+    return node;
+}
+
+node_t float_lets(node_t node, bool is_strict) {
+    return float_all(float_all(node, is_strict, float_out), is_strict, float_in);
+}
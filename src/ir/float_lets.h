@@ -0,0 +1,20 @@
+#ifndef IR_FLOAT_LETS_H
+#define IR_FLOAT_LETS_H
+
+#include "ir/node.h"
+
+/*
+ * Let-floating, based on the free variables of the bound values. Bindings at the
+ * top of the body of an abstraction that do not depend on its variable are first
+ * floated out of it, so that they are computed once instead of once per application.
+ * Then, bindings that are only used by one case of a match expression are floated
+ * into that case, so that the other cases do not compute them. Bindings are not
+ * floated into abstractions, as that would undo the first transformation.
+ *
+ * Programs that are evaluated strictly (on the virtual machine, or once compiled to C)
+ * must set `is_strict`: Only cheap values that always terminate are then floated out.
+ */
+
+node_t float_lets(node_t, bool is_strict);
+
+#endif
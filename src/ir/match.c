@@ -0,0 +1,421 @@
+#include <assert.h>
+#include <string.h>
+
+#include "utils/utils.h"
+#include "utils/arena.h"
+#include "utils/buf.h"
+#include "utils/hash.h"
+#include "utils/map.h"
+#include "utils/sort.h"
+#include "utils/vec.h"
+#include "ir/match.h"
+
+// Positions in the argument refer to their parent position. The argument itself is
+// the position 0.
+struct match_path {
+    size_t parent;
+    label_t label;  // Field of the parent record, or NULL for the argument of an injection
+};
+
+struct match_branch {
+    const void* head; // Literal node or injection label
+    const struct decision* decision;
+};
+
+struct decision {
+    enum {
+        DECISION_FAIL,
+        DECISION_LEAF,
+        DECISION_SWITCH
+    } tag;
+    union {
+        struct {
+            size_t case_index;
+            const node_t* vars;
+            const size_t* paths;
+            size_t var_count;
+        } leaf;
+        struct {
+            size_t path;
+            const struct match_branch* branches; // Sorted by head address
+            size_t branch_count;
+            const struct decision* default_branch;
+        } switch_;
+    };
+};
+
+struct match_tree {
+    const struct match_path* paths;
+    size_t path_count;
+    const struct decision* root;
+};
+
+struct match_key {
+    const node_t* pats;
+    size_t pat_count;
+};
+
+static inline uint32_t hash_match_key(const void* ptr) {
+    const struct match_key* key = ptr;
+    uint32_t h = hash_init();
+    for (size_t i = 0; i < key->pat_count; ++i)
+        h = hash_ptr(h, key->pats[i]);
+    return h;
+}
+
+static inline bool compare_match_key(const void* ptr1, const void* ptr2) {
+    const struct match_key* key1 = ptr1, *key2 = ptr2;
+    return
+        key1->pat_count == key2->pat_count &&
+        !memcmp(key1->pats, key2->pats, sizeof(node_t) * key1->pat_count);
+}
+
+static inline bool is_match_branch_less_than(const struct match_branch* left, const struct match_branch* right) {
+    return left->head < right->head;
+}
+
+CUSTOM_MAP(match_trees, struct match_key, const struct match_tree*, hash_match_key, compare_match_key)
+CUSTOM_SORT(sort_match_branches, struct match_branch, is_match_branch_less_than)
+VEC(match_path_vec, struct match_path)
+
+struct match_cache {
+    arena_t arena;
+    struct match_trees trees;
+};
+
+static const struct decision fail_decision = { .tag = DECISION_FAIL };
+
+// Compilation ---------------------------------------------------------------------
+
+// Pattern variables are bound to positions as patterns get decomposed. Rows derived
+// from the same row share their bindings.
+struct binding {
+    node_t var;
+    size_t path;
+    const struct binding* next;
+};
+
+struct row {
+    size_t case_index;
+    const struct binding* bindings;
+};
+
+// Patterns are stored row by row. Variables are replaced by wildcards, represented
+// with NULL, so that only literals, records, and injections remain.
+struct matrix {
+    size_t* columns;
+    size_t column_count;
+    node_t* pats;
+    struct row* rows;
+    size_t row_count;
+};
+
+struct compiler {
+    arena_t* arena;
+    struct match_path_vec paths;
+};
+
+static const struct decision* compile_matrix(struct compiler*, const struct matrix*);
+
+static inline size_t get_path(struct compiler* compiler, size_t parent, label_t label) {
+    for (size_t i = 0; i < compiler->paths.size; ++i) {
+        if (compiler->paths.elems[i].parent == parent && compiler->paths.elems[i].label == label)
+            return i;
+    }
+    push_to_match_path_vec(&compiler->paths, (struct match_path) { .parent = parent, .label = label });
+    return compiler->paths.size - 1;
+}
+
+static inline node_t bind_pat(struct compiler* compiler, struct row* row, node_t pat, size_t path) {
+    if (pat->tag != NODE_VAR)
+        return pat;
+    if (!is_unbound_var(pat)) {
+        struct binding* binding = alloc_from_arena(compiler->arena, sizeof(struct binding));
+        *binding = (struct binding) { .var = pat, .path = path, .next = row->bindings };
+        row->bindings = binding;
+    }
+    return NULL;
+}
+
+static inline const void* get_pat_head(node_t pat) {
+    return pat->tag == NODE_INJ ? (const void*)pat->inj.label : (const void*)pat;
+}
+
+static inline const struct decision* compile_leaf(struct compiler* compiler, const struct row* row) {
+    size_t var_count = 0;
+    for (const struct binding* binding = row->bindings; binding; binding = binding->next)
+        var_count++;
+    node_t* vars = alloc_from_arena(compiler->arena, sizeof(node_t) * var_count);
+    size_t* paths = alloc_from_arena(compiler->arena, sizeof(size_t) * var_count);
+    size_t i = 0;
+    for (const struct binding* binding = row->bindings; binding; binding = binding->next, ++i) {
+        vars[i] = binding->var;
+        paths[i] = binding->path;
+    }
+    struct decision* leaf = alloc_from_arena(compiler->arena, sizeof(struct decision));
+    leaf->tag = DECISION_LEAF;
+    leaf->leaf.case_index = row->case_index;
+    leaf->leaf.vars = vars;
+    leaf->leaf.paths = paths;
+    leaf->leaf.var_count = var_count;
+    return leaf;
+}
+
+static inline const struct decision* expand_record(struct compiler* compiler, const struct matrix* matrix, size_t column, node_t record) {
+    // Replace the column by one column per field, since records always match
+    size_t field_count = record->record.arg_count;
+    size_t column_count = matrix->column_count - 1 + field_count;
+    struct matrix expanded = {
+        .columns = new_buf(size_t, column_count),
+        .column_count = column_count,
+        .pats = new_buf(node_t, column_count * matrix->row_count),
+        .rows = new_buf(struct row, matrix->row_count),
+        .row_count = matrix->row_count
+    };
+    memcpy(expanded.columns, matrix->columns, sizeof(size_t) * column);
+    for (size_t i = 0; i < field_count; ++i)
+        expanded.columns[column + i] = get_path(compiler, matrix->columns[column], record->record.labels[i]);
+    memcpy(expanded.columns + column + field_count, matrix->columns + column + 1, sizeof(size_t) * (matrix->column_count - column - 1));
+
+    for (size_t i = 0; i < matrix->row_count; ++i) {
+        const node_t* pats = matrix->pats + i * matrix->column_count;
+        node_t* expanded_pats = expanded.pats + i * column_count;
+        expanded.rows[i] = matrix->rows[i];
+        memcpy(expanded_pats, pats, sizeof(node_t) * column);
+        for (size_t j = 0; j < field_count; ++j) {
+            node_t field = NULL;
+            if (pats[column]) {
+                size_t index = find_label_in_node(pats[column], record->record.labels[j]);
+                assert(index != SIZE_MAX);
+                field = bind_pat(compiler, &expanded.rows[i], pats[column]->record.args[index], expanded.columns[column + j]);
+            }
+            expanded_pats[column + j] = field;
+        }
+        memcpy(expanded_pats + column + field_count, pats + column + 1, sizeof(node_t) * (matrix->column_count - column - 1));
+    }
+
+    const struct decision* decision = compile_matrix(compiler, &expanded);
+    free_buf(expanded.columns);
+    free_buf(expanded.pats);
+    free_buf(expanded.rows);
+    return decision;
+}
+
+static inline const struct decision* compile_specialized(struct compiler* compiler, const struct matrix* matrix, size_t column, const void* head, size_t child_path) {
+    // Keep the rows that can match the given head, or all the rows that have a wildcard
+    // in the column when the head is NULL. The column is replaced by the argument of
+    // the injection when there is one, and removed otherwise.
+    bool has_child = head && child_path != SIZE_MAX;
+    size_t column_count = has_child ? matrix->column_count : matrix->column_count - 1;
+    struct matrix specialized = {
+        .columns = new_buf(size_t, column_count),
+        .column_count = column_count,
+        .pats = new_buf(node_t, column_count * matrix->row_count),
+        .rows = new_buf(struct row, matrix->row_count),
+        .row_count = 0
+    };
+    memcpy(specialized.columns, matrix->columns, sizeof(size_t) * column);
+    if (has_child)
+        specialized.columns[column] = child_path;
+    memcpy(specialized.columns + column + has_child, matrix->columns + column + 1, sizeof(size_t) * (matrix->column_count - column - 1));
+
+    for (size_t i = 0; i < matrix->row_count; ++i) {
+        const node_t* pats = matrix->pats + i * matrix->column_count;
+        if (pats[column] && get_pat_head(pats[column]) != head)
+            continue;
+        node_t* specialized_pats = specialized.pats + specialized.row_count * column_count;
+        struct row* row = &specialized.rows[specialized.row_count++];
+        *row = matrix->rows[i];
+        memcpy(specialized_pats, pats, sizeof(node_t) * column);
+        if (has_child)
+            specialized_pats[column] = pats[column] ? bind_pat(compiler, row, pats[column]->inj.arg, child_path) : NULL;
+        memcpy(specialized_pats + column + has_child, pats + column + 1, sizeof(node_t) * (matrix->column_count - column - 1));
+    }
+
+    const struct decision* decision = compile_matrix(compiler, &specialized);
+    free_buf(specialized.columns);
+    free_buf(specialized.pats);
+    free_buf(specialized.rows);
+    return decision;
+}
+
+static inline const struct decision* compile_switch(struct compiler* compiler, const struct matrix* matrix, size_t column, node_t pat) {
+    size_t child_path = pat->tag == NODE_INJ ? get_path(compiler, matrix->columns[column], NULL) : SIZE_MAX;
+    struct match_branch* branches = alloc_from_arena(compiler->arena, sizeof(struct match_branch) * matrix->row_count);
+    size_t branch_count = 0;
+    for (size_t i = 0; i < matrix->row_count; ++i) {
+        node_t other = matrix->pats[i * matrix->column_count + column];
+        if (!other)
+            continue;
+        const void* head = get_pat_head(other);
+        bool is_new_head = true;
+        for (size_t j = 0; j < branch_count && is_new_head; ++j)
+            is_new_head = branches[j].head != head;
+        if (is_new_head)
+            branches[branch_count++].head = head;
+    }
+    for (size_t i = 0; i < branch_count; ++i)
+        branches[i].decision = compile_specialized(compiler, matrix, column, branches[i].head, child_path);
+    sort_match_branches(branches, branch_count);
+
+    // The default branch is not needed when all the options of a sum are covered
+    bool is_exhaustive = pat->tag == NODE_INJ && pat->type->tag == NODE_SUM && pat->type->sum.arg_count == branch_count;
+    struct decision* decision = alloc_from_arena(compiler->arena, sizeof(struct decision));
+    decision->tag = DECISION_SWITCH;
+    decision->switch_.path = matrix->columns[column];
+    decision->switch_.branches = branches;
+    decision->switch_.branch_count = branch_count;
+    decision->switch_.default_branch = is_exhaustive
+        ? &fail_decision
+        : compile_specialized(compiler, matrix, column, NULL, child_path);
+    return decision;
+}
+
+static const struct decision* compile_matrix(struct compiler* compiler, const struct matrix* matrix) {
+    if (matrix->row_count == 0)
+        return &fail_decision;
+
+    // Test the first column that is not a wildcard in the first row. If there is none,
+    // the first row always matches.
+    for (size_t i = 0; i < matrix->column_count; ++i) {
+        node_t pat = matrix->pats[i];
+        if (!pat)
+            continue;
+        return pat->tag == NODE_RECORD
+            ? expand_record(compiler, matrix, i, pat)
+            : compile_switch(compiler, matrix, i, pat);
+    }
+    return compile_leaf(compiler, &matrix->rows[0]);
+}
+
+static inline const struct match_tree* compile_match_tree(arena_t* arena, const node_t* pats, size_t pat_count) {
+    struct compiler compiler = { .arena = arena, .paths = new_match_path_vec() };
+    push_to_match_path_vec(&compiler.paths, (struct match_path) { .parent = SIZE_MAX, .label = NULL });
+
+    struct matrix matrix = {
+        .columns = &(size_t) { 0 },
+        .column_count = 1,
+        .pats = new_buf(node_t, pat_count),
+        .rows = new_buf(struct row, pat_count),
+        .row_count = pat_count
+    };
+    for (size_t i = 0; i < pat_count; ++i) {
+        assert(is_pat(pats[i]));
+        matrix.rows[i] = (struct row) { .case_index = i, .bindings = NULL };
+        matrix.pats[i] = bind_pat(&compiler, &matrix.rows[i], pats[i], 0);
+    }
+    const struct decision* root = compile_matrix(&compiler, &matrix);
+    free_buf(matrix.pats);
+    free_buf(matrix.rows);
+
+    struct match_path* paths = alloc_from_arena(arena, sizeof(struct match_path) * compiler.paths.size);
+    memcpy(paths, compiler.paths.elems, sizeof(struct match_path) * compiler.paths.size);
+    struct match_tree* tree = alloc_from_arena(arena, sizeof(struct match_tree));
+    tree->paths = paths;
+    tree->path_count = compiler.paths.size;
+    tree->root = root;
+    free_match_path_vec(&compiler.paths);
+    return tree;
+}
+
+// Cache ---------------------------------------------------------------------------
+
+struct match_cache* new_match_cache(void) {
+    struct match_cache* cache = xmalloc(sizeof(struct match_cache));
+    cache->arena = new_arena();
+    cache->trees = new_match_trees();
+    return cache;
+}
+
+void free_match_cache(struct match_cache* cache) {
+    free_match_trees(&cache->trees);
+    free_arena(cache->arena);
+    free(cache);
+}
+
+const struct match_tree* get_match_tree(mod_t mod, const node_t* pats, size_t pat_count) {
+    lock_mod(mod);
+    struct match_cache* cache = get_match_cache(mod);
+    const struct match_tree* tree = deref_or_null((void**)find_in_match_trees(&cache->trees, (struct match_key) { pats, pat_count }));
+    if (!tree) {
+        tree = compile_match_tree(&cache->arena, pats, pat_count);
+        node_t* key_pats = alloc_from_arena(&cache->arena, sizeof(node_t) * pat_count);
+        memcpy(key_pats, pats, sizeof(node_t) * pat_count);
+        insert_in_match_trees(&cache->trees, (struct match_key) { key_pats, pat_count }, tree);
+    }
+    unlock_mod(mod);
+    return tree;
+}
+
+// Execution -----------------------------------------------------------------------
+
+static inline node_t find_path_node(const struct match_tree* tree, node_t arg, size_t path) {
+    // Returns NULL if the node at this position is not known without building an extract
+    if (path == 0)
+        return arg;
+    node_t parent = find_path_node(tree, arg, tree->paths[path].parent);
+    if (!parent)
+        return NULL;
+    label_t label = tree->paths[path].label;
+    if (!label) {
+        assert(parent->tag == NODE_INJ);
+        return parent->inj.arg;
+    }
+    if (parent->tag != NODE_RECORD)
+        return NULL;
+    size_t index = find_label_in_node(parent, label);
+    assert(index != SIZE_MAX);
+    return parent->record.args[index];
+}
+
+static inline node_t build_path_node(mod_t mod, const struct match_tree* tree, node_t arg, size_t path) {
+    if (path == 0)
+        return arg;
+    node_t parent = build_path_node(mod, tree, arg, tree->paths[path].parent);
+    label_t label = tree->paths[path].label;
+    if (!label) {
+        assert(parent->tag == NODE_INJ);
+        return parent->inj.arg;
+    }
+    if (parent->tag != NODE_RECORD)
+        return new_ext(mod, parent, label, NULL);
+    size_t index = find_label_in_node(parent, label);
+    assert(index != SIZE_MAX);
+    return parent->record.args[index];
+}
+
+static inline const struct decision* find_branch(const struct decision* decision, const void* head) {
+    const struct match_branch* branches = decision->switch_.branches;
+    size_t i = 0, j = decision->switch_.branch_count;
+    while (i < j) {
+        size_t m = (i + j) / 2;
+        if (branches[m].head < head)
+            i = m + 1;
+        else if (branches[m].head > head)
+            j = m;
+        else
+            return branches[m].decision;
+    }
+    return decision->switch_.default_branch;
+}
+
+enum match_res run_match_tree(const struct match_tree* tree, node_t arg, size_t* case_index, struct node_vec* vars, struct node_vec* vals) {
+    const struct decision* decision = tree->root;
+    while (decision->tag == DECISION_SWITCH) {
+        node_t node = find_path_node(tree, arg, decision->switch_.path);
+        if (!node || (node->tag != NODE_LIT && node->tag != NODE_INJ))
+            return MAY_MATCH;
+        decision = find_branch(decision, get_pat_head(node));
+    }
+    if (decision->tag == DECISION_FAIL)
+        return NO_MATCH;
+
+    // Extracts are only built for variables bound to the fields of unknown records
+    mod_t mod = decision->leaf.var_count > 0 ? get_mod(arg) : NULL;
+    for (size_t i = 0, n = decision->leaf.var_count; i < n; ++i) {
+        push_to_node_vec(vars, decision->leaf.vars[i]);
+        push_to_node_vec(vals, build_path_node(mod, tree, arg, decision->leaf.paths[i]));
+    }
+    *case_index = decision->leaf.case_index;
+    return MATCH;
+}
@@ -0,0 +1,31 @@
+#ifndef IR_MATCH_H
+#define IR_MATCH_H
+
+#include "ir/node.h"
+
+/*
+ * Match expressions are compiled into decision trees, using a pattern-matrix
+ * algorithm. Each test of a tree looks at the literal or injection found at some
+ * position in the argument, where positions are reached by following record fields
+ * and injection arguments. The argument is inspected directly, without building
+ * any node. Trees only depend on the patterns, and are cached in the module.
+ */
+
+struct match_cache;
+struct match_tree;
+
+enum match_res {
+    NO_MATCH, MATCH, MAY_MATCH
+};
+
+struct match_cache* new_match_cache(void);
+void free_match_cache(struct match_cache*);
+struct match_cache* get_match_cache(mod_t);
+
+const struct match_tree* get_match_tree(mod_t, const node_t*, size_t);
+
+// Runs a decision tree on the argument of a match expression. If the match succeeds,
+// the index of the case is returned and the pattern variables are bound to their value.
+enum match_res run_match_tree(const struct match_tree*, node_t, size_t*, struct node_vec*, struct node_vec*);
+
+#endif
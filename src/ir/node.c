@@ -1,6 +1,9 @@
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "utils/utils.h"
 #include "utils/arena.h"
@@ -9,7 +12,12 @@
 #include "utils/vec.h"
 #include "utils/buf.h"
 #include "utils/sort.h"
+#include "utils/thread_pool.h"
 #include "ir/node.h"
+#include "ir/prim.h"
+#include "ir/match.h"
+#include "ir/profile.h"
+#include "ir/operands.h"
 
 // Hash consing --------------------------------------------------------------------
 
@@ -19,19 +27,126 @@ static inline bool compare_node(const void*, const void*);
 static inline uint32_t hash_vars(const void*);
 static inline uint32_t hash_label(const void*);
 static inline uint32_t hash_node(const void*);
+static inline bool compare_subst(const void*, const void*);
+static inline uint32_t hash_subst(const void*);
 CUSTOM_MAP(mod_nodes, node_t, node_t, hash_node, compare_node)
 CUSTOM_SET(mod_labels, label_t, hash_label, compare_label)
 CUSTOM_SET(mod_vars, vars_t, hash_vars, compare_vars)
 
-struct mod {
+// Substitutions are interned so that their address can be used as an identifier
+// in the substitution cache. The variables are sorted by address. Interned
+// substitutions live as long as the entries of the cache that refer to them.
+struct subst {
+    const node_t* vars;
+    const node_t* vals;
+    size_t count;
+};
+
+typedef const struct subst* subst_t;
+
+struct replace_key {
+    node_t node;
+    subst_t subst;
+};
+
+CUSTOM_SET(mod_substs, subst_t, hash_subst, compare_subst)
+MAP(replace_cache, struct replace_key, node_t)
+MAP(binder_indices, label_t, size_t)
+
+// Maximum number of entries in the substitution cache before it gets flushed
+#define MAX_REPLACE_CACHE_SIZE 65536
+
+// Size of the buffer used to format canonical binder names
+#define BINDER_NAME_SIZE 32
+
+// Number of shards in thread-safe modules (other modules only have one)
+#define SHARD_COUNT 64
+
+// Nodes, sets of variables, and cached reductions are spread over shards that
+// have their own lock, so that threads interning or reducing different nodes
+// do not contend. Nodes and sets of variables go to the shard given by their
+// hash, and cache entries to the shard given by the address of their key.
+// A shard lock is never held while taking another lock.
+struct mod_shard {
+    pthread_mutex_t lock;
     arena_t arena;
     struct mod_nodes nodes;
-    struct mod_labels labels;
     struct mod_vars vars;
+    struct node_map normal_forms;
+    struct node_map whnfs;
+    size_t reduce_cache_hits;
+    size_t reduce_cache_misses;
+};
+
+struct mod {
+    arena_t arena;
+    arena_t subst_arena;
+    struct mod_shard* shards;
+    size_t shard_count;
+    struct mod_labels labels;
+    struct mod_substs substs;
+    struct replace_cache replace_cache;
+    struct mod_stats stats;
+    struct label_vec binder_labels;
+    struct binder_indices binder_indices;
+    struct match_cache* match_cache;
+    struct thread_pool* pool;
+    struct budget_state* budget_state;
+    struct profile* profile;
+    struct node_set deferred_nodes; // Nodes inserted without being simplified
+    bool defers_simplification;
+    pthread_mutex_t lock;
     node_t uni, star, nat, int_, float_;
     vars_t empty_vars;
+    unsigned flags;
 };
 
+// Helpers -------------------------------------------------------------------------
+
+static inline struct mod_shard* get_shard(mod_t mod, uint32_t hash) {
+    return &mod->shards[hash % mod->shard_count];
+}
+
+static inline struct mod_shard* get_ptr_shard(mod_t mod, const void* ptr) {
+    return get_shard(mod, hash_ptr(hash_init(), ptr));
+}
+
+static inline void lock_shard(mod_t mod, struct mod_shard* shard) {
+    if (mod->flags & MOD_THREAD_SAFE)
+        pthread_mutex_lock(&shard->lock);
+}
+
+static inline void unlock_shard(mod_t mod, struct mod_shard* shard) {
+    if (mod->flags & MOD_THREAD_SAFE)
+        pthread_mutex_unlock(&shard->lock);
+}
+
+static inline void* alloc_from_shard(mod_t mod, struct mod_shard* shard, size_t size) {
+    lock_shard(mod, shard);
+    void* ptr = alloc_from_arena(&shard->arena, size);
+    unlock_shard(mod, shard);
+    return ptr;
+}
+
+static inline node_t* copy_nodes(mod_t mod, struct mod_shard* shard, const node_t* nodes, size_t count) {
+    node_t* new_nodes = alloc_from_shard(mod, shard, sizeof(node_t) * count);
+    memcpy(new_nodes, nodes, sizeof(node_t) * count);
+    return new_nodes;
+}
+
+static inline label_t* copy_labels(mod_t mod, struct mod_shard* shard, const label_t* labels, size_t count) {
+    label_t* new_labels = alloc_from_shard(mod, shard, sizeof(label_t) * count);
+    memcpy(new_labels, labels, sizeof(label_t) * count);
+    return new_labels;
+}
+
+static inline size_t count_nodes(mod_t mod) {
+    size_t count = 0;
+    for (size_t i = 0; i < mod->shard_count; ++i)
+        count += mod->shards[i].nodes.htable.size;
+    return count;
+}
+
 // Free variables ------------------------------------------------------------------
 
 static inline bool compare_vars(const void* ptr1, const void* ptr2) {
@@ -50,30 +165,40 @@ static inline uint32_t hash_vars(const void* ptr) {
 }
 
 static inline vars_t insert_vars(mod_t mod, vars_t vars) {
-    const vars_t* found = find_in_mod_vars(&mod->vars, vars);
-    if (found)
-        return *found;
+    struct mod_shard* shard = get_shard(mod, hash_vars(&vars));
+    lock_shard(mod, shard);
+    const vars_t* found = find_in_mod_vars(&shard->vars, vars);
+    if (found) {
+        vars_t res = *found;
+        unlock_shard(mod, shard);
+        return res;
+    }
 
-    struct vars* new_vars = alloc_from_arena(&mod->arena, sizeof(struct vars));
-    new_vars->vars = alloc_from_arena(&mod->arena, sizeof(node_t) * vars->count);
+    struct vars* new_vars = alloc_from_arena(&shard->arena, sizeof(struct vars));
+    new_vars->vars = alloc_from_arena(&shard->arena, sizeof(node_t) * vars->count);
     new_vars->count = vars->count;
     memcpy((node_t*)new_vars->vars, vars->vars, sizeof(node_t) * vars->count);
     vars_t copy = new_vars;
-    insert_in_mod_vars(&mod->vars, copy);
+    insert_in_mod_vars(&shard->vars, copy);
+    unlock_shard(mod, shard);
     return new_vars;
 }
 
 SORT(sort_vars, node_t)
 
+static inline vars_t new_sorted_vars(mod_t mod, const node_t* vars, size_t count) {
+#ifndef NDEBUG
+    for (size_t i = 1; i < count; ++i)
+        assert(vars[i - 1] < vars[i]);
+#endif
+    return insert_vars(mod, &(struct vars) { .vars = vars, .count = count });
+}
+
 vars_t new_vars(mod_t mod, const node_t* vars, size_t count) {
     node_t* sorted_vars = new_buf(node_t, count);
     memcpy(sorted_vars, vars, sizeof(node_t) * count);
     sort_vars(sorted_vars, count);
-#ifndef NDEBUG
-    for (size_t i = 1; i < count; ++i)
-        assert(sorted_vars[i - 1] < sorted_vars[i]);
-#endif
-    vars_t res = insert_vars(mod, &(struct vars) { .vars = sorted_vars, .count = count });
+    vars_t res = new_sorted_vars(mod, sorted_vars, count);
     free_buf(sorted_vars);
     return res;
 }
@@ -91,7 +216,7 @@ vars_t union_vars(mod_t mod, vars_t vars1, vars_t vars2) {
     }
     while (i < vars1->count) vars[count++] = vars1->vars[i++];
     while (j < vars2->count) vars[count++] = vars2->vars[j++];
-    vars_t res = new_vars(mod, vars, count);
+    vars_t res = new_sorted_vars(mod, vars, count);
     free_buf(vars);
     return res;
 }
@@ -108,11 +233,35 @@ vars_t intr_vars(mod_t mod, vars_t vars1, vars_t vars2) {
         else
             vars[count++] = vars1->vars[i++], j++;
     }
-    vars_t res = new_vars(mod, vars, count);
+    vars_t res = new_sorted_vars(mod, vars, count);
     free_buf(vars);
     return res;
 }
 
+vars_t union_free_vars(mod_t mod, vars_t vars, const node_t* nodes, size_t node_count) {
+    // Gather the free variables of all the nodes at once, instead of interning every
+    // intermediate set, which would be quadratic in the number of nodes.
+    size_t count = vars->count;
+    for (size_t i = 0; i < node_count; ++i)
+        count += nodes[i]->free_vars->count;
+    node_t* all_vars = new_buf(node_t, count);
+    memcpy(all_vars, vars->vars, sizeof(node_t) * vars->count);
+    count = vars->count;
+    for (size_t i = 0; i < node_count; ++i) {
+        memcpy(all_vars + count, nodes[i]->free_vars->vars, sizeof(node_t) * nodes[i]->free_vars->count);
+        count += nodes[i]->free_vars->count;
+    }
+    sort_vars(all_vars, count);
+    size_t unique_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (unique_count == 0 || all_vars[unique_count - 1] != all_vars[i])
+            all_vars[unique_count++] = all_vars[i];
+    }
+    vars_t res = new_sorted_vars(mod, all_vars, unique_count);
+    free_buf(all_vars);
+    return res;
+}
+
 vars_t diff_vars(mod_t mod, vars_t vars1, vars_t vars2) {
     node_t* vars = new_buf(node_t, vars1->count);
     size_t i = 0, j = 0, count = 0;
@@ -125,7 +274,7 @@ vars_t diff_vars(mod_t mod, vars_t vars1, vars_t vars2) {
             i++, j++;
     }
     while (i < vars1->count) vars[count++] = vars1->vars[i++];
-    vars_t res = new_vars(mod, vars, count);
+    vars_t res = new_sorted_vars(mod, vars, count);
     free_buf(vars);
     return res;
 }
@@ -161,6 +310,74 @@ bool contains_var(vars_t vars, node_t var) {
     return false;
 }
 
+// Substitutions -------------------------------------------------------------------
+
+static inline bool compare_subst(const void* ptr1, const void* ptr2) {
+    subst_t subst1 = *(subst_t*)ptr1, subst2 = *(subst_t*)ptr2;
+    return
+        subst1->count == subst2->count &&
+        !memcmp(subst1->vars, subst2->vars, sizeof(node_t) * subst1->count) &&
+        !memcmp(subst1->vals, subst2->vals, sizeof(node_t) * subst1->count);
+}
+
+static inline uint32_t hash_subst(const void* ptr) {
+    subst_t subst = *(subst_t*)ptr;
+    uint32_t h = hash_init();
+    for (size_t i = 0, n = subst->count; i < n; ++i) {
+        h = hash_ptr(h, subst->vars[i]);
+        h = hash_ptr(h, subst->vals[i]);
+    }
+    return h;
+}
+
+static inline subst_t insert_subst(mod_t mod, subst_t subst) {
+    // The module must be locked by the caller
+    const subst_t* found = find_in_mod_substs(&mod->substs, subst);
+    if (found)
+        return *found;
+
+    struct subst* new_subst = alloc_from_arena(&mod->subst_arena, sizeof(struct subst));
+    node_t* vars = alloc_from_arena(&mod->subst_arena, sizeof(node_t) * subst->count);
+    node_t* vals = alloc_from_arena(&mod->subst_arena, sizeof(node_t) * subst->count);
+    memcpy(vars, subst->vars, sizeof(node_t) * subst->count);
+    memcpy(vals, subst->vals, sizeof(node_t) * subst->count);
+    new_subst->vars = vars;
+    new_subst->vals = vals;
+    new_subst->count = subst->count;
+    subst_t copy = new_subst;
+    insert_in_mod_substs(&mod->substs, copy);
+    return new_subst;
+}
+
+static inline void flush_replace_cache(mod_t mod) {
+    // Substitutions are only referenced by the cache, and can go along with it
+    clear_replace_cache(&mod->replace_cache);
+    clear_mod_substs(&mod->substs);
+    reset_arena(&mod->subst_arena);
+}
+
+struct subst_pair {
+    node_t var, val;
+};
+
+static inline bool is_subst_pair_less_than(const struct subst_pair* pair1, const struct subst_pair* pair2) {
+    return pair1->var < pair2->var;
+}
+
+CUSTOM_SORT(sort_subst_pairs, struct subst_pair, is_subst_pair_less_than)
+
+static inline void sort_subst(const node_t* vars, const node_t* vals, size_t count, node_t* sorted_vars, node_t* sorted_vals) {
+    struct subst_pair* pairs = new_buf(struct subst_pair, count);
+    for (size_t i = 0; i < count; ++i)
+        pairs[i] = (struct subst_pair) { vars[i], vals[i] };
+    sort_subst_pairs(pairs, count);
+    for (size_t i = 0; i < count; ++i) {
+        sorted_vars[i] = pairs[i].var;
+        sorted_vals[i] = pairs[i].val;
+    }
+    free_buf(pairs);
+}
+
 // Labels --------------------------------------------------------------------------
 
 static inline bool compare_label(const void* ptr1, const void* ptr2) {
@@ -173,9 +390,13 @@ static inline uint32_t hash_label(const void* ptr) {
 }
 
 static inline label_t insert_label(mod_t mod, label_t label) {
+    lock_mod(mod);
     const label_t* found = find_in_mod_labels(&mod->labels, label);
-    if (found)
-        return *found;
+    if (found) {
+        label_t res = *found;
+        unlock_mod(mod);
+        return res;
+    }
 
     struct label* new_label = alloc_from_arena(&mod->arena, sizeof(struct label));
     size_t len = strlen(label->name);
@@ -188,6 +409,7 @@ static inline label_t insert_label(mod_t mod, label_t label) {
 
     bool ok = insert_in_mod_labels(&mod->labels, new_label);
     assert(ok); (void)ok;
+    unlock_mod(mod);
     return new_label;
 }
 
@@ -198,26 +420,65 @@ label_t new_label(mod_t mod, const char* name, const struct loc* loc) {
     });
 }
 
-size_t find_label(const label_t* labels, size_t label_count, label_t label) {
+struct label_index {
+    label_t label;
+    size_t index;
+};
+
+static inline bool is_label_index_less_than(const struct label_index* left, const struct label_index* right) {
+    return left->label < right->label;
+}
+
+CUSTOM_SORT(sort_label_indices, struct label_index, is_label_index_less_than)
+
+static inline const size_t* new_label_order(mod_t mod, struct mod_shard* shard, const label_t* labels, size_t label_count) {
+    struct label_index* label_indices = new_buf(struct label_index, label_count);
+    for (size_t i = 0; i < label_count; ++i)
+        label_indices[i] = (struct label_index) { labels[i], i };
+    sort_label_indices(label_indices, label_count);
+    size_t* label_order = alloc_from_shard(mod, shard, sizeof(size_t) * label_count);
     for (size_t i = 0; i < label_count; ++i) {
-        if (labels[i] == label)
-            return i;
+        assert((i == 0 || label_indices[i - 1].label != label_indices[i].label) && "duplicate label");
+        label_order[i] = label_indices[i].index;
     }
-    return SIZE_MAX;
+    free_buf(label_indices);
+    return label_order;
 }
 
 size_t find_label_in_node(node_t node, label_t label) {
+    // Labels are searched by address, so that wide records do not need a linear scan
     assert(node->tag == NODE_RECORD || node->tag == NODE_PROD || node->tag == NODE_SUM);
-    return find_label(node->record.labels, node->record.arg_count, label);
+    const size_t* label_order = node->record.label_order;
+    size_t i = 0, j = node->record.arg_count;
+    while (i < j) {
+        size_t m = (i + j) / 2;
+        label_t other = node->record.labels[label_order[m]];
+        if (other < label)
+            i = m + 1;
+        else if (other > label)
+            j = m;
+        else
+            return label_order[m];
+    }
+    return SIZE_MAX;
 }
 
 node_t get_elem_type(node_t val_type, label_t label) {
-    val_type = reduce_node(val_type);
+    val_type = reduce_type(val_type);
     assert(val_type->tag == NODE_SUM || val_type->tag == NODE_PROD);
     size_t index = find_label_in_node(val_type, label);
     return index != SIZE_MAX ? val_type->prod.args[index] : NULL;
 }
 
+bool get_array_dim(node_t array_type, uintmax_t* dim) {
+    assert(array_type->tag == NODE_ARRAY);
+    node_t dim_node = reduce_node(array_type->array.dim);
+    if (dim_node->tag != NODE_LIT)
+        return false;
+    *dim = dim_node->lit.int_val;
+    return true;
+}
+
 // Expressions ---------------------------------------------------------------------
 
 static inline bool compare_node(const void* ptr1, const void* ptr2) {
@@ -256,11 +517,14 @@ static inline bool compare_node(const void* ptr1, const void* ptr2) {
         case NODE_RECORD:
             return
                 node1->record.arg_count == node2->record.arg_count &&
-                !memcmp(node1->record.args, node2->record.args, sizeof(node_t) * node1->record.arg_count);
+                !memcmp(node1->record.args, node2->record.args, sizeof(node_t) * node1->record.arg_count) &&
+                !memcmp(node1->record.labels, node2->record.labels, sizeof(label_t) * node1->record.arg_count);
         case NODE_INS:
-            if (node1->ins.elem != node2->ins.elem)
-                return false;
-            // fallthrough
+            return
+                node1->ins.val == node2->ins.val &&
+                node1->ins.elem_count == node2->ins.elem_count &&
+                !memcmp(node1->ins.elems, node2->ins.elems, sizeof(node_t) * node1->ins.elem_count) &&
+                !memcmp(node1->ins.labels, node2->ins.labels, sizeof(label_t) * node1->ins.elem_count);
         case NODE_EXT:
             return
                 node1->ext.val == node2->ext.val &&
@@ -294,6 +558,35 @@ static inline bool compare_node(const void* ptr1, const void* ptr2) {
                 node1->match.pat_count == node2->match.pat_count &&
                 !memcmp(node1->match.vals, node2->match.vals, sizeof(node_t) * node1->match.pat_count) &&
                 !memcmp(node1->match.pats, node2->match.pats, sizeof(node_t) * node1->match.pat_count);
+        case NODE_PRIM:
+            return
+                node1->prim.op == node2->prim.op &&
+                node1->prim.arg_count == node2->prim.arg_count &&
+                !memcmp(node1->prim.args, node2->prim.args, sizeof(node_t) * node1->prim.arg_count);
+        case NODE_ARRAY:
+            return
+                node1->array.elem == node2->array.elem &&
+                node1->array.dim == node2->array.dim;
+        case NODE_ELEMS:
+            return
+                node1->elems.arg_count == node2->elems.arg_count &&
+                !memcmp(node1->elems.args, node2->elems.args, sizeof(node_t) * node1->elems.arg_count);
+        case NODE_UPDATE:
+            if (node1->update.elem != node2->update.elem)
+                return false;
+            // fallthrough
+        case NODE_INDEX:
+            return
+                node1->index.val == node2->index.val &&
+                node1->index.index == node2->index.index;
+        case NODE_FOLD:
+            if (node1->fold.init != node2->fold.init)
+                return false;
+            // fallthrough
+        case NODE_MAP:
+            return
+                node1->map.fn == node2->map.fn &&
+                node1->map.val == node2->map.val;
         default:
             assert(false && "invalid node tag");
             return false;
@@ -339,12 +632,18 @@ static inline uint32_t hash_node(const void* ptr) {
         case NODE_SUM:
         case NODE_PROD:
         case NODE_RECORD:
-            for (size_t i = 0, n = node->record.arg_count; i < n; ++i)
+            for (size_t i = 0, n = node->record.arg_count; i < n; ++i) {
                 hash = hash_ptr(hash, node->record.args[i]);
+                hash = hash_ptr(hash, node->record.labels[i]);
+            }
             break;
         case NODE_INS:
-            hash = hash_ptr(hash, node->ins.elem);
-            // fallthrough
+            hash = hash_ptr(hash, node->ins.val);
+            for (size_t i = 0, n = node->ins.elem_count; i < n; ++i) {
+                hash = hash_ptr(hash, node->ins.elems[i]);
+                hash = hash_ptr(hash, node->ins.labels[i]);
+            }
+            break;
         case NODE_EXT:
             hash = hash_ptr(hash, node->ext.val);
             hash = hash_ptr(hash, node->ext.label);
@@ -379,42 +678,101 @@ static inline uint32_t hash_node(const void* ptr) {
             }
             hash = hash_ptr(hash, node->match.arg);
             break;
+        case NODE_PRIM:
+            hash = hash_uint(hash, node->prim.op);
+            for (size_t i = 0, n = node->prim.arg_count; i < n; ++i)
+                hash = hash_ptr(hash, node->prim.args[i]);
+            break;
+        case NODE_ARRAY:
+            hash = hash_ptr(hash, node->array.elem);
+            hash = hash_ptr(hash, node->array.dim);
+            break;
+        case NODE_ELEMS:
+            for (size_t i = 0, n = node->elems.arg_count; i < n; ++i)
+                hash = hash_ptr(hash, node->elems.args[i]);
+            break;
+        case NODE_UPDATE:
+            hash = hash_ptr(hash, node->update.elem);
+            // fallthrough
+        case NODE_INDEX:
+            hash = hash_ptr(hash, node->index.val);
+            hash = hash_ptr(hash, node->index.index);
+            break;
+        case NODE_FOLD:
+            hash = hash_ptr(hash, node->fold.init);
+            // fallthrough
+        case NODE_MAP:
+            hash = hash_ptr(hash, node->map.fn);
+            hash = hash_ptr(hash, node->map.val);
+            break;
     }
     return hash;
 }
 
-static inline node_t* copy_nodes(mod_t mod, const node_t* nodes, size_t count) {
-    node_t* new_nodes = alloc_from_arena(&mod->arena, sizeof(node_t) * count);
-    memcpy(new_nodes, nodes, sizeof(node_t) * count);
-    return new_nodes;
+static inline size_t max_depth(node_t node1, node_t node2) {
+    return node1->depth > node2->depth ? node1->depth : node2->depth;
 }
 
-static inline label_t* copy_labels(mod_t mod, const label_t* labels, size_t count) {
-    label_t* new_labels = alloc_from_arena(&mod->arena, sizeof(label_t) * count);
-    memcpy(new_labels, labels, sizeof(label_t) * count);
-    return new_labels;
+static inline size_t max_binder_depth(mod_t mod, size_t depth, const node_t* vars, size_t var_count) {
+    // Canonical binders may have been named above the depth of their scope,
+    // and the depth of the node must account for that.
+    if (!(mod->flags & MOD_CANONICAL_BINDERS))
+        return depth;
+    for (size_t i = 0; i < var_count; ++i) {
+        if (is_unbound_var(vars[i]))
+            continue;
+        lock_mod(mod);
+        const size_t* index = find_in_binder_indices(&mod->binder_indices, vars[i]->var.label);
+        if (index && *index + 1 > depth)
+            depth = *index + 1;
+        unlock_mod(mod);
+    }
+    return depth;
 }
 
-static inline size_t max_depth(node_t node1, node_t node2) {
-    return node1->depth > node2->depth ? node1->depth : node2->depth;
+node_t simplify_node(mod_t, node_t);
+
+static inline bool defers_simplification(mod_t mod, node_t node) {
+    // Types are always simplified, since they are compared by pointer
+    return mod->defers_simplification && !is_type_node(node);
 }
 
-node_t simplify_node(mod_t, node_t);
+static inline node_t simplify_deferred_node(mod_t mod, node_t node) {
+    // Deferred modules are not thread-safe, which means that the module need not be locked
+    if (!remove_from_node_set(&mod->deferred_nodes, node))
+        return node;
+    node_t res = simplify_node(mod, node);
+    *find_in_mod_nodes(&get_shard(mod, hash_node(&node))->nodes, node) = res;
+    if (mod->profile && res != node)
+        record_simplification(mod->profile, node);
+    return res;
+}
 
 static inline node_t insert_node(mod_t mod, node_t node) {
     assert(node->type);
 
-    node_t* found = find_in_mod_nodes(&mod->nodes, node);
-    if (found)
-        return *found;
+    struct mod_shard* shard = get_shard(mod, hash_node(&node));
+    lock_shard(mod, shard);
+    node_t* found = find_in_mod_nodes(&shard->nodes, node);
+    if (found) {
+        node_t res = *found;
+        unlock_shard(mod, shard);
+        // Nodes built while simplification was deferred are simplified when they are needed
+        if ((mod->flags & MOD_DEFER_SIMPLIFY) && !mod->defers_simplification)
+            res = simplify_deferred_node(mod, res);
+        return res;
+    }
 
-    struct node* new_node = alloc_from_arena(&mod->arena, sizeof(struct node));
+    struct node* new_node = alloc_from_arena(&shard->arena, sizeof(struct node));
+    unlock_shard(mod, shard);
     memcpy(new_node, node, sizeof(struct node));
     new_node->free_vars = node->type->free_vars;
     new_node->bound_vars = mod->empty_vars;
+    new_node->normal_type = NULL;
     new_node->depth = 0;
 
-    // Copy the data contained in the original expression and compute properties
+    // Copy the data contained in the original expression and compute properties.
+    // The shard is not locked in the meantime, since sets of variables are interned.
     switch (node->tag) {
         case NODE_SUM:
         case NODE_PROD:
@@ -424,8 +782,9 @@ static inline node_t insert_node(mod_t mod, node_t node) {
                 new_node->free_vars = union_vars(mod, new_node->free_vars, node->record.args[i]->free_vars);
                 new_node->bound_vars = union_vars(mod, new_node->bound_vars, node->record.args[i]->bound_vars);
             }
-            new_node->record.args = copy_nodes(mod, node->record.args, node->record.arg_count);
-            new_node->record.labels = copy_labels(mod, node->record.labels, node->record.arg_count);
+            new_node->record.args = copy_nodes(mod, shard, node->record.args, node->record.arg_count);
+            new_node->record.labels = copy_labels(mod, shard, node->record.labels, node->record.arg_count);
+            new_node->record.label_order = new_label_order(mod, shard, node->record.labels, node->record.arg_count);
             break;
         case NODE_INJ:
             new_node->depth = max_depth(new_node, node->inj.arg);
@@ -433,8 +792,12 @@ static inline node_t insert_node(mod_t mod, node_t node) {
             new_node->bound_vars = node->inj.arg->bound_vars;
             break;
         case NODE_INS:
-            new_node->depth = max_depth(new_node, node->ins.elem);
-            new_node->free_vars = union_vars(mod, new_node->free_vars, node->ins.elem->free_vars);
+            for (size_t i = 0, n = node->ins.elem_count; i < n; ++i) {
+                new_node->depth = max_depth(new_node, node->ins.elems[i]);
+                new_node->free_vars = union_vars(mod, new_node->free_vars, node->ins.elems[i]->free_vars);
+            }
+            new_node->ins.elems = copy_nodes(mod, shard, node->ins.elems, node->ins.elem_count);
+            new_node->ins.labels = copy_labels(mod, shard, node->ins.labels, node->ins.elem_count);
             // fallthrough
         case NODE_EXT:
             new_node->depth = max_depth(new_node, node->ext.val);
@@ -446,9 +809,11 @@ static inline node_t insert_node(mod_t mod, node_t node) {
             if (!is_unbound_var(new_node->arrow.var))
                 new_node->free_vars = diff_vars(mod, new_node->free_vars, new_vars(mod, &node->arrow.var, 1));
             new_node->depth++;
+            new_node->depth = max_binder_depth(mod, new_node->depth, &node->arrow.var, 1);
             break;
         case NODE_ABS:
             new_node->depth = max_depth(new_node, node->abs.body) + 1;
+            new_node->depth = max_binder_depth(mod, new_node->depth, &node->abs.var, 1);
             new_node->free_vars = union_vars(mod, new_node->free_vars, node->abs.body->free_vars);
             if (!is_unbound_var(new_node->abs.var))
                 new_node->free_vars = diff_vars(mod, new_node->free_vars, new_vars(mod, &node->abs.var, 1));
@@ -466,16 +831,17 @@ static inline node_t insert_node(mod_t mod, node_t node) {
             for (size_t i = 0, n = node->let.var_count; i < n; ++i) {
                 assert(!is_unbound_var(node->let.vars[i]));
                 new_node->depth = max_depth(new_node, node->let.vals[i]);
-                new_node->free_vars = union_vars(mod, new_node->free_vars, node->let.vals[i]->free_vars);
             }
+            new_node->free_vars = union_free_vars(mod, new_node->free_vars, node->let.vals, node->let.var_count);
             new_node->free_vars = diff_vars(mod, new_node->free_vars, new_vars(mod, node->let.vars, node->let.var_count));
-            new_node->let.vars = copy_nodes(mod, node->let.vars, node->let.var_count);
-            new_node->let.vals = copy_nodes(mod, node->let.vals, node->let.var_count);
+            new_node->let.vars = copy_nodes(mod, shard, node->let.vars, node->let.var_count);
+            new_node->let.vals = copy_nodes(mod, shard, node->let.vals, node->let.var_count);
             new_node->depth += node->let.var_count;
+            new_node->depth = max_binder_depth(mod, new_node->depth, node->let.vars, node->let.var_count);
             break;
         case NODE_MATCH:
-            new_node->match.vals = copy_nodes(mod, node->match.vals, node->match.pat_count);
-            new_node->match.pats = copy_nodes(mod, node->match.pats, node->match.pat_count);
+            new_node->match.vals = copy_nodes(mod, shard, node->match.vals, node->match.pat_count);
+            new_node->match.pats = copy_nodes(mod, shard, node->match.pats, node->match.pat_count);
             for (size_t i = 0, n = node->match.pat_count; i < n; ++i) {
                 new_node->depth = max_depth(new_node, node->match.vals[i]);
                 new_node->free_vars = union_vars(mod, new_node->free_vars,
@@ -484,6 +850,45 @@ static inline node_t insert_node(mod_t mod, node_t node) {
             new_node->free_vars = union_vars(mod, new_node->free_vars, node->match.arg->free_vars);
             new_node->depth += node->match.pat_count;
             break;
+        case NODE_PRIM:
+            for (size_t i = 0, n = node->prim.arg_count; i < n; ++i) {
+                new_node->depth = max_depth(new_node, node->prim.args[i]);
+                new_node->free_vars = union_vars(mod, new_node->free_vars, node->prim.args[i]->free_vars);
+            }
+            new_node->prim.args = copy_nodes(mod, shard, node->prim.args, node->prim.arg_count);
+            break;
+        case NODE_ARRAY:
+            new_node->depth = max_depth(node->array.elem, node->array.dim);
+            new_node->free_vars = union_vars(mod, new_node->free_vars, node->array.elem->free_vars);
+            new_node->free_vars = union_vars(mod, new_node->free_vars, node->array.dim->free_vars);
+            break;
+        case NODE_ELEMS:
+            for (size_t i = 0, n = node->elems.arg_count; i < n; ++i) {
+                new_node->depth = max_depth(new_node, node->elems.args[i]);
+                new_node->free_vars = union_vars(mod, new_node->free_vars, node->elems.args[i]->free_vars);
+            }
+            new_node->elems.args = copy_nodes(mod, shard, node->elems.args, node->elems.arg_count);
+            break;
+        case NODE_UPDATE:
+            new_node->depth = max_depth(new_node, node->update.elem);
+            new_node->free_vars = union_vars(mod, new_node->free_vars, node->update.elem->free_vars);
+            // fallthrough
+        case NODE_INDEX:
+            new_node->depth = max_depth(new_node, node->index.val);
+            new_node->depth = max_depth(new_node, node->index.index);
+            new_node->free_vars = union_vars(mod, new_node->free_vars, node->index.val->free_vars);
+            new_node->free_vars = union_vars(mod, new_node->free_vars, node->index.index->free_vars);
+            break;
+        case NODE_FOLD:
+            new_node->depth = max_depth(new_node, node->fold.init);
+            new_node->free_vars = union_vars(mod, new_node->free_vars, node->fold.init->free_vars);
+            // fallthrough
+        case NODE_MAP:
+            new_node->depth = max_depth(new_node, node->map.fn);
+            new_node->depth = max_depth(new_node, node->map.val);
+            new_node->free_vars = union_vars(mod, new_node->free_vars, node->map.fn->free_vars);
+            new_node->free_vars = union_vars(mod, new_node->free_vars, node->map.val->free_vars);
+            break;
         case NODE_VAR:
             if (!is_unbound_var(node)) {
                 new_node->bound_vars = new_vars(mod, (const node_t*)&new_node, 1);
@@ -505,22 +910,108 @@ static inline node_t insert_node(mod_t mod, node_t node) {
             break;
     }
 
-    assert(!find_in_mod_nodes(&mod->nodes, node));
-    node_t res = simplify_node(mod, new_node);
-    assert(!find_in_mod_nodes(&mod->nodes, node));
-    bool ok = insert_in_mod_nodes(&mod->nodes, new_node, res);
-    assert(ok); (void)ok;
+    // The shard is not locked during simplification, since it creates other nodes.
+    // In the meantime, another thread may insert the same node: Its result is kept.
+    bool is_deferred = defers_simplification(mod, new_node);
+    node_t res = is_deferred ? new_node : simplify_node(mod, new_node);
+    lock_shard(mod, shard);
+    bool is_new = false;
+    if ((found = find_in_mod_nodes(&shard->nodes, node))) {
+        assert(mod->flags & MOD_THREAD_SAFE);
+        res = *found;
+    } else {
+        bool ok = insert_in_mod_nodes(&shard->nodes, new_node, res);
+        assert(ok); (void)ok;
+        if (is_deferred)
+            insert_in_node_set(&mod->deferred_nodes, new_node);
+        is_new = true;
+    }
+    unlock_shard(mod, shard);
+    if (is_new && mod->profile) {
+        lock_mod(mod);
+        record_profile_event(mod->profile, PROFILE_NODE);
+        if (res != new_node)
+            record_simplification(mod->profile, new_node);
+        unlock_mod(mod);
+    }
     return res;
 }
 
 // Module --------------------------------------------------------------------------
 
+static inline void init_mod_lock(mod_t mod) {
+    // The lock is recursive, since binder labels are interned while it is held
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mod->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static inline void init_shards(mod_t mod) {
+    mod->shard_count = mod->flags & MOD_THREAD_SAFE ? SHARD_COUNT : 1;
+    mod->shards = xmalloc(sizeof(struct mod_shard) * mod->shard_count);
+    for (size_t i = 0; i < mod->shard_count; ++i) {
+        struct mod_shard* shard = &mod->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->arena = new_arena();
+        shard->nodes = new_mod_nodes();
+        shard->vars = new_mod_vars();
+        shard->normal_forms = new_node_map();
+        shard->whnfs = new_node_map();
+        shard->reduce_cache_hits = 0;
+        shard->reduce_cache_misses = 0;
+    }
+}
+
+static inline void free_shards(mod_t mod) {
+    for (size_t i = 0; i < mod->shard_count; ++i) {
+        struct mod_shard* shard = &mod->shards[i];
+        free_mod_nodes(&shard->nodes);
+        free_mod_vars(&shard->vars);
+        free_node_map(&shard->normal_forms);
+        free_node_map(&shard->whnfs);
+        free_arena(shard->arena);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(mod->shards);
+}
+
+void lock_mod(mod_t mod) {
+    if (mod->flags & MOD_THREAD_SAFE)
+        pthread_mutex_lock(&mod->lock);
+}
+
+void unlock_mod(mod_t mod) {
+    if (mod->flags & MOD_THREAD_SAFE)
+        pthread_mutex_unlock(&mod->lock);
+}
+
 mod_t new_mod() {
+    return new_mod_with_flags(0);
+}
+
+mod_t new_mod_with_flags(unsigned flags) {
+    assert(!((flags & MOD_DEFER_SIMPLIFY) && (flags & MOD_THREAD_SAFE)) &&
+        "deferred simplification is not supported by thread-safe modules");
     mod_t mod = xmalloc(sizeof(struct mod));
+    mod->flags = flags;
     mod->arena = new_arena();
-    mod->nodes = new_mod_nodes();
+    mod->subst_arena = new_arena();
     mod->labels = new_mod_labels();
-    mod->vars = new_mod_vars();
+    mod->substs = new_mod_substs();
+    mod->replace_cache = new_replace_cache();
+    mod->stats = (struct mod_stats) { 0 };
+    mod->binder_labels = new_label_vec();
+    mod->binder_indices = new_binder_indices();
+    mod->match_cache = NULL;
+    mod->pool = NULL;
+    mod->budget_state = NULL;
+    mod->profile = NULL;
+    mod->deferred_nodes = new_node_set();
+    mod->defers_simplification = false;
+    init_mod_lock(mod);
+    init_shards(mod);
     mod->empty_vars = new_vars(mod, NULL, 0);
 
     mod->uni  = insert_node(mod, &(struct node) { .tag = NODE_UNI,  .uni.mod = mod, .type = new_untyped_err(mod, NULL) });
@@ -529,13 +1020,22 @@ mod_t new_mod() {
     node_t int_or_float_type = new_arrow(mod, new_unbound_var(mod, mod->nat, NULL), mod->star, NULL);
     mod->int_   = insert_node(mod, &(struct node) { .tag = NODE_INT,   .type = int_or_float_type });
     mod->float_ = insert_node(mod, &(struct node) { .tag = NODE_FLOAT, .type = int_or_float_type });
+    mod->defers_simplification = flags & MOD_DEFER_SIMPLIFY;
     return mod;
 }
 
 void free_mod(mod_t mod) {
-    free_mod_nodes(&mod->nodes);
+    free_shards(mod);
     free_mod_labels(&mod->labels);
-    free_mod_vars(&mod->vars);
+    free_mod_substs(&mod->substs);
+    free_replace_cache(&mod->replace_cache);
+    free_label_vec(&mod->binder_labels);
+    free_binder_indices(&mod->binder_indices);
+    free_node_set(&mod->deferred_nodes);
+    if (mod->match_cache)
+        free_match_cache(mod->match_cache);
+    pthread_mutex_destroy(&mod->lock);
+    free_arena(mod->subst_arena);
     free_arena(mod->arena);
     free(mod);
 }
@@ -546,6 +1046,33 @@ mod_t get_mod(node_t node) {
     return node->uni.mod;
 }
 
+const struct mod_stats* get_mod_stats(mod_t mod) {
+    mod->stats.node_count = 0;
+    mod->stats.reduce_cache_hits = 0;
+    mod->stats.reduce_cache_misses = 0;
+    for (size_t i = 0; i < mod->shard_count; ++i) {
+        mod->stats.node_count += mod->shards[i].nodes.htable.size;
+        mod->stats.reduce_cache_hits += mod->shards[i].reduce_cache_hits;
+        mod->stats.reduce_cache_misses += mod->shards[i].reduce_cache_misses;
+    }
+    return &mod->stats;
+}
+
+struct profile* get_mod_profile(mod_t mod) {
+    return mod->profile;
+}
+
+void set_mod_profile(mod_t mod, struct profile* profile) {
+    mod->profile = profile;
+}
+
+struct match_cache* get_match_cache(mod_t mod) {
+    // The cache is created on first use, as most modules have no match expression
+    if (!mod->match_cache)
+        mod->match_cache = new_match_cache();
+    return mod->match_cache;
+}
+
 // Patterns ------------------------------------------------------------------------
 
 bool is_pat(node_t node) {
@@ -588,6 +1115,181 @@ bool is_unbound_var(node_t var) {
     return var->var.label == NULL;
 }
 
+// Binders -------------------------------------------------------------------------
+
+static inline label_t get_binder_label(mod_t mod, size_t index) {
+    lock_mod(mod);
+    while (mod->binder_labels.size <= index) {
+        char name[BINDER_NAME_SIZE];
+        snprintf(name, sizeof(name), "_%zu", mod->binder_labels.size);
+        label_t label = new_label(mod, name, NULL);
+        insert_in_binder_indices(&mod->binder_indices, label, mod->binder_labels.size);
+        push_to_label_vec(&mod->binder_labels, label);
+    }
+    label_t label = mod->binder_labels.elems[index];
+    unlock_mod(mod);
+    return label;
+}
+
+SORT(sort_binder_indices, size_t)
+
+static inline size_t find_binder_index(mod_t mod, vars_t outer_vars, size_t depth, size_t count) {
+    // Binders are numbered from the depth of their scope, which is above any binder inside it.
+    // After a substitution, free variables may have an index in that range: Those are skipped,
+    // so that they are not captured.
+    size_t* used_indices = new_buf(size_t, outer_vars->count);
+    size_t used_count = 0;
+    lock_mod(mod);
+    for (size_t i = 0, n = outer_vars->count; i < n; ++i) {
+        if (is_unbound_var(outer_vars->vars[i]))
+            continue;
+        const size_t* index = find_in_binder_indices(&mod->binder_indices, outer_vars->vars[i]->var.label);
+        if (index && *index >= depth)
+            used_indices[used_count++] = *index;
+    }
+    unlock_mod(mod);
+    sort_binder_indices(used_indices, used_count);
+    size_t index = depth;
+    for (size_t i = 0; i < used_count && used_indices[i] < index + count; ++i) {
+        if (used_indices[i] >= index)
+            index = used_indices[i] + 1;
+    }
+    free_buf(used_indices);
+    return index;
+}
+
+static inline node_t new_binder_var(mod_t mod, node_t var, size_t index) {
+    return new_var(mod, var->type, get_binder_label(mod, index), &var->loc);
+}
+
+static inline void canonicalize_binder(mod_t mod, node_t* var, node_t* scope) {
+    if (!(mod->flags & MOD_CANONICAL_BINDERS) || is_unbound_var(*var))
+        return;
+    vars_t outer_vars = diff_vars(mod,
+        union_vars(mod, (*var)->free_vars, (*scope)->free_vars),
+        new_vars(mod, var, 1));
+    node_t binder_var = new_binder_var(mod, *var, find_binder_index(mod, outer_vars, (*scope)->depth, 1));
+    if (binder_var != *var) {
+        *scope = replace_var(*scope, *var, binder_var);
+        *var = binder_var;
+    }
+}
+
+// Budget --------------------------------------------------------------------------
+
+#define BUDGET_ERRORS(f) \
+    f(OUT_OF_FUEL,   "maximum number of reduction steps reached") \
+    f(OUT_OF_MEMORY, "maximum number of nodes reached") \
+    f(TIMEOUT,       "time limit exceeded") \
+    f(CYCLE,         "reduction does not terminate: a previous term was reached again") \
+    f(TOO_DEEP,      "maximum depth of nested reductions reached")
+
+// Clock is only read once in this many steps
+#define BUDGET_CLOCK_PERIOD 256
+// Reductions nested deeper than this are stopped before they overflow the stack
+#define BUDGET_MAX_DEPTH 2048
+
+enum budget_status {
+    BUDGET_OK,
+#define f(name, msg) BUDGET_##name,
+    BUDGET_ERRORS(f)
+#undef f
+};
+
+struct budget_state {
+    const struct budget* budget;
+    struct node_set active_nodes; // Nodes that are being reduced
+    struct node_set active_whnfs; // Nodes that are being reduced to weak head normal form
+    size_t steps;
+    size_t depth;                 // Nested calls to `reduce_node` and `reduce_to_whnf`
+    size_t max_node_count;
+    struct timespec deadline;
+    enum budget_status status;
+};
+
+// Loops that reduce a term are checked for cycles with Brent's algorithm: Terms are
+// hash-consed, so a repeated state is a term that is pointer-equal to the saved one.
+struct cycle_detector {
+    node_t saved;
+    size_t power;
+    size_t length;
+};
+
+#define NEW_CYCLE_DETECTOR ((struct cycle_detector) { .saved = NULL, .power = 1, .length = 0 })
+
+static inline bool is_cycle(struct cycle_detector* detector, node_t node) {
+    if (node == detector->saved)
+        return true;
+    if (detector->length == detector->power) {
+        detector->saved = node;
+        detector->power *= 2;
+        detector->length = 0;
+    }
+    detector->length++;
+    return false;
+}
+
+static inline bool is_past_deadline(const struct timespec* deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static inline bool is_budget_exhausted(mod_t mod) {
+    return mod->budget_state && mod->budget_state->status != BUDGET_OK;
+}
+
+static inline bool consume_step(mod_t mod, struct cycle_detector* detector, node_t node) {
+    // Returns false once the budget of the current reduction is exhausted, if any.
+    // Without a budget, there is no limit and cycles are not reported.
+    struct budget_state* state = mod->budget_state;
+    if (!state)
+        return true;
+    lock_mod(mod);
+    if (state->status == BUDGET_OK) {
+        const struct budget* budget = state->budget;
+        state->steps++;
+        if (detector && is_cycle(detector, node))
+            state->status = BUDGET_CYCLE;
+        else if (budget->max_steps && state->steps > budget->max_steps)
+            state->status = BUDGET_OUT_OF_FUEL;
+        else if (state->max_node_count && count_nodes(mod) >= state->max_node_count)
+            state->status = BUDGET_OUT_OF_MEMORY;
+        else if (budget->max_seconds > 0 && state->steps % BUDGET_CLOCK_PERIOD == 0 && is_past_deadline(&state->deadline))
+            state->status = BUDGET_TIMEOUT;
+    }
+    bool ok = state->status == BUDGET_OK;
+    unlock_mod(mod);
+    return ok;
+}
+
+static inline bool enter_reduction(mod_t mod, node_t node, bool is_whnf) {
+    // Reductions are deterministic, so a node that is reduced again while it is
+    // being reduced (to the same form) leads to an infinite recursion. Reductions
+    // are recursive, so their depth is bounded as well.
+    struct budget_state* state = mod->budget_state;
+    if (!state)
+        return true;
+    struct node_set* active_nodes = is_whnf ? &state->active_whnfs : &state->active_nodes;
+    if (state->status != BUDGET_OK)
+        return false;
+    if (state->depth >= BUDGET_MAX_DEPTH)
+        state->status = BUDGET_TOO_DEEP;
+    else if (!insert_in_node_set(active_nodes, node))
+        state->status = BUDGET_CYCLE;
+    else
+        state->depth++;
+    return state->status == BUDGET_OK;
+}
+
+static inline void leave_reduction(mod_t mod, node_t node, bool is_whnf) {
+    struct budget_state* state = mod->budget_state;
+    if (!state)
+        return;
+    remove_from_node_set(is_whnf ? &state->active_whnfs : &state->active_nodes, node);
+    state->depth--;
+}
+
 // Constructors --------------------------------------------------------------------
 
 node_t new_err(mod_t mod, node_t type, const struct loc* loc) {
@@ -599,12 +1301,16 @@ node_t new_err(mod_t mod, node_t type, const struct loc* loc) {
 }
 
 node_t new_untyped_err(mod_t mod, const struct loc* loc) {
+    lock_mod(mod);
     struct node* err = alloc_from_arena(&mod->arena, sizeof(struct node));
+    unlock_mod(mod);
     err->tag = NODE_ERR;
     err->type = err;
     err->loc = loc ? *loc : (struct loc) { .file = NULL };
     err->depth = 0;
     err->free_vars = mod->empty_vars;
+    err->bound_vars = mod->empty_vars;
+    err->normal_type = NULL;
     return err;
 }
 
@@ -683,6 +1389,7 @@ node_t new_prod(mod_t mod, const node_t* args, const label_t* labels, size_t arg
 }
 
 node_t new_arrow(mod_t mod, node_t var, node_t codom, const struct loc* loc) {
+    canonicalize_binder(mod, &var, &codom);
     return insert_node(mod, &(struct node) {
         .tag = NODE_ARROW,
         .type = codom->type,
@@ -724,11 +1431,31 @@ node_t new_record(mod_t mod, const node_t* args, const label_t* labels, size_t a
     });
 }
 
-node_t new_ins(mod_t mod, node_t val, label_t label, node_t elem, const struct loc* loc) {
+#ifndef NDEBUG
+SORT(sort_labels, label_t)
+
+static inline bool has_duplicate_labels(const label_t* labels, size_t label_count) {
+    label_t* sorted_labels = new_buf(label_t, label_count);
+    memcpy(sorted_labels, labels, sizeof(label_t) * label_count);
+    sort_labels(sorted_labels, label_count);
+    bool has_duplicates = false;
+    for (size_t i = 1; i < label_count && !has_duplicates; ++i)
+        has_duplicates = sorted_labels[i - 1] == sorted_labels[i];
+    free_buf(sorted_labels);
+    return has_duplicates;
+}
+#endif
+
+node_t new_ins(mod_t mod, node_t val, const node_t* elems, const label_t* labels, size_t elem_count, const struct loc* loc) {
 #ifndef NDEBUG
     assert(val->type);
-    node_t elem_type = get_elem_type(val->type, label);
-    assert(elem_type == reduce_node(elem->type) && "element type does not match deduced element type");
+    assert(elem_count > 0);
+    assert((elem_count == 1 || reduce_type(val->type)->tag == NODE_PROD) && "sums can only be given one element");
+    for (size_t i = 0; i < elem_count; ++i) {
+        node_t elem_type = get_elem_type(val->type, labels[i]);
+        assert(elem_type == reduce_type(elems[i]->type) && "element type does not match deduced element type");
+    }
+    assert(!has_duplicate_labels(labels, elem_count) && "duplicate label");
 #endif
     return insert_node(mod, &(struct node) {
         .tag = NODE_INS,
@@ -736,8 +1463,9 @@ node_t new_ins(mod_t mod, node_t val, label_t label, node_t elem, const struct l
         .loc = loc ? *loc : (struct loc) { .file = NULL },
         .ins = {
             .val = val,
-            .label = label,
-            .elem = elem
+            .elems = elems,
+            .labels = labels,
+            .elem_count = elem_count
         }
     });
 }
@@ -761,6 +1489,7 @@ static inline node_t infer_abs_type(node_t var, node_t body) {
 }
 
 node_t new_abs(mod_t mod, node_t var, node_t body, const struct loc* loc) {
+    canonicalize_binder(mod, &var, &body);
     return insert_node(mod, &(struct node) {
         .tag = NODE_ABS,
         .type = infer_abs_type(var, body),
@@ -773,17 +1502,17 @@ node_t new_abs(mod_t mod, node_t var, node_t body, const struct loc* loc) {
 }
 
 node_t new_app(mod_t mod, node_t left, node_t right, const struct loc* loc) {
-    node_t callee_type = reduce_node(left->type);
+    node_t callee_type = reduce_type(left->type);
 #ifndef NDEBUG
     assert(callee_type->tag == NODE_ARROW && "invalid callee type");
-    node_t arg_type = reduce_node(right->type);
+    node_t arg_type = reduce_type(right->type);
     assert(callee_type->arrow.var->type == arg_type && "parameter type does not match argument type");
 #endif
     return insert_node(mod, &(struct node) {
         .tag = NODE_APP,
-        .type = left->type->arrow.var
+        .type = callee_type->arrow.var
             ? replace_var(callee_type->arrow.codom, callee_type->arrow.var, right)
-            : left->type->arrow.codom,
+            : callee_type->arrow.codom,
         .loc = loc ? *loc : (struct loc) { .file = NULL },
         .app = {
             .left = left,
@@ -792,28 +1521,29 @@ node_t new_app(mod_t mod, node_t left, node_t right, const struct loc* loc) {
     });
 }
 
-static inline node_t infer_let_type(const node_t* vars, const node_t* vals, size_t var_count, node_t body_type) {
-    // Replace bound variables in the expression and reduce it
-    // until a fix point is reached. This may loop forever if
-    // the expression does not terminate.
-    bool todo;
+static inline node_t infer_let_type(bool is_rec, const node_t* vars, const node_t* vals, size_t var_count, node_t body_type) {
+    // Replace bound variables in the expression and reduce it. Non-recursive
+    // values cannot refer to the bound variables, so one step is enough. Otherwise,
+    // this is repeated until a fix point is reached, which may loop forever if the
+    // expression does not terminate, unless the current reduction has a budget.
+    mod_t mod = get_mod(body_type);
+    struct cycle_detector detector = NEW_CYCLE_DETECTOR;
+    node_t old_type;
     do {
-        node_t old_type = body_type;
-        body_type = replace_vars(body_type, vars, vals, var_count);
-        body_type = reduce_node(body_type);
-        todo = old_type != body_type;
-    } while (todo);
+        old_type = body_type;
+        body_type = reduce_type(replace_vars(body_type, vars, vals, var_count));
+    } while (is_rec && old_type != body_type && consume_step(mod, &detector, body_type));
     return body_type;
 }
 
-static inline node_t new_let_or_letrec(mod_t mod, bool is_rec, const node_t* vars, const node_t* vals, size_t var_count, node_t body, const struct loc* loc) {
+static inline node_t insert_let_or_letrec(mod_t mod, bool is_rec, const node_t* vars, const node_t* vals, size_t var_count, node_t body, const struct loc* loc) {
 #ifndef NDEBUG
     for (size_t i = 0; i < var_count; ++i)
         assert(vars[i]->type == vals[i]->type && "variable type must match value type");
 #endif
     return insert_node(mod, &(struct node) {
         .tag = is_rec ? NODE_LETREC : NODE_LET,
-        .type = infer_let_type(vars, vals, var_count, body->type),
+        .type = infer_let_type(is_rec, vars, vals, var_count, body->type),
         .loc = loc ? *loc : (struct loc) { .file = NULL },
         .let = {
             .vars = vars,
@@ -824,6 +1554,34 @@ static inline node_t new_let_or_letrec(mod_t mod, bool is_rec, const node_t* var
     });
 }
 
+static inline node_t new_let_or_letrec(mod_t mod, bool is_rec, const node_t* vars, const node_t* vals, size_t var_count, node_t body, const struct loc* loc) {
+    if (!(mod->flags & MOD_CANONICAL_BINDERS))
+        return insert_let_or_letrec(mod, is_rec, vars, vals, var_count, body, loc);
+
+    // Variables are numbered consecutively, starting from the depth of the whole expression
+    vars_t outer_vars = body->free_vars;
+    size_t depth = body->depth;
+    for (size_t i = 0; i < var_count; ++i) {
+        outer_vars = union_vars(mod, outer_vars, union_vars(mod, vars[i]->free_vars, vals[i]->free_vars));
+        if (vals[i]->depth > depth)
+            depth = vals[i]->depth;
+    }
+    outer_vars = diff_vars(mod, outer_vars, new_vars(mod, vars, var_count));
+    size_t index = find_binder_index(mod, outer_vars, depth, var_count);
+
+    node_t* binder_vars = new_buf(node_t, var_count);
+    node_t* binder_vals = new_buf(node_t, var_count);
+    for (size_t i = 0; i < var_count; ++i)
+        binder_vars[i] = new_binder_var(mod, vars[i], index + i);
+    for (size_t i = 0; i < var_count; ++i)
+        binder_vals[i] = is_rec ? replace_vars(vals[i], vars, binder_vars, var_count) : vals[i];
+    body = replace_vars(body, vars, binder_vars, var_count);
+    node_t res = insert_let_or_letrec(mod, is_rec, binder_vars, binder_vals, var_count, body, loc);
+    free_buf(binder_vars);
+    free_buf(binder_vals);
+    return res;
+}
+
 node_t new_let(mod_t mod, const node_t* vars, const node_t* vals, size_t var_count, node_t body, const struct loc* loc) {
     return new_let_or_letrec(mod, false, vars, vals, var_count, body, loc);
 }
@@ -853,6 +1611,203 @@ node_t new_match(mod_t mod, const node_t* pats, const node_t* vals, size_t pat_c
     });
 }
 
+node_t new_prim(mod_t mod, enum prim_op op, node_t type, const node_t* args, size_t arg_count, const struct loc* loc) {
+#ifndef NDEBUG
+    assert(arg_count == get_prim_arity(op) && "invalid number of operands for primitive");
+    struct num_type arg_type, res_type;
+    assert(get_num_type(reduce_type(args[0]->type), &arg_type) && "primitive operands must be numbers");
+    assert(get_num_type(reduce_type(type), &res_type) && "primitive results must be numbers");
+    assert(is_valid_prim(op, arg_type) && "invalid operand type for primitive");
+    for (size_t i = 1; i < arg_count; ++i)
+        assert(args[i]->type == args[0]->type && "primitive operands must have the same type");
+#endif
+    return insert_node(mod, &(struct node) {
+        .tag = NODE_PRIM,
+        .type = type,
+        .loc = loc ? *loc : (struct loc) { .file = NULL },
+        .prim = {
+            .op = op,
+            .args = args,
+            .arg_count = arg_count
+        }
+    });
+}
+
+node_t new_array(mod_t mod, node_t elem, node_t dim, const struct loc* loc) {
+    assert(elem->type->tag == NODE_STAR && "array elements must be typed");
+    assert(reduce_type(dim->type)->tag == NODE_NAT && "array dimensions must be natural numbers");
+    return insert_node(mod, &(struct node) {
+        .tag = NODE_ARRAY,
+        .type = new_star(mod),
+        .loc = loc ? *loc : (struct loc) { .file = NULL },
+        .array = {
+            .elem = elem,
+            .dim = dim
+        }
+    });
+}
+
+node_t new_elems(mod_t mod, node_t elem_type, const node_t* args, size_t arg_count, const struct loc* loc) {
+#ifndef NDEBUG
+    for (size_t i = 0; i < arg_count; ++i)
+        assert(reduce_type(args[i]->type) == reduce_type(elem_type) && "array element type does not match");
+#endif
+    node_t dim = new_lit(mod, new_nat(mod), &(struct lit) { .tag = LIT_INT, .int_val = arg_count }, loc);
+    return insert_node(mod, &(struct node) {
+        .tag = NODE_ELEMS,
+        .type = new_array(mod, elem_type, dim, loc),
+        .loc = loc ? *loc : (struct loc) { .file = NULL },
+        .elems = {
+            .args = args,
+            .arg_count = arg_count
+        }
+    });
+}
+
+static inline node_t get_array_type(node_t val) {
+    node_t type = reduce_type(val->type);
+    assert(type->tag == NODE_ARRAY && "expected an array");
+    return type;
+}
+
+node_t new_index(mod_t mod, node_t val, node_t index, const struct loc* loc) {
+    assert(reduce_type(index->type)->tag == NODE_NAT && "array indices must be natural numbers");
+    return insert_node(mod, &(struct node) {
+        .tag = NODE_INDEX,
+        .type = get_array_type(val)->array.elem,
+        .loc = loc ? *loc : (struct loc) { .file = NULL },
+        .index = {
+            .val = val,
+            .index = index
+        }
+    });
+}
+
+node_t new_update(mod_t mod, node_t val, node_t index, node_t elem, const struct loc* loc) {
+    assert(reduce_type(index->type)->tag == NODE_NAT && "array indices must be natural numbers");
+    assert(reduce_type(get_array_type(val)->array.elem) == reduce_type(elem->type) && "array element type does not match");
+    return insert_node(mod, &(struct node) {
+        .tag = NODE_UPDATE,
+        .type = val->type,
+        .loc = loc ? *loc : (struct loc) { .file = NULL },
+        .update = {
+            .val = val,
+            .index = index,
+            .elem = elem
+        }
+    });
+}
+
+static inline node_t get_fn_codom(node_t fn, node_t arg_type) {
+    node_t fn_type = reduce_type(fn->type);
+    assert(fn_type->tag == NODE_ARROW && "expected a function");
+    assert(is_unbound_var(fn_type->arrow.var) && "functions used in bulk operations cannot be dependent");
+    assert(reduce_type(fn_type->arrow.var->type) == reduce_type(arg_type) && "parameter type does not match argument type");
+    (void)arg_type;
+    return fn_type->arrow.codom;
+}
+
+node_t new_map(mod_t mod, node_t fn, node_t val, const struct loc* loc) {
+    node_t array_type = get_array_type(val);
+    node_t elem_type = get_fn_codom(fn, array_type->array.elem);
+    return insert_node(mod, &(struct node) {
+        .tag = NODE_MAP,
+        .type = new_array(mod, elem_type, array_type->array.dim, loc),
+        .loc = loc ? *loc : (struct loc) { .file = NULL },
+        .map = {
+            .fn = fn,
+            .val = val
+        }
+    });
+}
+
+node_t new_fold(mod_t mod, node_t fn, node_t init, node_t val, const struct loc* loc) {
+#ifndef NDEBUG
+    // The function takes the accumulator first, and then the element
+    node_t step_type = reduce_type(get_fn_codom(fn, init->type));
+    assert(step_type->tag == NODE_ARROW);
+    assert(reduce_type(step_type->arrow.var->type) == reduce_type(get_array_type(val)->array.elem));
+    assert(reduce_type(step_type->arrow.codom) == reduce_type(init->type));
+#endif
+    return insert_node(mod, &(struct node) {
+        .tag = NODE_FOLD,
+        .type = init->type,
+        .loc = loc ? *loc : (struct loc) { .file = NULL },
+        .fold = {
+            .fn = fn,
+            .val = val,
+            .init = init
+        }
+    });
+}
+
+// Deferred simplification --------------------------------------------------------
+
+void defer_simplification(mod_t mod) {
+    assert(mod->flags & MOD_DEFER_SIMPLIFY);
+    mod->defers_simplification = true;
+}
+
+node_t simplify_module(node_t root) {
+    // Operands are simplified before the nodes that use them, with an explicit stack
+    // since programs can be deep. Rebuilding a node that has already been inserted
+    // simplifies it, and new nodes are simplified as they are inserted.
+    mod_t mod = get_mod(root);
+    mod->defers_simplification = false;
+    if (!(mod->flags & MOD_DEFER_SIMPLIFY))
+        return root;
+
+    // Substitutions and reductions made in the meantime (during elaboration, for
+    // instance) may have results that contain nodes that are not simplified
+    flush_replace_cache(mod);
+    for (size_t i = 0; i < mod->shard_count; ++i) {
+        clear_node_map(&mod->shards[i].normal_forms);
+        clear_node_map(&mod->shards[i].whnfs);
+    }
+
+    struct node_map simplified = new_node_map();
+    struct node_vec stack = new_node_vec();
+    struct node_vec operands = new_node_vec();
+    push_to_node_vec(&stack, root);
+    while (stack.size > 0) {
+        node_t node = stack.elems[stack.size - 1];
+        if (find_in_node_map(&simplified, node)) {
+            stack.size--;
+            continue;
+        }
+        if (is_type_node(node)) {
+            insert_in_node_map(&simplified, node, node);
+            stack.size--;
+            continue;
+        }
+
+        bool is_ready = true;
+        size_t operand_count = get_operand_count(node);
+        clear_node_vec(&operands);
+        for (size_t i = 0; i < operand_count; ++i) {
+            node_t* operand = find_in_node_map(&simplified, get_operand(node, i));
+            if (!operand) {
+                push_to_node_vec(&stack, get_operand(node, i));
+                is_ready = false;
+            } else
+                push_to_node_vec(&operands, *operand);
+        }
+        if (!is_ready)
+            continue;
+
+        stack.size--;
+        node_t res = operand_count > 0
+            ? rebuild_with_operands(mod, node, operands.elems)
+            : simplify_deferred_node(mod, node);
+        insert_in_node_map(&simplified, node, res);
+    }
+    node_t res = *find_in_node_map(&simplified, root);
+    free_node_map(&simplified);
+    free_node_vec(&stack);
+    free_node_vec(&operands);
+    return res;
+}
+
 // Rebuild/Import/Replace ----------------------------------------------------------
 
 node_t rebuild_node(node_t node) {
@@ -875,11 +1830,20 @@ node_t import_node(mod_t mod, node_t node) {
         case NODE_ARROW:  return new_arrow(mod, node->arrow.var, node->arrow.codom, &node->loc);
         case NODE_INJ:    return new_inj(mod, node->type, node->inj.label, node->inj.arg, &node->loc);
         case NODE_RECORD: return new_record(mod, node->record.args, node->record.labels, node->record.arg_count, &node->loc);
+        case NODE_EXT:    return new_ext(mod, node->ext.val, node->ext.label, &node->loc);
+        case NODE_INS:    return new_ins(mod, node->ins.val, node->ins.elems, node->ins.labels, node->ins.elem_count, &node->loc);
         case NODE_ABS:    return new_abs(mod, node->abs.var, node->abs.body, &node->loc);
         case NODE_APP:    return new_app(mod, node->app.left, node->app.right, &node->loc);
         case NODE_LET:    return new_let(mod, node->let.vars, node->let.vals, node->let.var_count, node->let.body, &node->loc);
         case NODE_LETREC: return new_letrec(mod, node->letrec.vars, node->letrec.vals, node->letrec.var_count, node->letrec.body, &node->loc);
         case NODE_MATCH:  return new_match(mod, node->match.pats, node->match.vals, node->match.pat_count, node->match.arg, &node->loc);
+        case NODE_PRIM:   return new_prim(mod, node->prim.op, node->type, node->prim.args, node->prim.arg_count, &node->loc);
+        case NODE_ARRAY:  return new_array(mod, node->array.elem, node->array.dim, &node->loc);
+        case NODE_ELEMS:  return new_elems(mod, node->type->array.elem, node->elems.args, node->elems.arg_count, &node->loc);
+        case NODE_INDEX:  return new_index(mod, node->index.val, node->index.index, &node->loc);
+        case NODE_UPDATE: return new_update(mod, node->update.val, node->update.index, node->update.elem, &node->loc);
+        case NODE_MAP:    return new_map(mod, node->map.fn, node->map.val, &node->loc);
+        case NODE_FOLD:   return new_fold(mod, node->fold.fn, node->fold.init, node->fold.val, &node->loc);
         case NODE_ERR:
             return node->type == node
                 ? new_untyped_err(mod, &node->loc)
@@ -890,6 +1854,213 @@ node_t import_node(mod_t mod, node_t node) {
     }
 }
 
+// Copies between modules are deep, since the operands of a node, its type, and its
+// labels must all belong to the same module. Programs can be deep, so nodes are copied
+// with an explicit stack: A node is copied once all its operands have been copied.
+static inline node_t find_replaced(node_t old, struct node_vec* stack, struct node_map* map) {
+    node_t new = deref_or_null((void**)find_in_node_map(map, old));
+    if (!new)
+        push_to_node_vec(stack, old);
+    return new;
+}
+
+static inline bool find_all_replaced(const node_t* nodes, node_t* new_nodes, size_t count, struct node_vec* stack, struct node_map* map) {
+    bool valid = true;
+    for (size_t i = 0; i < count; ++i)
+        valid &= (new_nodes[i] = find_replaced(nodes[i], stack, map)) != NULL;
+    return valid;
+}
+
+static inline void copy_labels_to(mod_t mod, const label_t* labels, label_t* new_labels, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        new_labels[i] = new_label(mod, labels[i]->name, &labels[i]->loc);
+}
+
+static node_t try_copy_node(mod_t mod, node_t node, struct node_vec* stack, struct node_map* map) {
+    struct node copy = *node;
+    node_t res = NULL;
+    switch (node->tag) {
+        case NODE_UNI:
+        case NODE_STAR:
+        case NODE_NAT:
+        case NODE_INT:
+        case NODE_FLOAT:
+            return import_node(mod, node);
+        case NODE_ERR:
+            if (node->type == node)
+                return new_untyped_err(mod, &node->loc);
+            if ((copy.type = find_replaced(node->type, stack, map)))
+                res = new_err(mod, copy.type, &node->loc);
+            return res;
+        case NODE_VAR:
+            if (!(copy.type = find_replaced(node->type, stack, map)))
+                return NULL;
+            if (is_unbound_var(node))
+                return new_unbound_var(mod, copy.type, &node->loc);
+            return new_var(mod, copy.type, new_label(mod, node->var.label->name, &node->var.label->loc), &node->loc);
+        case NODE_TOP:
+        case NODE_BOT:
+        case NODE_LIT:
+            if ((copy.type = find_replaced(node->type, stack, map)))
+                res = import_node(mod, &copy);
+            return res;
+        case NODE_SUM:
+        case NODE_PROD:
+        case NODE_RECORD: {
+            node_t* args = new_buf(node_t, node->record.arg_count);
+            label_t* labels = new_buf(label_t, node->record.arg_count);
+            if (find_all_replaced(node->record.args, args, node->record.arg_count, stack, map)) {
+                copy_labels_to(mod, node->record.labels, labels, node->record.arg_count);
+                copy.record.args = args;
+                copy.record.labels = labels;
+                res = import_node(mod, &copy);
+            }
+            free_buf(args);
+            free_buf(labels);
+            return res;
+        }
+        case NODE_ARROW: {
+            bool valid = (copy.arrow.var = find_replaced(node->arrow.var, stack, map)) != NULL;
+            valid &= (copy.arrow.codom = find_replaced(node->arrow.codom, stack, map)) != NULL;
+            return valid ? import_node(mod, &copy) : NULL;
+        }
+        case NODE_INJ: {
+            bool valid = (copy.type = find_replaced(node->type, stack, map)) != NULL;
+            valid &= (copy.inj.arg = find_replaced(node->inj.arg, stack, map)) != NULL;
+            if (!valid)
+                return NULL;
+            copy.inj.label = new_label(mod, node->inj.label->name, &node->inj.label->loc);
+            return import_node(mod, &copy);
+        }
+        case NODE_EXT:
+            if (!(copy.ext.val = find_replaced(node->ext.val, stack, map)))
+                return NULL;
+            copy.ext.label = new_label(mod, node->ext.label->name, &node->ext.label->loc);
+            return import_node(mod, &copy);
+        case NODE_INS: {
+            node_t* elems = new_buf(node_t, node->ins.elem_count);
+            label_t* labels = new_buf(label_t, node->ins.elem_count);
+            bool valid = find_all_replaced(node->ins.elems, elems, node->ins.elem_count, stack, map);
+            valid &= (copy.ins.val = find_replaced(node->ins.val, stack, map)) != NULL;
+            if (valid) {
+                copy_labels_to(mod, node->ins.labels, labels, node->ins.elem_count);
+                copy.ins.elems = elems;
+                copy.ins.labels = labels;
+                res = import_node(mod, &copy);
+            }
+            free_buf(elems);
+            free_buf(labels);
+            return res;
+        }
+        case NODE_ABS: {
+            bool valid = (copy.abs.var = find_replaced(node->abs.var, stack, map)) != NULL;
+            valid &= (copy.abs.body = find_replaced(node->abs.body, stack, map)) != NULL;
+            return valid ? import_node(mod, &copy) : NULL;
+        }
+        case NODE_APP: {
+            bool valid = (copy.app.left = find_replaced(node->app.left, stack, map)) != NULL;
+            valid &= (copy.app.right = find_replaced(node->app.right, stack, map)) != NULL;
+            return valid ? import_node(mod, &copy) : NULL;
+        }
+        case NODE_LET:
+        case NODE_LETREC: {
+            node_t* vars = new_buf(node_t, node->let.var_count);
+            node_t* vals = new_buf(node_t, node->let.var_count);
+            bool valid = find_all_replaced(node->let.vars, vars, node->let.var_count, stack, map);
+            valid &= find_all_replaced(node->let.vals, vals, node->let.var_count, stack, map);
+            valid &= (copy.let.body = find_replaced(node->let.body, stack, map)) != NULL;
+            if (valid) {
+                copy.let.vars = vars;
+                copy.let.vals = vals;
+                res = import_node(mod, &copy);
+            }
+            free_buf(vars);
+            free_buf(vals);
+            return res;
+        }
+        case NODE_MATCH: {
+            node_t* pats = new_buf(node_t, node->match.pat_count);
+            node_t* vals = new_buf(node_t, node->match.pat_count);
+            bool valid = find_all_replaced(node->match.pats, pats, node->match.pat_count, stack, map);
+            valid &= find_all_replaced(node->match.vals, vals, node->match.pat_count, stack, map);
+            valid &= (copy.match.arg = find_replaced(node->match.arg, stack, map)) != NULL;
+            if (valid) {
+                copy.match.pats = pats;
+                copy.match.vals = vals;
+                res = import_node(mod, &copy);
+            }
+            free_buf(pats);
+            free_buf(vals);
+            return res;
+        }
+        case NODE_PRIM: {
+            node_t* args = new_buf(node_t, node->prim.arg_count);
+            bool valid = find_all_replaced(node->prim.args, args, node->prim.arg_count, stack, map);
+            valid &= (copy.type = find_replaced(node->type, stack, map)) != NULL;
+            if (valid) {
+                copy.prim.args = args;
+                res = import_node(mod, &copy);
+            }
+            free_buf(args);
+            return res;
+        }
+        case NODE_ELEMS: {
+            node_t* args = new_buf(node_t, node->elems.arg_count);
+            bool valid = find_all_replaced(node->elems.args, args, node->elems.arg_count, stack, map);
+            valid &= (copy.type = find_replaced(node->type, stack, map)) != NULL;
+            if (valid) {
+                copy.elems.args = args;
+                res = import_node(mod, &copy);
+            }
+            free_buf(args);
+            return res;
+        }
+        case NODE_ARRAY: {
+            bool valid = (copy.array.elem = find_replaced(node->array.elem, stack, map)) != NULL;
+            valid &= (copy.array.dim = find_replaced(node->array.dim, stack, map)) != NULL;
+            return valid ? import_node(mod, &copy) : NULL;
+        }
+        case NODE_INDEX:
+        case NODE_UPDATE: {
+            bool valid = (copy.index.val = find_replaced(node->index.val, stack, map)) != NULL;
+            valid &= (copy.index.index = find_replaced(node->index.index, stack, map)) != NULL;
+            if (node->tag == NODE_UPDATE)
+                valid &= (copy.update.elem = find_replaced(node->update.elem, stack, map)) != NULL;
+            return valid ? import_node(mod, &copy) : NULL;
+        }
+        case NODE_MAP:
+        case NODE_FOLD: {
+            bool valid = (copy.map.fn = find_replaced(node->map.fn, stack, map)) != NULL;
+            valid &= (copy.map.val = find_replaced(node->map.val, stack, map)) != NULL;
+            if (node->tag == NODE_FOLD)
+                valid &= (copy.fold.init = find_replaced(node->fold.init, stack, map)) != NULL;
+            return valid ? import_node(mod, &copy) : NULL;
+        }
+        default:
+            assert(false && "invalid node tag");
+            return NULL;
+    }
+}
+
+static node_t copy_node(mod_t mod, node_t node, struct node_map* map) {
+    struct node_vec stack = new_node_vec();
+    push_to_node_vec(&stack, node);
+    while (stack.size > 0) {
+        node_t top = stack.elems[stack.size - 1];
+        if (find_in_node_map(map, top)) {
+            pop_from_node_vec(&stack);
+            continue;
+        }
+        node_t res = try_copy_node(mod, top, &stack, map);
+        if (res) {
+            insert_in_node_map(map, top, res);
+            pop_from_node_vec(&stack);
+        }
+    }
+    free_node_vec(&stack);
+    return *find_in_node_map(map, node);
+}
+
 static inline bool needs_replace(node_t node, const node_t* vars, size_t var_count) {
     switch (node->tag) {
         case NODE_UNI:
@@ -912,23 +2083,45 @@ static inline bool needs_replace(node_t node, const node_t* vars, size_t var_cou
     return needs_replace;
 }
 
-static inline node_t find_replaced(node_t old, struct node_vec* stack, struct node_map* map) {
-    node_t new = deref_or_null((void**)find_in_node_map(map, old));
-    if (!new)
-        push_to_node_vec(stack, old);
-    return new;
+static inline node_t find_in_replace_cache_or_null(mod_t mod, node_t node, subst_t subst) {
+    // The cache has no entry for substitutions that are not interned
+    lock_mod(mod);
+    const subst_t* interned = find_in_mod_substs(&mod->substs, subst);
+    node_t res = interned
+        ? deref_or_null((void**)find_in_replace_cache(&mod->replace_cache, (struct replace_key) { node, *interned }))
+        : NULL;
+    if (res)
+        mod->stats.replace_cache_hits++;
+    else
+        mod->stats.replace_cache_misses++;
+    unlock_mod(mod);
+    return res;
+}
+
+static inline void insert_in_replace_cache_or_flush(mod_t mod, node_t node, subst_t subst, node_t new_node) {
+    // Keep the cache bounded: Once it is full, start again from an empty cache
+    lock_mod(mod);
+    if (mod->replace_cache.htable.size >= MAX_REPLACE_CACHE_SIZE)
+        flush_replace_cache(mod);
+    insert_in_replace_cache(&mod->replace_cache, (struct replace_key) { node, insert_subst(mod, subst) }, new_node);
+    unlock_mod(mod);
 }
 
-static inline node_t try_replace_vars(node_t node, const node_t* vars, size_t var_count, struct node_vec* stack, struct node_map* map) {
+static inline node_t try_replace_vars(mod_t mod, node_t node, subst_t subst, struct node_vec* stack, struct node_map* map) {
     node_t new_node = deref_or_null((void**)find_in_node_map(map, node));
     if (new_node)
         return new_node;
 
-    if (!needs_replace(node, vars, var_count)) {
+    if (!needs_replace(node, subst->vars, subst->count)) {
         insert_in_node_map(map, node, node);
         return node;
     }
 
+    if ((new_node = find_in_replace_cache_or_null(mod, node, subst))) {
+        insert_in_node_map(map, node, new_node);
+        return new_node;
+    }
+
     switch (node->tag) {
         case NODE_ERR:
             assert(node->type != node);
@@ -988,10 +2181,14 @@ static inline node_t try_replace_vars(node_t node, const node_t* vars, size_t va
             break;
         }
         case NODE_INS: {
-            node_t new_val = find_replaced(node->ext.val, stack, map);
-            node_t new_elem = find_replaced(node->ins.elem, stack, map);
-            if (new_val && new_elem)
-                new_node = new_ins(get_mod(node), new_val, node->ins.label, new_elem, &node->loc);
+            node_t new_val = find_replaced(node->ins.val, stack, map);
+            node_t* new_elems = new_buf(node_t, node->ins.elem_count);
+            bool valid = new_val != NULL;
+            for (size_t i = 0, n = node->ins.elem_count; i < n; ++i)
+                valid &= (new_elems[i] = find_replaced(node->ins.elems[i], stack, map)) != NULL;
+            if (valid)
+                new_node = new_ins(get_mod(node), new_val, new_elems, node->ins.labels, node->ins.elem_count, &node->loc);
+            free_buf(new_elems);
             break;
         }
         case NODE_ARROW: {
@@ -1052,13 +2249,74 @@ static inline node_t try_replace_vars(node_t node, const node_t* vars, size_t va
             free_buf(new_vals);
             break;
         }
+        case NODE_PRIM: {
+            node_t* new_args = new_buf(node_t, node->prim.arg_count);
+            node_t new_type = find_replaced(node->type, stack, map);
+            bool valid = new_type != NULL;
+            for (size_t i = 0, n = node->prim.arg_count; i < n; ++i)
+                valid &= (new_args[i] = find_replaced(node->prim.args[i], stack, map)) != NULL;
+            if (valid)
+                new_node = new_prim(get_mod(node), node->prim.op, new_type, new_args, node->prim.arg_count, &node->loc);
+            free_buf(new_args);
+            break;
+        }
+        case NODE_ARRAY: {
+            node_t new_elem = find_replaced(node->array.elem, stack, map);
+            node_t new_dim = find_replaced(node->array.dim, stack, map);
+            if (new_elem && new_dim)
+                new_node = new_array(get_mod(node), new_elem, new_dim, &node->loc);
+            break;
+        }
+        case NODE_ELEMS: {
+            node_t* new_args = new_buf(node_t, node->elems.arg_count);
+            node_t new_elem_type = find_replaced(node->type->array.elem, stack, map);
+            bool valid = new_elem_type != NULL;
+            for (size_t i = 0, n = node->elems.arg_count; i < n; ++i)
+                valid &= (new_args[i] = find_replaced(node->elems.args[i], stack, map)) != NULL;
+            if (valid)
+                new_node = new_elems(get_mod(node), new_elem_type, new_args, node->elems.arg_count, &node->loc);
+            free_buf(new_args);
+            break;
+        }
+        case NODE_INDEX: {
+            node_t new_val = find_replaced(node->index.val, stack, map);
+            node_t new_index_ = find_replaced(node->index.index, stack, map);
+            if (new_val && new_index_)
+                new_node = new_index(get_mod(node), new_val, new_index_, &node->loc);
+            break;
+        }
+        case NODE_UPDATE: {
+            node_t new_val = find_replaced(node->update.val, stack, map);
+            node_t new_index_ = find_replaced(node->update.index, stack, map);
+            node_t new_elem = find_replaced(node->update.elem, stack, map);
+            if (new_val && new_index_ && new_elem)
+                new_node = new_update(get_mod(node), new_val, new_index_, new_elem, &node->loc);
+            break;
+        }
+        case NODE_MAP: {
+            node_t new_fn = find_replaced(node->map.fn, stack, map);
+            node_t new_val = find_replaced(node->map.val, stack, map);
+            if (new_fn && new_val)
+                new_node = new_map(get_mod(node), new_fn, new_val, &node->loc);
+            break;
+        }
+        case NODE_FOLD: {
+            node_t new_fn = find_replaced(node->fold.fn, stack, map);
+            node_t new_init = find_replaced(node->fold.init, stack, map);
+            node_t new_val = find_replaced(node->fold.val, stack, map);
+            if (new_fn && new_init && new_val)
+                new_node = new_fold(get_mod(node), new_fn, new_init, new_val, &node->loc);
+            break;
+        }
         default:
             assert(false && "invalid node tag");
             break;
     }
 #undef DEPENDS_ON
-    if (new_node)
+    if (new_node) {
         insert_in_node_map(map, node, new_node);
+        insert_in_replace_cache_or_flush(mod, node, subst, new_node);
+    }
     return new_node;
 }
 
@@ -1067,6 +2325,25 @@ node_t replace_var(node_t node, node_t from, node_t to) {
 }
 
 node_t replace_vars(node_t node, const node_t* vars, const node_t* vals, size_t var_count) {
+    if (!needs_replace(node, vars, var_count))
+        return node;
+
+    // Substitutions always terminate, so they are completed even without budget
+    mod_t mod = get_mod(node);
+    consume_step(mod, NULL, node);
+    if (mod->profile)
+        record_profile_event(mod->profile, PROFILE_REPLACE);
+    node_t* sorted_vars = new_buf(node_t, var_count);
+    node_t* sorted_vals = new_buf(node_t, var_count);
+    sort_subst(vars, vals, var_count, sorted_vars, sorted_vals);
+    subst_t subst = &(struct subst) { .vars = sorted_vars, .vals = sorted_vals, .count = var_count };
+    node_t res = find_in_replace_cache_or_null(mod, node, subst);
+    if (res) {
+        free_buf(sorted_vars);
+        free_buf(sorted_vals);
+        return res;
+    }
+
     uint32_t hashes[16];
     node_t keys[ARRAY_SIZE(hashes)];
     node_t values[ARRAY_SIZE(hashes)];
@@ -1082,40 +2359,522 @@ node_t replace_vars(node_t node, const node_t* vars, const node_t* vals, size_t
     node_t last = NULL;
     while (stack.size > 0) {
         node_t node = stack.elems[stack.size - 1];
-        if ((last = try_replace_vars(node, vars, var_count, &stack, &map)))
+        if ((last = try_replace_vars(mod, node, subst, &stack, &map)))
             pop_from_node_vec(&stack);
     }
 
     free_node_vec(&stack);
     free_node_map(&map);
+    free_buf(sorted_vars);
+    free_buf(sorted_vals);
     return last;
 }
 
-node_t reduce_node(node_t node) {
+static inline size_t find_var(const node_t* vars, size_t var_count, node_t var) {
+    for (size_t i = 0; i < var_count; ++i) {
+        if (vars[i] == var)
+            return i;
+    }
+    return SIZE_MAX;
+}
+
+static inline bool is_folded_letrec(node_t node) {
+    // A folded letrec-expression is of the form `letrec x = ... in x`.
+    // It represents a recursive value, and is only unfolded when needed.
+    return
+        node->tag == NODE_LETREC &&
+        node->letrec.body->tag == NODE_VAR &&
+        find_var(node->letrec.vars, node->letrec.var_count, node->letrec.body) != SIZE_MAX;
+}
+
+static inline node_t fold_letrec(node_t letrec, size_t i) {
+    return new_letrec(get_mod(letrec),
+        letrec->letrec.vars, letrec->letrec.vals,
+        letrec->letrec.var_count,
+        letrec->letrec.vars[i], &letrec->loc);
+}
+
+static inline node_t replace_letrec_vars(node_t node, node_t letrec) {
+    node_t* folded_vals = new_buf(node_t, letrec->letrec.var_count);
+    for (size_t i = 0, n = letrec->letrec.var_count; i < n; ++i)
+        folded_vals[i] = fold_letrec(letrec, i);
+    node = replace_vars(node, letrec->letrec.vars, folded_vals, letrec->letrec.var_count);
+    free_buf(folded_vals);
+    return node;
+}
+
+static inline node_t unfold_letrec(node_t node) {
+    size_t index = find_var(node->letrec.vars, node->letrec.var_count, node->letrec.body);
+    return replace_letrec_vars(node->letrec.vals[index], node);
+}
+
+// Subterms that are not at least this deep are reduced by the current thread,
+// since they are not worth the cost of a task.
+#define MIN_PARALLEL_REDUCE_DEPTH 8
+
+struct reduce_task {
+    struct task task;
+    node_t node;
+    node_t res;
+};
+
+static void run_reduce_task(struct task* task) {
+    struct reduce_task* reduce_task = (struct reduce_task*)task;
+    reduce_task->res = reduce_node(reduce_task->node);
+}
+
+static inline void reduce_nodes(mod_t mod, const node_t* nodes, node_t* res, size_t count) {
+    // Independent subterms are reduced in parallel when a thread pool is available.
+    // The last one is always reduced by the current thread.
+    struct thread_pool* pool = mod->pool;
+    if (!pool || count < 2) {
+        for (size_t i = 0; i < count; ++i)
+            res[i] = reduce_node(nodes[i]);
+        return;
+    }
+    struct reduce_task* tasks = new_buf(struct reduce_task, count);
+    for (size_t i = 0; i < count; ++i) {
+        tasks[i] = (struct reduce_task) { .task.run = NULL, .node = nodes[i] };
+        if (i + 1 < count && nodes[i]->depth >= MIN_PARALLEL_REDUCE_DEPTH) {
+            tasks[i].task.run = run_reduce_task;
+            spawn_task(pool, &tasks[i].task);
+        }
+    }
+    for (size_t i = count; i-- > 0;) {
+        if (tasks[i].task.run)
+            wait_task(pool, &tasks[i].task);
+        else
+            tasks[i].res = reduce_node(nodes[i]);
+    }
+    for (size_t i = 0; i < count; ++i)
+        res[i] = tasks[i].res;
+    free_buf(tasks);
+}
+
+static inline node_t reduce_head(node_t node) {
+    // Values that are inspected only need to be reduced until their head is known
+    node = reduce_to_whnf(node);
+    return is_folded_letrec(node) ? reduce_to_whnf(unfold_letrec(node)) : node;
+}
+
+static inline node_t reduce_match_arg(node_t match) {
+    // Patterns are first tried on the head of the argument. Nested patterns may need
+    // its operands as well, in which case the argument is reduced completely.
+    node_t arg = reduce_head(match->match.arg);
+    node_t res = new_match(get_mod(match), match->match.pats, match->match.vals, match->match.pat_count, arg, &match->loc);
+    if (res->tag != NODE_MATCH)
+        return res;
+    arg = reduce_node(arg);
+    if (is_folded_letrec(arg))
+        arg = reduce_node(unfold_letrec(arg));
+    return new_match(get_mod(match), match->match.pats, match->match.vals, match->match.pat_count, arg, &match->loc);
+}
+
+static node_t reduce_node_uncached(node_t node) {
+    mod_t mod = get_mod(node);
+    struct cycle_detector detector = NEW_CYCLE_DETECTOR;
     bool todo;
     do {
+        // When the budget is exhausted, the partially reduced term is returned
+        if (!consume_step(mod, &detector, node))
+            return node;
         node_t old_node = node;
-        if (node->tag == NODE_ABS)
-            return new_abs(get_mod(node), node->abs.var, reduce_node(node->abs.body), &node->loc);
-        while (node->tag == NODE_APP) {
-            node_t left  = reduce_node(node->app.left);
-            node_t right = reduce_node(node->app.right);
-            if (left->tag != NODE_ABS)
-                return new_app(get_mod(node), left, right, &node->loc);
-            node = replace_var(left->abs.body, left->abs.var, right);
+        switch (node->tag) {
+            case NODE_ABS:
+                return new_abs(get_mod(node), node->abs.var, reduce_node(node->abs.body), &node->loc);
+            case NODE_APP: {
+                node_t operands[] = { node->app.left, node->app.right };
+                reduce_nodes(get_mod(node), operands, operands, 2);
+                node_t left = operands[0], right = operands[1];
+                if (is_folded_letrec(left))
+                    left = reduce_node(unfold_letrec(left));
+                if (left->tag != NODE_ABS)
+                    return new_app(get_mod(node), left, right, &node->loc);
+                if (mod->profile)
+                    enter_profiled_fn(mod->profile, left);
+                node = replace_var(left->abs.body, left->abs.var, right);
+                break;
+            }
+            case NODE_LET: {
+                node_t* new_vals = new_buf(node_t, node->let.var_count);
+                reduce_nodes(get_mod(node), node->let.vals, new_vals, node->let.var_count);
+                node = replace_vars(node->let.body, node->let.vars, new_vals, node->let.var_count);
+                free_buf(new_vals);
+                break;
+            }
+            case NODE_LETREC:
+                // Recursive bindings are replaced by folded letrec-expressions,
+                // which are then unfolded when they are applied or inspected.
+                if (!is_folded_letrec(node))
+                    node = replace_letrec_vars(node->letrec.body, node);
+                break;
+            case NODE_MATCH:
+                node = reduce_match_arg(node);
+                if (node->tag == NODE_MATCH)
+                    return node;
+                break;
+            case NODE_EXT: {
+                node_t ext = new_ext(get_mod(node), reduce_head(node->ext.val), node->ext.label, &node->loc);
+                if (ext->tag == NODE_EXT) {
+                    node_t val = reduce_node(node->ext.val);
+                    if (is_folded_letrec(val))
+                        val = reduce_node(unfold_letrec(val));
+                    return new_ext(get_mod(node), val, node->ext.label, &node->loc);
+                }
+                node = ext;
+                break;
+            }
+            case NODE_INS: {
+                node_t* new_elems = new_buf(node_t, node->ins.elem_count);
+                reduce_nodes(get_mod(node), node->ins.elems, new_elems, node->ins.elem_count);
+                node = new_ins(get_mod(node), reduce_node(node->ins.val), new_elems, node->ins.labels, node->ins.elem_count, &node->loc);
+                free_buf(new_elems);
+                return node;
+            }
+            case NODE_INJ:
+                return new_inj(get_mod(node), node->type, node->inj.label, reduce_node(node->inj.arg), &node->loc);
+            case NODE_RECORD: {
+                node_t* new_args = new_buf(node_t, node->record.arg_count);
+                reduce_nodes(get_mod(node), node->record.args, new_args, node->record.arg_count);
+                node = new_record(get_mod(node), new_args, node->record.labels, node->record.arg_count, &node->loc);
+                free_buf(new_args);
+                return node;
+            }
+            case NODE_PRIM: {
+                // Primitives with literal operands are folded when they are rebuilt
+                node_t* new_args = new_buf(node_t, node->prim.arg_count);
+                reduce_nodes(get_mod(node), node->prim.args, new_args, node->prim.arg_count);
+                node = new_prim(get_mod(node), node->prim.op, node->type, new_args, node->prim.arg_count, &node->loc);
+                free_buf(new_args);
+                return node;
+            }
+            case NODE_ARRAY:
+                return new_array(get_mod(node), reduce_node(node->array.elem), reduce_node(node->array.dim), &node->loc);
+            case NODE_ELEMS: {
+                node_t* new_args = new_buf(node_t, node->elems.arg_count);
+                reduce_nodes(get_mod(node), node->elems.args, new_args, node->elems.arg_count);
+                node = new_elems(get_mod(node), node->type->array.elem, new_args, node->elems.arg_count, &node->loc);
+                free_buf(new_args);
+                return node;
+            }
+            case NODE_INDEX:
+            case NODE_UPDATE: {
+                // Accesses with a known index into an array literal are folded when rebuilt
+                node_t val = reduce_node(node->index.val);
+                if (is_folded_letrec(val))
+                    val = reduce_node(unfold_letrec(val));
+                node_t index = reduce_node(node->index.index);
+                node = node->tag == NODE_INDEX
+                    ? new_index(get_mod(node), val, index, &node->loc)
+                    : new_update(get_mod(node), val, index, reduce_node(node->update.elem), &node->loc);
+                if (node->tag == NODE_INDEX || node->tag == NODE_UPDATE)
+                    return node;
+                break;
+            }
+            case NODE_MAP:
+            case NODE_FOLD: {
+                // Bulk operations on array literals are unrolled into applications
+                node_t fn = reduce_node(node->map.fn);
+                node_t val = reduce_node(node->map.val);
+                if (is_folded_letrec(val))
+                    val = reduce_node(unfold_letrec(val));
+                if (val->tag != NODE_ELEMS) {
+                    return node->tag == NODE_MAP
+                        ? new_map(mod, fn, val, &node->loc)
+                        : new_fold(mod, fn, reduce_node(node->fold.init), val, &node->loc);
+                }
+                if (node->tag == NODE_MAP) {
+                    node_t* args = new_buf(node_t, val->elems.arg_count);
+                    for (size_t i = 0, n = val->elems.arg_count; i < n; ++i)
+                        args[i] = new_app(mod, fn, val->elems.args[i], &node->loc);
+                    node = new_elems(mod, node->type->array.elem, args, val->elems.arg_count, &node->loc);
+                    free_buf(args);
+                } else {
+                    node_t acc = node->fold.init;
+                    for (size_t i = 0, n = val->elems.arg_count; i < n; ++i)
+                        acc = reduce_node(new_app(mod, new_app(mod, fn, acc, &node->loc), val->elems.args[i], &node->loc));
+                    node = acc;
+                }
+                break;
+            }
+            default:
+                break;
         }
-        while (node->tag == NODE_LET || node->tag == NODE_LETREC) {
-            node_t* new_vals = new_buf(node_t, node->letrec.var_count);
-            for (size_t i = 0, n = node->let.var_count; i < n; ++i)
-                new_vals[i] = reduce_node(node->let.vals[i]);
-            node_t new_body = replace_vars(node->let.body, node->let.vars, new_vals, node->let.var_count);
-            node = new_letrec(get_mod(node),
-                node->letrec.vars, new_vals,
-                node->letrec.var_count,
-                new_body, &node->loc);
-            free_buf(new_vals);
+        todo = old_node != node;
+    } while (todo);
+    return node;
+}
+
+static node_t reduce_to_whnf_uncached(node_t node) {
+    // Unlike `reduce_node_uncached`, this does not reduce under abstractions, nor the
+    // operands of constructors, nor the arguments of applications before substitution.
+    mod_t mod = get_mod(node);
+    struct cycle_detector detector = NEW_CYCLE_DETECTOR;
+    bool todo;
+    do {
+        if (!consume_step(mod, &detector, node))
+            return node;
+        node_t old_node = node;
+        switch (node->tag) {
+            case NODE_APP: {
+                node_t left = reduce_head(node->app.left);
+                if (left->tag != NODE_ABS)
+                    return new_app(mod, left, node->app.right, &node->loc);
+                if (mod->profile)
+                    enter_profiled_fn(mod->profile, left);
+                node = replace_var(left->abs.body, left->abs.var, node->app.right);
+                break;
+            }
+            case NODE_LET:
+                node = replace_vars(node->let.body, node->let.vars, node->let.vals, node->let.var_count);
+                break;
+            case NODE_LETREC:
+                if (!is_folded_letrec(node))
+                    node = replace_letrec_vars(node->letrec.body, node);
+                break;
+            case NODE_MATCH:
+                node = reduce_match_arg(node);
+                if (node->tag == NODE_MATCH)
+                    return node;
+                break;
+            case NODE_EXT:
+                node = new_ext(mod, reduce_head(node->ext.val), node->ext.label, &node->loc);
+                if (node->tag == NODE_EXT)
+                    return node;
+                break;
+            case NODE_INS:
+                node = new_ins(mod, reduce_head(node->ins.val), node->ins.elems, node->ins.labels, node->ins.elem_count, &node->loc);
+                if (node->tag == NODE_INS)
+                    return node;
+                break;
+            case NODE_PRIM: {
+                node_t* new_args = new_buf(node_t, node->prim.arg_count);
+                for (size_t i = 0, n = node->prim.arg_count; i < n; ++i)
+                    new_args[i] = reduce_to_whnf(node->prim.args[i]);
+                node = new_prim(mod, node->prim.op, node->type, new_args, node->prim.arg_count, &node->loc);
+                free_buf(new_args);
+                return node;
+            }
+            case NODE_INDEX:
+            case NODE_UPDATE: {
+                node_t val = reduce_head(node->index.val);
+                node_t index = reduce_to_whnf(node->index.index);
+                node = node->tag == NODE_INDEX
+                    ? new_index(mod, val, index, &node->loc)
+                    : new_update(mod, val, index, node->update.elem, &node->loc);
+                if (node->tag == NODE_INDEX || node->tag == NODE_UPDATE)
+                    return node;
+                break;
+            }
+            case NODE_MAP:
+            case NODE_FOLD: {
+                node_t val = reduce_head(node->map.val);
+                if (val->tag != NODE_ELEMS) {
+                    return node->tag == NODE_MAP
+                        ? new_map(mod, node->map.fn, val, &node->loc)
+                        : new_fold(mod, node->fold.fn, node->fold.init, val, &node->loc);
+                }
+                if (node->tag == NODE_MAP) {
+                    node_t* args = new_buf(node_t, val->elems.arg_count);
+                    for (size_t i = 0, n = val->elems.arg_count; i < n; ++i)
+                        args[i] = new_app(mod, node->map.fn, val->elems.args[i], &node->loc);
+                    node = new_elems(mod, node->type->array.elem, args, val->elems.arg_count, &node->loc);
+                    free_buf(args);
+                    return node;
+                }
+                // The accumulator is reduced at every step, as in `reduce_node_uncached`
+                node_t acc = node->fold.init;
+                for (size_t i = 0, n = val->elems.arg_count; i < n; ++i)
+                    acc = reduce_to_whnf(new_app(mod, new_app(mod, node->fold.fn, acc, &node->loc), val->elems.args[i], &node->loc));
+                node = acc;
+                break;
+            }
+            default:
+                // Abstractions, constructors, and types are already in weak head normal form
+                return node;
         }
         todo = old_node != node;
     } while (todo);
     return node;
 }
+
+static inline void insert_reduced_node(mod_t mod, node_t node, node_t res, bool is_whnf) {
+    node_t keys[] = { node, res };
+    for (size_t i = 0; i < (res != node ? 2 : 1); ++i) {
+        struct mod_shard* shard = get_ptr_shard(mod, keys[i]);
+        lock_shard(mod, shard);
+        insert_in_node_map(is_whnf ? &shard->whnfs : &shard->normal_forms, keys[i], res);
+        unlock_shard(mod, shard);
+    }
+}
+
+node_t reduce_type(node_t type) {
+    // Types are normalized over and over during elaboration, so their normal form
+    // is kept in the node itself, which avoids a lookup in the module-wide cache.
+    mod_t mod = get_mod(type);
+    struct mod_shard* shard = get_ptr_shard(mod, type);
+    lock_shard(mod, shard);
+    node_t res = type->normal_type;
+    unlock_shard(mod, shard);
+    if (!res) {
+        res = reduce_node(type);
+        if (is_budget_exhausted(mod))
+            return res;
+        lock_shard(mod, shard);
+        ((struct node*)type)->normal_type = res;
+        unlock_shard(mod, shard);
+        shard = get_ptr_shard(mod, res);
+        lock_shard(mod, shard);
+        ((struct node*)res)->normal_type = res;
+        unlock_shard(mod, shard);
+    }
+    return res;
+}
+
+node_t reduce_node(node_t node) {
+    // Since nodes are hash-consed, the normal form of a node can be
+    // memoized. Normal forms are also registered as their own normal
+    // form, so that reducing them again returns immediately.
+    mod_t mod = get_mod(node);
+    struct mod_shard* shard = get_ptr_shard(mod, node);
+    lock_shard(mod, shard);
+    node_t res = deref_or_null((void**)find_in_node_map(&shard->normal_forms, node));
+    if (res)
+        shard->reduce_cache_hits++;
+    else
+        shard->reduce_cache_misses++;
+    unlock_shard(mod, shard);
+    if (res)
+        return res;
+
+    // Results obtained after the budget is exhausted are not normal forms
+    if (!enter_reduction(mod, node, false))
+        return node;
+    // Reduction relies on simplification, which cannot be deferred in the meantime
+    bool defers_simplification = mod->defers_simplification;
+    mod->defers_simplification = false;
+    res = reduce_node_uncached(node);
+    mod->defers_simplification = defers_simplification;
+    leave_reduction(mod, node, false);
+    if (is_budget_exhausted(mod))
+        return res;
+    insert_reduced_node(mod, node, res, false);
+    return res;
+}
+
+node_t reduce_to_whnf(node_t node) {
+    // Normal forms are also weak head normal forms, and are looked up first
+    mod_t mod = get_mod(node);
+    struct mod_shard* shard = get_ptr_shard(mod, node);
+    lock_shard(mod, shard);
+    node_t res = node->normal_type;
+    if (!res)
+        res = deref_or_null((void**)find_in_node_map(&shard->normal_forms, node));
+    if (!res)
+        res = deref_or_null((void**)find_in_node_map(&shard->whnfs, node));
+    if (res)
+        shard->reduce_cache_hits++;
+    else
+        shard->reduce_cache_misses++;
+    unlock_shard(mod, shard);
+    if (res)
+        return res;
+
+    if (!enter_reduction(mod, node, true))
+        return node;
+    bool defers_simplification = mod->defers_simplification;
+    mod->defers_simplification = false;
+    res = reduce_to_whnf_uncached(node);
+    mod->defers_simplification = defers_simplification;
+    leave_reduction(mod, node, true);
+    if (is_budget_exhausted(mod))
+        return res;
+    insert_reduced_node(mod, node, res, true);
+    return res;
+}
+
+node_t reduce_node_with_strategy(node_t node, enum reduce_strategy strategy) {
+    switch (strategy) {
+        case REDUCE_WHNF:
+            return reduce_to_whnf(node);
+        case REDUCE_HNF: {
+            node = reduce_to_whnf(node);
+            if (node->tag != NODE_ABS || is_budget_exhausted(get_mod(node)))
+                return node;
+            node_t body = reduce_node_with_strategy(node->abs.body, REDUCE_HNF);
+            return new_abs(get_mod(node), node->abs.var, body, &node->loc);
+        }
+        default:
+            return reduce_node(node);
+    }
+}
+
+node_t reduce_node_with_budget(node_t node, const struct budget* budget, struct log* log) {
+    mod_t mod = get_mod(node);
+    assert(!mod->pool && "budgets cannot be used with parallel reduction");
+    struct budget_state state = {
+        .budget = budget,
+        .active_nodes = new_node_set(),
+        .active_whnfs = new_node_set(),
+        .steps = 0,
+        .depth = 0,
+        .max_node_count = budget->max_nodes ? count_nodes(mod) + budget->max_nodes : 0,
+        .status = BUDGET_OK
+    };
+    if (budget->max_seconds > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &state.deadline);
+        double secs = (double)state.deadline.tv_sec + (double)state.deadline.tv_nsec * 1.0e-9 + budget->max_seconds;
+        state.deadline.tv_sec = (time_t)secs;
+        state.deadline.tv_nsec = (long)((secs - (double)state.deadline.tv_sec) * 1.0e9);
+    }
+
+    struct budget_state* old_state = mod->budget_state;
+    mod->budget_state = &state;
+    node_t res = reduce_node(node);
+    mod->budget_state = old_state;
+    free_node_set(&state.active_nodes);
+    free_node_set(&state.active_whnfs);
+    if (state.status == BUDGET_OK)
+        return res;
+
+    static const char* msgs[] = {
+#define f(name, msg) [BUDGET_##name] = msg,
+        BUDGET_ERRORS(f)
+#undef f
+    };
+    log_error(log, &node->loc, "cannot reduce expression, %0:s", FORMAT_ARGS({ .s = msgs[state.status] }));
+    return NULL;
+}
+
+node_t reduce_node_in_scratch(node_t node, const struct budget* budget, struct log* log) {
+    // Intermediate terms are built in a scratch module, which is freed in bulk once
+    // the normal form has been copied back into the module of the original node.
+    // The reduction always runs with a budget, which bounds its depth even when
+    // there are no other limits.
+    mod_t mod = get_mod(node);
+    assert(!mod->pool && !mod->budget_state && "scratch reduction cannot be parallel or nested");
+    mod_t scratch = new_mod_with_flags(mod->flags & MOD_CANONICAL_BINDERS);
+    struct node_map map = new_node_map();
+    node_t res = reduce_node_with_budget(copy_node(scratch, node, &map), budget, log);
+    free_node_map(&map);
+    if (res) {
+        map = new_node_map();
+        res = copy_node(mod, res, &map);
+        free_node_map(&map);
+    }
+    free_mod(scratch);
+    if (!res)
+        return NULL;
+
+    insert_reduced_node(mod, node, res, false);
+    return res;
+}
+
+node_t reduce_node_in_parallel(node_t node, struct thread_pool* pool) {
+    mod_t mod = get_mod(node);
+    assert(mod->flags & MOD_THREAD_SAFE && "parallel reduction requires a thread-safe module");
+    mod->pool = pool;
+    node_t res = reduce_node(node);
+    mod->pool = NULL;
+    return res;
+}
@@ -16,7 +16,8 @@
  * to simplify variable replacement.
  * By default, no convention is enforced, but Axelsson-Claessen-style indices
  * (based on the depth of the enclosed expression) can be used to obtain
- * alpha-equivalence.
+ * alpha-equivalence. Modules created with MOD_CANONICAL_BINDERS rename binders
+ * this way when they are built, so that alpha-equivalent nodes are shared.
  */
 
 typedef struct mod* mod_t;
@@ -35,6 +36,36 @@ struct lit {
     };
 };
 
+// Primitive operations on numbers: Name, symbol, and number of operands.
+// Comparisons produce 0 or 1 as a natural number.
+#define PRIM_OPS(f) \
+    f(ADD,  "+",   2) \
+    f(SUB,  "-",   2) \
+    f(MUL,  "*",   2) \
+    f(DIV,  "/",   2) \
+    f(REM,  "%",   2) \
+    f(AND,  "and", 2) \
+    f(OR,   "or",  2) \
+    f(XOR,  "xor", 2) \
+    f(SHL,  "shl", 2) \
+    f(SHR,  "shr", 2) \
+    f(EQ,   "==",  2) \
+    f(NE,   "!=",  2) \
+    f(LT,   "<",   2) \
+    f(GT,   ">",   2) \
+    f(LE,   "<=",  2) \
+    f(GE,   ">=",  2) \
+    f(NEG,  "-",   1) \
+    f(NOT,  "not", 1) \
+    f(CONV, "as",  1)
+
+enum prim_op {
+#define f(name, str, n) PRIM_##name,
+    PRIM_OPS(f)
+#undef f
+    PRIM_COUNT
+};
+
 struct vars {
     const node_t* vars;
     size_t count;
@@ -68,13 +99,21 @@ struct node {
         NODE_APP,
         NODE_LET,
         NODE_LETREC,
-        NODE_MATCH
+        NODE_MATCH,
+        NODE_PRIM,
+        NODE_ARRAY,
+        NODE_ELEMS,
+        NODE_INDEX,
+        NODE_UPDATE,
+        NODE_MAP,
+        NODE_FOLD
     } tag;
     struct loc loc;
     size_t depth;
     vars_t free_vars;
     vars_t bound_vars;
     node_t type;
+    node_t normal_type;  // Normal form of this type, filled lazily by `reduce_type`
     union {
         struct {
             struct mod* mod;
@@ -89,6 +128,7 @@ struct node {
         struct {
             const node_t* args;
             const label_t* labels;
+            const size_t* label_order; // Indices of the labels, sorted by address
             size_t arg_count;
         } record, prod, sum;
         struct {
@@ -97,8 +137,9 @@ struct node {
         } ext;
         struct {
             node_t val;
-            label_t label;
-            node_t elem;
+            const node_t* elems;
+            const label_t* labels;
+            size_t elem_count;
         } ins;
         struct {
             node_t var;
@@ -128,18 +169,74 @@ struct node {
             size_t pat_count;
             node_t arg;
         } match;
+        struct {
+            enum prim_op op;
+            const node_t* args;
+            size_t arg_count;
+        } prim;
+        struct {
+            node_t elem;
+            node_t dim;
+        } array;
+        struct {
+            const node_t* args;
+            size_t arg_count;
+        } elems;
+        struct {
+            node_t val;
+            node_t index;
+            node_t elem;
+        } index, update;
+        struct {
+            node_t fn;
+            node_t val;
+            node_t init;
+        } map, fold;
     };
 };
 
+struct mod_stats {
+    size_t replace_cache_hits;
+    size_t replace_cache_misses;
+    size_t reduce_cache_hits;
+    size_t reduce_cache_misses;
+    size_t node_count;
+};
+
 MAP(node_map, node_t, node_t)
 SET(node_set, node_t)
 VEC(node_vec, node_t)
 VEC(label_vec, label_t)
 
+// Thread-safe modules can be used by several threads at once, which is required by
+// `reduce_node_in_parallel`. Their tables are protected by a lock.
+// Modules created with MOD_DEFER_SIMPLIFY do not simplify expressions when they are
+// built (types excepted, as they are compared by pointer), until `simplify_module`
+// simplifies the final program once. Reduction always simplifies.
+enum mod_flags {
+    MOD_CANONICAL_BINDERS = 0x01,
+    MOD_THREAD_SAFE       = 0x02,
+    MOD_DEFER_SIMPLIFY    = 0x04
+};
+
+struct thread_pool;
+struct profile;
+
 mod_t new_mod(void);
+mod_t new_mod_with_flags(unsigned);
 void free_mod(mod_t);
 
 mod_t get_mod(node_t);
+const struct mod_stats* get_mod_stats(mod_t);
+struct profile* get_mod_profile(mod_t);
+void set_mod_profile(mod_t, struct profile*);
+void lock_mod(mod_t);
+void unlock_mod(mod_t);
+
+// Stops simplifying the expressions that are built, until the next call to `simplify_module`.
+void defer_simplification(mod_t);
+// Simplifies the given expression and its operands, and stops deferring simplification.
+node_t simplify_module(node_t);
 
 bool is_pat(node_t);
 bool is_trivial_pat(node_t);
@@ -149,15 +246,18 @@ vars_t new_vars(mod_t, const node_t*, size_t);
 vars_t union_vars(mod_t, vars_t, vars_t);
 vars_t intr_vars(mod_t, vars_t, vars_t);
 vars_t diff_vars(mod_t, vars_t, vars_t);
+vars_t union_free_vars(mod_t, vars_t, const node_t*, size_t);
 bool contains_vars(vars_t, vars_t);
 bool contains_var(vars_t, node_t);
 
 label_t new_label(mod_t, const char*, const struct loc*);
-size_t find_label(const label_t*, size_t, label_t);
 size_t find_label_in_node(node_t, label_t);
 
 node_t get_elem_type(node_t, label_t);
 
+// Returns the dimension of an array type as a number, or false if it is not a literal.
+bool get_array_dim(node_t, uintmax_t*);
+
 node_t new_uni(mod_t);
 node_t new_err(mod_t, node_t, const struct loc*);
 node_t new_untyped_err(mod_t, const struct loc*);
@@ -175,18 +275,54 @@ node_t new_prod(mod_t, const node_t*, const label_t*, size_t, const struct loc*)
 node_t new_arrow(mod_t, node_t, node_t, const struct loc*);
 node_t new_inj(mod_t, node_t, label_t, node_t, const struct loc*);
 node_t new_record(mod_t, const node_t*, const label_t*, size_t, const struct loc*);
-node_t new_ins(mod_t, node_t, label_t, node_t, const struct loc*);
+node_t new_ins(mod_t, node_t, const node_t*, const label_t*, size_t, const struct loc*);
 node_t new_ext(mod_t, node_t, label_t, const struct loc*);
 node_t new_abs(mod_t, node_t, node_t, const struct loc*);
 node_t new_app(mod_t, node_t, node_t, const struct loc*);
 node_t new_let(mod_t, const node_t*, const node_t*, size_t, node_t, const struct loc*);
 node_t new_letrec(mod_t, const node_t*, const node_t*, size_t, node_t, const struct loc*);
 node_t new_match(mod_t, const node_t*, const node_t*, size_t, node_t, const struct loc*);
+node_t new_prim(mod_t, enum prim_op, node_t, const node_t*, size_t, const struct loc*);
+node_t new_array(mod_t, node_t, node_t, const struct loc*);
+node_t new_elems(mod_t, node_t, const node_t*, size_t, const struct loc*);
+node_t new_index(mod_t, node_t, node_t, const struct loc*);
+node_t new_update(mod_t, node_t, node_t, node_t, const struct loc*);
+node_t new_map(mod_t, node_t, node_t, const struct loc*);
+node_t new_fold(mod_t, node_t, node_t, node_t, const struct loc*);
 
 node_t rebuild_node(node_t);
 node_t import_node(mod_t, node_t);
 node_t replace_var(node_t, node_t, node_t);
 node_t replace_vars(node_t, const node_t*, const node_t*, size_t);
+// Limits on the resources used by `reduce_node_with_budget`. Zero means no limit.
+// When a limit is reached, an error is reported and NULL is returned. Reductions that
+// nest too deeply to fit on the stack are stopped as well.
+struct budget {
+    size_t max_steps;   // Reduction steps and substitutions
+    size_t max_nodes;   // New nodes in the module
+    double max_seconds; // Wall-clock time
+};
+
+// Reduction strategies, from the cheapest to the most complete. Weak head normal forms
+// only reduce a term until its head (e.g. an abstraction or a constructor) is known.
+// Head normal forms also reduce the bodies of abstractions, and normal forms reduce
+// every subterm. Callers that only inspect the head of a term should use the first.
+enum reduce_strategy {
+    REDUCE_WHNF,
+    REDUCE_HNF,
+    REDUCE_NF
+};
+
 node_t reduce_node(node_t);
+node_t reduce_to_whnf(node_t);
+node_t reduce_node_with_strategy(node_t, enum reduce_strategy);
+node_t reduce_node_with_budget(node_t, const struct budget*, struct log*);
+node_t reduce_node_in_parallel(node_t, struct thread_pool*);
+// Reduces the node in a temporary module, so that the intermediate terms are freed
+// as soon as the reduction is over. Only the normal form is copied into the module
+// of the node. Reductions in the temporary module are not profiled. The budget is
+// applied as in `reduce_node_with_budget`, and may have no limits.
+node_t reduce_node_in_scratch(node_t, const struct budget*, struct log*);
+node_t reduce_type(node_t);
 
 #endif
@@ -0,0 +1,91 @@
+#ifndef IR_OPERANDS_H
+#define IR_OPERANDS_H
+
+#include <assert.h>
+
+#include "ir/node.h"
+
+/*
+ * Generic access to the operands of expressions, for passes that transform every
+ * sub-expression of a node in the same way. Types and binders are not operands.
+ */
+
+static inline bool is_type_node(node_t node) {
+    return node->tag == NODE_UNI || node->type->tag == NODE_STAR || node->type->tag == NODE_UNI;
+}
+
+static inline size_t get_operand_count(node_t node) {
+    // Types and binders are not operands: They are kept as they are
+    if (is_type_node(node))
+        return 0;
+    switch (node->tag) {
+        case NODE_RECORD: return node->record.arg_count;
+        case NODE_INS:    return node->ins.elem_count + 1;
+        case NODE_LET:
+        case NODE_LETREC: return node->let.var_count + 1;
+        case NODE_MATCH:  return node->match.pat_count + 1;
+        case NODE_PRIM:   return node->prim.arg_count;
+        case NODE_ELEMS:  return node->elems.arg_count;
+        case NODE_INJ:
+        case NODE_EXT:
+        case NODE_ABS:    return 1;
+        case NODE_APP:
+        case NODE_INDEX:
+        case NODE_MAP:    return 2;
+        case NODE_UPDATE:
+        case NODE_FOLD:   return 3;
+        default:          return 0;
+    }
+}
+
+static inline node_t get_operand(node_t node, size_t i) {
+    switch (node->tag) {
+        case NODE_RECORD: return node->record.args[i];
+        case NODE_INS:    return i == 0 ? node->ins.val : node->ins.elems[i - 1];
+        case NODE_LET:
+        case NODE_LETREC: return i < node->let.var_count ? node->let.vals[i] : node->let.body;
+        case NODE_MATCH:  return i == 0 ? node->match.arg : node->match.vals[i - 1];
+        case NODE_PRIM:   return node->prim.args[i];
+        case NODE_ELEMS:  return node->elems.args[i];
+        case NODE_INJ:    return node->inj.arg;
+        case NODE_EXT:    return node->ext.val;
+        case NODE_ABS:    return node->abs.body;
+        case NODE_APP:    return i == 0 ? node->app.left : node->app.right;
+        case NODE_INDEX:
+        case NODE_UPDATE: return i == 0 ? node->index.val : i == 1 ? node->index.index : node->update.elem;
+        case NODE_MAP:
+        case NODE_FOLD:   return i == 0 ? node->map.fn : i == 1 ? node->map.val : node->fold.init;
+        default:
+            assert(false && "invalid operand index");
+            return NULL;
+    }
+}
+
+static inline node_t rebuild_with_operands(mod_t mod, node_t node, const node_t* operands) {
+    struct node copy = *node;
+    switch (node->tag) {
+        case NODE_RECORD: copy.record.args = operands; break;
+        case NODE_INS:    copy.ins.val = operands[0]; copy.ins.elems = operands + 1; break;
+        case NODE_LET:
+        case NODE_LETREC: copy.let.vals = operands; copy.let.body = operands[node->let.var_count]; break;
+        case NODE_MATCH:  copy.match.arg = operands[0]; copy.match.vals = operands + 1; break;
+        case NODE_PRIM:   copy.prim.args = operands; break;
+        case NODE_ELEMS:  copy.elems.args = operands; break;
+        case NODE_INJ:    copy.inj.arg = operands[0]; break;
+        case NODE_EXT:    copy.ext.val = operands[0]; break;
+        case NODE_ABS:    copy.abs.body = operands[0]; break;
+        case NODE_APP:    copy.app.left = operands[0]; copy.app.right = operands[1]; break;
+        case NODE_UPDATE: copy.update.elem = operands[2];
+            // fallthrough
+        case NODE_INDEX:  copy.index.val = operands[0]; copy.index.index = operands[1]; break;
+        case NODE_FOLD:   copy.fold.init = operands[2];
+            // fallthrough
+        case NODE_MAP:    copy.map.fn = operands[0]; copy.map.val = operands[1]; break;
+        default:
+            assert(false && "invalid node tag");
+            break;
+    }
+    return import_node(mod, &copy);
+}
+
+#endif
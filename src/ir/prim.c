@@ -0,0 +1,212 @@
+#include <assert.h>
+
+#include "ir/prim.h"
+
+// Helpers -------------------------------------------------------------------------
+
+const char* get_prim_symbol(enum prim_op op) {
+    static const char* symbols[] = {
+#define f(name, str, n) str,
+        PRIM_OPS(f)
+#undef f
+    };
+    return symbols[op];
+}
+
+size_t get_prim_arity(enum prim_op op) {
+    static const size_t arities[] = {
+#define f(name, str, n) n,
+        PRIM_OPS(f)
+#undef f
+    };
+    return arities[op];
+}
+
+bool is_cmp_prim(enum prim_op op) {
+    return op >= PRIM_EQ && op <= PRIM_GE;
+}
+
+bool get_num_type(node_t type, struct num_type* num_type) {
+    if (type->tag == NODE_NAT) {
+        *num_type = (struct num_type) { .tag = NUM_NAT, .bitwidth = 64 };
+        return true;
+    }
+    if (type->tag != NODE_APP ||
+        type->app.right->tag != NODE_LIT ||
+        type->app.right->lit.tag != LIT_INT ||
+        (type->app.left->tag != NODE_INT && type->app.left->tag != NODE_FLOAT))
+        return false;
+    uintmax_t bitwidth = type->app.right->lit.int_val;
+    if (bitwidth == 0 || bitwidth > 64)
+        return false;
+    *num_type = (struct num_type) {
+        .tag = type->app.left->tag == NODE_INT ? NUM_INT : NUM_FLOAT,
+        .bitwidth = bitwidth
+    };
+    return true;
+}
+
+bool is_valid_prim(enum prim_op op, struct num_type type) {
+    switch (op) {
+        case PRIM_REM:
+        case PRIM_AND:
+        case PRIM_OR:
+        case PRIM_XOR:
+        case PRIM_SHL:
+        case PRIM_SHR:
+        case PRIM_NOT:
+            return type.tag != NUM_FLOAT;
+        case PRIM_NEG:
+            return type.tag != NUM_NAT;
+        default:
+            return true;
+    }
+}
+
+static inline uintmax_t mask_int(uintmax_t val, unsigned bitwidth) {
+    return bitwidth >= 64 ? val : val & ((UINTMAX_C(1) << bitwidth) - 1);
+}
+
+static inline intmax_t sign_extend(uintmax_t val, unsigned bitwidth) {
+    if (bitwidth >= 64)
+        return (intmax_t)val;
+    uintmax_t sign = UINTMAX_C(1) << (bitwidth - 1);
+    return (intmax_t)((val ^ sign) - sign);
+}
+
+static inline double round_float(double val, unsigned bitwidth) {
+    return bitwidth <= 32 ? (double)(float)val : val;
+}
+
+static inline struct lit make_int_lit(uintmax_t val, unsigned bitwidth) {
+    return (struct lit) { .tag = LIT_INT, .int_val = mask_int(val, bitwidth) };
+}
+
+static inline struct lit make_float_lit(double val, unsigned bitwidth) {
+    return (struct lit) { .tag = LIT_FLOAT, .float_val = round_float(val, bitwidth) };
+}
+
+// Evaluation ----------------------------------------------------------------------
+
+static inline uintmax_t float_to_int(double val, unsigned bitwidth) {
+    // Out-of-range values saturate, and NaN converts to zero
+    uintmax_t max = (UINTMAX_C(1) << (bitwidth - 1)) - 1;
+    double limit = (double)(UINTMAX_C(1) << (bitwidth - 1));
+    if (val != val)
+        return 0;
+    if (val >= limit)
+        return max;
+    if (val <= -limit)
+        return max + 1;
+    return (uintmax_t)(intmax_t)val;
+}
+
+static inline uintmax_t float_to_nat(double val) {
+    if (val != val || val <= 0)
+        return 0;
+    if (val >= 18446744073709551616.0)
+        return UINTMAX_MAX;
+    return (uintmax_t)val;
+}
+
+static inline struct lit eval_conv(struct num_type from, struct num_type to, const struct lit* arg) {
+    if (to.tag == NUM_FLOAT) {
+        double val =
+            from.tag == NUM_FLOAT ? arg->float_val :
+            from.tag == NUM_INT   ? (double)sign_extend(arg->int_val, from.bitwidth) :
+            (double)arg->int_val;
+        return make_float_lit(val, to.bitwidth);
+    }
+    uintmax_t val;
+    if (from.tag == NUM_FLOAT)
+        val = to.tag == NUM_INT ? float_to_int(arg->float_val, to.bitwidth) : float_to_nat(arg->float_val);
+    else if (from.tag == NUM_INT) {
+        intmax_t signed_val = sign_extend(arg->int_val, from.bitwidth);
+        val = to.tag == NUM_NAT && signed_val < 0 ? 0 : (uintmax_t)signed_val;
+    } else
+        val = arg->int_val;
+    return make_int_lit(val, to.bitwidth);
+}
+
+static inline struct lit eval_float_prim(enum prim_op op, unsigned bitwidth, double left, double right) {
+    switch (op) {
+        case PRIM_ADD: return make_float_lit(left + right, bitwidth);
+        case PRIM_SUB: return make_float_lit(left - right, bitwidth);
+        case PRIM_MUL: return make_float_lit(left * right, bitwidth);
+        case PRIM_DIV: return make_float_lit(left / right, bitwidth);
+        case PRIM_NEG: return make_float_lit(-left, bitwidth);
+        case PRIM_EQ:  return make_int_lit(left == right, 64);
+        case PRIM_NE:  return make_int_lit(left != right, 64);
+        case PRIM_LT:  return make_int_lit(left <  right, 64);
+        case PRIM_GT:  return make_int_lit(left >  right, 64);
+        case PRIM_LE:  return make_int_lit(left <= right, 64);
+        case PRIM_GE:  return make_int_lit(left >= right, 64);
+        default:
+            assert(false && "invalid floating-point primitive");
+            return make_float_lit(0, bitwidth);
+    }
+}
+
+static inline struct lit eval_int_prim(enum prim_op op, struct num_type type, uintmax_t left, uintmax_t right) {
+    bool is_signed = type.tag == NUM_INT;
+    unsigned bitwidth = type.bitwidth;
+    intmax_t signed_left  = is_signed ? sign_extend(left,  bitwidth) : 0;
+    intmax_t signed_right = is_signed ? sign_extend(right, bitwidth) : 0;
+    uintmax_t res = 0;
+    switch (op) {
+        case PRIM_ADD: res = left + right; break;
+        case PRIM_SUB: res = !is_signed && right > left ? 0 : left - right; break;
+        case PRIM_MUL: res = left * right; break;
+        case PRIM_DIV:
+            // Dividing by -1 is a negation, which avoids overflowing on the minimum value
+            if (right == 0)
+                res = 0;
+            else if (!is_signed)
+                res = left / right;
+            else
+                res = signed_right == -1 ? -left : (uintmax_t)(signed_left / signed_right);
+            break;
+        case PRIM_REM:
+            if (right == 0)
+                res = left;
+            else if (!is_signed)
+                res = left % right;
+            else
+                res = signed_right == -1 ? 0 : (uintmax_t)(signed_left % signed_right);
+            break;
+        case PRIM_AND: res = left & right; break;
+        case PRIM_OR:  res = left | right; break;
+        case PRIM_XOR: res = left ^ right; break;
+        case PRIM_SHL: res = right >= bitwidth ? 0 : left << right; break;
+        case PRIM_SHR:
+            if (!is_signed)
+                res = right >= bitwidth ? 0 : left >> right;
+            else
+                res = (uintmax_t)(right >= bitwidth ? (signed_left < 0 ? -1 : 0) : signed_left >> right);
+            break;
+        case PRIM_EQ: return make_int_lit(left == right, 64);
+        case PRIM_NE: return make_int_lit(left != right, 64);
+        case PRIM_LT: return make_int_lit(is_signed ? signed_left <  signed_right : left <  right, 64);
+        case PRIM_GT: return make_int_lit(is_signed ? signed_left >  signed_right : left >  right, 64);
+        case PRIM_LE: return make_int_lit(is_signed ? signed_left <= signed_right : left <= right, 64);
+        case PRIM_GE: return make_int_lit(is_signed ? signed_left >= signed_right : left >= right, 64);
+        case PRIM_NEG: res = is_signed ? -left : 0; break;
+        case PRIM_NOT: res = ~left; break;
+        default:
+            assert(false && "invalid integer primitive");
+            break;
+    }
+    return make_int_lit(res, bitwidth);
+}
+
+struct lit eval_prim(enum prim_op op, struct num_type arg_type, struct num_type res_type, const struct lit* args) {
+    if (op == PRIM_CONV)
+        return eval_conv(arg_type, res_type, &args[0]);
+    bool is_unary = get_prim_arity(op) == 1;
+    if (arg_type.tag == NUM_FLOAT) {
+        return eval_float_prim(op, arg_type.bitwidth,
+            args[0].float_val, is_unary ? 0 : args[1].float_val);
+    }
+    return eval_int_prim(op, arg_type,
+        args[0].int_val, is_unary ? 0 : args[1].int_val);
+}
@@ -0,0 +1,39 @@
+#ifndef IR_PRIM_H
+#define IR_PRIM_H
+
+#include "ir/node.h"
+
+/*
+ * Primitives operate on natural numbers, integers, and floating-point numbers.
+ * Natural numbers are 64-bit wide, and subtraction saturates at zero. Integers
+ * of bitwidth `n` are stored as their lowest `n` bits, and are interpreted as
+ * two's complement numbers for division, shifts, comparisons, and conversions.
+ * Floating-point numbers of bitwidth 32 or less are rounded to single precision
+ * after every operation. All operations are total: A division by zero returns
+ * zero, the remainder of a division by zero returns the dividend, and shifting
+ * by the bitwidth or more shifts out every bit.
+ */
+
+struct num_type {
+    enum {
+        NUM_NAT,
+        NUM_INT,
+        NUM_FLOAT
+    } tag;
+    unsigned bitwidth;
+};
+
+const char* get_prim_symbol(enum prim_op);
+size_t get_prim_arity(enum prim_op);
+bool is_cmp_prim(enum prim_op);
+
+// Returns true if the given (reduced) type is a number type.
+bool get_num_type(node_t, struct num_type*);
+
+// Returns true if the primitive accepts operands of the given type.
+bool is_valid_prim(enum prim_op, struct num_type);
+
+// Evaluates a primitive on literals of type `arg_type`, with a result of type `res_type`.
+struct lit eval_prim(enum prim_op, struct num_type arg_type, struct num_type res_type, const struct lit*);
+
+#endif
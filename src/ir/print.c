@@ -2,6 +2,7 @@
 
 #include "utils/utils.h"
 #include "ir/print.h"
+#include "ir/prim.h"
 
 #define PRINT_BUF_SIZE 256
 
@@ -42,6 +43,14 @@ static inline bool needs_parens(node_t node) {
     return node->tag != NODE_VAR && node->tag != NODE_LIT;
 }
 
+static inline void print_operand(struct format_out* out, node_t node) {
+    if (needs_parens(node))
+        format(out, "(", NULL);
+    print_node(out, node);
+    if (needs_parens(node))
+        format(out, ")", NULL);
+}
+
 static void print_exp_or_pat(struct format_out* out, node_t node, bool is_pat) {
     assert(node->type || node->tag == NODE_UNI);
     switch (node->tag) {
@@ -103,9 +112,14 @@ static void print_exp_or_pat(struct format_out* out, node_t node, bool is_pat) {
             format(out, ".%0:s", FORMAT_ARGS({ .s = node->ext.label->name }));
             break;
         case NODE_INS:
-            print_node(out, node->ext.val);
-            format(out, ".{ %0:s = ", FORMAT_ARGS({ .s = node->ins.label->name }));
-            print_node(out, node->ins.elem);
+            print_node(out, node->ins.val);
+            format(out, ".{ ", NULL);
+            for (size_t i = 0, n = node->ins.elem_count; i < n; ++i) {
+                format(out, "%0:s = ", FORMAT_ARGS({ .s = node->ins.labels[i]->name }));
+                print_node(out, node->ins.elems[i]);
+                if (i != n - 1)
+                    format(out, ", ", NULL);
+            }
             format(out, " }", NULL);
             break;
         case NODE_ARROW:
@@ -188,6 +202,63 @@ static void print_exp_or_pat(struct format_out* out, node_t node, bool is_pat) {
             if (node->match.pat_count > 1)
                 out->indent--;
             break;
+        case NODE_PRIM: {
+            const char* symbol = get_prim_symbol(node->prim.op);
+            if (node->prim.op == PRIM_CONV) {
+                print_operand(out, node->prim.args[0]);
+                format(out, " ", NULL);
+                print_keyword(out, symbol);
+                format(out, " ", NULL);
+                print_node(out, node->type);
+            } else if (node->prim.arg_count == 1) {
+                format(out, node->prim.op == PRIM_NOT ? "%0:s " : "%0:s", FORMAT_ARGS({ .s = symbol }));
+                print_operand(out, node->prim.args[0]);
+            } else {
+                print_operand(out, node->prim.args[0]);
+                format(out, " %0:s ", FORMAT_ARGS({ .s = symbol }));
+                print_operand(out, node->prim.args[1]);
+            }
+            break;
+        }
+        case NODE_ARRAY:
+            format(out, "[", NULL);
+            print_node(out, node->array.elem);
+            format(out, "; ", NULL);
+            print_node(out, node->array.dim);
+            format(out, "]", NULL);
+            break;
+        case NODE_ELEMS:
+            format(out, "[", NULL);
+            for (size_t i = 0, n = node->elems.arg_count; i < n; ++i) {
+                print_node(out, node->elems.args[i]);
+                if (i != n - 1)
+                    format(out, ", ", NULL);
+            }
+            format(out, "]", NULL);
+            break;
+        case NODE_INDEX:
+        case NODE_UPDATE:
+            print_node(out, node->index.val);
+            format(out, ".[", NULL);
+            print_node(out, node->index.index);
+            if (node->tag == NODE_UPDATE) {
+                format(out, " = ", NULL);
+                print_node(out, node->update.elem);
+            }
+            format(out, "]", NULL);
+            break;
+        case NODE_MAP:
+        case NODE_FOLD:
+            print_keyword(out, node->tag == NODE_MAP ? "map" : "fold");
+            format(out, " ", NULL);
+            print_operand(out, node->map.fn);
+            if (node->tag == NODE_FOLD) {
+                format(out, " ", NULL);
+                print_operand(out, node->fold.init);
+            }
+            format(out, " ", NULL);
+            print_operand(out, node->map.val);
+            break;
         default:
             assert(false && "invalid expression tag");
             break;
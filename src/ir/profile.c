@@ -0,0 +1,146 @@
+#include "utils/utils.h"
+#include "utils/buf.h"
+#include "utils/hash.h"
+#include "utils/map.h"
+#include "utils/vec.h"
+#include "utils/sort.h"
+#include "ir/profile.h"
+
+#define TAG_COUNT (NODE_FOLD + 1)
+
+struct site_key {
+    const char* file;
+    int row, col;
+};
+
+struct site {
+    struct site_key key;
+    size_t counts[PROFILE_EVENT_COUNT];
+};
+
+static inline uint32_t hash_site_key(const void* ptr) {
+    const struct site_key* key = ptr;
+    return hash_uint(hash_uint(hash_ptr(hash_init(), key->file), (uint32_t)key->row), (uint32_t)key->col);
+}
+
+static inline bool compare_site_key(const void* ptr1, const void* ptr2) {
+    const struct site_key* key1 = ptr1, *key2 = ptr2;
+    return key1->file == key2->file && key1->row == key2->row && key1->col == key2->col;
+}
+
+struct rule {
+    const char* name;
+    size_t count;
+};
+
+static inline bool is_site_hotter(const struct site* left, const struct site* right) {
+    return left->counts[PROFILE_BETA] > right->counts[PROFILE_BETA];
+}
+
+static inline bool is_rule_hotter(const struct rule* left, const struct rule* right) {
+    return left->count > right->count;
+}
+
+CUSTOM_MAP(site_indices, struct site_key, size_t, hash_site_key, compare_site_key)
+CUSTOM_SORT(sort_sites, struct site, is_site_hotter)
+CUSTOM_SORT(sort_rules, struct rule, is_rule_hotter)
+VEC(site_vec, struct site)
+
+struct profile {
+    struct site_indices site_indices;
+    struct site_vec sites;  // The first site collects the events outside of any function
+    size_t current_site;
+    size_t simplifications[TAG_COUNT];
+};
+
+static const char* rule_names[TAG_COUNT] = {
+    [NODE_EXT]    = "ext",
+    [NODE_INS]    = "ins",
+    [NODE_RECORD] = "record",
+    [NODE_LET]    = "let",
+    [NODE_LETREC] = "letrec",
+    [NODE_MATCH]  = "match",
+    [NODE_PRIM]   = "prim",
+    [NODE_INDEX]  = "index",
+    [NODE_UPDATE] = "update",
+    [NODE_MAP]    = "map",
+    [NODE_FOLD]   = "fold",
+    [NODE_ARROW]  = "arrow",
+    [NODE_ABS]    = "abs",
+    [NODE_BOT]    = "bot",
+    [NODE_TOP]    = "top"
+};
+
+struct profile* new_profile(void) {
+    struct profile* profile = xcalloc(1, sizeof(struct profile));
+    profile->site_indices = new_site_indices();
+    profile->sites = new_site_vec();
+    push_to_site_vec(&profile->sites, (struct site) { .key = { NULL, -1, -1 } });
+    return profile;
+}
+
+void free_profile(struct profile* profile) {
+    free_site_indices(&profile->site_indices);
+    free_site_vec(&profile->sites);
+    free(profile);
+}
+
+void enter_profiled_fn(struct profile* profile, node_t fn) {
+    struct site_key key = { fn->loc.file, fn->loc.begin.row, fn->loc.begin.col };
+    const size_t* index = find_in_site_indices(&profile->site_indices, key);
+    if (!index) {
+        insert_in_site_indices(&profile->site_indices, key, profile->sites.size);
+        push_to_site_vec(&profile->sites, (struct site) { .key = key });
+        profile->current_site = profile->sites.size - 1;
+    } else
+        profile->current_site = *index;
+    profile->sites.elems[profile->current_site].counts[PROFILE_BETA]++;
+}
+
+void record_profile_event(struct profile* profile, enum profile_event event) {
+    profile->sites.elems[profile->current_site].counts[event]++;
+}
+
+void record_simplification(struct profile* profile, node_t node) {
+    profile->simplifications[node->tag]++;
+}
+
+void print_profile(const struct profile* profile, size_t max_sites, FILE* fp) {
+    size_t totals[PROFILE_EVENT_COUNT] = { 0 };
+    struct site* sites = new_buf(struct site, profile->sites.size);
+    memcpy(sites, profile->sites.elems, sizeof(struct site) * profile->sites.size);
+    for (size_t i = 0, n = profile->sites.size; i < n; ++i) {
+        for (size_t j = 0; j < PROFILE_EVENT_COUNT; ++j)
+            totals[j] += sites[i].counts[j];
+    }
+    sort_sites(sites, profile->sites.size);
+
+    fprintf(fp, "profile:\n");
+#define f(name, str) fprintf(fp, "%10s", str);
+    PROFILE_EVENTS(f)
+#undef f
+    fprintf(fp, "  function\n");
+    for (size_t i = 0, n = profile->sites.size; i < n && i < max_sites; ++i) {
+        for (size_t j = 0; j < PROFILE_EVENT_COUNT; ++j)
+            fprintf(fp, "%10zu", sites[i].counts[j]);
+        if (sites[i].key.file)
+            fprintf(fp, "  %s(%d, %d)\n", sites[i].key.file, sites[i].key.row, sites[i].key.col);
+        else
+            fprintf(fp, "  %s\n", sites[i].key.row < 0 ? "<top level>" : "<unknown>");
+    }
+    for (size_t j = 0; j < PROFILE_EVENT_COUNT; ++j)
+        fprintf(fp, "%10zu", totals[j]);
+    fprintf(fp, "  total\n");
+    free_buf(sites);
+
+    struct rule rules[TAG_COUNT];
+    size_t rule_count = 0;
+    for (size_t i = 0; i < TAG_COUNT; ++i) {
+        if (profile->simplifications[i] > 0)
+            rules[rule_count++] = (struct rule) { rule_names[i], profile->simplifications[i] };
+    }
+    sort_rules(rules, rule_count);
+    fprintf(fp, "simplifications:\n");
+    for (size_t i = 0; i < rule_count; ++i)
+        fprintf(fp, "%10zu  %s\n", rules[i].count, rules[i].name);
+}
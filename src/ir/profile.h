@@ -0,0 +1,42 @@
+#ifndef IR_PROFILE_H
+#define IR_PROFILE_H
+
+#include <stdio.h>
+
+#include "ir/node.h"
+
+/*
+ * Profiles count the work done while a module evaluates expressions: Beta-reductions,
+ * substitutions, and node creations are attributed to the function that was applied
+ * last, identified by the location of its abstraction, while simplifications are
+ * counted per rule. Modules only record events when a profile is attached to them
+ * with `set_mod_profile`. Profiles are not thread-safe.
+ */
+
+#define PROFILE_EVENTS(f) \
+    f(BETA,    "beta") \
+    f(REPLACE, "replace") \
+    f(NODE,    "nodes")
+
+enum profile_event {
+#define f(name, str) PROFILE_##name,
+    PROFILE_EVENTS(f)
+#undef f
+    PROFILE_EVENT_COUNT
+};
+
+struct profile;
+
+struct profile* new_profile(void);
+void free_profile(struct profile*);
+
+// Records the application of a function, to which the following events are attributed.
+void enter_profiled_fn(struct profile*, node_t);
+void record_profile_event(struct profile*, enum profile_event);
+// Records a simplification of the given node by `simplify_node`.
+void record_simplification(struct profile*, node_t);
+
+// Prints the functions with the most beta-reductions, and the simplification rules.
+void print_profile(const struct profile*, size_t, FILE*);
+
+#endif
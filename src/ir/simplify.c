@@ -4,7 +4,11 @@
 #include "utils/utils.h"
 #include "utils/buf.h"
 #include "utils/map.h"
+#include "utils/vec.h"
+#include "utils/sort.h"
 #include "ir/node.h"
+#include "ir/prim.h"
+#include "ir/match.h"
 
 // Ext -----------------------------------------------------------------------------
 
@@ -23,18 +27,71 @@ static inline node_t simplify_ext(mod_t mod, node_t ext) {
 
 // Ins -----------------------------------------------------------------------------
 
+struct ins_elem {
+    label_t label;
+    node_t elem;
+};
+
+static inline bool is_ins_elem_less_than(const struct ins_elem* left, const struct ins_elem* right) {
+    return left->label < right->label;
+}
+
+CUSTOM_SORT(sort_ins_elems, struct ins_elem, is_ins_elem_less_than)
+
+static inline void get_sorted_ins_elems(node_t ins, struct ins_elem* ins_elems) {
+    for (size_t i = 0, n = ins->ins.elem_count; i < n; ++i)
+        ins_elems[i] = (struct ins_elem) { ins->ins.labels[i], ins->ins.elems[i] };
+    sort_ins_elems(ins_elems, ins->ins.elem_count);
+}
+
+static inline node_t merge_ins(mod_t mod, node_t outer, node_t inner) {
+    // Both insertions are sorted by label and merged in one pass. The elements of the
+    // outer insertion take precedence over those of the inner one.
+    size_t outer_count = outer->ins.elem_count, inner_count = inner->ins.elem_count;
+    struct ins_elem* outer_elems = new_buf(struct ins_elem, outer_count);
+    struct ins_elem* inner_elems = new_buf(struct ins_elem, inner_count);
+    get_sorted_ins_elems(outer, outer_elems);
+    get_sorted_ins_elems(inner, inner_elems);
+    size_t elem_count = 0;
+    node_t* elems = new_buf(node_t, outer_count + inner_count);
+    label_t* labels = new_buf(label_t, outer_count + inner_count);
+    for (size_t i = 0, j = 0; i < outer_count || j < inner_count; elem_count++) {
+        struct ins_elem ins_elem;
+        if (j == inner_count || (i < outer_count && outer_elems[i].label <= inner_elems[j].label)) {
+            if (j < inner_count && inner_elems[j].label == outer_elems[i].label)
+                j++;
+            ins_elem = outer_elems[i++];
+        } else
+            ins_elem = inner_elems[j++];
+        elems[elem_count] = ins_elem.elem;
+        labels[elem_count] = ins_elem.label;
+    }
+    node_t res = new_ins(mod, inner->ins.val, elems, labels, elem_count, &outer->loc);
+    free_buf(outer_elems);
+    free_buf(inner_elems);
+    free_buf(elems);
+    free_buf(labels);
+    return res;
+}
+
 static inline node_t simplify_ins(mod_t mod, node_t ins) {
-    if (ins->ins.val->tag == NODE_RECORD) {
-        node_t* args = new_buf(node_t, ins->ins.val->record.arg_count);
-        memcpy(args, ins->ins.val->record.args, sizeof(node_t) * ins->ins.val->record.arg_count);
-        size_t index = find_label_in_node(ins->ins.val, ins->ins.label);
-        assert(index != SIZE_MAX);
-        args[index] = ins->ins.elem;
-        node_t res = new_record(mod, args, ins->ins.val->record.labels, ins->ins.val->record.arg_count, &ins->loc);
+    node_t val = ins->ins.val;
+    if (val->tag == NODE_RECORD) {
+        // All the elements are inserted at once, so that the record is only copied once
+        node_t* args = new_buf(node_t, val->record.arg_count);
+        memcpy(args, val->record.args, sizeof(node_t) * val->record.arg_count);
+        for (size_t i = 0, n = ins->ins.elem_count; i < n; ++i) {
+            size_t index = find_label_in_node(val, ins->ins.labels[i]);
+            assert(index != SIZE_MAX);
+            args[index] = ins->ins.elems[i];
+        }
+        node_t res = new_record(mod, args, val->record.labels, val->record.arg_count, &ins->loc);
         free_buf(args);
         return res;
-    } else if (ins->type->tag == NODE_SUM) {
-        return new_inj(mod, ins->type, ins->ins.label, ins->ins.elem, &ins->loc);
+    } else if (reduce_type(ins->type)->tag == NODE_SUM) {
+        return new_inj(mod, ins->type, ins->ins.labels[0], ins->ins.elems[0], &ins->loc);
+    } else if (val->tag == NODE_INS) {
+        return merge_ins(mod, ins, val);
     }
     return ins;
 }
@@ -67,11 +124,9 @@ static inline node_t try_merge_let(mod_t mod, node_t outer_let, node_t inner_let
     node_t* outer_vars = new_buf(node_t, outer_let->let.var_count);
     node_t* outer_vals = new_buf(node_t, outer_let->let.var_count);
     size_t inner_count = 0, outer_count = 0;
+    vars_t inner_uses = union_free_vars(mod, new_vars(mod, NULL, 0), inner_let->let.vals, inner_let->let.var_count);
     for (size_t i = 0, n = outer_let->let.var_count; i < n; ++i) {
-        bool push_down = true;
-        for (size_t j = 0, m = inner_let->let.var_count; j < m && push_down; ++j)
-            push_down &= !contains_var(inner_let->let.vals[j]->free_vars, outer_let->let.vars[i]);
-        if (push_down) {
+        if (!contains_var(inner_uses, outer_let->let.vars[i])) {
             inner_vars[inner_count] = outer_let->let.vars[i];
             inner_vals[inner_count] = outer_let->let.vals[i];
             inner_count++;
@@ -86,7 +141,9 @@ static inline node_t try_merge_let(mod_t mod, node_t outer_let, node_t inner_let
         memcpy(inner_vars + inner_count, inner_let->let.vars, sizeof(node_t) * inner_let->let.var_count);
         inner_count += inner_let->let.var_count;
         inner_let = new_let(mod, inner_vars, inner_vals, inner_count, inner_let->let.body, &inner_let->loc);
-        outer_let = new_let(mod, outer_vars, outer_vals, outer_count, inner_let, &outer_let->loc);
+        outer_let = outer_count > 0
+            ? new_let(mod, outer_vars, outer_vals, outer_count, inner_let, &outer_let->loc)
+            : inner_let;
     } else
         outer_let = NULL;
     free_buf(inner_vars);
@@ -106,16 +163,20 @@ static inline node_t simplify_let(mod_t mod, node_t let) {
             return res;
     }
 
-    size_t var_count = 0;
+    size_t var_count = 0, alias_count = 0;
     node_t* vars = new_buf(node_t, let->let.var_count);
     node_t* vals = new_buf(node_t, let->let.var_count);
+    node_t* alias_vars = new_buf(node_t, let->let.var_count);
+    node_t* alias_vals = new_buf(node_t, let->let.var_count);
     node_t body = let->let.body;
     for (size_t i = 0, n = let->let.var_count; i < n; ++i) {
         // Only keep the variables that are referenced in the body
         if (contains_var(body->free_vars, let->let.vars[i])) {
             // Remove variables that are directly equal to another
             if (let->let.vals[i]->tag == NODE_VAR) {
-                body = replace_var(body, let->let.vars[i], let->let.vals[i]);
+                alias_vars[alias_count] = let->let.vars[i];
+                alias_vals[alias_count] = let->let.vals[i];
+                alias_count++;
             } else {
                 vars[var_count] = let->let.vars[i];
                 vals[var_count] = let->let.vals[i];
@@ -124,219 +185,240 @@ static inline node_t simplify_let(mod_t mod, node_t let) {
         }
     }
 
+    // Values cannot refer to the variables of the let-expression,
+    // so that all the aliases can be replaced at once.
+    if (alias_count > 0)
+        body = replace_vars(body, alias_vars, alias_vals, alias_count);
     node_t res = var_count != let->let.var_count
         ? new_let(mod, vars, vals, var_count, body, &let->loc)
         : let;
     free_buf(vars);
     free_buf(vals);
+    free_buf(alias_vars);
+    free_buf(alias_vals);
     return res;
 }
 
 // Letrec --------------------------------------------------------------------------
 
-struct var_binding {
-    node_t  val;
-    vars_t uses;
+// Bindings are the vertices of the dependency graph of the letrec-expression, in which
+// strongly connected components are found with Tarjan's algorithm. Components are
+// complete only after all the components they depend on, which gives a valid order
+// for the resulting let- and letrec-expressions.
+struct letrec_binding {
+    size_t index;
+    size_t low_link;
+    size_t first_dep;
+    size_t dep_count;
+    size_t group;
+    bool on_stack;
 };
 
-MAP(bindings, node_t, struct var_binding)
+struct letrec_call {
+    size_t binding;
+    size_t next_dep;
+};
 
-static node_t split_letrec_var(mod_t, node_t, node_t, node_t, struct node_set*, struct bindings*);
+MAP(var_indices, node_t, size_t)
+VEC(index_vec, size_t)
+VEC(letrec_call_vec, struct letrec_call)
+
+struct letrec_graph {
+    struct letrec_binding* bindings;
+    struct index_vec deps;
+    struct index_vec stack;
+    struct index_vec order;           // Bindings, sorted by component in order of completion
+    struct index_vec component_ends;  // End of each component in `order`
+    struct letrec_call_vec calls;
+    size_t next_index;
+};
 
-static inline node_t split_letrec_vars(
-    mod_t mod, node_t body, node_t letrec, vars_t vars,
-    struct node_set* done, struct bindings* bindings)
-{
-    for (size_t i = 0, n = vars->count; i < n; ++i)
-        body = split_letrec_var(mod, body, letrec, vars->vars[i], done, bindings);
-    return body;
+static inline void push_letrec_call(struct letrec_graph* graph, size_t binding) {
+    graph->bindings[binding].index = graph->bindings[binding].low_link = graph->next_index++;
+    graph->bindings[binding].on_stack = true;
+    push_to_index_vec(&graph->stack, binding);
+    push_to_letrec_call_vec(&graph->calls, (struct letrec_call) { .binding = binding, .next_dep = 0 });
 }
 
-static node_t split_letrec_var(
-    mod_t mod, node_t body, node_t letrec, node_t var,
-    struct node_set* done, struct bindings* bindings)
-{
-    if (!insert_in_node_set(done, var))
-        return body;
-    struct var_binding* binding = find_in_bindings(bindings, var);
-    if (contains_var(binding->uses, var)) {
-        // If this binding is recursive, find all the members
-        // of the cycle and group them together in a letrec.
-        node_t* rec_vars = new_buf(node_t, binding->uses->count);
-        node_t* rec_vals = new_buf(node_t, binding->uses->count);
-        size_t rec_count = 1;
-        rec_vars[0] = var;
-        rec_vals[0] = binding->val;
-        for (size_t i = 0, n = binding->uses->count; i < n; ++i) {
-            node_t other_var = binding->uses->vars[i];
-            if (other_var == var)
-                continue;
-            struct var_binding* other_binding = find_in_bindings(bindings, other_var);
-            if (contains_var(other_binding->uses, var) && insert_in_node_set(done, other_var)) {
-                rec_vars[rec_count] = other_var;
-                rec_vals[rec_count] = other_binding->val;
-                rec_count++;
-            }
+static inline void find_components(struct letrec_graph* graph, size_t root) {
+    // Non-recursive version of Tarjan's algorithm, to support long chains of bindings
+    push_letrec_call(graph, root);
+    while (graph->calls.size > 0) {
+        struct letrec_call* call = &graph->calls.elems[graph->calls.size - 1];
+        struct letrec_binding* binding = &graph->bindings[call->binding];
+        if (call->next_dep < binding->dep_count) {
+            size_t dep = graph->deps.elems[binding->first_dep + call->next_dep++];
+            if (graph->bindings[dep].index == SIZE_MAX)
+                push_letrec_call(graph, dep);
+            else if (graph->bindings[dep].on_stack && graph->bindings[dep].index < binding->low_link)
+                binding->low_link = graph->bindings[dep].index;
+            continue;
+        }
+
+        size_t index = call->binding;
+        pop_from_letrec_call_vec(&graph->calls);
+        if (graph->calls.size > 0) {
+            struct letrec_binding* parent = &graph->bindings[graph->calls.elems[graph->calls.size - 1].binding];
+            if (binding->low_link < parent->low_link)
+                parent->low_link = binding->low_link;
+        }
+        if (binding->low_link == binding->index) {
+            size_t member;
+            do {
+                member = pop_from_index_vec(&graph->stack);
+                graph->bindings[member].on_stack = false;
+                push_to_index_vec(&graph->order, member);
+            } while (member != index);
+            push_to_index_vec(&graph->component_ends, graph->order.size);
         }
-        if (letrec->letrec.var_count != rec_count) {
-            body = split_letrec_vars(mod, body, letrec, binding->uses, done, bindings);
-            // Generate a letrec-expression for the cycle
-            body = new_letrec(mod, rec_vars, rec_vals, rec_count, body, &letrec->loc);
-        } else
-            body = letrec;
-        free_buf(rec_vars);
-        free_buf(rec_vals);
-    } else {
-        body = split_letrec_vars(mod, body, letrec, binding->uses, done, bindings);
-        // Generate a non-recursive let-expression for this variable
-        body = new_let(mod, &var, (node_t*)&binding->val, 1, body, &letrec->loc);
     }
-    return body;
 }
 
-static inline vars_t transitive_uses(mod_t mod, vars_t uses, struct bindings* bindings) {
-    vars_t old_uses = uses;
-    for (size_t j = 0, m = old_uses->count; j < m; ++j)
-        uses = union_vars(mod, uses, find_in_bindings(bindings, old_uses->vars[j])->uses);
-    return uses;
+static inline bool is_recursive_component(const struct letrec_graph* graph, size_t begin, size_t end) {
+    if (end - begin > 1)
+        return true;
+    const struct letrec_binding* binding = &graph->bindings[graph->order.elems[begin]];
+    for (size_t i = 0; i < binding->dep_count; ++i) {
+        if (graph->deps.elems[binding->first_dep + i] == graph->order.elems[begin])
+            return true;
+    }
+    return false;
 }
 
-static inline node_t simplify_letrec(mod_t mod, node_t letrec) {
-    struct bindings bindings = new_bindings();
-
-    // Create initial bindings with empty uses
-    for (size_t i = 0, n = letrec->letrec.var_count; i < n; ++i) {
-        insert_in_bindings(&bindings,
-            letrec->letrec.vars[i],
-            (struct var_binding) {
-                .val = letrec->letrec.vals[i],
-                .uses = new_vars(mod, NULL, 0)
-            });
-    }
-    vars_t letrec_vars = new_vars(mod, letrec->letrec.vars, letrec->letrec.var_count);
-
-    // We start by getting the direct uses (i.e. for a given variable, the variables of the
-    // letrec-expression that use it in their definition). For the letrec-expression
-    // (letrec ((#1 : nat) (#2 : nat) (#3 : nat)) (#2 #3 #1) #1)
-    // we get:
-    // #1 "used by" { #3 }
-    // #2 "used by" { #1 }
-    // #3 "used by" { #2 }
-    for (size_t i = 0, n = letrec->letrec.var_count; i < n; ++i) {
-        vars_t used_vars = intr_vars(mod, letrec->letrec.vals[i]->free_vars, letrec_vars);
-        for (size_t j = 0, m = used_vars->count; j < m; ++j) {
-            struct var_binding* binding = find_in_bindings(&bindings, used_vars->vars[j]);
-            binding->uses = union_vars(mod, binding->uses, new_vars(mod, &letrec->letrec.vars[i], 1));
-        }
+static inline bool depends_on_group(const struct letrec_graph* graph, size_t binding, size_t group) {
+    const struct letrec_binding* letrec_binding = &graph->bindings[binding];
+    for (size_t i = 0; i < letrec_binding->dep_count; ++i) {
+        if (graph->bindings[graph->deps.elems[letrec_binding->first_dep + i]].group == group)
+            return true;
     }
+    return false;
+}
 
-    // For each binding, add the uses of its uses. This is basically
-    // computing the fix point of the transitive_uses() function.
-    // The result is a map from variable to the variables that use it.
-    // For the letrec-expression above, we would get at the end of the process:
-    // #1 "used by transitively" { #1, #2, #3 }
-    // #2 "used by transitively" { #1, #2, #3 }
-    // #3 "used by transitively" { #1, #2, #3 }
-    bool todo;
-    do {
-        todo = false;
-        FORALL_IN_MAP(&bindings, node_t, key, struct var_binding, binding, {
-            vars_t uses = transitive_uses(mod, binding->uses, &bindings);
-            todo |= binding->uses != uses;
-            binding->uses = uses;
-        })
-    } while(todo);
-
-    // We need to compute the variables that are needed (transitively) to compute the body.
-    vars_t body_vars = intr_vars(mod, letrec->letrec.body->free_vars, letrec_vars);
-    do {
-        vars_t old_vars = body_vars;
-        for (size_t i = 0, n = old_vars->count; i < n; ++i) {
-            body_vars = union_vars(mod, body_vars,
-                intr_vars(mod, find_in_bindings(&bindings, old_vars->vars[i])->val->free_vars, letrec_vars));
-        }
-        todo = body_vars != old_vars;
-    } while (todo);
-
-    // Now, we can simplify the letrec expression, by breaking individual cycles into
-    // several letrec-expressions and separating non-recursive bindings into distinct,
-    // regular (non-recursive) let-expressions.
-    struct node_set done = new_node_set();
-    node_t res = split_letrec_vars(mod, letrec->letrec.body, letrec, body_vars, &done, &bindings);
-    free_bindings(&bindings);
-    free_node_set(&done);
+static inline node_t new_letrec_group(
+    mod_t mod, node_t letrec, const struct letrec_graph* graph,
+    size_t begin, size_t end, bool is_rec, node_t body)
+{
+    node_t* vars = new_buf(node_t, end - begin);
+    node_t* vals = new_buf(node_t, end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        vars[i - begin] = letrec->letrec.vars[graph->order.elems[i]];
+        vals[i - begin] = letrec->letrec.vals[graph->order.elems[i]];
+    }
+    node_t res = is_rec
+        ? new_letrec(mod, vars, vals, end - begin, body, &letrec->loc)
+        : new_let(mod, vars, vals, end - begin, body, &letrec->loc);
+    free_buf(vars);
+    free_buf(vals);
     return res;
 }
 
-// Match ---------------------------------------------------------------------------
+static inline node_t simplify_letrec(mod_t mod, node_t letrec) {
+    size_t var_count = letrec->letrec.var_count;
+    struct var_indices var_indices = new_var_indices();
+    for (size_t i = 0; i < var_count; ++i)
+        insert_in_var_indices(&var_indices, letrec->letrec.vars[i], i);
+
+    // Build the dependency graph: There is an edge from a binding to every
+    // variable of the letrec-expression that is used in its definition.
+    struct letrec_graph graph = {
+        .bindings = new_buf(struct letrec_binding, var_count),
+        .deps = new_index_vec(),
+        .stack = new_index_vec(),
+        .order = new_index_vec(),
+        .component_ends = new_index_vec(),
+        .calls = new_letrec_call_vec()
+    };
+    for (size_t i = 0; i < var_count; ++i) {
+        vars_t free_vars = letrec->letrec.vals[i]->free_vars;
+        graph.bindings[i] = (struct letrec_binding) {
+            .index = SIZE_MAX,
+            .group = SIZE_MAX,
+            .first_dep = graph.deps.size
+        };
+        for (size_t j = 0, n = free_vars->count; j < n; ++j) {
+            const size_t* dep = find_in_var_indices(&var_indices, free_vars->vars[j]);
+            if (dep)
+                push_to_index_vec(&graph.deps, *dep);
+        }
+        graph.bindings[i].dep_count = graph.deps.size - graph.bindings[i].first_dep;
+    }
 
-enum match_res {
-    NO_MATCH, MATCH, MAY_MATCH
-};
+    // Only the bindings that are (transitively) needed by the body are visited
+    vars_t body_vars = letrec->letrec.body->free_vars;
+    for (size_t i = 0, n = body_vars->count; i < n; ++i) {
+        const size_t* root = find_in_var_indices(&var_indices, body_vars->vars[i]);
+        if (root && graph.bindings[*root].index == SIZE_MAX)
+            find_components(&graph, *root);
+    }
 
-static inline enum match_res try_match(mod_t mod, node_t pat, node_t arg, struct node_vec* vars, struct node_vec* vals) {
-    // Try to match the pattern against a value. If the match succeeds, return MATCH
-    // and record the value associated with each pattern variable in the map.
-    switch (pat->tag) {
-        case NODE_LIT:
-            return arg == pat ? MATCH : (arg->tag == NODE_LIT ? NO_MATCH : MAY_MATCH);
-        case NODE_VAR:
-            if (!is_unbound_var(pat)) {
-                push_to_node_vec(vars, pat);
-                push_to_node_vec(vals, arg);
-            }
-            return MATCH;
-        case NODE_RECORD:
-            assert(arg->type->tag == NODE_PROD && arg->type->prod.arg_count == pat->record.arg_count);
-            for (size_t i = 0, n = pat->record.arg_count; i < n; ++i) {
-                node_t elem = new_ext(mod, arg, pat->record.labels[i], &pat->record.args[i]->loc);
-                enum match_res match_res = try_match(mod, pat->record.args[i], elem, vars, vals);
-                if (match_res == NO_MATCH)
-                    return NO_MATCH;
-                if (match_res == MAY_MATCH)
-                    return MAY_MATCH;
-            }
-            return MATCH;
-        case NODE_INJ:
-            if (arg->tag == NODE_INJ) {
-                if (arg->inj.label != pat->inj.label)
-                    return NO_MATCH;
-                return try_match(mod, pat->inj.arg, arg->inj.arg, vars, vals);
-            }
-            return MAY_MATCH;
-        default:
-            assert(false && "invalid pattern");
-            return MAY_MATCH;
+    // Split the bindings into groups: Each recursive component forms a letrec-expression,
+    // and consecutive non-recursive bindings are grouped in let-expressions, as long as
+    // they do not depend on each other.
+    struct index_vec group_ends = new_index_vec();
+    struct index_vec rec_groups = new_index_vec();
+    for (size_t i = 0, begin = 0, n = graph.component_ends.size; i < n; ++i) {
+        size_t end = graph.component_ends.elems[i];
+        bool is_rec = is_recursive_component(&graph, begin, end);
+        bool is_new_group =
+            is_rec || group_ends.size == 0 ||
+            rec_groups.elems[group_ends.size - 1] ||
+            depends_on_group(&graph, graph.order.elems[begin], group_ends.size - 1);
+        if (is_new_group) {
+            push_to_index_vec(&group_ends, end);
+            push_to_index_vec(&rec_groups, is_rec);
+        } else
+            group_ends.elems[group_ends.size - 1] = end;
+        for (size_t j = begin; j < end; ++j)
+            graph.bindings[graph.order.elems[j]].group = group_ends.size - 1;
+        begin = end;
+    }
+
+    node_t res = letrec;
+    if (group_ends.size != 1 || !rec_groups.elems[0] || group_ends.elems[0] != var_count) {
+        // Generate the expressions from the innermost one
+        res = letrec->letrec.body;
+        for (size_t i = group_ends.size; i-- > 0;) {
+            size_t begin = i > 0 ? group_ends.elems[i - 1] : 0;
+            res = new_letrec_group(mod, letrec, &graph, begin, group_ends.elems[i], rec_groups.elems[i], res);
+        }
     }
+
+    free_index_vec(&group_ends);
+    free_index_vec(&rec_groups);
+    free_buf(graph.bindings);
+    free_index_vec(&graph.deps);
+    free_index_vec(&graph.stack);
+    free_index_vec(&graph.order);
+    free_index_vec(&graph.component_ends);
+    free_letrec_call_vec(&graph.calls);
+    free_var_indices(&var_indices);
+    return res;
 }
 
+// Match ---------------------------------------------------------------------------
+
 static inline node_t simplify_match(mod_t mod, node_t match) {
-    // Try to execute the match expression.
+    // Try to execute the match expression, using the decision tree of its patterns
     node_t vars_buf[16];
     node_t vals_buf[16];
     struct node_vec vars = new_node_vec_on_stack(ARRAY_SIZE(vars_buf), vars_buf);
     struct node_vec vals = new_node_vec_on_stack(ARRAY_SIZE(vals_buf), vals_buf);
+    const struct match_tree* tree = get_match_tree(mod, match->match.pats, match->match.pat_count);
+    size_t case_index = 0;
     node_t res = NULL;
-    for (size_t i = 0, n = match->match.pat_count; i < n; ++i) {
-        clear_node_vec(&vars);
-        clear_node_vec(&vals);
-        enum match_res match_res = try_match(mod, match->match.pats[i], match->match.arg, &vars, &vals);
-        assert(vars.size == vals.size);
-        switch (match_res) {
-            case NO_MATCH:
-                // If all the cases are guaranteed not to match the argument,
-                // return a bottom value.
-                if (i == n - 1)
-                    res = new_bot(mod, match->type, &match->loc);
-                continue;
-            case MATCH:
-                res = replace_vars(match->match.vals[i], vars.elems, vals.elems, vars.size);
-                // fallthrough
-            case MAY_MATCH:
-                goto end;
-        }
+    switch (run_match_tree(tree, match->match.arg, &case_index, &vars, &vals)) {
+        case NO_MATCH:
+            // If all the cases are guaranteed not to match the argument,
+            // return a bottom value.
+            res = new_bot(mod, match->type, &match->loc);
+            break;
+        case MATCH:
+            assert(vars.size == vals.size);
+            res = replace_vars(match->match.vals[case_index], vars.elems, vals.elems, vars.size);
+            break;
+        case MAY_MATCH:
+            break;
     }
-end:
     free_node_vec(&vars);
     free_node_vec(&vals);
     // If the match expression could be executed, return the result
@@ -352,6 +434,84 @@ end:
     return match;
 }
 
+// Prim ----------------------------------------------------------------------------
+
+static inline node_t simplify_prim(mod_t mod, node_t prim) {
+    // Constant-fold primitives whose operands are all literals
+    struct lit args[2];
+    assert(prim->prim.arg_count <= ARRAY_SIZE(args));
+    for (size_t i = 0, n = prim->prim.arg_count; i < n; ++i) {
+        if (prim->prim.args[i]->tag != NODE_LIT)
+            return prim;
+        args[i] = prim->prim.args[i]->lit;
+    }
+    struct num_type arg_type, res_type;
+    bool ok =
+        get_num_type(reduce_type(prim->prim.args[0]->type), &arg_type) &&
+        get_num_type(reduce_type(prim->type), &res_type);
+    if (!ok)
+        return prim;
+    struct lit res = eval_prim(prim->prim.op, arg_type, res_type, args);
+    return new_lit(mod, prim->type, &res, &prim->loc);
+}
+
+// Arrays --------------------------------------------------------------------------
+
+static inline bool is_in_bounds(node_t array, node_t index) {
+    uintmax_t dim;
+    node_t type = reduce_type(array->type);
+    return
+        index->tag == NODE_LIT && type->tag == NODE_ARRAY &&
+        get_array_dim(type, &dim) && index->lit.int_val < dim;
+}
+
+static inline node_t simplify_index(mod_t mod, node_t index) {
+    node_t val = index->index.val;
+    if (val->tag == NODE_BOT)
+        return new_bot(mod, index->type, &index->loc);
+    // An out-of-bounds update is the bottom value, so the updated element can only be
+    // read back when the index is known to be in bounds
+    if (val->tag == NODE_UPDATE &&
+        val->update.index == index->index.index &&
+        is_in_bounds(val, index->index.index))
+        return val->update.elem;
+    if (val->tag == NODE_ELEMS && index->index.index->tag == NODE_LIT) {
+        // Out-of-bounds accesses produce the bottom value
+        uintmax_t i = index->index.index->lit.int_val;
+        return i < val->elems.arg_count
+            ? val->elems.args[i]
+            : new_bot(mod, index->type, &index->loc);
+    }
+    return index;
+}
+
+static inline node_t simplify_update(mod_t mod, node_t update) {
+    node_t val = update->update.val;
+    if (val->tag == NODE_BOT)
+        return val;
+    if (val->tag == NODE_UPDATE && val->update.index == update->update.index)
+        return new_update(mod, val->update.val, update->update.index, update->update.elem, &update->loc);
+    if (val->tag == NODE_ELEMS && update->update.index->tag == NODE_LIT) {
+        uintmax_t i = update->update.index->lit.int_val;
+        if (i >= val->elems.arg_count)
+            return new_bot(mod, update->type, &update->loc);
+        node_t* args = new_buf(node_t, val->elems.arg_count);
+        memcpy(args, val->elems.args, sizeof(node_t) * val->elems.arg_count);
+        args[i] = update->update.elem;
+        node_t res = new_elems(mod, val->type->array.elem, args, val->elems.arg_count, &update->loc);
+        free_buf(args);
+        return res;
+    }
+    return update;
+}
+
+static inline node_t simplify_bulk_op(mod_t mod, node_t node) {
+    // Bulk operations are strict in the array
+    if (node->map.val->tag == NODE_BOT)
+        return new_bot(mod, node->type, &node->loc);
+    return node;
+}
+
 // Simplify ------------------------------------------------------------------------
 
 node_t simplify_node(mod_t mod, node_t node) {
@@ -368,6 +528,15 @@ node_t simplify_node(mod_t mod, node_t node) {
             return simplify_letrec(mod, node);
         case NODE_MATCH:
             return simplify_match(mod, node);
+        case NODE_PRIM:
+            return simplify_prim(mod, node);
+        case NODE_INDEX:
+            return simplify_index(mod, node);
+        case NODE_UPDATE:
+            return simplify_update(mod, node);
+        case NODE_MAP:
+        case NODE_FOLD:
+            return simplify_bulk_op(mod, node);
         case NODE_ARROW:
             // If the codomain of an arrow does not depend on its variable, mark the variable as unbound
             if (!is_unbound_var(node->arrow.var) && !contains_var(node->arrow.codom->free_vars, node->arrow.var))
@@ -0,0 +1,222 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "utils/utils.h"
+#include "utils/buf.h"
+#include "utils/map.h"
+#include "utils/vec.h"
+#include "ir/specialize.h"
+#include "ir/operands.h"
+
+// Recursive functions called with ever-changing closed arguments (e.g. a counter)
+// would otherwise be unrolled forever.
+#define MAX_COPIES 128
+#define LABEL_SIZE 256
+
+// Functions bound by the enclosing letrec-expressions
+struct fn_info {
+    node_t val;
+    size_t group;
+};
+
+// Copies that are added to a letrec-expression
+struct copy_group {
+    struct node_vec vars;
+    struct node_vec vals;
+};
+
+MAP(fn_infos, node_t, struct fn_info)
+VEC(copy_group_vec, struct copy_group)
+
+struct specializer {
+    mod_t mod;
+    struct fn_infos fns;
+    struct copy_group_vec groups;
+    struct node_map copies;     // Partial applications to the variable of their copy
+    struct node_map rewritten;
+    size_t copy_count;
+};
+
+static node_t specialize(struct specializer*, node_t);
+
+static inline bool is_static_arg(node_t arg) {
+    return arg->free_vars->count == 0;
+}
+
+static inline node_t specialize_operands(struct specializer* specializer, node_t node) {
+    size_t operand_count = get_operand_count(node);
+    if (operand_count == 0)
+        return node;
+    bool has_changed = false;
+    node_t* operands = new_buf(node_t, operand_count);
+    for (size_t i = 0; i < operand_count; ++i) {
+        operands[i] = specialize(specializer, get_operand(node, i));
+        has_changed |= operands[i] != get_operand(node, i);
+    }
+    node_t res = has_changed ? rebuild_with_operands(specializer->mod, node, operands) : node;
+    free_buf(operands);
+    return res;
+}
+
+static inline void make_copy_name(char* name, node_t fn, const node_t* args, size_t arg_count) {
+    // Copies are named after their arguments, so that the same arguments always give
+    // the same variable. Arguments other than literals are named by their address.
+    int len = snprintf(name, LABEL_SIZE, "%s", fn->var.label->name);
+    for (size_t i = 0; i < arg_count && len < LABEL_SIZE; ++i) {
+        char* end = name + len;
+        size_t size = LABEL_SIZE - len;
+        if (args[i]->tag == NODE_LIT && args[i]->lit.tag == LIT_INT)
+            len += snprintf(end, size, ".%ju", args[i]->lit.int_val);
+        else if (args[i]->tag == NODE_LIT)
+            len += snprintf(end, size, ".%g", args[i]->lit.float_val);
+        else
+            len += snprintf(end, size, ".%"PRIxPTR, (uintptr_t)args[i]);
+    }
+}
+
+static inline node_t new_copy(
+    struct specializer* specializer, node_t fn, const struct fn_info* fn_info,
+    node_t partial_app, const node_t* args, size_t arg_count)
+{
+    mod_t mod = specializer->mod;
+    char name[LABEL_SIZE];
+    make_copy_name(name, fn, args, arg_count);
+    node_t var = new_var(mod, partial_app->type, new_label(mod, name, &fn->loc), &fn->loc);
+    insert_in_node_map(&specializer->copies, partial_app, var);
+    specializer->copy_count++;
+
+    size_t var_count = 0;
+    node_t val = fn_info->val;
+    node_t* vars = new_buf(node_t, arg_count);
+    node_t* vals = new_buf(node_t, arg_count);
+    for (size_t i = 0; i < arg_count; ++i, val = val->abs.body) {
+        if (!is_unbound_var(val->abs.var)) {
+            vars[var_count] = val->abs.var;
+            vals[var_count] = args[i];
+            var_count++;
+        }
+    }
+    val = specialize(specializer, replace_vars(val, vars, vals, var_count));
+    free_buf(vars);
+    free_buf(vals);
+
+    struct copy_group* group = &specializer->groups.elems[fn_info->group];
+    push_to_node_vec(&group->vars, var);
+    push_to_node_vec(&group->vals, val);
+    return var;
+}
+
+static inline node_t specialize_app(struct specializer* specializer, node_t app) {
+    // Applications are decomposed into the function and its arguments, from the last one
+    struct node_vec apps = new_node_vec();
+    node_t fn = app;
+    for (; fn->tag == NODE_APP; fn = fn->app.left)
+        push_to_node_vec(&apps, fn);
+
+    // Only the leading static arguments of the function are substituted. The information
+    // about the function is copied, as the map may grow when the copy is specialized.
+    const struct fn_info* found = fn->tag == NODE_VAR ? find_in_fn_infos(&specializer->fns, fn) : NULL;
+    struct fn_info fn_info = found ? *found : (struct fn_info) { NULL, 0 };
+    size_t static_count = 0;
+    if (found) {
+        node_t val = fn_info.val;
+        for (size_t i = apps.size; i-- > 0 && val->tag == NODE_ABS && is_static_arg(apps.elems[i]->app.right); val = val->abs.body)
+            static_count++;
+    }
+
+    node_t res = NULL;
+    if (static_count > 0) {
+        node_t partial_app = apps.elems[apps.size - static_count];
+        node_t* copy = find_in_node_map(&specializer->copies, partial_app);
+        if (copy)
+            res = *copy;
+        else if (specializer->copy_count < MAX_COPIES) {
+            node_t* args = new_buf(node_t, static_count);
+            for (size_t i = 0; i < static_count; ++i)
+                args[i] = apps.elems[apps.size - 1 - i]->app.right;
+            res = new_copy(specializer, fn, &fn_info, partial_app, args, static_count);
+            free_buf(args);
+        }
+    }
+    if (res) {
+        for (size_t i = apps.size - static_count; i-- > 0;)
+            res = new_app(specializer->mod, res, specialize(specializer, apps.elems[i]->app.right), &apps.elems[i]->loc);
+    } else
+        res = specialize_operands(specializer, app);
+    free_node_vec(&apps);
+    return res;
+}
+
+static inline node_t specialize_letrec(struct specializer* specializer, node_t letrec) {
+    size_t group = specializer->groups.size;
+    push_to_copy_group_vec(&specializer->groups, (struct copy_group) {
+        .vars = new_node_vec(),
+        .vals = new_node_vec()
+    });
+    size_t var_count = letrec->letrec.var_count;
+    for (size_t i = 0; i < var_count; ++i)
+        insert_in_fn_infos(&specializer->fns, letrec->letrec.vars[i], (struct fn_info) { letrec->letrec.vals[i], group });
+
+    struct node_vec vars = new_node_vec();
+    struct node_vec vals = new_node_vec();
+    bool has_changed = false;
+    for (size_t i = 0; i < var_count; ++i) {
+        push_to_node_vec(&vars, letrec->letrec.vars[i]);
+        push_to_node_vec(&vals, specialize(specializer, letrec->letrec.vals[i]));
+        has_changed |= vals.elems[i] != letrec->letrec.vals[i];
+    }
+    node_t body = specialize(specializer, letrec->letrec.body);
+    has_changed |= body != letrec->letrec.body;
+
+    // The copies are only known once the whole expression has been specialized
+    struct copy_group* copies = &specializer->groups.elems[group];
+    for (size_t i = 0; i < copies->vars.size; ++i) {
+        push_to_node_vec(&vars, copies->vars.elems[i]);
+        push_to_node_vec(&vals, copies->vals.elems[i]);
+    }
+    has_changed |= copies->vars.size > 0;
+    node_t res = has_changed
+        ? new_letrec(specializer->mod, vars.elems, vals.elems, vars.size, body, &letrec->loc)
+        : letrec;
+    free_node_vec(&copies->vars);
+    free_node_vec(&copies->vals);
+    specializer->groups.size--;
+    free_node_vec(&vars);
+    free_node_vec(&vals);
+    return res;
+}
+
+static node_t specialize(struct specializer* specializer, node_t node) {
+    if (is_type_node(node))
+        return node;
+    node_t* found = find_in_node_map(&specializer->rewritten, node);
+    if (found)
+        return *found;
+    node_t res;
+    if (node->tag == NODE_LETREC)
+        res = specialize_letrec(specializer, node);
+    else if (node->tag == NODE_APP)
+        res = specialize_app(specializer, node);
+    else
+        res = specialize_operands(specializer, node);
+    insert_in_node_map(&specializer->rewritten, node, res);
+    return res;
+}
+
+node_t specialize_node(node_t node) {
+    struct specializer specializer = {
+        .mod = get_mod(node),
+        .fns = new_fn_infos(),
+        .groups = new_copy_group_vec(),
+        .copies = new_node_map(),
+        .rewritten = new_node_map(),
+        .copy_count = 0
+    };
+    node_t res = specialize(&specializer, node);
+    free_fn_infos(&specializer.fns);
+    free_copy_group_vec(&specializer.groups);
+    free_node_map(&specializer.copies);
+    free_node_map(&specializer.rewritten);
+    return res;
+}
@@ -0,0 +1,18 @@
+#ifndef IR_SPECIALIZE_H
+#define IR_SPECIALIZE_H
+
+#include "ir/node.h"
+
+/*
+ * Specialization of functions bound by letrec-expressions. When such a function is
+ * applied to arguments that are closed (literals, types, or closed records, for
+ * instance), a copy of the function in which these arguments are substituted is
+ * added to the letrec-expression, and the call is rewritten to use it. Copies are
+ * identified by the partial application they replace, which is hash-consed: Calls
+ * with the same arguments share the same copy, including the recursive calls made
+ * by the copy itself.
+ */
+
+node_t specialize_node(node_t);
+
+#endif
@@ -28,6 +28,12 @@ struct ast {
         AST_RECORD,
         AST_PROD,
         AST_ARRAY,
+        AST_ELEMS,
+        AST_INDEX,
+        AST_UPDATE,
+        AST_MAP,
+        AST_FOLD,
+        AST_PRIM,
         AST_ERR
     } tag;
     struct loc loc;
@@ -73,11 +79,29 @@ struct ast {
             struct ast* elem;
             struct ast* dim;
         } array;
+        struct {
+            struct ast* args;
+        } elems;
+        struct {
+            struct ast* val;
+            struct ast* index;
+            struct ast* elem;
+        } index, update;
+        struct {
+            struct ast* fn;
+            struct ast* init;
+            struct ast* val;
+        } map, fold;
         struct {
             struct ast* arg;
             struct ast* pats;
             struct ast* vals;
         } match;
+        struct {
+            enum prim_op op;
+            struct ast* args;
+            struct ast* type;
+        } prim;
         struct ident ident;
     };
 };
@@ -133,6 +133,28 @@ static void bind_exp(struct binder* binder, struct ast* ast) {
             for (struct ast* arg = ast->record.args; arg; arg = arg->next)
                 bind_exp(binder, arg);
             break;
+        case AST_ARRAY:
+            bind_exp(binder, ast->array.elem);
+            bind_exp(binder, ast->array.dim);
+            break;
+        case AST_ELEMS:
+            for (struct ast* arg = ast->elems.args; arg; arg = arg->next)
+                bind_exp(binder, arg);
+            break;
+        case AST_INDEX:
+        case AST_UPDATE:
+            bind_exp(binder, ast->index.val);
+            bind_exp(binder, ast->index.index);
+            if (ast->tag == AST_UPDATE)
+                bind_exp(binder, ast->update.elem);
+            break;
+        case AST_MAP:
+        case AST_FOLD:
+            bind_exp(binder, ast->map.fn);
+            if (ast->tag == AST_FOLD)
+                bind_exp(binder, ast->fold.init);
+            bind_exp(binder, ast->map.val);
+            break;
         case AST_IDENT:
             ast->ident.to = find_ident(binder, &ast->loc, ast->ident.name);
             break;
@@ -140,6 +162,12 @@ static void bind_exp(struct binder* binder, struct ast* ast) {
             bind_exp(binder, ast->app.left);
             bind_exp(binder, ast->app.right);
             break;
+        case AST_PRIM:
+            for (struct ast* arg = ast->prim.args; arg; arg = arg->next)
+                bind_exp(binder, arg);
+            if (ast->prim.type)
+                bind_exp(binder, ast->prim.type);
+            break;
         default:
             assert(false && "invalid AST node tag");
             // fallthrough
@@ -2,6 +2,7 @@
 #include "utils/buf.h"
 #include "utils/format.h"
 #include "ir/node.h"
+#include "ir/prim.h"
 
 #define LABEL_BUF_SIZE 20
 
@@ -54,8 +55,109 @@ static inline node_t get_var_for_param(struct emitter* emitter, node_t type, str
     return get_fresh_var(emitter, type, "param", &param->loc);
 }
 
+static inline bool is_valid_operand_type(struct emitter* emitter, struct ast* ast, enum prim_op op, node_t type) {
+    struct num_type num_type;
+    if (get_num_type(reduce_node(type), &num_type) && is_valid_prim(op, num_type))
+        return true;
+    log_error(emitter->log, &ast->loc,
+        "invalid operand type '%0:e' for operator '%1:s'",
+        FORMAT_ARGS({ .n = type }, { .s = get_prim_symbol(op) }));
+    return false;
+}
+
+static inline bool is_const_exp(struct ast* ast) {
+    // Constant expressions are made of literals and arithmetic operators
+    if (ast->tag == AST_LIT)
+        return true;
+    if (ast->tag != AST_PRIM || ast->prim.op == PRIM_CONV || is_cmp_prim(ast->prim.op))
+        return false;
+    for (struct ast* arg = ast->prim.args; arg; arg = arg->next) {
+        if (!is_const_exp(arg))
+            return false;
+    }
+    return true;
+}
+
+static inline node_t expect_type(struct emitter* emitter, struct ast* ast, const char* expected, node_t type) {
+    log_error(emitter->log, &ast->loc,
+        "expected %0:s, but got '%1:e'",
+        FORMAT_ARGS({ .s = expected }, { .n = type }));
+    return new_err(emitter->mod, new_star(emitter->mod), &ast->loc);
+}
+
+static inline node_t infer_array_type(struct emitter* emitter, struct ast* ast) {
+    node_t type = reduce_node(infer_exp(emitter, ast));
+    return type->tag == NODE_ARRAY ? type : expect_type(emitter, ast, "array type", type);
+}
+
+static inline node_t infer_fn_type(struct emitter* emitter, struct ast* ast) {
+    // Bulk operations can only apply functions whose result type does not depend on their argument
+    node_t type = reduce_node(infer_exp(emitter, ast));
+    return type->tag == NODE_ARROW && is_unbound_var(type->arrow.var)
+        ? type : expect_type(emitter, ast, "non-dependent function type", type);
+}
+
+static inline bool is_same_type(struct emitter* emitter, struct ast* ast, node_t expected_type, node_t type) {
+    if (reduce_node(expected_type) == reduce_node(type))
+        return true;
+    log_error(emitter->log, &ast->loc,
+        "expected type '%0:e', but got '%1:e'",
+        FORMAT_ARGS({ .n = expected_type }, { .n = type }));
+    return false;
+}
+
 // Inference and checking ----------------------------------------------------------
 
+static inline node_t infer_bulk_op(struct emitter* emitter, struct ast* ast) {
+    node_t fn_type = infer_fn_type(emitter, ast->map.fn);
+    node_t array_type = infer_array_type(emitter, ast->map.val);
+    if (fn_type->tag != NODE_ARROW || array_type->tag != NODE_ARRAY)
+        return new_err(emitter->mod, new_star(emitter->mod), &ast->loc);
+    if (ast->tag == AST_MAP) {
+        is_same_type(emitter, ast->map.fn, array_type->array.elem, fn_type->arrow.var->type);
+        return new_array(emitter->mod, fn_type->arrow.codom, array_type->array.dim, &ast->loc);
+    }
+
+    // The function takes the accumulator first, and then the element
+    node_t acc_type = fn_type->arrow.var->type;
+    check_exp(emitter, ast->fold.init, acc_type);
+    node_t step_type = reduce_node(fn_type->arrow.codom);
+    if (step_type->tag != NODE_ARROW || !is_unbound_var(step_type->arrow.var))
+        return expect_type(emitter, ast->fold.fn, "function of two arguments", fn_type);
+    is_same_type(emitter, ast->fold.fn, array_type->array.elem, step_type->arrow.var->type);
+    is_same_type(emitter, ast->fold.fn, acc_type, step_type->arrow.codom);
+    return acc_type;
+}
+
+static inline node_t infer_prim(struct emitter* emitter, struct ast* ast) {
+    // Constant operands take the type of the other operand, if any
+    struct ast* left = ast->prim.args, *right = left->next;
+    node_t arg_type;
+    if (right && is_const_exp(left) && !is_const_exp(right)) {
+        arg_type = infer_exp(emitter, right);
+        check_exp(emitter, left, arg_type);
+    } else {
+        arg_type = infer_exp(emitter, left);
+        if (right)
+            check_exp(emitter, right, arg_type);
+    }
+
+    if (!is_valid_operand_type(emitter, left, ast->prim.op, arg_type))
+        return arg_type;
+    if (is_cmp_prim(ast->prim.op))
+        return new_nat(emitter->mod);
+    if (ast->prim.op == PRIM_CONV) {
+        struct num_type num_type;
+        node_t type = emit_exp(emitter, ast->prim.type);
+        if (!get_num_type(reduce_node(type), &num_type)) {
+            log_error(emitter->log, &ast->prim.type->loc,
+                "invalid conversion to '%0:e'", FORMAT_ARGS({ .n = type }));
+        }
+        return type;
+    }
+    return arg_type;
+}
+
 static inline node_t infer_pat(struct emitter* emitter, struct ast* pat, struct ast* exp) {
     // TODO: Be a bit more clever for tuples/records
     return check_exp(emitter, pat, infer_exp(emitter, exp));
@@ -75,8 +177,18 @@ static node_t infer_exp(struct emitter* emitter, struct ast* ast) {
                 new_star(emitter->mod), NULL);
         case AST_LET:
         case AST_LETREC:
-            for (struct ast* var = ast->let.vars, *val = ast->let.vals; var; var = var->next, val = val->next)
-                infer_pat(emitter, var, val);
+            // Recursive bindings must be annotated, since values may refer to them.
+            // Annotated values are checked, so that they need not be inferable (e.g. `[]`).
+            if (ast->tag == AST_LETREC) {
+                for (struct ast* var = ast->let.vars; var; var = var->next)
+                    infer_exp(emitter, var);
+            }
+            for (struct ast* var = ast->let.vars, *val = ast->let.vals; var; var = var->next, val = val->next) {
+                if (ast->tag == AST_LETREC || var->tag == AST_ANNOT)
+                    check_exp(emitter, val, infer_exp(emitter, var));
+                else
+                    infer_pat(emitter, var, val);
+            }
             for (struct ast* var = ast->let.vars; var; var = var->next)
                 emit_pat(emitter, var);
             return ast->type = infer_exp(emitter, ast->let.body); 
@@ -119,6 +231,34 @@ static node_t infer_exp(struct emitter* emitter, struct ast* ast) {
             label_t elem_label = new_label(emitter->mod, ast->ext.elem->ident.name, &ast->ext.elem->loc);
             return ast->type = get_elem_type(val_type, elem_label);
         }
+        case AST_ARRAY:
+            infer_exp(emitter, ast->array.elem);
+            check_exp(emitter, ast->array.dim, new_nat(emitter->mod));
+            return ast->type = new_star(emitter->mod);
+        case AST_ELEMS: {
+            if (!ast->elems.args)
+                return cannot_infer(emitter, ast, "empty array");
+            node_t elem_type = infer_exp(emitter, ast->elems.args);
+            for (struct ast* arg = ast->elems.args->next; arg; arg = arg->next)
+                check_exp(emitter, arg, elem_type);
+            node_t dim = new_lit(emitter->mod, new_nat(emitter->mod),
+                &(struct lit) { .tag = LIT_INT, .int_val = get_ast_list_length(ast->elems.args) }, &ast->loc);
+            return ast->type = new_array(emitter->mod, elem_type, dim, &ast->loc);
+        }
+        case AST_INDEX:
+        case AST_UPDATE: {
+            node_t array_type = infer_array_type(emitter, ast->index.val);
+            check_exp(emitter, ast->index.index, new_nat(emitter->mod));
+            if (array_type->tag != NODE_ARRAY)
+                return ast->type = array_type;
+            if (ast->tag == AST_INDEX)
+                return ast->type = array_type->array.elem;
+            check_exp(emitter, ast->update.elem, array_type->array.elem);
+            return ast->type = infer_exp(emitter, ast->update.val);
+        }
+        case AST_MAP:
+        case AST_FOLD:
+            return ast->type = infer_bulk_op(emitter, ast);
         case AST_ARROW: {
             infer_exp(emitter, ast->arrow.dom);
             return ast->type = infer_exp(emitter, ast->arrow.codom);
@@ -144,6 +284,8 @@ static node_t infer_exp(struct emitter* emitter, struct ast* ast) {
                     &(struct lit) { .tag = LIT_INT, .int_val = 64 }, &ast->loc);
                 return ast->type = new_app(emitter->mod, new_float(emitter->mod), max_bitwidth, &ast->loc);
             }
+        case AST_PRIM:
+            return ast->type = infer_prim(emitter, ast);
         case AST_APP: {
             node_t left_type  = infer_exp(emitter, ast->app.left);
             node_t right_type = infer_exp(emitter, ast->app.right);
@@ -163,7 +305,47 @@ static node_t check_exp(struct emitter* emitter, struct ast* ast, node_t expecte
     switch (ast->tag) {
         case AST_IDENT:
             return ast->type = expected_type;
-        default: {
+        case AST_LIT: {
+            // Literals can also be integers or floating-point numbers of any bitwidth
+            struct num_type num_type;
+            if (get_num_type(reduce_node(expected_type), &num_type) &&
+                (num_type.tag == NUM_FLOAT || (num_type.tag == NUM_INT && ast->lit.tag == LIT_INT)))
+            {
+                struct num_type lit_type = ast->lit.tag == LIT_INT
+                    ? (struct num_type) { .tag = NUM_NAT,   .bitwidth = 64 }
+                    : (struct num_type) { .tag = NUM_FLOAT, .bitwidth = 64 };
+                ast->lit = eval_prim(PRIM_CONV, lit_type, num_type, &ast->lit);
+                return ast->type = expected_type;
+            }
+            goto infer;
+        }
+        case AST_ELEMS: {
+            // Empty array literals can only be checked
+            node_t array_type = reduce_node(expected_type);
+            uintmax_t dim;
+            if (array_type->tag != NODE_ARRAY)
+                goto infer;
+            size_t arg_count = 0;
+            for (struct ast* arg = ast->elems.args; arg; arg = arg->next, arg_count++)
+                check_exp(emitter, arg, array_type->array.elem);
+            if (get_array_dim(array_type, &dim) && dim != arg_count) {
+                log_error(emitter->log, &ast->loc,
+                    "expected %0:u array element(s), but got %1:u",
+                    FORMAT_ARGS({ .u = dim }, { .u = arg_count }));
+                return new_err(emitter->mod, expected_type, &ast->loc);
+            }
+            return ast->type = expected_type;
+        }
+        case AST_PRIM:
+            // Constant expressions are checked against the expected type
+            if (is_const_exp(ast) && is_valid_operand_type(emitter, ast, ast->prim.op, expected_type)) {
+                for (struct ast* arg = ast->prim.args; arg; arg = arg->next)
+                    check_exp(emitter, arg, expected_type);
+                return ast->type = expected_type;
+            }
+            // fallthrough
+        default:
+        infer: {
             node_t type = infer_exp(emitter, ast);
             if (type != expected_type) {
                 log_error(emitter->log, &ast->loc,
@@ -274,14 +456,20 @@ static node_t emit_exp(struct emitter* emitter, struct ast* ast) {
             return ast->node = new_ext(emitter->mod, emit_exp(emitter, ast->ext.val), elem_label, &ast->loc);
         }
         case AST_INS: {
-            node_t node = emit_exp(emitter, ast->ins.val);
+            node_t val = emit_exp(emitter, ast->ins.val);
+            size_t elem_count = get_ast_list_length(ast->ins.record->record.args);
+            node_t* elems = new_buf(node_t, elem_count);
+            label_t* labels = new_buf(label_t, elem_count);
+            size_t i = 0;
             for (struct ast* arg = ast->ins.record->record.args, *field = ast->ins.record->record.fields;
-                 arg; arg = arg->next, field = field->next)
+                 arg; arg = arg->next, field = field->next, i++)
             {
-                node = new_ins(emitter->mod, node,
-                    new_label(emitter->mod, field->ident.name, &field->loc),
-                    emit_exp(emitter, arg), &arg->loc);
+                elems[i] = emit_exp(emitter, arg);
+                labels[i] = new_label(emitter->mod, field->ident.name, &field->loc);
             }
+            node_t node = new_ins(emitter->mod, val, elems, labels, elem_count, &ast->loc);
+            free_buf(elems);
+            free_buf(labels);
             return ast->node = node;
         }
         case AST_PROD:
@@ -315,6 +503,46 @@ static node_t emit_exp(struct emitter* emitter, struct ast* ast) {
             node_t right = emit_exp(emitter, ast->app.right);
             return ast->node = new_app(emitter->mod, left, right, &ast->loc);
         }
+        case AST_ARRAY: {
+            node_t elem = emit_exp(emitter, ast->array.elem);
+            node_t dim = emit_exp(emitter, ast->array.dim);
+            return ast->node = new_array(emitter->mod, elem, dim, &ast->loc);
+        }
+        case AST_ELEMS: {
+            size_t arg_count = get_ast_list_length(ast->elems.args);
+            node_t* args = new_buf(node_t, arg_count);
+            size_t i = 0;
+            for (struct ast* arg = ast->elems.args; arg; arg = arg->next, i++)
+                args[i] = emit_exp(emitter, arg);
+            node_t elems = new_elems(emitter->mod, reduce_node(ast->type)->array.elem, args, arg_count, &ast->loc);
+            free_buf(args);
+            return ast->node = elems;
+        }
+        case AST_INDEX:
+            return ast->node = new_index(emitter->mod,
+                emit_exp(emitter, ast->index.val),
+                emit_exp(emitter, ast->index.index), &ast->loc);
+        case AST_UPDATE:
+            return ast->node = new_update(emitter->mod,
+                emit_exp(emitter, ast->update.val),
+                emit_exp(emitter, ast->update.index),
+                emit_exp(emitter, ast->update.elem), &ast->loc);
+        case AST_MAP:
+            return ast->node = new_map(emitter->mod,
+                emit_exp(emitter, ast->map.fn),
+                emit_exp(emitter, ast->map.val), &ast->loc);
+        case AST_FOLD:
+            return ast->node = new_fold(emitter->mod,
+                emit_exp(emitter, ast->fold.fn),
+                emit_exp(emitter, ast->fold.init),
+                emit_exp(emitter, ast->fold.val), &ast->loc);
+        case AST_PRIM: {
+            node_t args[2];
+            size_t arg_count = 0;
+            for (struct ast* arg = ast->prim.args; arg; arg = arg->next)
+                args[arg_count++] = emit_exp(emitter, arg);
+            return ast->node = new_prim(emitter->mod, ast->prim.op, ast->type, args, arg_count, &ast->loc);
+        }
         default:
             assert(false && "invalid AST node type");
             return NULL;
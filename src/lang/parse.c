@@ -19,6 +19,10 @@
     f(RBRACKET, "]") \
     f(LANGLE, "<") \
     f(RANGLE, ">") \
+    f(LE, "<=") \
+    f(GE, ">=") \
+    f(EQEQ, "==") \
+    f(NE, "!=") \
     f(THINARROW, "->") \
     f(FATARROW, "=>") \
     f(DOT, ".") \
@@ -28,6 +32,8 @@
     f(PLUS, "+") \
     f(MINUS, "-") \
     f(STAR, "*") \
+    f(SLASH, "/") \
+    f(PERCENT, "%") \
     f(VBAR, "|") \
     f(BACKSLASH, "\\") \
     f(EQ, "=")
@@ -43,7 +49,16 @@
     f(LET, "let") \
     f(LETREC, "letrec") \
     f(MATCH, "match") \
-    f(WITH, "with")
+    f(WITH, "with") \
+    f(AND, "and") \
+    f(OR, "or") \
+    f(XOR, "xor") \
+    f(NOT, "not") \
+    f(SHL, "shl") \
+    f(SHR, "shr") \
+    f(AS, "as") \
+    f(MAP, "map") \
+    f(FOLD, "fold")
 
 #define SPECIAL(f) \
     f(IDENT, "identifier") \
@@ -51,6 +66,25 @@
     f(ERR, "error") \
     f(EOF, "end-of-file")
 
+// Binary operators: Token, primitive, and precedence (higher binds tighter)
+#define BINARY_OPS(f) \
+    f(OR,      OR,  1) \
+    f(XOR,     XOR, 2) \
+    f(AND,     AND, 3) \
+    f(EQEQ,    EQ,  4) \
+    f(NE,      NE,  4) \
+    f(LANGLE,  LT,  5) \
+    f(RANGLE,  GT,  5) \
+    f(LE,      LE,  5) \
+    f(GE,      GE,  5) \
+    f(SHL,     SHL, 6) \
+    f(SHR,     SHR, 6) \
+    f(PLUS,    ADD, 7) \
+    f(MINUS,   SUB, 7) \
+    f(STAR,    MUL, 8) \
+    f(SLASH,   DIV, 8) \
+    f(PERCENT, REM, 8)
+
 #define TOKENS(f) \
     SYMBOLS(f) \
     KEYWORDS(f) \
@@ -149,6 +183,28 @@ static inline struct tok lex(struct lexer* lexer) {
         if (accept_char(lexer, ','))  return make_tok(lexer, &begin, TOK_COMMA);
         if (accept_char(lexer, '\\')) return make_tok(lexer, &begin, TOK_BACKSLASH);
         if (accept_char(lexer, '|'))  return make_tok(lexer, &begin, TOK_VBAR);
+        if (accept_char(lexer, '+'))  return make_tok(lexer, &begin, TOK_PLUS);
+        if (accept_char(lexer, '*'))  return make_tok(lexer, &begin, TOK_STAR);
+        if (accept_char(lexer, '/'))  return make_tok(lexer, &begin, TOK_SLASH);
+        if (accept_char(lexer, '%'))  return make_tok(lexer, &begin, TOK_PERCENT);
+
+        if (accept_char(lexer, '<')) {
+            if (accept_char(lexer, '='))
+                return make_tok(lexer, &begin, TOK_LE);
+            return make_tok(lexer, &begin, TOK_LANGLE);
+        }
+
+        if (accept_char(lexer, '>')) {
+            if (accept_char(lexer, '='))
+                return make_tok(lexer, &begin, TOK_GE);
+            return make_tok(lexer, &begin, TOK_RANGLE);
+        }
+
+        if (accept_char(lexer, '!')) {
+            if (accept_char(lexer, '='))
+                return make_tok(lexer, &begin, TOK_NE);
+            goto error;
+        }
 
         if (accept_char(lexer, '-')) {
             if (accept_char(lexer, '>'))
@@ -159,6 +215,8 @@ static inline struct tok lex(struct lexer* lexer) {
         if (accept_char(lexer, '=')) {
             if (accept_char(lexer, '>'))
                 return make_tok(lexer, &begin, TOK_FATARROW);
+            if (accept_char(lexer, '='))
+                return make_tok(lexer, &begin, TOK_EQEQ);
             return make_tok(lexer, &begin, TOK_EQ);
         }
 
@@ -197,7 +255,7 @@ static inline struct tok lex(struct lexer* lexer) {
                         eat_char(lexer);
                 }
                 exp = accept_char(lexer, 'p') || accept_char(lexer, 'P');
-            } else if (accept_char(lexer, '0')) {
+            } else if (lexer->pos.ptr + 1 != lexer->end && lexer->pos.ptr[0] == '0' && isdigit(lexer->pos.ptr[1])) {
                 // Octal integer literal
                 base = 8;
                 while (lexer->pos.ptr != lexer->end && *lexer->pos.ptr >= '0' && *lexer->pos.ptr <= '7')
@@ -219,10 +277,14 @@ static inline struct tok lex(struct lexer* lexer) {
             }
             struct tok tok = make_tok(lexer, &begin, TOK_LIT);
             COPY_STR(str, begin.ptr, lexer->pos.ptr)
-            if (exp || dot)
+            errno = 0;
+            if (exp || dot) {
+                tok.lit.tag = LIT_FLOAT;
                 tok.lit.float_val = strtod(str, NULL);
-            else
+            } else {
+                tok.lit.tag = LIT_INT;
                 tok.lit.int_val = strtoumax(str, NULL, base);
+            }
             bool ok = errno == 0;
             free_buf(str);
             if (!ok) goto error;
@@ -294,6 +356,7 @@ static inline void expect_tok(struct parser* parser, unsigned tag) {
 // Parsing functions ---------------------------------------------------------------
 
 static struct ast* parse_exp(struct parser*);
+static struct ast* parse_app_exp(struct parser*);
 static struct ast* parse_pat(struct parser*);
 
 static struct ast* parse_err(struct parser* parser, const char* msg) {
@@ -465,6 +528,59 @@ static struct ast* parse_pat(struct parser* parser) {
     }
 }
 
+static struct ast* parse_array_or_elems(struct parser* parser) {
+    // Array types are written `[T; n]`, and array literals `[a, b, c]`
+    struct pos begin = parser->ahead->loc.begin;
+    eat_tok(parser, TOK_LBRACKET);
+    if (accept_tok(parser, TOK_RBRACKET))
+        return make_ast(parser, &begin, &(struct ast) { .tag = AST_ELEMS });
+    struct ast* first = parse_exp(parser);
+    if (accept_tok(parser, TOK_SEMICOLON)) {
+        struct ast* dim = parse_exp(parser);
+        expect_tok(parser, TOK_RBRACKET);
+        return make_ast(parser, &begin, &(struct ast) {
+            .tag = AST_ARRAY,
+            .array = {
+                .elem = first,
+                .dim = dim
+            }
+        });
+    }
+    struct ast* args = first, **next_arg = &first->next;
+    while (accept_tok(parser, TOK_COMMA))
+        next_arg = append_ast(next_arg, parse_exp(parser));
+    expect_tok(parser, TOK_RBRACKET);
+    return make_ast(parser, &begin, &(struct ast) { .tag = AST_ELEMS, .elems.args = args });
+}
+
+static struct ast* parse_basic_exp(struct parser*);
+static struct ast* parse_suffix_exp(struct parser*, struct ast*);
+
+static struct ast* parse_operand(struct parser* parser) {
+    // Operands of `map` and `fold` may be projected, but not applied
+    struct ast* ast = parse_basic_exp(parser);
+    while (parser->ahead->tag == TOK_DOT)
+        ast = parse_suffix_exp(parser, ast);
+    return ast;
+}
+
+static struct ast* parse_map_or_fold(struct parser* parser) {
+    struct pos begin = parser->ahead->loc.begin;
+    bool is_fold = parser->ahead->tag == TOK_FOLD;
+    eat_tok(parser, is_fold ? TOK_FOLD : TOK_MAP);
+    struct ast* fn = parse_operand(parser);
+    struct ast* init = is_fold ? parse_operand(parser) : NULL;
+    struct ast* val = parse_operand(parser);
+    return make_ast(parser, &begin, &(struct ast) {
+        .tag = is_fold ? AST_FOLD : AST_MAP,
+        .map = {
+            .fn = fn,
+            .init = init,
+            .val = val
+        }
+    });
+}
+
 static struct ast* parse_basic_exp(struct parser* parser) {
     struct pos begin = parser->ahead->loc.begin;
     switch (parser->ahead->tag) {
@@ -489,6 +605,11 @@ static struct ast* parse_basic_exp(struct parser* parser) {
         }
         case TOK_LBRACE:
             return parse_prod_or_record(parser, parser->ahead[2].tag, parse_exp);
+        case TOK_LBRACKET:
+            return parse_array_or_elems(parser);
+        case TOK_MAP:
+        case TOK_FOLD:
+            return parse_map_or_fold(parser);
         case TOK_LET:
             return parse_let_or_letrec(parser, parse_pat);
         case TOK_LETREC:
@@ -518,7 +639,19 @@ static struct ast* parse_suffix_exp(struct parser* parser, struct ast* ast) {
         }
         case TOK_DOT: {
             eat_tok(parser, TOK_DOT);
-            if (parser->ahead->tag == TOK_LBRACE) {
+            if (accept_tok(parser, TOK_LBRACKET)) {
+                struct ast* index = parse_exp(parser);
+                struct ast* elem = accept_tok(parser, TOK_EQ) ? parse_exp(parser) : NULL;
+                expect_tok(parser, TOK_RBRACKET);
+                return make_ast(parser, &begin, &(struct ast) {
+                    .tag = elem ? AST_UPDATE : AST_INDEX,
+                    .index = {
+                        .val = ast,
+                        .index = index,
+                        .elem = elem
+                    }
+                });
+            } else if (parser->ahead->tag == TOK_LBRACE) {
                 struct ast* record = parse_prod_or_record(parser, TOK_EQ, parse_exp);
                 return make_ast(parser, &begin, &(struct ast) {
                     .tag = AST_INS,
@@ -538,6 +671,14 @@ static struct ast* parse_suffix_exp(struct parser* parser, struct ast* ast) {
                 });
             }
         }
+        case TOK_AS: {
+            eat_tok(parser, TOK_AS);
+            struct ast* type = parse_app_exp(parser);
+            return make_ast(parser, &begin, &(struct ast) {
+                .tag = AST_PRIM,
+                .prim = { .op = PRIM_CONV, .args = ast, .type = type }
+            });
+        }
         case TOK_IDENT:
         case TOK_LIT:
         case TOK_NAT:
@@ -545,8 +686,11 @@ static struct ast* parse_suffix_exp(struct parser* parser, struct ast* ast) {
         case TOK_FLOAT:
         case TOK_LPAREN:
         case TOK_LBRACE:
+        case TOK_LBRACKET:
         case TOK_BACKSLASH:
         case TOK_MATCH:
+        case TOK_MAP:
+        case TOK_FOLD:
         case TOK_LET:
         case TOK_LETREC: {
             struct ast* right = parse_basic_exp(parser);
@@ -560,7 +704,7 @@ static struct ast* parse_suffix_exp(struct parser* parser, struct ast* ast) {
     }
 }
 
-static struct ast* parse_exp(struct parser* parser) {
+static struct ast* parse_app_exp(struct parser* parser) {
     struct ast* cur = parse_basic_exp(parser), *old;
     do {
         old = cur;
@@ -568,6 +712,50 @@ static struct ast* parse_exp(struct parser* parser) {
     } while (cur != old);
     return cur;
 }
+
+static struct ast* parse_unary_exp(struct parser* parser) {
+    struct pos begin = parser->ahead->loc.begin;
+    if (parser->ahead->tag != TOK_MINUS && parser->ahead->tag != TOK_NOT)
+        return parse_app_exp(parser);
+    enum prim_op op = parser->ahead->tag == TOK_MINUS ? PRIM_NEG : PRIM_NOT;
+    eat_tok(parser, parser->ahead->tag);
+    struct ast* arg = parse_unary_exp(parser);
+    return make_ast(parser, &begin, &(struct ast) {
+        .tag = AST_PRIM,
+        .prim = { .op = op, .args = arg }
+    });
+}
+
+static inline bool get_binary_op(unsigned tok, enum prim_op* op, int* prec) {
+    switch (tok) {
+#define f(x, y, z) case TOK_##x: *op = PRIM_##y; *prec = z; return true;
+        BINARY_OPS(f)
+#undef f
+        default:
+            return false;
+    }
+}
+
+static struct ast* parse_binary_exp(struct parser* parser, int min_prec) {
+    // Operators are parsed by precedence climbing, and are all left-associative
+    struct ast* left = parse_unary_exp(parser);
+    enum prim_op op;
+    int prec;
+    while (get_binary_op(parser->ahead->tag, &op, &prec) && prec >= min_prec) {
+        eat_tok(parser, parser->ahead->tag);
+        struct ast* right = parse_binary_exp(parser, prec + 1);
+        left->next = right;
+        left = make_ast(parser, &left->loc.begin, &(struct ast) {
+            .tag = AST_PRIM,
+            .prim = { .op = op, .args = left }
+        });
+    }
+    return left;
+}
+
+static struct ast* parse_exp(struct parser* parser) {
+    return parse_binary_exp(parser, 0);
+}
     
 struct ast* parse_ast(struct arena** arena, struct log* log, const char* file_name, const char* data, size_t data_size) {
     struct parser parser = {
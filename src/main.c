@@ -5,32 +5,136 @@
 
 #include "ir/node.h"
 #include "ir/print.h"
+#include "ir/eval.h"
+#include "ir/profile.h"
+#include "ir/egraph.h"
+#include "ir/specialize.h"
+#include "ir/float_lets.h"
+#include "vm/vm.h"
+#include "erase/erase.h"
+#include "cgen/cgen.h"
 #include "lang/ast.h"
 #include "utils/log.h"
+#include "utils/thread_pool.h"
 
 #define READ_BUF_SIZE 1024
 #define ERR_BUF_SIZE  64
+#define PROFILE_SIZE  20
 
 static mod_t mod;
+static struct profile* profile;
 static struct log err_log;
 
+static node_t run_on_vm(node_t node) {
+    struct bytecode* bytecode = compile_to_bytecode(node, &err_log);
+    if (!bytecode)
+        return node;
+    node = run_bytecode(bytecode);
+    free_bytecode(bytecode);
+    return node;
+}
+
+static node_t run_erased(node_t node) {
+    // Programs that cannot be erased are evaluated with their types
+    struct erased_program* program = erase_program(node);
+    if (!program)
+        return eval_node(node);
+    node = run_erased_program(program);
+    free_erased_program(program);
+    return node;
+}
+
+static node_t reduce_in_parallel(node_t node) {
+    struct thread_pool* pool = new_thread_pool(get_default_thread_count());
+    node = reduce_node_in_parallel(node, pool);
+    free_thread_pool(pool);
+    return node;
+}
+
+static bool emit_c_file(const char* file_name, node_t node) {
+    FILE* fp = fopen(file_name, "w");
+    if (!fp) {
+        log_error(&err_log, NULL, "cannot open file '%0:s'", FORMAT_ARGS({ .s = file_name }));
+        return false;
+    }
+    bool ok = emit_c(node, fp, &err_log);
+    fclose(fp);
+    return ok;
+}
+
 static void usage(void) {
     printf(
         "usage: noname [options] files...\n"
         "options:\n"
         "  -h   --help       Prints this message\n"
         "  -e   --execute    Executes the contents of the files\n"
+        "       --reduce     Executes the contents of the files by term rewriting\n"
+        "       --parallel   Uses all the cores of the machine for term rewriting\n"
+        "       --max-steps  Limits the number of steps of term rewriting\n"
+        "       --max-nodes  Limits the number of nodes created by term rewriting\n"
+        "       --timeout    Limits the time spent in term rewriting, in seconds\n"
+        "       --scratch    Frees the intermediate terms of term rewriting once it is over\n"
+        "       --reduce-to  Chooses how far execution reduces the result: whnf, hnf, or nf (default)\n"
+        "       --vm         Executes the contents of the files on the virtual machine\n"
+        "       --erase      Executes the contents of the files without their types\n"
+        "       --emit-c     Writes the contents of the files as a C program to the given file\n"
+        "       --stats      Prints module statistics on exit\n"
+        "       --profile    Prints the functions and simplifications that took the most work on exit\n"
+        "       --canonical  Names binders canonically to share alpha-equivalent expressions\n"
+        "       --defer      Simplifies the contents of the files once they are built, not while they are built\n"
+        "       --specialize Specializes recursive functions for their static arguments\n"
+        "       --float-lets Moves let-bindings out of functions and into the cases that use them\n"
+        "       --egraph     Optimizes the contents of the files with equality saturation\n"
         "       --no-color   Disables colored output\n");
 }
 
+static bool takes_value(const char* option) {
+    return
+        !strcmp(option, "--emit-c") ||
+        !strcmp(option, "--reduce-to") ||
+        !strcmp(option, "--max-steps") ||
+        !strcmp(option, "--max-nodes") ||
+        !strcmp(option, "--timeout");
+}
+
 struct options {
     size_t file_count;
-    bool exec;
+    enum {
+        EXEC_NONE,
+        EXEC_EVAL,
+        EXEC_REDUCE,
+        EXEC_VM,
+        EXEC_ERASED
+    } exec;
+    const char* c_file;
+    bool stats;
+    bool profile;
+    bool specialize;
+    bool float_lets;
+    bool egraph;
+    bool parallel;
+    bool scratch;
+    enum reduce_strategy strategy;
+    bool has_budget;
+    struct budget budget;
+    unsigned mod_flags;
 };
 
 static bool parse_options(int argc, char** argv, struct options* options) {
     options->file_count = 0;
-    options->exec = false;
+    options->exec = EXEC_NONE;
+    options->c_file = NULL;
+    options->stats = false;
+    options->profile = false;
+    options->specialize = false;
+    options->float_lets = false;
+    options->egraph = false;
+    options->parallel = false;
+    options->scratch = false;
+    options->strategy = REDUCE_NF;
+    options->has_budget = false;
+    options->budget = (struct budget) { 0 };
+    options->mod_flags = 0;
 
     for (int i = 1; i < argc; ++i) {
         if (argv[i][0] != '-') {
@@ -41,7 +145,73 @@ static bool parse_options(int argc, char** argv, struct options* options) {
             usage();
             return false;
         } else if (!strcmp(argv[i], "--execute") || !strcmp(argv[i], "-e")) {
-            options->exec = true;
+            options->exec = EXEC_EVAL;
+        } else if (!strcmp(argv[i], "--reduce")) {
+            options->exec = EXEC_REDUCE;
+        } else if (!strcmp(argv[i], "--parallel")) {
+            options->parallel = true;
+            options->mod_flags |= MOD_THREAD_SAFE;
+        } else if (!strcmp(argv[i], "--scratch")) {
+            options->scratch = true;
+        } else if (!strcmp(argv[i], "--vm")) {
+            options->exec = EXEC_VM;
+        } else if (!strcmp(argv[i], "--erase")) {
+            options->exec = EXEC_ERASED;
+        } else if (!strcmp(argv[i], "--emit-c")) {
+            if (i + 1 >= argc) {
+                log_error(&err_log, NULL, "missing file name for '%0:s'", FORMAT_ARGS({ .s = argv[i] }));
+                return false;
+            }
+            options->c_file = argv[++i];
+        } else if (!strcmp(argv[i], "--reduce-to")) {
+            if (i + 1 >= argc) {
+                log_error(&err_log, NULL, "missing value for '%0:s'", FORMAT_ARGS({ .s = argv[i] }));
+                return false;
+            }
+            const char* strategy = argv[++i];
+            if (!strcmp(strategy, "whnf"))
+                options->strategy = REDUCE_WHNF;
+            else if (!strcmp(strategy, "hnf"))
+                options->strategy = REDUCE_HNF;
+            else if (!strcmp(strategy, "nf"))
+                options->strategy = REDUCE_NF;
+            else {
+                log_error(&err_log, NULL, "invalid value for '%0:s'", FORMAT_ARGS({ .s = argv[i - 1] }));
+                return false;
+            }
+        } else if (!strcmp(argv[i], "--max-steps") || !strcmp(argv[i], "--max-nodes") || !strcmp(argv[i], "--timeout")) {
+            if (i + 1 >= argc) {
+                log_error(&err_log, NULL, "missing value for '%0:s'", FORMAT_ARGS({ .s = argv[i] }));
+                return false;
+            }
+            char* end = NULL;
+            double value = strtod(argv[i + 1], &end);
+            if (*end || value <= 0) {
+                log_error(&err_log, NULL, "invalid value for '%0:s'", FORMAT_ARGS({ .s = argv[i] }));
+                return false;
+            }
+            if (!strcmp(argv[i], "--max-steps"))
+                options->budget.max_steps = (size_t)value;
+            else if (!strcmp(argv[i], "--max-nodes"))
+                options->budget.max_nodes = (size_t)value;
+            else
+                options->budget.max_seconds = value;
+            options->has_budget = true;
+            i++;
+        } else if (!strcmp(argv[i], "--stats")) {
+            options->stats = true;
+        } else if (!strcmp(argv[i], "--profile")) {
+            options->profile = true;
+        } else if (!strcmp(argv[i], "--canonical")) {
+            options->mod_flags |= MOD_CANONICAL_BINDERS;
+        } else if (!strcmp(argv[i], "--defer")) {
+            options->mod_flags |= MOD_DEFER_SIMPLIFY;
+        } else if (!strcmp(argv[i], "--specialize")) {
+            options->specialize = true;
+        } else if (!strcmp(argv[i], "--float-lets")) {
+            options->float_lets = true;
+        } else if (!strcmp(argv[i], "--egraph")) {
+            options->egraph = true;
         } else if (!strcmp(argv[i], "--no-color")) {
             err_log.out.color = false;
         } else {
@@ -49,6 +219,34 @@ static bool parse_options(int argc, char** argv, struct options* options) {
             return false;
         }
     }
+    if (options->has_budget && options->parallel) {
+        log_error(&err_log, NULL, "resource limits cannot be used with '--parallel'", NULL);
+        return false;
+    }
+    if (options->has_budget && options->exec != EXEC_REDUCE) {
+        log_error(&err_log, NULL, "resource limits can only be used with '--reduce'", NULL);
+        return false;
+    }
+    if ((options->mod_flags & MOD_DEFER_SIMPLIFY) && options->parallel) {
+        log_error(&err_log, NULL, "'--defer' cannot be used with '--parallel'", NULL);
+        return false;
+    }
+    if (options->scratch && options->parallel) {
+        log_error(&err_log, NULL, "'--scratch' cannot be used with '--parallel'", NULL);
+        return false;
+    }
+    if (options->strategy != REDUCE_NF && (options->parallel || options->scratch || options->has_budget)) {
+        log_error(&err_log, NULL, "'--reduce-to' cannot be used with '--parallel', '--scratch', or resource limits", NULL);
+        return false;
+    }
+    if (options->strategy != REDUCE_NF && (options->exec == EXEC_VM || options->exec == EXEC_ERASED)) {
+        log_error(&err_log, NULL, "'--reduce-to' cannot be used with '--vm' or '--erase'", NULL);
+        return false;
+    }
+    if (options->profile && options->parallel) {
+        log_error(&err_log, NULL, "'--profile' cannot be used with '--parallel'", NULL);
+        return false;
+    }
     if (options->file_count == 0) {
         log_error(&err_log, NULL, "no input file", NULL);
         return false;
@@ -76,10 +274,30 @@ static char* read_file(const char* name, size_t* size) {
     return data;
 }
 
+static inline double get_hit_rate(size_t hits, size_t misses) {
+    return hits + misses > 0 ? 100.0 * (double)hits / (double)(hits + misses) : 0.0;
+}
+
+static void print_stats(void) {
+    const struct mod_stats* stats = get_mod_stats(mod);
+    printf(
+        "replace cache: %zu hit(s), %zu miss(es) (%.1f%% hit rate)\n",
+        stats->replace_cache_hits, stats->replace_cache_misses,
+        get_hit_rate(stats->replace_cache_hits, stats->replace_cache_misses));
+    printf(
+        "reduce cache: %zu hit(s), %zu miss(es) (%.1f%% hit rate)\n",
+        stats->reduce_cache_hits, stats->reduce_cache_misses,
+        get_hit_rate(stats->reduce_cache_hits, stats->reduce_cache_misses));
+    printf("nodes: %zu\n", stats->node_count);
+}
+
 static bool compile_files(int argc, char** argv, const struct options* options) {
     for (int i = 1; i < argc; ++i) {
-        if (argv[i][0] == '-')
+        if (argv[i][0] == '-') {
+            if (takes_value(argv[i]))
+                i++;
             continue;
+        }
         size_t size = 0;
         char* data = read_file(argv[i], &size);
         if (!data) {
@@ -92,12 +310,47 @@ static bool compile_files(int argc, char** argv, const struct options* options)
         if (err_log.errors == 0)
             bind_ast(ast, &err_log);
         node_t node = NULL;
+        if (options->mod_flags & MOD_DEFER_SIMPLIFY)
+            defer_simplification(mod);
         if (err_log.errors == 0)
             node = emit_node(ast, mod, &err_log);
         free_arena(arena);
+        if (node)
+            node = simplify_module(node);
+        if (node && options->specialize)
+            node = specialize_node(node);
+        if (node && options->float_lets)
+            node = float_lets(node, options->exec == EXEC_VM || options->c_file);
+        if (node && options->egraph)
+            node = saturate_node(node, &DEFAULT_EGRAPH_OPTIONS);
+        if (node && options->c_file && !emit_c_file(options->c_file, node)) {
+            free(data);
+            return false;
+        }
         if (node) {
-            if (options->exec)
-                node = reduce_node(node);
+            // Only the execution is profiled, not the construction of the program
+            set_mod_profile(mod, profile);
+            if (options->exec == EXEC_EVAL && options->strategy == REDUCE_WHNF)
+                node = eval_node_to_whnf(node);
+            else if (options->exec == EXEC_EVAL)
+                node = eval_node(node);
+            else if (options->exec == EXEC_REDUCE && options->parallel)
+                node = reduce_in_parallel(node);
+            else if (options->exec == EXEC_REDUCE && options->scratch)
+                node = reduce_node_in_scratch(node, &options->budget, &err_log);
+            else if (options->exec == EXEC_REDUCE && options->has_budget)
+                node = reduce_node_with_budget(node, &options->budget, &err_log);
+            else if (options->exec == EXEC_REDUCE)
+                node = reduce_node_with_strategy(node, options->strategy);
+            else if (options->exec == EXEC_VM)
+                node = run_on_vm(node);
+            else if (options->exec == EXEC_ERASED)
+                node = run_erased(node);
+            set_mod_profile(mod, NULL);
+            if (!node) {
+                free(data);
+                return false;
+            }
             dump_node(node);
             while (true) {
                 node = node->type;
@@ -123,20 +376,30 @@ int main(int argc, char** argv) {
     err_log.out.color = is_color_supported(stderr);
     err_log.out.tab = "  ";
     err_log.out.indent = 0;
-    mod = new_mod();
 
     struct options options;
     if (!parse_options(argc, argv, &options))
         goto failure;
 
+    mod = new_mod_with_flags(options.mod_flags);
+    if (options.profile)
+        profile = new_profile();
+
     if (!compile_files(argc, argv, &options))
         goto failure;
+    if (options.stats)
+        print_stats();
+    if (profile)
+        print_profile(profile, PROFILE_SIZE, stdout);
     goto success;
 
 failure:
     status = EXIT_FAILURE;
 success:
-    free_mod(mod);
+    if (mod)
+        free_mod(mod);
+    if (profile)
+        free_profile(profile);
     dump_format_buf(&err_buf, stderr);
     free_format_buf(err_buf.next);
     return status;
@@ -50,6 +50,7 @@ void reset_arena(arena_t* arena) {
         cur->size = 0;
         cur = cur->prev;
     }
+    cur->size = 0;
     *arena = cur;
 }
 
@@ -125,20 +125,25 @@ bool remove_from_htable(
     size_t index = ((char*)key - (char*)htable->keys) / key_size;
     size_t next_index = increment_wrap(htable->cap, index);
     void* value = ((char*)values) + value_size * index;
-    // Move the elements that belong to the collision chain
+    // Move the elements that belong to the collision chain into the hole, unless their
+    // desired position lies between the hole and their current position (cyclically),
+    // in which case they would not be found any more.
     while (htable->hashes[next_index] & ~HASH_MASK) {
         uint32_t next_hash = htable->hashes[next_index];
         size_t desired_index = mod_prime(next_hash, htable->cap);
-        if (next_index == desired_index)
-            break;
-        void* next_key   = ((char*)htable->keys) + key_size * next_index;
-        void* next_value = ((char*)values) + value_size * next_index;
-        memcpy(key, next_key, key_size);
-        memcpy(value, next_value, value_size);
-        htable->hashes[index] = next_hash;
-        key   = next_key;
-        value = next_value;
-        index = next_index;
+        bool is_after_hole = index <= next_index
+            ? desired_index > index && desired_index <= next_index
+            : desired_index > index || desired_index <= next_index;
+        if (!is_after_hole) {
+            void* next_key   = ((char*)htable->keys) + key_size * next_index;
+            void* next_value = ((char*)values) + value_size * next_index;
+            memcpy(key, next_key, key_size);
+            memcpy(value, next_value, value_size);
+            htable->hashes[index] = next_hash;
+            key   = next_key;
+            value = next_value;
+            index = next_index;
+        }
         next_index = increment_wrap(htable->cap, next_index);
     }
     htable->hashes[index] = 0;
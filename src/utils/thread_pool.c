@@ -0,0 +1,202 @@
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "utils/thread_pool.h"
+#include "utils/utils.h"
+
+#define INITIAL_DEQUE_CAP 16
+
+// Deques are circular buffers protected by a lock
+struct deque {
+    pthread_mutex_t lock;
+    struct task** tasks;
+    size_t first;
+    size_t count;
+    size_t cap;
+};
+
+struct thread_pool {
+    struct deque* deques;
+    pthread_t* threads;
+    size_t thread_count;
+    atomic_size_t task_count;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool is_stopping;
+};
+
+struct worker {
+    struct thread_pool* pool;
+    size_t index;
+};
+
+static _Thread_local struct worker current_worker;
+
+// Deques --------------------------------------------------------------------------
+
+static inline void init_deque(struct deque* deque) {
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->tasks = xmalloc(sizeof(struct task*) * INITIAL_DEQUE_CAP);
+    deque->first = 0;
+    deque->count = 0;
+    deque->cap = INITIAL_DEQUE_CAP;
+}
+
+static inline void destroy_deque(struct deque* deque) {
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->tasks);
+}
+
+static inline void push_back(struct deque* deque, struct task* task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->cap) {
+        struct task** tasks = xmalloc(sizeof(struct task*) * deque->cap * 2);
+        for (size_t i = 0; i < deque->count; ++i)
+            tasks[i] = deque->tasks[(deque->first + i) % deque->cap];
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->first = 0;
+        deque->cap *= 2;
+    }
+    deque->tasks[(deque->first + deque->count) % deque->cap] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static inline struct task* pop_back(struct deque* deque) {
+    struct task* task = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        task = deque->tasks[(deque->first + deque->count) % deque->cap];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return task;
+}
+
+static inline struct task* pop_front(struct deque* deque) {
+    struct task* task = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        task = deque->tasks[deque->first];
+        deque->first = (deque->first + 1) % deque->cap;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return task;
+}
+
+// Workers -------------------------------------------------------------------------
+
+static inline size_t get_worker_index(struct thread_pool* pool) {
+    // Threads that do not belong to the pool share the deque of the first worker
+    return current_worker.pool == pool ? current_worker.index : 0;
+}
+
+static inline struct task* find_task(struct thread_pool* pool, size_t index) {
+    struct task* task = pop_back(&pool->deques[index]);
+    for (size_t i = 1, n = pool->thread_count; i < n && !task; ++i)
+        task = pop_front(&pool->deques[(index + i) % n]);
+    if (task)
+        atomic_fetch_sub(&pool->task_count, 1);
+    return task;
+}
+
+static inline void run_task(struct task* task) {
+    task->run(task);
+    atomic_store_explicit(&task->is_done, true, memory_order_release);
+}
+
+static void* run_worker(void* data) {
+    current_worker = *(struct worker*)data;
+    free(data);
+    struct thread_pool* pool = current_worker.pool;
+    while (true) {
+        struct task* task = find_task(pool, current_worker.index);
+        if (task) {
+            run_task(task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->task_count) == 0 && !pool->is_stopping)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        bool is_stopping = pool->is_stopping;
+        pthread_mutex_unlock(&pool->lock);
+        if (is_stopping)
+            break;
+    }
+    return NULL;
+}
+
+// Pool ----------------------------------------------------------------------------
+
+struct thread_pool* new_thread_pool(size_t thread_count) {
+    if (thread_count == 0)
+        thread_count = get_default_thread_count();
+    struct thread_pool* pool = xmalloc(sizeof(struct thread_pool));
+    pool->deques = xmalloc(sizeof(struct deque) * thread_count);
+    pool->threads = xmalloc(sizeof(pthread_t) * thread_count);
+    pool->thread_count = thread_count;
+    pool->is_stopping = false;
+    atomic_init(&pool->task_count, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (size_t i = 0; i < thread_count; ++i)
+        init_deque(&pool->deques[i]);
+
+    current_worker = (struct worker) { .pool = pool, .index = 0 };
+    for (size_t i = 1; i < thread_count; ++i) {
+        struct worker* worker = xmalloc(sizeof(struct worker));
+        *worker = (struct worker) { .pool = pool, .index = i };
+        pthread_create(&pool->threads[i], NULL, run_worker, worker);
+    }
+    return pool;
+}
+
+void free_thread_pool(struct thread_pool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->is_stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 1; i < pool->thread_count; ++i)
+        pthread_join(pool->threads[i], NULL);
+    for (size_t i = 0; i < pool->thread_count; ++i)
+        destroy_deque(&pool->deques[i]);
+    if (current_worker.pool == pool)
+        current_worker.pool = NULL;
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
+
+size_t get_thread_count(const struct thread_pool* pool) {
+    return pool->thread_count;
+}
+
+size_t get_default_thread_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+}
+
+void spawn_task(struct thread_pool* pool, struct task* task) {
+    atomic_init(&task->is_done, false);
+    push_back(&pool->deques[get_worker_index(pool)], task);
+    atomic_fetch_add(&pool->task_count, 1);
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void wait_task(struct thread_pool* pool, struct task* task) {
+    size_t index = get_worker_index(pool);
+    while (!atomic_load_explicit(&task->is_done, memory_order_acquire)) {
+        struct task* other = find_task(pool, index);
+        if (other)
+            run_task(other);
+        else
+            sched_yield();
+    }
+}
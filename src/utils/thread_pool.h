@@ -0,0 +1,31 @@
+#ifndef UTILS_THREAD_POOL_H
+#define UTILS_THREAD_POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Work-stealing thread pool. Each worker has its own deque of tasks: Workers push
+ * and pop tasks at the back of their own deque, and steal tasks from the front of
+ * the deques of other workers when theirs is empty. The thread that creates the
+ * pool is the first worker, and waiting for a task executes other tasks in the
+ * meantime, so that nested parallelism does not block workers.
+ */
+
+struct thread_pool;
+
+struct task {
+    void (*run)(struct task*);
+    atomic_bool is_done;
+};
+
+struct thread_pool* new_thread_pool(size_t);
+void free_thread_pool(struct thread_pool*);
+size_t get_thread_count(const struct thread_pool*);
+size_t get_default_thread_count(void);
+
+void spawn_task(struct thread_pool*, struct task*);
+void wait_task(struct thread_pool*, struct task*);
+
+#endif
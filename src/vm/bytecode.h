@@ -0,0 +1,112 @@
+#ifndef VM_BYTECODE_H
+#define VM_BYTECODE_H
+
+#include <stdint.h>
+
+#include "ir/node.h"
+#include "ir/prim.h"
+#include "utils/vec.h"
+
+/*
+ * Instructions are encoded as a sequence of 32-bit words: The opcode first,
+ * followed by its operands. Registers are local to a function call, and
+ * register 0 always contains the closure of the function being executed,
+ * while register 1 contains its argument. Arrays are immutable, except when
+ * they are filled with STORE_ELEM right after being created with NEW_ARRAY.
+ */
+
+#define OPCODES(f) \
+    f(LOAD_CONST, 2)        /* dst, const */ \
+    f(MOVE, 2)              /* dst, src */ \
+    f(MAKE_CLOSURE, 3)      /* dst, fn, n, captures... */ \
+    f(MAKE_RECORD, 2)       /* dst, n, args... */ \
+    f(MAKE_INJ, 3)          /* dst, tag, arg */ \
+    f(GET_FIELD, 3)         /* dst, src, index */ \
+    f(SET_FIELDS, 3)        /* dst, src, n, (index, elem)... */ \
+    f(GET_CAPTURE, 2)       /* dst, index */ \
+    f(SET_CAPTURE, 3)       /* closure, index, src */ \
+    f(CALL, 3)              /* dst, callee, arg */ \
+    f(TAIL_CALL, 2)         /* callee, arg */ \
+    f(RET, 1)               /* src */ \
+    f(JUMP, 1)              /* target */ \
+    f(JUMP_IF_NOT_CONST, 3) /* src, const, target */ \
+    f(JUMP_IF_NOT_TAG, 3)   /* src, tag, target */ \
+    f(PRIM, 3)              /* dst, op, types, args... */ \
+    f(MAKE_ARRAY, 2)        /* dst, n, elems... */ \
+    f(NEW_ARRAY, 2)         /* dst, len */ \
+    f(ARRAY_LEN, 2)         /* dst, src */ \
+    f(GET_ELEM, 4)          /* dst, src, index, bot */ \
+    f(SET_ELEM, 5)          /* dst, src, index, elem, bot */ \
+    f(STORE_ELEM, 3)        /* array, index, elem */
+
+enum opcode {
+#define f(name, n) OP_##name,
+    OPCODES(f)
+#undef f
+    OP_COUNT
+};
+
+#define REG_CLOSURE 0
+#define REG_ARG     1
+
+// The operand and result types of primitives are packed in a single word
+static inline uint32_t encode_num_types(struct num_type arg_type, struct num_type res_type) {
+    return
+        (uint32_t)arg_type.tag << 24 | (uint32_t)arg_type.bitwidth << 16 |
+        (uint32_t)res_type.tag << 8  | (uint32_t)res_type.bitwidth;
+}
+
+static inline struct num_type decode_num_type(uint32_t word) {
+    return (struct num_type) { .tag = (word >> 8) & 0xFF, .bitwidth = word & 0xFF };
+}
+
+struct object;
+
+struct value {
+    enum {
+        VALUE_INT,
+        VALUE_FLOAT,
+        VALUE_NODE,
+        VALUE_OBJ
+    } tag;
+    union {
+        uintmax_t int_val;
+        double float_val;
+        node_t node;
+        struct object* obj;
+    };
+};
+
+struct object {
+    enum {
+        OBJ_RECORD,
+        OBJ_INJ,
+        OBJ_CLOSURE,
+        OBJ_ARRAY,
+        OBJ_FORWARD
+    } kind;
+    uint32_t aux;  // Function index for closures, tag for injections
+    size_t size;   // Number of values stored in the object
+    struct value values[];
+};
+
+VEC(code_vec, uint32_t)
+VEC(value_vec, struct value)
+
+struct function {
+    struct code_vec code;
+    size_t reg_count;
+    node_t abs;
+    struct node_vec captures;
+};
+
+VEC(function_vec, struct function)
+
+struct bytecode {
+    mod_t mod;
+    node_t type;
+    struct function_vec functions;
+    struct value_vec consts;
+};
+
+#endif
@@ -0,0 +1,621 @@
+#include <assert.h>
+#include <inttypes.h>
+
+#include "vm/vm.h"
+#include "vm/bytecode.h"
+#include "utils/buf.h"
+#include "utils/format.h"
+
+MAP(reg_map, node_t, uint32_t)
+VEC(jump_vec, size_t)
+
+struct compiler {
+    struct bytecode* bytecode;
+    struct log* log;
+};
+
+struct fn_compiler {
+    struct compiler* compiler;
+    struct function fn;
+    struct reg_map regs;
+};
+
+static void compile_exp(struct fn_compiler*, node_t, uint32_t, bool);
+
+// Helpers -------------------------------------------------------------------------
+
+static inline bool is_type_level(node_t node) {
+    // Types and type constructors are erased at run time
+    return
+        node->tag == NODE_UNI ||
+        node->type->tag == NODE_UNI ||
+        node->type->type->tag == NODE_UNI;
+}
+
+static inline uint32_t new_reg(struct fn_compiler* fn_compiler) {
+    return fn_compiler->fn.reg_count++;
+}
+
+static inline void emit(struct fn_compiler* fn_compiler, uint32_t word) {
+    push_to_code_vec(&fn_compiler->fn.code, word);
+}
+
+static inline size_t emit_jump_target(struct fn_compiler* fn_compiler) {
+    emit(fn_compiler, 0);
+    return fn_compiler->fn.code.size - 1;
+}
+
+static inline void patch_jumps(struct fn_compiler* fn_compiler, struct jump_vec* jumps) {
+    for (size_t i = 0; i < jumps->size; ++i)
+        fn_compiler->fn.code.elems[jumps->elems[i]] = fn_compiler->fn.code.size;
+    clear_jump_vec(jumps);
+}
+
+static inline uint32_t new_const(struct fn_compiler* fn_compiler, struct value value) {
+    struct value_vec* consts = &fn_compiler->compiler->bytecode->consts;
+    for (size_t i = 0; i < consts->size; ++i) {
+        if (consts->elems[i].tag == value.tag && consts->elems[i].int_val == value.int_val)
+            return i;
+    }
+    push_to_value_vec(consts, value);
+    return consts->size - 1;
+}
+
+static inline uint32_t new_node_const(struct fn_compiler* fn_compiler, node_t node) {
+    return new_const(fn_compiler, (struct value) { .tag = VALUE_NODE, .node = node });
+}
+
+static inline uint32_t new_lit_const(struct fn_compiler* fn_compiler, const struct lit* lit) {
+    return lit->tag == LIT_FLOAT
+        ? new_const(fn_compiler, (struct value) { .tag = VALUE_FLOAT, .float_val = lit->float_val })
+        : new_const(fn_compiler, (struct value) { .tag = VALUE_INT, .int_val = lit->int_val });
+}
+
+static inline uint32_t find_elem_index(node_t type, label_t label) {
+    size_t index = find_label_in_node(reduce_node(type), label);
+    assert(index != SIZE_MAX);
+    return index;
+}
+
+static inline bool is_sum_type(node_t type) {
+    return reduce_node(type)->tag == NODE_SUM;
+}
+
+static inline void unsupported(struct fn_compiler* fn_compiler, node_t node, const char* msg) {
+    log_error(fn_compiler->compiler->log, &node->loc,
+        "%0:s are not supported by the virtual machine", FORMAT_ARGS({ .s = msg }));
+}
+
+// Functions -----------------------------------------------------------------------
+
+static inline struct fn_compiler new_fn_compiler(struct compiler* compiler, node_t abs) {
+    struct fn_compiler fn_compiler = {
+        .compiler = compiler,
+        .fn = {
+            .code = new_code_vec(),
+            .reg_count = 2,
+            .abs = abs,
+            .captures = new_node_vec()
+        },
+        .regs = new_reg_map()
+    };
+    return fn_compiler;
+}
+
+static inline uint32_t reserve_function(struct compiler* compiler) {
+    push_to_function_vec(&compiler->bytecode->functions, (struct function) { .reg_count = 0 });
+    return compiler->bytecode->functions.size - 1;
+}
+
+static inline void finish_function(struct fn_compiler* fn_compiler, uint32_t index) {
+    free_reg_map(&fn_compiler->regs);
+    fn_compiler->compiler->bytecode->functions.elems[index] = fn_compiler->fn;
+}
+
+static uint32_t compile_abs(struct fn_compiler* parent, node_t abs, struct node_vec* captures) {
+    // Closures capture the free variables of their body that are defined in the enclosing function
+    struct fn_compiler fn_compiler = new_fn_compiler(parent->compiler, abs);
+    uint32_t index = reserve_function(parent->compiler);
+    for (size_t i = 0, n = abs->free_vars->count; i < n; ++i) {
+        node_t var = abs->free_vars->vars[i];
+        if (!find_in_reg_map(&parent->regs, var))
+            continue;
+        uint32_t reg = new_reg(&fn_compiler);
+        emit(&fn_compiler, OP_GET_CAPTURE);
+        emit(&fn_compiler, reg);
+        emit(&fn_compiler, fn_compiler.fn.captures.size);
+        insert_in_reg_map(&fn_compiler.regs, var, reg);
+        push_to_node_vec(&fn_compiler.fn.captures, var);
+    }
+    if (!is_unbound_var(abs->abs.var))
+        insert_in_reg_map(&fn_compiler.regs, abs->abs.var, REG_ARG);
+    compile_exp(&fn_compiler, abs->abs.body, new_reg(&fn_compiler), true);
+    for (size_t i = 0; i < fn_compiler.fn.captures.size; ++i)
+        push_to_node_vec(captures, fn_compiler.fn.captures.elems[i]);
+    finish_function(&fn_compiler, index);
+    return index;
+}
+
+static void emit_closure(struct fn_compiler* fn_compiler, node_t abs, uint32_t dst, struct node_vec* captures) {
+    uint32_t index = compile_abs(fn_compiler, abs, captures);
+    emit(fn_compiler, OP_MAKE_CLOSURE);
+    emit(fn_compiler, dst);
+    emit(fn_compiler, index);
+    emit(fn_compiler, captures->size);
+    for (size_t i = 0; i < captures->size; ++i)
+        emit(fn_compiler, *find_in_reg_map(&fn_compiler->regs, captures->elems[i]));
+}
+
+// Expressions ---------------------------------------------------------------------
+
+static uint32_t compile_val(struct fn_compiler* fn_compiler, node_t node) {
+    if (node->tag == NODE_VAR && !is_type_level(node)) {
+        uint32_t* reg = find_in_reg_map(&fn_compiler->regs, node);
+        if (reg)
+            return *reg;
+    }
+    uint32_t reg = new_reg(fn_compiler);
+    compile_exp(fn_compiler, node, reg, false);
+    return reg;
+}
+
+static void compile_pat(struct fn_compiler* fn_compiler, node_t pat, uint32_t src, struct jump_vec* fail_jumps) {
+    switch (pat->tag) {
+        case NODE_VAR:
+            if (!is_unbound_var(pat))
+                insert_in_reg_map(&fn_compiler->regs, pat, src);
+            break;
+        case NODE_LIT:
+            emit(fn_compiler, OP_JUMP_IF_NOT_CONST);
+            emit(fn_compiler, src);
+            emit(fn_compiler, new_lit_const(fn_compiler, &pat->lit));
+            push_to_jump_vec(fail_jumps, emit_jump_target(fn_compiler));
+            break;
+        case NODE_INJ: {
+            uint32_t arg = new_reg(fn_compiler);
+            emit(fn_compiler, OP_JUMP_IF_NOT_TAG);
+            emit(fn_compiler, src);
+            emit(fn_compiler, find_elem_index(pat->type, pat->inj.label));
+            push_to_jump_vec(fail_jumps, emit_jump_target(fn_compiler));
+            emit(fn_compiler, OP_GET_FIELD);
+            emit(fn_compiler, arg);
+            emit(fn_compiler, src);
+            emit(fn_compiler, 0);
+            compile_pat(fn_compiler, pat->inj.arg, arg, fail_jumps);
+            break;
+        }
+        case NODE_RECORD:
+            for (size_t i = 0, n = pat->record.arg_count; i < n; ++i) {
+                uint32_t arg = new_reg(fn_compiler);
+                emit(fn_compiler, OP_GET_FIELD);
+                emit(fn_compiler, arg);
+                emit(fn_compiler, src);
+                emit(fn_compiler, find_elem_index(pat->type, pat->record.labels[i]));
+                compile_pat(fn_compiler, pat->record.args[i], arg, fail_jumps);
+            }
+            break;
+        default:
+            assert(false && "invalid pattern");
+            break;
+    }
+}
+
+static void compile_match(struct fn_compiler* fn_compiler, node_t match, uint32_t dst, bool is_tail) {
+    uint32_t arg = compile_val(fn_compiler, match->match.arg);
+    struct jump_vec fail_jumps = new_jump_vec();
+    struct jump_vec end_jumps = new_jump_vec();
+    for (size_t i = 0, n = match->match.pat_count; i < n; ++i) {
+        compile_pat(fn_compiler, match->match.pats[i], arg, &fail_jumps);
+        compile_exp(fn_compiler, match->match.vals[i], dst, is_tail);
+        if (!is_tail) {
+            emit(fn_compiler, OP_JUMP);
+            push_to_jump_vec(&end_jumps, emit_jump_target(fn_compiler));
+        }
+        patch_jumps(fn_compiler, &fail_jumps);
+    }
+    // If no pattern matches, the result is the bottom value
+    compile_exp(fn_compiler, new_bot(get_mod(match), match->type, &match->loc), dst, is_tail);
+    patch_jumps(fn_compiler, &end_jumps);
+    free_jump_vec(&fail_jumps);
+    free_jump_vec(&end_jumps);
+}
+
+static void compile_letrec(struct fn_compiler* fn_compiler, node_t letrec) {
+    // Closures are created first, and the captured variables that refer
+    // to other members of the letrec-expression are patched afterwards.
+    uint32_t* regs = new_buf(uint32_t, letrec->letrec.var_count);
+    for (size_t i = 0, n = letrec->letrec.var_count; i < n; ++i) {
+        if (letrec->letrec.vals[i]->tag != NODE_ABS) {
+            unsupported(fn_compiler, letrec->letrec.vals[i], "recursive values that are not functions");
+            free_buf(regs);
+            return;
+        }
+        regs[i] = new_reg(fn_compiler);
+        insert_in_reg_map(&fn_compiler->regs, letrec->letrec.vars[i], regs[i]);
+    }
+    struct node_vec captures = new_node_vec();
+    struct code_vec patches = new_code_vec();
+    for (size_t i = 0, n = letrec->letrec.var_count; i < n; ++i) {
+        clear_node_vec(&captures);
+        emit_closure(fn_compiler, letrec->letrec.vals[i], regs[i], &captures);
+        for (size_t j = 0; j < captures.size; ++j) {
+            for (size_t k = i; k < n; ++k) {
+                if (captures.elems[j] != letrec->letrec.vars[k])
+                    continue;
+                push_to_code_vec(&patches, OP_SET_CAPTURE);
+                push_to_code_vec(&patches, regs[i]);
+                push_to_code_vec(&patches, j);
+                push_to_code_vec(&patches, regs[k]);
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < patches.size; ++i)
+        emit(fn_compiler, patches.elems[i]);
+    free_code_vec(&patches);
+    free_node_vec(&captures);
+    free_buf(regs);
+}
+
+static inline uint32_t new_nat_const(struct fn_compiler* fn_compiler, uintmax_t i) {
+    return new_const(fn_compiler, (struct value) { .tag = VALUE_INT, .int_val = i });
+}
+
+static inline void emit_nat_prim(struct fn_compiler* fn_compiler, enum prim_op op, uint32_t dst, uint32_t left, uint32_t right) {
+    struct num_type nat = { .tag = NUM_NAT, .bitwidth = 64 };
+    emit(fn_compiler, OP_PRIM);
+    emit(fn_compiler, dst);
+    emit(fn_compiler, op);
+    emit(fn_compiler, encode_num_types(nat, nat));
+    emit(fn_compiler, left);
+    emit(fn_compiler, right);
+}
+
+static void compile_bulk_op(struct fn_compiler* fn_compiler, node_t node, uint32_t dst) {
+    // Bulk operations are compiled to a loop over the elements of the array:
+    // The result of a map is created empty and filled in place.
+    uint32_t fn  = compile_val(fn_compiler, node->map.fn);
+    uint32_t src = compile_val(fn_compiler, node->map.val);
+    uint32_t res = new_reg(fn_compiler);
+    uint32_t len = new_reg(fn_compiler);
+    emit(fn_compiler, OP_ARRAY_LEN);
+    emit(fn_compiler, len);
+    emit(fn_compiler, src);
+    if (node->tag == NODE_MAP) {
+        emit(fn_compiler, OP_NEW_ARRAY);
+        emit(fn_compiler, res);
+        emit(fn_compiler, len);
+    } else {
+        uint32_t init = compile_val(fn_compiler, node->fold.init);
+        emit(fn_compiler, OP_MOVE);
+        emit(fn_compiler, res);
+        emit(fn_compiler, init);
+    }
+
+    uint32_t i = new_reg(fn_compiler), one = new_reg(fn_compiler), cond = new_reg(fn_compiler);
+    uint32_t elem = new_reg(fn_compiler), tmp = new_reg(fn_compiler);
+    emit(fn_compiler, OP_LOAD_CONST);
+    emit(fn_compiler, i);
+    emit(fn_compiler, new_nat_const(fn_compiler, 0));
+    emit(fn_compiler, OP_LOAD_CONST);
+    emit(fn_compiler, one);
+    emit(fn_compiler, new_nat_const(fn_compiler, 1));
+
+    size_t loop = fn_compiler->fn.code.size;
+    emit_nat_prim(fn_compiler, PRIM_LT, cond, i, len);
+    emit(fn_compiler, OP_JUMP_IF_NOT_CONST);
+    emit(fn_compiler, cond);
+    emit(fn_compiler, new_nat_const(fn_compiler, 1));
+    size_t end_jump = emit_jump_target(fn_compiler);
+    emit(fn_compiler, OP_GET_ELEM);
+    emit(fn_compiler, elem);
+    emit(fn_compiler, src);
+    emit(fn_compiler, i);
+    emit(fn_compiler, new_node_const(fn_compiler, new_bot(get_mod(node), reduce_node(node->map.val->type)->array.elem, &node->loc)));
+    if (node->tag == NODE_MAP) {
+        emit(fn_compiler, OP_CALL);
+        emit(fn_compiler, tmp);
+        emit(fn_compiler, fn);
+        emit(fn_compiler, elem);
+        emit(fn_compiler, OP_STORE_ELEM);
+        emit(fn_compiler, res);
+        emit(fn_compiler, i);
+        emit(fn_compiler, tmp);
+    } else {
+        emit(fn_compiler, OP_CALL);
+        emit(fn_compiler, tmp);
+        emit(fn_compiler, fn);
+        emit(fn_compiler, res);
+        emit(fn_compiler, OP_CALL);
+        emit(fn_compiler, res);
+        emit(fn_compiler, tmp);
+        emit(fn_compiler, elem);
+    }
+    emit_nat_prim(fn_compiler, PRIM_ADD, i, i, one);
+    emit(fn_compiler, OP_JUMP);
+    emit(fn_compiler, loop);
+    fn_compiler->fn.code.elems[end_jump] = fn_compiler->fn.code.size;
+
+    // The loop exits early when the array is not an object (e.g. bottom), in which case the result is bottom
+    emit(fn_compiler, OP_JUMP_IF_NOT_CONST);
+    emit(fn_compiler, cond);
+    emit(fn_compiler, new_nat_const(fn_compiler, 0));
+    size_t bot_jump = emit_jump_target(fn_compiler);
+    emit(fn_compiler, OP_MOVE);
+    emit(fn_compiler, dst);
+    emit(fn_compiler, res);
+    emit(fn_compiler, OP_JUMP);
+    size_t done_jump = emit_jump_target(fn_compiler);
+    fn_compiler->fn.code.elems[bot_jump] = fn_compiler->fn.code.size;
+    emit(fn_compiler, OP_LOAD_CONST);
+    emit(fn_compiler, dst);
+    emit(fn_compiler, new_node_const(fn_compiler, new_bot(get_mod(node), node->type, &node->loc)));
+    fn_compiler->fn.code.elems[done_jump] = fn_compiler->fn.code.size;
+}
+
+static void compile_exp(struct fn_compiler* fn_compiler, node_t node, uint32_t dst, bool is_tail) {
+    if (is_type_level(node)) {
+        emit(fn_compiler, OP_LOAD_CONST);
+        emit(fn_compiler, dst);
+        emit(fn_compiler, new_node_const(fn_compiler, node));
+        goto end;
+    }
+    switch (node->tag) {
+        case NODE_VAR: {
+            uint32_t* reg = find_in_reg_map(&fn_compiler->regs, node);
+            if (!reg) {
+                unsupported(fn_compiler, node, "free variables");
+                return;
+            }
+            emit(fn_compiler, OP_MOVE);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, *reg);
+            break;
+        }
+        case NODE_LIT:
+            emit(fn_compiler, OP_LOAD_CONST);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, new_lit_const(fn_compiler, &node->lit));
+            break;
+        case NODE_ERR:
+        case NODE_TOP:
+        case NODE_BOT:
+            emit(fn_compiler, OP_LOAD_CONST);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, new_node_const(fn_compiler, node));
+            break;
+        case NODE_ABS: {
+            struct node_vec captures = new_node_vec();
+            emit_closure(fn_compiler, node, dst, &captures);
+            free_node_vec(&captures);
+            break;
+        }
+        case NODE_APP: {
+            uint32_t left  = compile_val(fn_compiler, node->app.left);
+            uint32_t right = compile_val(fn_compiler, node->app.right);
+            if (is_tail) {
+                emit(fn_compiler, OP_TAIL_CALL);
+                emit(fn_compiler, left);
+                emit(fn_compiler, right);
+                return;
+            }
+            emit(fn_compiler, OP_CALL);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, left);
+            emit(fn_compiler, right);
+            break;
+        }
+        case NODE_LET:
+            for (size_t i = 0, n = node->let.var_count; i < n; ++i)
+                insert_in_reg_map(&fn_compiler->regs, node->let.vars[i], compile_val(fn_compiler, node->let.vals[i]));
+            compile_exp(fn_compiler, node->let.body, dst, is_tail);
+            return;
+        case NODE_LETREC:
+            compile_letrec(fn_compiler, node);
+            compile_exp(fn_compiler, node->letrec.body, dst, is_tail);
+            return;
+        case NODE_MATCH:
+            compile_match(fn_compiler, node, dst, is_tail);
+            return;
+        case NODE_RECORD: {
+            uint32_t* args = new_buf(uint32_t, node->record.arg_count);
+            for (size_t i = 0, n = node->record.arg_count; i < n; ++i)
+                args[i] = compile_val(fn_compiler, node->record.args[i]);
+            emit(fn_compiler, OP_MAKE_RECORD);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, node->record.arg_count);
+            for (size_t i = 0, n = node->record.arg_count; i < n; ++i)
+                emit(fn_compiler, args[i]);
+            free_buf(args);
+            break;
+        }
+        case NODE_INJ: {
+            uint32_t arg = compile_val(fn_compiler, node->inj.arg);
+            emit(fn_compiler, OP_MAKE_INJ);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, find_elem_index(node->type, node->inj.label));
+            emit(fn_compiler, arg);
+            break;
+        }
+        case NODE_EXT: {
+            uint32_t val = compile_val(fn_compiler, node->ext.val);
+            uint32_t index = find_elem_index(node->ext.val->type, node->ext.label);
+            if (is_sum_type(node->ext.val->type)) {
+                // Extracting from an injection with the wrong label produces the bottom value
+                struct jump_vec fail_jumps = new_jump_vec();
+                emit(fn_compiler, OP_JUMP_IF_NOT_TAG);
+                emit(fn_compiler, val);
+                emit(fn_compiler, index);
+                push_to_jump_vec(&fail_jumps, emit_jump_target(fn_compiler));
+                emit(fn_compiler, OP_GET_FIELD);
+                emit(fn_compiler, dst);
+                emit(fn_compiler, val);
+                emit(fn_compiler, 0);
+                emit(fn_compiler, OP_JUMP);
+                size_t end_jump = emit_jump_target(fn_compiler);
+                patch_jumps(fn_compiler, &fail_jumps);
+                emit(fn_compiler, OP_LOAD_CONST);
+                emit(fn_compiler, dst);
+                emit(fn_compiler, new_node_const(fn_compiler, new_bot(get_mod(node), node->type, &node->loc)));
+                fn_compiler->fn.code.elems[end_jump] = fn_compiler->fn.code.size;
+                free_jump_vec(&fail_jumps);
+            } else {
+                emit(fn_compiler, OP_GET_FIELD);
+                emit(fn_compiler, dst);
+                emit(fn_compiler, val);
+                emit(fn_compiler, index);
+            }
+            break;
+        }
+        case NODE_INS: {
+            uint32_t* elems = new_buf(uint32_t, node->ins.elem_count);
+            for (size_t i = 0, n = node->ins.elem_count; i < n; ++i)
+                elems[i] = compile_val(fn_compiler, node->ins.elems[i]);
+            if (is_sum_type(node->type)) {
+                emit(fn_compiler, OP_MAKE_INJ);
+                emit(fn_compiler, dst);
+                emit(fn_compiler, find_elem_index(node->type, node->ins.labels[0]));
+                emit(fn_compiler, elems[0]);
+            } else {
+                uint32_t val = compile_val(fn_compiler, node->ins.val);
+                emit(fn_compiler, OP_SET_FIELDS);
+                emit(fn_compiler, dst);
+                emit(fn_compiler, val);
+                emit(fn_compiler, node->ins.elem_count);
+                for (size_t i = 0, n = node->ins.elem_count; i < n; ++i) {
+                    emit(fn_compiler, find_elem_index(node->type, node->ins.labels[i]));
+                    emit(fn_compiler, elems[i]);
+                }
+            }
+            free_buf(elems);
+            break;
+        }
+        case NODE_PRIM: {
+            struct num_type arg_type, res_type;
+            bool ok =
+                get_num_type(reduce_node(node->prim.args[0]->type), &arg_type) &&
+                get_num_type(reduce_node(node->type), &res_type);
+            assert(ok); (void)ok;
+            uint32_t args[2];
+            for (size_t i = 0, n = node->prim.arg_count; i < n; ++i)
+                args[i] = compile_val(fn_compiler, node->prim.args[i]);
+            emit(fn_compiler, OP_PRIM);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, node->prim.op);
+            emit(fn_compiler, encode_num_types(arg_type, res_type));
+            for (size_t i = 0, n = node->prim.arg_count; i < n; ++i)
+                emit(fn_compiler, args[i]);
+            break;
+        }
+        case NODE_ELEMS: {
+            uint32_t* elems = new_buf(uint32_t, node->elems.arg_count);
+            for (size_t i = 0, n = node->elems.arg_count; i < n; ++i)
+                elems[i] = compile_val(fn_compiler, node->elems.args[i]);
+            emit(fn_compiler, OP_MAKE_ARRAY);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, node->elems.arg_count);
+            for (size_t i = 0, n = node->elems.arg_count; i < n; ++i)
+                emit(fn_compiler, elems[i]);
+            free_buf(elems);
+            break;
+        }
+        case NODE_INDEX: {
+            uint32_t val = compile_val(fn_compiler, node->index.val);
+            uint32_t index = compile_val(fn_compiler, node->index.index);
+            emit(fn_compiler, OP_GET_ELEM);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, val);
+            emit(fn_compiler, index);
+            emit(fn_compiler, new_node_const(fn_compiler, new_bot(get_mod(node), node->type, &node->loc)));
+            break;
+        }
+        case NODE_UPDATE: {
+            uint32_t val = compile_val(fn_compiler, node->update.val);
+            uint32_t index = compile_val(fn_compiler, node->update.index);
+            uint32_t elem = compile_val(fn_compiler, node->update.elem);
+            emit(fn_compiler, OP_SET_ELEM);
+            emit(fn_compiler, dst);
+            emit(fn_compiler, val);
+            emit(fn_compiler, index);
+            emit(fn_compiler, elem);
+            emit(fn_compiler, new_node_const(fn_compiler, new_bot(get_mod(node), node->type, &node->loc)));
+            break;
+        }
+        case NODE_MAP:
+        case NODE_FOLD:
+            compile_bulk_op(fn_compiler, node, dst);
+            break;
+        default:
+            unsupported(fn_compiler, node, "expressions of this kind");
+            return;
+    }
+end:
+    if (is_tail) {
+        emit(fn_compiler, OP_RET);
+        emit(fn_compiler, dst);
+    }
+}
+
+struct bytecode* compile_to_bytecode(node_t node, struct log* log) {
+    struct bytecode* bytecode = xmalloc(sizeof(struct bytecode));
+    bytecode->mod = get_mod(node);
+    bytecode->type = node->type;
+    bytecode->functions = new_function_vec();
+    bytecode->consts = new_value_vec();
+
+    struct compiler compiler = {
+        .bytecode = bytecode,
+        .log = log
+    };
+    size_t errors = log->errors;
+    struct fn_compiler fn_compiler = new_fn_compiler(&compiler, NULL);
+    uint32_t index = reserve_function(&compiler);
+    compile_exp(&fn_compiler, node, new_reg(&fn_compiler), true);
+    finish_function(&fn_compiler, index);
+    if (log->errors != errors) {
+        free_bytecode(bytecode);
+        return NULL;
+    }
+    return bytecode;
+}
+
+void free_bytecode(struct bytecode* bytecode) {
+    for (size_t i = 0; i < bytecode->functions.size; ++i) {
+        free_code_vec(&bytecode->functions.elems[i].code);
+        free_node_vec(&bytecode->functions.elems[i].captures);
+    }
+    free_function_vec(&bytecode->functions);
+    free_value_vec(&bytecode->consts);
+    free(bytecode);
+}
+
+void dump_bytecode(const struct bytecode* bytecode) {
+    static const char* names[] = {
+#define f(name, n) #name,
+        OPCODES(f)
+#undef f
+    };
+    static const size_t operand_counts[] = {
+#define f(name, n) n,
+        OPCODES(f)
+#undef f
+    };
+    for (size_t i = 0; i < bytecode->functions.size; ++i) {
+        const struct function* fn = &bytecode->functions.elems[i];
+        printf("function %zu (%zu register(s)):\n", i, fn->reg_count);
+        for (size_t pc = 0; pc < fn->code.size;) {
+            uint32_t op = fn->code.elems[pc];
+            printf("  %4zu: %s", pc++, names[op]);
+            size_t operand_count = operand_counts[op];
+            if (op == OP_MAKE_CLOSURE || op == OP_MAKE_RECORD || op == OP_MAKE_ARRAY)
+                operand_count += fn->code.elems[pc + operand_count - 1];
+            else if (op == OP_SET_FIELDS)
+                operand_count += 2 * fn->code.elems[pc + operand_count - 1];
+            else if (op == OP_PRIM)
+                operand_count += get_prim_arity(fn->code.elems[pc + 1]);
+            for (size_t j = 0; j < operand_count; ++j)
+                printf(" %"PRIu32, fn->code.elems[pc++]);
+            printf("\n");
+        }
+    }
+}
@@ -0,0 +1,577 @@
+#include <assert.h>
+#include <string.h>
+
+#include "vm/vm.h"
+#include "vm/bytecode.h"
+#include "utils/buf.h"
+#include "utils/thread_pool.h"
+
+#define MIN_HEAP_CAP (1024 * 1024)
+
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO
+#endif
+
+struct frame {
+    const struct function* fn;
+    const uint32_t* pc;
+    size_t base;
+    uint32_t dst;
+};
+
+VEC(frame_vec, struct frame)
+
+struct heap {
+    char* data;
+    size_t size, cap;
+};
+
+struct vm {
+    const struct bytecode* bytecode;
+    struct value_vec stack;
+    struct frame_vec frames;
+    struct heap heap;
+};
+
+// Heap ----------------------------------------------------------------------------
+
+static inline size_t get_object_size(size_t value_count) {
+    // Objects always have room for at least one value, which is needed to forward them
+    return sizeof(struct object) + sizeof(struct value) * (value_count > 0 ? value_count : 1);
+}
+
+static inline void forward_value(struct heap* to_heap, struct value* value) {
+    if (value->tag != VALUE_OBJ)
+        return;
+    struct object* obj = value->obj;
+    if (obj->kind != OBJ_FORWARD) {
+        size_t size = get_object_size(obj->size);
+        struct object* copy = (struct object*)(to_heap->data + to_heap->size);
+        memcpy(copy, obj, size);
+        to_heap->size += size;
+        obj->kind = OBJ_FORWARD;
+        obj->values[0] = (struct value) { .tag = VALUE_OBJ, .obj = copy };
+    }
+    value->obj = obj->values[0].obj;
+}
+
+static void copy_heap(struct vm* vm, size_t cap) {
+    // Cheney-style copying collection: The registers of all active frames are the roots
+    struct heap to_heap = { .data = xmalloc(cap), .cap = cap };
+    for (size_t i = 0; i < vm->stack.size; ++i)
+        forward_value(&to_heap, &vm->stack.elems[i]);
+    for (size_t offset = 0; offset < to_heap.size;) {
+        struct object* obj = (struct object*)(to_heap.data + offset);
+        for (size_t i = 0; i < obj->size; ++i)
+            forward_value(&to_heap, &obj->values[i]);
+        offset += get_object_size(obj->size);
+    }
+    free(vm->heap.data);
+    vm->heap = to_heap;
+}
+
+static void collect_garbage(struct vm* vm, size_t needed) {
+    copy_heap(vm, vm->heap.cap);
+    // Grow the heap when it is more than half full after a collection
+    if (vm->heap.size + needed > vm->heap.cap / 2)
+        copy_heap(vm, round_to_pow2((vm->heap.size + needed) * 2));
+}
+
+static inline struct object* alloc_object(struct vm* vm, int kind, uint32_t aux, size_t value_count) {
+    size_t size = get_object_size(value_count);
+    if (vm->heap.size + size > vm->heap.cap)
+        collect_garbage(vm, size);
+    struct object* obj = (struct object*)(vm->heap.data + vm->heap.size);
+    vm->heap.size += size;
+    obj->kind = kind;
+    obj->aux = aux;
+    obj->size = value_count;
+    return obj;
+}
+
+// Interpreter ---------------------------------------------------------------------
+
+static inline struct value* enter_frame(struct vm* vm, size_t base, const struct function* fn) {
+    // Registers are cleared so that the collector never sees stale objects
+    size_t top = base + fn->reg_count;
+    if (top > vm->stack.cap)
+        grow_value_vec(&vm->stack, round_to_pow2(top) * 2);
+    vm->stack.size = top;
+    memset(vm->stack.elems + base, 0, sizeof(struct value) * fn->reg_count);
+    return vm->stack.elems + base;
+}
+
+static inline bool is_same_const(const struct value* value, const struct value* constant) {
+    return value->tag == constant->tag && value->int_val == constant->int_val;
+}
+
+static inline bool is_closure(const struct value* value) {
+    return value->tag == VALUE_OBJ && value->obj->kind == OBJ_CLOSURE;
+}
+
+static inline struct value run_prim(enum prim_op op, uint32_t types, const struct value* regs, const uint32_t* args, size_t arg_count) {
+    // Values that are not numbers (e.g. bottom) are propagated
+    struct lit lits[2];
+    for (size_t i = 0; i < arg_count; ++i) {
+        const struct value* arg = &regs[args[i]];
+        if (arg->tag == VALUE_FLOAT)
+            lits[i] = (struct lit) { .tag = LIT_FLOAT, .float_val = arg->float_val };
+        else if (arg->tag == VALUE_INT)
+            lits[i] = (struct lit) { .tag = LIT_INT, .int_val = arg->int_val };
+        else
+            return *arg;
+    }
+    struct lit res = eval_prim(op, decode_num_type(types >> 16), decode_num_type(types), lits);
+    return res.tag == LIT_FLOAT
+        ? (struct value) { .tag = VALUE_FLOAT, .float_val = res.float_val }
+        : (struct value) { .tag = VALUE_INT, .int_val = res.int_val };
+}
+
+static struct value run(struct vm* vm, const struct function* fn, struct value closure, struct value arg) {
+    // The values that are already on the stack are kept, as they may be roots
+    const struct function* functions = vm->bytecode->functions.elems;
+    const struct value* consts = vm->bytecode->consts.elems;
+    const uint32_t* pc = fn->code.elems;
+    size_t base = vm->stack.size;
+    struct value* regs = enter_frame(vm, base, fn);
+    struct value res;
+    regs[REG_CLOSURE] = closure;
+    regs[REG_ARG] = arg;
+
+#ifdef USE_COMPUTED_GOTO
+    static const void* dispatch_table[] = {
+#define f(name, n) &&label_##name,
+        OPCODES(f)
+#undef f
+    };
+#define DISPATCH() goto *dispatch_table[*pc++]
+#define CASE(name) label_##name:
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define CASE(name) case OP_##name:
+dispatch:
+    switch (*pc++) {
+#endif
+        CASE(LOAD_CONST)
+            regs[pc[0]] = consts[pc[1]];
+            pc += 2;
+            DISPATCH();
+        CASE(MOVE)
+            regs[pc[0]] = regs[pc[1]];
+            pc += 2;
+            DISPATCH();
+        CASE(MAKE_CLOSURE) {
+            struct object* obj = alloc_object(vm, OBJ_CLOSURE, pc[1], pc[2]);
+            for (size_t i = 0, n = pc[2]; i < n; ++i)
+                obj->values[i] = regs[pc[3 + i]];
+            regs[pc[0]] = (struct value) { .tag = VALUE_OBJ, .obj = obj };
+            pc += 3 + pc[2];
+            DISPATCH();
+        }
+        CASE(MAKE_RECORD) {
+            struct object* obj = alloc_object(vm, OBJ_RECORD, 0, pc[1]);
+            for (size_t i = 0, n = pc[1]; i < n; ++i)
+                obj->values[i] = regs[pc[2 + i]];
+            regs[pc[0]] = (struct value) { .tag = VALUE_OBJ, .obj = obj };
+            pc += 2 + pc[1];
+            DISPATCH();
+        }
+        CASE(MAKE_INJ) {
+            struct object* obj = alloc_object(vm, OBJ_INJ, pc[1], 1);
+            obj->values[0] = regs[pc[2]];
+            regs[pc[0]] = (struct value) { .tag = VALUE_OBJ, .obj = obj };
+            pc += 3;
+            DISPATCH();
+        }
+        CASE(GET_FIELD)
+            // Values that are not objects (bottom, for instance) propagate through projections
+            regs[pc[0]] = regs[pc[1]].tag == VALUE_OBJ
+                ? regs[pc[1]].obj->values[pc[2]]
+                : regs[pc[1]];
+            pc += 3;
+            DISPATCH();
+        CASE(SET_FIELDS)
+            if (regs[pc[1]].tag == VALUE_OBJ) {
+                struct object* obj = alloc_object(vm, OBJ_RECORD, 0, regs[pc[1]].obj->size);
+                memcpy(obj->values, regs[pc[1]].obj->values, sizeof(struct value) * obj->size);
+                for (size_t i = 0, n = pc[2]; i < n; ++i)
+                    obj->values[pc[3 + 2 * i]] = regs[pc[4 + 2 * i]];
+                regs[pc[0]] = (struct value) { .tag = VALUE_OBJ, .obj = obj };
+            } else
+                regs[pc[0]] = regs[pc[1]];
+            pc += 3 + 2 * pc[2];
+            DISPATCH();
+        CASE(GET_CAPTURE)
+            regs[pc[0]] = regs[REG_CLOSURE].obj->values[pc[1]];
+            pc += 2;
+            DISPATCH();
+        CASE(SET_CAPTURE)
+            regs[pc[0]].obj->values[pc[1]] = regs[pc[2]];
+            pc += 3;
+            DISPATCH();
+        CASE(CALL) {
+            struct value callee = regs[pc[1]], arg = regs[pc[2]];
+            if (!is_closure(&callee)) {
+                regs[pc[0]] = callee;
+                pc += 3;
+                DISPATCH();
+            }
+            push_to_frame_vec(&vm->frames, (struct frame) { .fn = fn, .pc = pc + 3, .base = base, .dst = pc[0] });
+            base += fn->reg_count;
+            fn = &functions[callee.obj->aux];
+            pc = fn->code.elems;
+            regs = enter_frame(vm, base, fn);
+            regs[REG_CLOSURE] = callee;
+            regs[REG_ARG] = arg;
+            DISPATCH();
+        }
+        CASE(TAIL_CALL) {
+            struct value callee = regs[pc[0]], arg = regs[pc[1]];
+            if (!is_closure(&callee)) {
+                res = callee;
+                goto ret;
+            }
+            fn = &functions[callee.obj->aux];
+            pc = fn->code.elems;
+            regs = enter_frame(vm, base, fn);
+            regs[REG_CLOSURE] = callee;
+            regs[REG_ARG] = arg;
+            DISPATCH();
+        }
+        CASE(RET)
+            res = regs[pc[0]];
+        ret: {
+            if (vm->frames.size == 0)
+                return res;
+            struct frame frame = pop_from_frame_vec(&vm->frames);
+            vm->stack.size = base;
+            fn = frame.fn;
+            pc = frame.pc;
+            base = frame.base;
+            regs = vm->stack.elems + base;
+            regs[frame.dst] = res;
+            DISPATCH();
+        }
+        CASE(JUMP)
+            pc = fn->code.elems + pc[0];
+            DISPATCH();
+        CASE(JUMP_IF_NOT_CONST)
+            pc = is_same_const(&regs[pc[0]], &consts[pc[1]]) ? pc + 3 : fn->code.elems + pc[2];
+            DISPATCH();
+        CASE(JUMP_IF_NOT_TAG)
+            pc = regs[pc[0]].tag == VALUE_OBJ && regs[pc[0]].obj->aux == pc[1] ? pc + 3 : fn->code.elems + pc[2];
+            DISPATCH();
+        CASE(PRIM) {
+            size_t arg_count = get_prim_arity(pc[1]);
+            regs[pc[0]] = run_prim(pc[1], pc[2], regs, pc + 3, arg_count);
+            pc += 3 + arg_count;
+            DISPATCH();
+        }
+        CASE(MAKE_ARRAY) {
+            struct object* obj = alloc_object(vm, OBJ_ARRAY, 0, pc[1]);
+            for (size_t i = 0, n = pc[1]; i < n; ++i)
+                obj->values[i] = regs[pc[2 + i]];
+            regs[pc[0]] = (struct value) { .tag = VALUE_OBJ, .obj = obj };
+            pc += 2 + pc[1];
+            DISPATCH();
+        }
+        CASE(NEW_ARRAY)
+            // Elements are initialized so that the collector can scan the array before it is filled
+            if (regs[pc[1]].tag == VALUE_INT) {
+                struct object* obj = alloc_object(vm, OBJ_ARRAY, 0, regs[pc[1]].int_val);
+                memset(obj->values, 0, sizeof(struct value) * obj->size);
+                regs[pc[0]] = (struct value) { .tag = VALUE_OBJ, .obj = obj };
+            } else
+                regs[pc[0]] = regs[pc[1]];
+            pc += 2;
+            DISPATCH();
+        CASE(ARRAY_LEN)
+            regs[pc[0]] = regs[pc[1]].tag == VALUE_OBJ
+                ? (struct value) { .tag = VALUE_INT, .int_val = regs[pc[1]].obj->size }
+                : regs[pc[1]];
+            pc += 2;
+            DISPATCH();
+        CASE(GET_ELEM)
+            if (regs[pc[1]].tag != VALUE_OBJ)
+                regs[pc[0]] = regs[pc[1]];
+            else if (regs[pc[2]].tag != VALUE_INT)
+                regs[pc[0]] = regs[pc[2]];
+            else if (regs[pc[2]].int_val >= regs[pc[1]].obj->size)
+                regs[pc[0]] = consts[pc[3]];
+            else
+                regs[pc[0]] = regs[pc[1]].obj->values[regs[pc[2]].int_val];
+            pc += 4;
+            DISPATCH();
+        CASE(SET_ELEM)
+            if (regs[pc[1]].tag != VALUE_OBJ)
+                regs[pc[0]] = regs[pc[1]];
+            else if (regs[pc[2]].tag != VALUE_INT)
+                regs[pc[0]] = regs[pc[2]];
+            else if (regs[pc[2]].int_val >= regs[pc[1]].obj->size)
+                regs[pc[0]] = consts[pc[4]];
+            else {
+                struct object* obj = alloc_object(vm, OBJ_ARRAY, 0, regs[pc[1]].obj->size);
+                memcpy(obj->values, regs[pc[1]].obj->values, sizeof(struct value) * obj->size);
+                obj->values[regs[pc[2]].int_val] = regs[pc[3]];
+                regs[pc[0]] = (struct value) { .tag = VALUE_OBJ, .obj = obj };
+            }
+            pc += 5;
+            DISPATCH();
+        CASE(STORE_ELEM)
+            regs[pc[0]].obj->values[regs[pc[1]].int_val] = regs[pc[2]];
+            pc += 3;
+            DISPATCH();
+#ifndef USE_COMPUTED_GOTO
+        default:
+            assert(false && "invalid opcode");
+            return (struct value) { .tag = VALUE_INT };
+    }
+#endif
+#undef DISPATCH
+#undef CASE
+}
+
+// Read back -----------------------------------------------------------------------
+
+struct read_back_entry {
+    const struct object* obj;
+    node_t var;
+    bool is_recursive;
+};
+
+VEC(read_back_stack, struct read_back_entry)
+
+static node_t read_back(struct vm*, struct value, node_t, struct read_back_stack*);
+
+static node_t read_back_closure(struct vm* vm, struct object* obj, struct read_back_stack* stack) {
+    // Closures are read back by substituting their captured values in the original abstraction
+    const struct function* fn = &vm->bytecode->functions.elems[obj->aux];
+    node_t* vals = new_buf(node_t, fn->captures.size);
+    size_t index = stack->size;
+    push_to_read_back_stack(stack, (struct read_back_entry) { .obj = obj });
+    for (size_t i = 0; i < fn->captures.size; ++i) {
+        node_t var = fn->captures.elems[i];
+        struct value value = obj->values[i];
+        vals[i] = NULL;
+        for (size_t j = 0; j < stack->size && value.tag == VALUE_OBJ; ++j) {
+            if (stack->elems[j].obj != value.obj)
+                continue;
+            // Cycles come from letrec-expressions, and are read back as such
+            if (!stack->elems[j].var)
+                stack->elems[j].var = var;
+            stack->elems[j].is_recursive = true;
+            vals[i] = stack->elems[j].var;
+            break;
+        }
+        if (!vals[i])
+            vals[i] = read_back(vm, value, var->type, stack);
+    }
+    node_t node = replace_vars(fn->abs, fn->captures.elems, vals, fn->captures.size);
+    struct read_back_entry entry = stack->elems[index];
+    stack->size = index;
+    if (entry.is_recursive)
+        node = new_letrec(vm->bytecode->mod, &entry.var, &node, 1, entry.var, &node->loc);
+    free_buf(vals);
+    return node;
+}
+
+static node_t read_back(struct vm* vm, struct value value, node_t type, struct read_back_stack* stack) {
+    mod_t mod = vm->bytecode->mod;
+    switch (value.tag) {
+        case VALUE_INT:
+            return new_lit(mod, type, &(struct lit) { .tag = LIT_INT, .int_val = value.int_val }, NULL);
+        case VALUE_FLOAT:
+            return new_lit(mod, type, &(struct lit) { .tag = LIT_FLOAT, .float_val = value.float_val }, NULL);
+        case VALUE_NODE:
+            return value.node;
+        default:
+            break;
+    }
+    struct object* obj = value.obj;
+    node_t reduced_type = reduce_node(type);
+    switch (obj->kind) {
+        case OBJ_RECORD: {
+            assert(reduced_type->tag == NODE_PROD);
+            node_t* args = new_buf(node_t, obj->size);
+            for (size_t i = 0; i < obj->size; ++i)
+                args[i] = read_back(vm, obj->values[i], reduced_type->prod.args[i], stack);
+            node_t record = new_record(mod, args, reduced_type->prod.labels, obj->size, NULL);
+            free_buf(args);
+            return record;
+        }
+        case OBJ_INJ:
+            assert(reduced_type->tag == NODE_SUM);
+            return new_inj(mod, type, reduced_type->sum.labels[obj->aux],
+                read_back(vm, obj->values[0], reduced_type->sum.args[obj->aux], stack), NULL);
+        case OBJ_CLOSURE:
+            return read_back_closure(vm, obj, stack);
+        case OBJ_ARRAY: {
+            assert(reduced_type->tag == NODE_ARRAY);
+            node_t* elems = new_buf(node_t, obj->size);
+            for (size_t i = 0; i < obj->size; ++i)
+                elems[i] = read_back(vm, obj->values[i], reduced_type->array.elem, stack);
+            node_t array = new_elems(mod, reduced_type->array.elem, elems, obj->size, NULL);
+            free_buf(elems);
+            return array;
+        }
+        default:
+            assert(false && "invalid object");
+            return NULL;
+    }
+}
+
+static inline struct vm new_vm(const struct bytecode* bytecode) {
+    return (struct vm) {
+        .bytecode = bytecode,
+        .stack = new_value_vec(),
+        .frames = new_frame_vec(),
+        .heap = { .data = xmalloc(MIN_HEAP_CAP), .cap = MIN_HEAP_CAP }
+    };
+}
+
+static inline void free_vm(struct vm* vm) {
+    free_value_vec(&vm->stack);
+    free_frame_vec(&vm->frames);
+    free(vm->heap.data);
+}
+
+static inline node_t read_back_result(struct vm* vm, struct value value, node_t type) {
+    struct read_back_stack stack = new_read_back_stack();
+    node_t node = read_back(vm, value, type, &stack);
+    free_read_back_stack(&stack);
+    return node;
+}
+
+node_t run_bytecode(const struct bytecode* bytecode) {
+    struct vm vm = new_vm(bytecode);
+    struct value res = run(&vm, &bytecode->functions.elems[0], (struct value) { 0 }, (struct value) { 0 });
+    node_t node = read_back_result(&vm, res, bytecode->type);
+    free_vm(&vm);
+    return node;
+}
+
+// Batches -------------------------------------------------------------------------
+
+struct prepared_fn {
+    struct bytecode* bytecode;
+    node_t arrow;
+};
+
+struct batch_task {
+    struct task task;
+    const struct prepared_fn* prepared;
+    const node_t* inputs;
+    node_t* outputs;
+    size_t count;
+};
+
+static void load_value(struct vm* vm, node_t node) {
+    // Loads a value on top of the stack: Objects are only built once their
+    // elements are on the stack, so that they are seen by the collector.
+    struct value value = { .tag = VALUE_NODE, .node = node };
+    if (node->tag == NODE_LIT) {
+        value = node->lit.tag == LIT_FLOAT
+            ? (struct value) { .tag = VALUE_FLOAT, .float_val = node->lit.float_val }
+            : (struct value) { .tag = VALUE_INT, .int_val = node->lit.int_val };
+    } else if (node->tag == NODE_RECORD || node->tag == NODE_ELEMS || node->tag == NODE_INJ) {
+        const node_t* args = node->tag == NODE_INJ ? &node->inj.arg : node->record.args;
+        size_t arg_count = node->tag == NODE_INJ ? 1 : node->record.arg_count;
+        if (node->tag == NODE_ELEMS) {
+            args = node->elems.args;
+            arg_count = node->elems.arg_count;
+        }
+        for (size_t i = 0; i < arg_count; ++i)
+            load_value(vm, args[i]);
+        uint32_t aux = node->tag == NODE_INJ ? find_label_in_node(reduce_type(node->type), node->inj.label) : 0;
+        int kind = node->tag == NODE_RECORD ? OBJ_RECORD : node->tag == NODE_INJ ? OBJ_INJ : OBJ_ARRAY;
+        struct object* obj = alloc_object(vm, kind, aux, arg_count);
+        vm->stack.size -= arg_count;
+        memcpy(obj->values, vm->stack.elems + vm->stack.size, sizeof(struct value) * arg_count);
+        value = (struct value) { .tag = VALUE_OBJ, .obj = obj };
+    }
+    push_to_value_vec(&vm->stack, value);
+}
+
+static void run_batch_task(struct task* task) {
+    // The function is evaluated once, and stays at the bottom of the stack,
+    // while the heap of the machine is reused for every input.
+    struct batch_task* batch_task = (struct batch_task*)task;
+    const struct prepared_fn* prepared = batch_task->prepared;
+    const struct bytecode* bytecode = prepared->bytecode;
+    struct vm vm = new_vm(bytecode);
+    struct value fn = run(&vm, &bytecode->functions.elems[0], (struct value) { 0 }, (struct value) { 0 });
+    vm.stack.size = 0;
+    push_to_value_vec(&vm.stack, fn);
+    for (size_t i = 0; i < batch_task->count; ++i) {
+        node_t input = batch_task->inputs[i];
+        load_value(&vm, input);
+        struct value arg = pop_from_value_vec(&vm.stack);
+        struct value closure = vm.stack.elems[0];
+        struct value res = is_closure(&closure)
+            ? run(&vm, &bytecode->functions.elems[closure.obj->aux], closure, arg)
+            : closure;
+        vm.stack.size = 1;
+
+        node_t type = prepared->arrow->arrow.codom;
+        if (!is_unbound_var(prepared->arrow->arrow.var))
+            type = replace_var(type, prepared->arrow->arrow.var, input);
+        batch_task->outputs[i] = read_back_result(&vm, res, type);
+    }
+    free_vm(&vm);
+}
+
+struct prepared_fn* prepare_function(node_t fn, struct log* log) {
+    node_t arrow = reduce_type(fn->type);
+    if (arrow->tag != NODE_ARROW) {
+        log_error(log, &fn->loc, "only functions can be applied to batches of inputs", NULL);
+        return NULL;
+    }
+    struct bytecode* bytecode = compile_to_bytecode(fn, log);
+    if (!bytecode)
+        return NULL;
+    struct prepared_fn* prepared = xmalloc(sizeof(struct prepared_fn));
+    prepared->bytecode = bytecode;
+    prepared->arrow = arrow;
+    return prepared;
+}
+
+void free_prepared_function(struct prepared_fn* prepared) {
+    free_bytecode(prepared->bytecode);
+    free(prepared);
+}
+
+void apply_batch(
+    const struct prepared_fn* prepared,
+    const node_t* inputs, node_t* outputs, size_t count,
+    struct thread_pool* pool)
+{
+    size_t task_count = pool ? get_thread_count(pool) : 1;
+    if (task_count > count)
+        task_count = count;
+    if (task_count <= 1) {
+        struct batch_task task = { .prepared = prepared, .inputs = inputs, .outputs = outputs, .count = count };
+        run_batch_task(&task.task);
+        return;
+    }
+
+    // Results are read back concurrently into the module, which must be thread-safe
+    struct batch_task* tasks = new_buf(struct batch_task, task_count);
+    for (size_t i = 0, begin = 0; i < task_count; ++i) {
+        size_t end = (count * (i + 1)) / task_count;
+        tasks[i] = (struct batch_task) {
+            .task.run = run_batch_task,
+            .prepared = prepared,
+            .inputs = inputs + begin,
+            .outputs = outputs + begin,
+            .count = end - begin
+        };
+        begin = end;
+    }
+    for (size_t i = 1; i < task_count; ++i)
+        spawn_task(pool, &tasks[i].task);
+    run_batch_task(&tasks[0].task);
+    for (size_t i = 1; i < task_count; ++i)
+        wait_task(pool, &tasks[i].task);
+    free_buf(tasks);
+}
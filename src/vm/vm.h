@@ -0,0 +1,40 @@
+#ifndef VM_VM_H
+#define VM_VM_H
+
+#include "ir/node.h"
+#include "utils/log.h"
+
+/*
+ * The virtual machine executes IR programs that have been compiled to bytecode.
+ * It is a register machine with strict (call-by-value) semantics: Values are
+ * stored in registers, records are laid out flat in memory, and heap objects
+ * are managed by a copying garbage collector. Type-level expressions are erased,
+ * and evaluate to the corresponding IR node.
+ */
+
+struct bytecode;
+struct prepared_fn;
+struct thread_pool;
+
+// Compiles the given closed expression to bytecode.
+// Returns NULL and reports an error if some construct is not supported.
+struct bytecode* compile_to_bytecode(node_t, struct log*);
+void free_bytecode(struct bytecode*);
+void dump_bytecode(const struct bytecode*);
+
+// Runs the bytecode, and reads back the result into the module of the compiled expression.
+node_t run_bytecode(const struct bytecode*);
+
+// Compiles a closed function, so that it can be applied to many inputs with
+// `apply_batch`. Returns NULL and reports an error if the function cannot be compiled.
+struct prepared_fn* prepare_function(node_t, struct log*);
+void free_prepared_function(struct prepared_fn*);
+
+// Applies a prepared function to each input, and reads back the results into the
+// module. Inputs are loaded directly into the heap of the machine, which is reused
+// from one input to the next: Only the results are hash-consed. When a thread pool
+// is given, the inputs are split among its threads, which requires a thread-safe
+// module (see `MOD_THREAD_SAFE`).
+void apply_batch(const struct prepared_fn*, const node_t*, node_t*, size_t, struct thread_pool*);
+
+#endif
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/eval.h"
+#include "ir/print.h"
+#include "vm/vm.h"
+#include "helpers.h"
+
+#define ERR_BUF_SIZE 256
+
+// The program updates an array, squares its elements, and sums them.
+// Every execution engine must agree on the result, including bottom for out-of-bounds updates.
+
+static node_t new_program(mod_t mod, uintmax_t index) {
+    // (\(v : [Nat; 3]) -> fold (\(acc : Nat) -> \(x : Nat) -> acc + x) 0 (map (\(y : Nat) -> y * y) v.[index = 20])) [1, 2, 3]
+    node_t acc = new_nat_var(mod, "acc");
+    node_t x = new_nat_var(mod, "x");
+    node_t y = new_nat_var(mod, "y");
+    node_t add = new_abs(mod, acc, new_abs(mod, x, new_binary_prim(mod, PRIM_ADD, acc, x), NULL), NULL);
+    node_t square = new_abs(mod, y, new_binary_prim(mod, PRIM_MUL, y, y), NULL);
+
+    node_t elems[] = { new_nat_lit(mod, 1), new_nat_lit(mod, 2), new_nat_lit(mod, 3) };
+    node_t array = new_elems(mod, new_nat(mod), elems, 3, NULL);
+    node_t v = new_var(mod, array->type, new_label(mod, "v", NULL), NULL);
+    node_t update = new_update(mod, v, new_nat_lit(mod, index), new_nat_lit(mod, 20), NULL);
+    node_t body = new_fold(mod, add, new_nat_lit(mod, 0), new_map(mod, square, update, NULL), NULL);
+    return new_app(mod, new_abs(mod, v, body, NULL), array, NULL);
+}
+
+static bool run_test(uintmax_t index, node_t (*expected)(mod_t)) {
+    mod_t mod = new_mod();
+    node_t program = new_program(mod, index);
+    node_t res = expected(mod);
+
+    char err_data[ERR_BUF_SIZE];
+    struct format_buf err_buf = { .data = err_data, .cap = sizeof(err_data) };
+    struct log log = { .out = { .buf = &err_buf, .tab = "  " } };
+    struct bytecode* bytecode = compile_to_bytecode(program, &log);
+    node_t results[] = {
+        reduce_node(program),
+        eval_node(program),
+        bytecode ? run_bytecode(bytecode) : NULL
+    };
+    static const char* engines[] = { "reduce", "eval", "vm" };
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); ++i) {
+        if (results[i] == res)
+            continue;
+        printf("array(%ju): %s gave ", index, engines[i]);
+        if (results[i])
+            dump_node(results[i]);
+        else
+            printf("nothing\n");
+        ok = false;
+    }
+    if (bytecode)
+        free_bytecode(bytecode);
+    free_mod(mod);
+    dump_format_buf(&err_buf, stderr);
+    free_format_buf(err_buf.next);
+    return ok;
+}
+
+static node_t new_square_sum(mod_t mod) {
+    return new_nat_lit(mod, 1 + 400 + 9);
+}
+
+static node_t new_nat_bot(mod_t mod) {
+    return new_bot(mod, new_nat(mod), NULL);
+}
+
+static bool check_index_of_update(void) {
+    // (v : [Nat; 3]).[i = 20].(i) is 20 only when i is in bounds
+    mod_t mod = new_mod();
+    node_t elems[] = { new_nat_lit(mod, 1), new_nat_lit(mod, 2), new_nat_lit(mod, 3) };
+    node_t v = new_var(mod, new_elems(mod, new_nat(mod), elems, 3, NULL)->type, new_label(mod, "v", NULL), NULL);
+    node_t elem = new_nat_lit(mod, 20);
+    node_t in_bounds = new_index(mod, new_update(mod, v, new_nat_lit(mod, 1), elem, NULL), new_nat_lit(mod, 1), NULL);
+    node_t out_of_bounds = new_index(mod, new_update(mod, v, new_nat_lit(mod, 5), elem, NULL), new_nat_lit(mod, 5), NULL);
+    bool ok = in_bounds == elem && out_of_bounds != elem;
+    if (!ok)
+        printf("array: index of update simplified to the element out of bounds\n");
+    free_mod(mod);
+    return ok;
+}
+
+int main(void) {
+    bool ok = check_index_of_update();
+    ok &= run_test(1, new_square_sum);
+    ok &= run_test(5, new_nat_bot);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
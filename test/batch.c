@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "vm/vm.h"
+#include "utils/thread_pool.h"
+#include "utils/buf.h"
+#include "helpers.h"
+
+#define INPUT_COUNT  10000
+#define THREAD_COUNT 4
+#define OUTPUT_SIZE  1024
+
+// A function is applied to many records, with and without threads. The results
+// must be the same as those obtained by reducing each application separately.
+
+static node_t new_input_type(mod_t mod) {
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL) };
+    return new_prod(mod, (node_t[]) { new_nat(mod), new_nat(mod) }, labels, 2, NULL);
+}
+
+static node_t new_input(mod_t mod, size_t i) {
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL) };
+    return new_record(mod, (node_t[]) { new_nat_lit(mod, i), new_nat_lit(mod, i % 7) }, labels, 2, NULL);
+}
+
+static node_t new_fn(mod_t mod) {
+    // \(r : { a : Nat, b : Nat }) -> { s = r.a + r.b, p = r.a * r.b }
+    node_t r = new_var(mod, new_input_type(mod), new_label(mod, "r", NULL), NULL);
+    node_t a = new_ext(mod, r, new_label(mod, "a", NULL), NULL);
+    node_t b = new_ext(mod, r, new_label(mod, "b", NULL), NULL);
+    label_t labels[] = { new_label(mod, "s", NULL), new_label(mod, "p", NULL) };
+    node_t args[] = { new_binary_prim(mod, PRIM_ADD, a, b), new_binary_prim(mod, PRIM_MUL, a, b) };
+    return new_abs(mod, r, new_record(mod, args, labels, 2, NULL), NULL);
+}
+
+static bool run_test(struct thread_pool* pool) {
+    mod_t mod = new_mod_with_flags(pool ? MOD_THREAD_SAFE : 0);
+    char err_data[OUTPUT_SIZE];
+    struct format_buf err_buf = { .data = err_data, .cap = sizeof(err_data) };
+    struct log log = { .out = { .buf = &err_buf, .tab = "  " } };
+    node_t fn = new_fn(mod);
+    struct prepared_fn* prepared = prepare_function(fn, &log);
+    dump_format_buf(&err_buf, stderr);
+    free_format_buf(err_buf.next);
+    if (!prepared) {
+        free_mod(mod);
+        return false;
+    }
+
+    node_t* inputs = new_buf(node_t, INPUT_COUNT);
+    node_t* outputs = new_buf(node_t, INPUT_COUNT);
+    for (size_t i = 0; i < INPUT_COUNT; ++i)
+        inputs[i] = new_input(mod, i);
+    apply_batch(prepared, inputs, outputs, INPUT_COUNT, pool);
+
+    bool ok = true;
+    for (size_t i = 0; i < INPUT_COUNT && ok; ++i) {
+        node_t expected = reduce_node(new_app(mod, fn, inputs[i], NULL));
+        if (outputs[i] != expected) {
+            printf("batch: got ");
+            dump_node(outputs[i]);
+            ok = false;
+        }
+    }
+    free_buf(inputs);
+    free_buf(outputs);
+    free_prepared_function(prepared);
+    free_mod(mod);
+    return ok;
+}
+
+int main(void) {
+    bool ok = run_test(NULL);
+    struct thread_pool* pool = new_thread_pool(THREAD_COUNT);
+    ok &= run_test(pool);
+    free_thread_pool(pool);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
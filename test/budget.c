@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "utils/log.h"
+#include "helpers.h"
+
+#define MAX_STEPS   1000
+#define DEEP_ARG    100000
+#define OUTPUT_SIZE 1024
+
+// Reductions with a budget must stop on diverging programs, and must give the
+// same result as an unbounded reduction on the others.
+
+static node_t new_countdown(mod_t mod, uintmax_t i, bool is_diverging) {
+    // letrec f : Nat -> Nat = \(n : Nat) -> match n with 0 => 0 | _ => f (n -/+ 1) in f i
+    node_t nat = new_nat(mod);
+    node_t fn_type = new_arrow(mod, new_unbound_var(mod, nat, NULL), nat, NULL);
+    node_t f = new_var(mod, fn_type, new_label(mod, "f", NULL), NULL);
+    node_t n = new_var(mod, nat, new_label(mod, "n", NULL), NULL);
+    node_t args[] = { n, new_nat_lit(mod, 1) };
+    node_t next = new_prim(mod, is_diverging ? PRIM_ADD : PRIM_SUB, nat, args, 2, NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, nat, NULL) };
+    node_t vals[] = { new_nat_lit(mod, 0), new_app(mod, f, next, NULL) };
+    node_t fn = new_abs(mod, n, new_match(mod, pats, vals, 2, n, NULL), NULL);
+    return new_letrec(mod, &f, &fn, 1, new_app(mod, f, new_nat_lit(mod, i), NULL), NULL);
+}
+
+static node_t new_acc(mod_t mod, uintmax_t i) {
+    // letrec go = \(n : Nat) -> \(acc : Nat) -> match n with 0 => acc | _ => go (n - 1) (acc + n) in go i 0
+    node_t nat = new_nat(mod);
+    node_t go = new_var(mod, new_nat_fun_type(mod, new_nat_fun_type(mod, nat)), new_label(mod, "go", NULL), NULL);
+    node_t n = new_nat_var(mod, "n");
+    node_t acc = new_nat_var(mod, "acc");
+    node_t rec_call = new_app(mod,
+        new_app(mod, go, new_binary_prim(mod, PRIM_SUB, n, new_nat_lit(mod, 1)), NULL),
+        new_add(mod, acc, n), NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, nat, NULL) };
+    node_t vals[] = { acc, rec_call };
+    node_t go_fun = new_abs(mod, n, new_abs(mod, acc, new_match(mod, pats, vals, 2, n, NULL), NULL), NULL);
+    node_t body = new_app(mod, new_app(mod, go, new_nat_lit(mod, i), NULL), new_nat_lit(mod, 0), NULL);
+    return new_letrec(mod, &go, &go_fun, 1, body, NULL);
+}
+
+static node_t reduce_with_steps(node_t node, size_t max_steps, size_t* errors) {
+    char err_data[OUTPUT_SIZE];
+    struct format_buf err_buf = { .data = err_data, .cap = sizeof(err_data) };
+    struct log log = { .out = { .buf = &err_buf, .tab = "  " } };
+    node_t res = reduce_node_with_budget(node, &(struct budget) { .max_steps = max_steps }, &log);
+    free_format_buf(err_buf.next);
+    *errors = log.errors;
+    return res;
+}
+
+int main(void) {
+    mod_t mod = new_mod();
+    bool ok = true;
+    size_t errors = 0;
+
+    node_t res = reduce_with_steps(new_countdown(mod, 10, false), MAX_STEPS, &errors);
+    ok &= res == new_nat_lit(mod, 0) && errors == 0;
+
+    res = reduce_with_steps(new_countdown(mod, 10 * MAX_STEPS, false), MAX_STEPS, &errors);
+    ok &= !res && errors == 1;
+
+    res = reduce_with_steps(new_countdown(mod, 1, true), MAX_STEPS, &errors);
+    ok &= !res && errors == 1;
+
+    // Reductions nest once per call here, and must stop before the stack overflows,
+    // even when the number of steps is not limited
+    res = reduce_with_steps(new_acc(mod, DEEP_ARG), SIZE_MAX, &errors);
+    ok &= !res && errors == 1;
+    res = reduce_with_steps(new_acc(mod, 10), SIZE_MAX, &errors);
+    ok &= res == new_nat_lit(mod, 55) && errors == 0;
+
+    // Results reached after the budget is exhausted must not be cached
+    ok &= reduce_node(new_countdown(mod, 10 * MAX_STEPS, false)) == new_nat_lit(mod, 0);
+
+    if (!ok)
+        printf("budget: unexpected result\n");
+    free_mod(mod);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
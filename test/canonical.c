@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "helpers.h"
+
+// In a module with canonical binders, alpha-equivalent expressions must be the same node,
+// including those obtained by reduction.
+
+static node_t new_const_fn(mod_t mod, const char* a, const char* x, const char* y) {
+    // \(a : Nat) -> \(x : Nat) -> \(y : Nat) -> a + x
+    node_t a_var = new_nat_var(mod, a);
+    node_t x_var = new_nat_var(mod, x);
+    node_t y_var = new_nat_var(mod, y);
+    return new_abs(mod, a_var, new_abs(mod, x_var, new_abs(mod, y_var, new_add(mod, a_var, x_var), NULL), NULL), NULL);
+}
+
+static node_t new_redex(mod_t mod) {
+    // \(a : Nat) -> (\(g : Nat -> Nat) -> \(x : Nat) -> \(y : Nat) -> g x) (\(z : Nat) -> a + z)
+    node_t a = new_nat_var(mod, "a");
+    node_t x = new_nat_var(mod, "x");
+    node_t y = new_nat_var(mod, "y");
+    node_t z = new_nat_var(mod, "z");
+    node_t g = new_var(mod, new_arrow(mod, new_unbound_var(mod, new_nat(mod), NULL), new_nat(mod), NULL), new_label(mod, "g", NULL), NULL);
+    node_t fn = new_abs(mod, g, new_abs(mod, x, new_abs(mod, y, new_app(mod, g, x, NULL), NULL), NULL), NULL);
+    return new_abs(mod, a, new_app(mod, fn, new_abs(mod, z, new_add(mod, a, z), NULL), NULL), NULL);
+}
+
+static bool check(const char* name, node_t node, node_t expected) {
+    if (node == expected)
+        return true;
+    printf("%s: expected ", name);
+    dump_node(expected);
+    printf("%s: got ", name);
+    dump_node(node);
+    return false;
+}
+
+int main(void) {
+    mod_t mod = new_mod_with_flags(MOD_CANONICAL_BINDERS);
+    node_t expected = new_const_fn(mod, "a", "x", "y");
+    bool ok = true;
+    ok &= check("renaming", new_const_fn(mod, "b", "u", "v"), expected);
+    ok &= check("reduction", reduce_node(new_redex(mod)), expected);
+    free_mod(mod);
+
+    // Without the flag, binder names are kept as they are
+    mod = new_mod();
+    ok &= new_const_fn(mod, "a", "x", "y") != new_const_fn(mod, "b", "u", "v");
+    free_mod(mod);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
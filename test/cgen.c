@@ -0,0 +1,154 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "cgen/cgen.h"
+#include "helpers.h"
+
+#define MAX_PRED    10
+#define OUTPUT_SIZE 1024
+
+// The program is built directly in the IR, and uses records, injections,
+// closures, and mutually recursive functions.
+
+static node_t new_parity_type(mod_t mod) {
+    node_t args[] = { new_nat(mod), new_nat(mod) };
+    label_t labels[] = { new_label(mod, "even", NULL), new_label(mod, "odd", NULL) };
+    return new_sum(mod, args, labels, 2, NULL);
+}
+
+static node_t new_pair(mod_t mod, node_t a, node_t b) {
+    node_t args[] = { a, b };
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL) };
+    return new_record(mod, args, labels, 2, NULL);
+}
+
+static node_t new_pred(mod_t mod) {
+    // \(n : Nat) -> match n with 1 => 0 | 2 => 1 | ... | _ => 0
+    node_t n = new_nat_var(mod, "n");
+    node_t pats[MAX_PRED + 1];
+    node_t vals[MAX_PRED + 1];
+    for (size_t i = 0; i < MAX_PRED; ++i) {
+        pats[i] = new_nat_lit(mod, i + 1);
+        vals[i] = new_nat_lit(mod, i);
+    }
+    pats[MAX_PRED] = new_unbound_var(mod, new_nat(mod), NULL);
+    vals[MAX_PRED] = new_nat_lit(mod, 0);
+    return new_abs(mod, n, new_match(mod, pats, vals, MAX_PRED + 1, n, NULL), NULL);
+}
+
+static node_t new_parity_fun(mod_t mod, const char* name, const char* label, node_t other, node_t pred) {
+    // \(m : Nat) -> match m with 0 => inj label 0 | _ => other (pred m)
+    node_t m = new_nat_var(mod, name);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, new_nat(mod), NULL) };
+    node_t vals[] = {
+        new_inj(mod, new_parity_type(mod), new_label(mod, label, NULL), new_nat_lit(mod, 0), NULL),
+        new_app(mod, other, new_app(mod, pred, m, NULL), NULL)
+    };
+    return new_abs(mod, m, new_match(mod, pats, vals, 2, m, NULL), NULL);
+}
+
+static node_t new_program(mod_t mod, uintmax_t arg) {
+    // letrec pred = ..., even = ..., odd = ... in
+    // let c = arg in let mk = \(z : Nat) -> { a = z, b = c } in
+    // match even c with inj even x => mk x | inj odd y => (mk y).{ a = 1 }
+    node_t pred = new_var(mod, new_nat_fun_type(mod, new_nat(mod)), new_label(mod, "pred", NULL), NULL);
+    node_t even = new_var(mod, new_nat_fun_type(mod, new_parity_type(mod)), new_label(mod, "even", NULL), NULL);
+    node_t odd  = new_var(mod, new_nat_fun_type(mod, new_parity_type(mod)), new_label(mod, "odd",  NULL), NULL);
+
+    node_t c = new_nat_var(mod, "c");
+    node_t x = new_nat_var(mod, "x");
+    node_t y = new_nat_var(mod, "y");
+    node_t z = new_nat_var(mod, "z");
+    node_t mk_abs = new_abs(mod, z, new_pair(mod, z, c), NULL);
+    node_t mk = new_var(mod, mk_abs->type, new_label(mod, "mk", NULL), NULL);
+
+    node_t pats[] = {
+        new_inj(mod, new_parity_type(mod), new_label(mod, "even", NULL), x, NULL),
+        new_inj(mod, new_parity_type(mod), new_label(mod, "odd",  NULL), y, NULL)
+    };
+    node_t vals[] = {
+        new_app(mod, mk, x, NULL),
+        new_ins(mod, new_app(mod, mk, y, NULL), &(node_t) { new_nat_lit(mod, 1) }, &(label_t) { new_label(mod, "a", NULL) }, 1, NULL)
+    };
+    node_t match = new_match(mod, pats, vals, 2, new_app(mod, even, c, NULL), NULL);
+    node_t c_val = new_nat_lit(mod, arg);
+    node_t let = new_let(mod, &c, &c_val, 1, new_let(mod, &mk, &mk_abs, 1, match, NULL), NULL);
+
+    node_t vars[] = { pred, even, odd };
+    node_t vals_rec[] = {
+        new_pred(mod),
+        new_parity_fun(mod, "m", "even", odd, pred),
+        new_parity_fun(mod, "k", "odd", even, pred)
+    };
+    return new_letrec(mod, vars, vals_rec, 3, let, NULL);
+}
+
+static node_t new_float_lit(mod_t mod, unsigned bitwidth, double d) {
+    node_t type = new_app(mod, new_float(mod), new_nat_lit(mod, bitwidth), NULL);
+    return new_lit(mod, type, &(struct lit) { .tag = LIT_FLOAT, .float_val = d }, NULL);
+}
+
+static node_t new_float_program(mod_t mod, uintmax_t bitwidth) {
+    // { a = inf, b = -inf, c = 1.5 }
+    node_t args[] = {
+        new_float_lit(mod, bitwidth, INFINITY),
+        new_float_lit(mod, bitwidth, -INFINITY),
+        new_float_lit(mod, bitwidth, 1.5)
+    };
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL), new_label(mod, "c", NULL) };
+    return new_record(mod, args, labels, 3, NULL);
+}
+
+static bool run_test(const char* cc, const char* name, node_t (*new_test_program)(mod_t, uintmax_t), uintmax_t arg) {
+    mod_t mod = new_mod();
+    node_t program = new_test_program(mod, arg);
+
+    char expected[OUTPUT_SIZE];
+    struct format_buf buf = { .data = expected, .cap = sizeof(expected) - 1 };
+    struct format_out out = { .buf = &buf, .tab = "  " };
+    print_node(&out, reduce_node(program));
+    expected[buf.size] = 0;
+
+    FILE* fp = fopen("cgen_test.c", "w");
+    char err_data[OUTPUT_SIZE];
+    struct format_buf err_buf = { .data = err_data, .cap = sizeof(err_data) };
+    struct log log = { .out = { .buf = &err_buf, .tab = "  " } };
+    bool ok = fp && emit_c(program, fp, &log);
+    if (fp)
+        fclose(fp);
+    free_mod(mod);
+    dump_format_buf(&err_buf, stderr);
+    free_format_buf(err_buf.next);
+    if (!ok)
+        return false;
+
+    char command[OUTPUT_SIZE];
+    snprintf(command, sizeof(command), "%s -std=c11 -O2 -Wall -Werror -o cgen_test cgen_test.c", cc);
+    if (system(command) != 0)
+        return false;
+
+    char output[OUTPUT_SIZE] = { 0 };
+    fp = popen("./cgen_test", "r");
+    if (!fp || !fgets(output, sizeof(output), fp))
+        return false;
+    pclose(fp);
+    output[strcspn(output, "\n")] = 0;
+
+    ok = !strcmp(output, expected);
+    printf("%s(%ju): %s%s\n", name, arg, output, ok ? "" : " (expected different result)");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* cc = argc > 1 ? argv[1] : "cc";
+    bool ok = true;
+    ok &= run_test(cc, "cgen", new_program, 7);
+    ok &= run_test(cc, "cgen", new_program, 4);
+    ok &= run_test(cc, "float", new_float_program, 64);
+    ok &= run_test(cc, "float", new_float_program, 32);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
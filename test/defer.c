@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "helpers.h"
+
+// Expressions built in a module that defers simplification stay as they are, until
+// `simplify_module` simplifies them in the same way as a module that does not defer.
+
+static node_t new_program(mod_t mod) {
+    // \(y : Nat) -> let x = y in match 2 + 3 with 5 => x * 2 | _ => 0
+    node_t nat = new_nat(mod);
+    node_t x = new_var(mod, nat, new_label(mod, "x", NULL), NULL);
+    node_t y = new_var(mod, nat, new_label(mod, "y", NULL), NULL);
+    node_t sum_args[] = { new_nat_lit(mod, 2), new_nat_lit(mod, 3) };
+    node_t sum = new_prim(mod, PRIM_ADD, nat, sum_args, 2, NULL);
+    node_t mul_args[] = { x, new_nat_lit(mod, 2) };
+    node_t pats[] = { new_nat_lit(mod, 5), new_unbound_var(mod, nat, NULL) };
+    node_t vals[] = { new_prim(mod, PRIM_MUL, nat, mul_args, 2, NULL), new_nat_lit(mod, 0) };
+    node_t match = new_match(mod, pats, vals, 2, sum, NULL);
+    return new_abs(mod, y, new_let(mod, &x, &y, 1, match, NULL), NULL);
+}
+
+int main(void) {
+    mod_t mod = new_mod_with_flags(MOD_DEFER_SIMPLIFY);
+    node_t program = new_program(mod);
+    bool ok = program->abs.body->tag == NODE_LET;
+    node_t simplified = simplify_module(program);
+    // Once simplified, the body is `y * 2`
+    ok &= simplified->tag == NODE_ABS && simplified->abs.body->tag == NODE_PRIM;
+    // Expressions built afterwards are simplified right away
+    ok &= new_program(mod) == simplified;
+    node_t res = reduce_node(new_app(mod, simplified, new_nat_lit(mod, 21), NULL));
+    ok &= res->tag == NODE_LIT && res->lit.int_val == 42;
+    if (!ok) {
+        printf("defer: got ");
+        dump_node(simplified);
+    }
+    free_mod(mod);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "ir/egraph.h"
+#include "helpers.h"
+
+// The program is left untouched by the simplifier, because optimizing it requires
+// inlining a let-expression, folding the resulting extracts, and reassociating.
+
+static node_t new_program(mod_t mod, node_t x) {
+    // \(x : Nat) -> let r = { a = x + 1, b = 2 } in r.a + r.b
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL) };
+    node_t args[] = { new_add(mod, x, new_nat_lit(mod, 1)), new_nat_lit(mod, 2) };
+    node_t record = new_record(mod, args, labels, 2, NULL);
+    node_t r = new_var(mod, record->type, new_label(mod, "r", NULL), NULL);
+    node_t body = new_add(mod, new_ext(mod, r, labels[0], NULL), new_ext(mod, r, labels[1], NULL));
+    return new_abs(mod, x, new_let(mod, &r, &record, 1, body, NULL), NULL);
+}
+
+static bool run_test(const char* name, enum egraph_cost cost) {
+    mod_t mod = new_mod();
+    node_t x = new_var(mod, new_nat(mod), new_label(mod, "x", NULL), NULL);
+    node_t expected = new_abs(mod, x, new_add(mod, x, new_nat_lit(mod, 3)), NULL);
+    struct egraph_options options = DEFAULT_EGRAPH_OPTIONS;
+    options.cost = cost;
+    node_t res = saturate_node(new_program(mod, x), &options);
+    bool ok = res == expected;
+    if (!ok) {
+        printf("egraph(%s): got ", name);
+        dump_node(res);
+    }
+    free_mod(mod);
+    return ok;
+}
+
+int main(void) {
+    bool ok = true;
+    ok &= run_test("size", EGRAPH_COST_SIZE);
+    ok &= run_test("eval", EGRAPH_COST_EVAL);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,242 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/eval.h"
+#include "vm/vm.h"
+#include "erase/erase.h"
+#include "helpers.h"
+
+#define MAX_PRED 300
+#define DEEP_ARG 100000
+
+// Programs are built directly in the IR, and operate on pairs of natural numbers.
+
+static node_t new_pair_type(mod_t mod) {
+    node_t args[] = { new_nat(mod), new_nat(mod) };
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL) };
+    return new_prod(mod, args, labels, 2, NULL);
+}
+
+static node_t new_pair(mod_t mod, node_t a, node_t b) {
+    node_t args[] = { a, b };
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL) };
+    return new_record(mod, args, labels, 2, NULL);
+}
+
+static node_t new_fun_var(mod_t mod, const char* name) {
+    node_t type = new_arrow(mod, new_unbound_var(mod, new_nat(mod), NULL), new_pair_type(mod), NULL);
+    return new_var(mod, type, new_label(mod, name, NULL), NULL);
+}
+
+static node_t new_pred(mod_t mod) {
+    // \(n : Nat) -> match n with 1 => 0 | 2 => 1 | ... | _ => 0
+    node_t n = new_var(mod, new_nat(mod), new_label(mod, "n", NULL), NULL);
+    node_t pats[MAX_PRED + 1];
+    node_t vals[MAX_PRED + 1];
+    for (size_t i = 0; i < MAX_PRED; ++i) {
+        pats[i] = new_nat_lit(mod, i + 1);
+        vals[i] = new_nat_lit(mod, i);
+    }
+    pats[MAX_PRED] = new_unbound_var(mod, new_nat(mod), NULL);
+    vals[MAX_PRED] = new_nat_lit(mod, 0);
+    return new_abs(mod, n, new_match(mod, pats, vals, MAX_PRED + 1, n, NULL), NULL);
+}
+
+static node_t new_sub_pred(mod_t mod) {
+    // \(n : Nat) -> n - 1
+    node_t n = new_nat_var(mod, "n");
+    return new_abs(mod, n, new_binary_prim(mod, PRIM_SUB, n, new_nat_lit(mod, 1)), NULL);
+}
+
+static node_t new_rec_fun(mod_t mod, node_t fun, node_t pred, node_t (*new_step)(mod_t, node_t, node_t, node_t)) {
+    // \(m : Nat) -> match m with 0 => { a = 0, b = 1 } | _ => step
+    node_t m = new_var(mod, new_nat(mod), new_label(mod, "m", NULL), NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, new_nat(mod), NULL) };
+    node_t vals[] = { new_pair(mod, new_nat_lit(mod, 0), new_nat_lit(mod, 1)), new_step(mod, fun, pred, m) };
+    return new_abs(mod, m, new_match(mod, pats, vals, 2, m, NULL), NULL);
+}
+
+static node_t new_swap_step(mod_t mod, node_t fun, node_t pred, node_t m) {
+    // let r = f (pred m) in { a = r.b, b = r.a }
+    label_t a = new_label(mod, "a", NULL), b = new_label(mod, "b", NULL);
+    node_t r = new_var(mod, new_pair_type(mod), new_label(mod, "r", NULL), NULL);
+    node_t val = new_app(mod, fun, new_app(mod, pred, m, NULL), NULL);
+    node_t body = new_pair(mod, new_ext(mod, r, b, NULL), new_ext(mod, r, a, NULL));
+    return new_let(mod, &r, &val, 1, body, NULL);
+}
+
+static node_t new_tree_step(mod_t mod, node_t fun, node_t pred, node_t m) {
+    // let r = f (pred m), s = f (pred (pred m)) in { a = s.b, b = r.a }
+    label_t a = new_label(mod, "a", NULL), b = new_label(mod, "b", NULL);
+    node_t vars[] = {
+        new_var(mod, new_pair_type(mod), new_label(mod, "r", NULL), NULL),
+        new_var(mod, new_pair_type(mod), new_label(mod, "s", NULL), NULL)
+    };
+    node_t vals[] = {
+        new_app(mod, fun, new_app(mod, pred, m, NULL), NULL),
+        new_app(mod, fun, new_app(mod, pred, new_app(mod, pred, m, NULL), NULL), NULL)
+    };
+    node_t body = new_pair(mod, new_ext(mod, vars[1], b, NULL), new_ext(mod, vars[0], a, NULL));
+    return new_let(mod, vars, vals, 2, body, NULL);
+}
+
+static node_t new_program_with_pred(
+    mod_t mod, node_t (*new_step)(mod_t, node_t, node_t, node_t), node_t (*new_pred_fun)(mod_t), uintmax_t arg)
+{
+    // letrec pred = ..., f = ... in f arg
+    node_t pred = new_var(mod,
+        new_arrow(mod, new_unbound_var(mod, new_nat(mod), NULL), new_nat(mod), NULL),
+        new_label(mod, "pred", NULL), NULL);
+    node_t fun = new_fun_var(mod, "f");
+    node_t vars[] = { pred, fun };
+    node_t vals[] = { new_pred_fun(mod), new_rec_fun(mod, fun, pred, new_step) };
+    return new_letrec(mod, vars, vals, 2, new_app(mod, fun, new_nat_lit(mod, arg), NULL), NULL);
+}
+
+static node_t new_program(mod_t mod, node_t (*new_step)(mod_t, node_t, node_t, node_t), uintmax_t arg) {
+    return new_program_with_pred(mod, new_step, new_pred, arg);
+}
+
+static node_t new_deep_swap_program(mod_t mod, uintmax_t arg) {
+    return new_program_with_pred(mod, new_swap_step, new_sub_pred, arg);
+}
+
+static node_t new_acc_program(mod_t mod, uintmax_t arg) {
+    // letrec go = \(n : Nat) -> \(acc : Nat) -> match n with 0 => acc | _ => go (n - 1) (acc + n) in go arg 0
+    node_t nat = new_nat(mod);
+    node_t go = new_var(mod,
+        new_arrow(mod, new_unbound_var(mod, nat, NULL), new_arrow(mod, new_unbound_var(mod, nat, NULL), nat, NULL), NULL),
+        new_label(mod, "go", NULL), NULL);
+    node_t n = new_var(mod, nat, new_label(mod, "n", NULL), NULL);
+    node_t acc = new_var(mod, nat, new_label(mod, "acc", NULL), NULL);
+    node_t rec_call = new_app(mod,
+        new_app(mod, go, new_binary_prim(mod, PRIM_SUB, n, new_nat_lit(mod, 1)), NULL),
+        new_add(mod, acc, n), NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, nat, NULL) };
+    node_t vals[] = { acc, rec_call };
+    node_t go_fun = new_abs(mod, n, new_abs(mod, acc, new_match(mod, pats, vals, 2, n, NULL), NULL), NULL);
+    node_t body = new_app(mod, new_app(mod, go, new_nat_lit(mod, arg), NULL), new_nat_lit(mod, 0), NULL);
+    return new_letrec(mod, &go, &go_fun, 1, body, NULL);
+}
+
+static bool is_same_value(node_t node1, node_t node2) {
+    if (node1->tag != node2->tag)
+        return false;
+    switch (node1->tag) {
+        case NODE_LIT:
+            return node1->lit.int_val == node2->lit.int_val;
+        case NODE_RECORD:
+            for (size_t i = 0, n = node1->record.arg_count; i < n; ++i) {
+                if (!is_same_value(node1->record.args[i], node2->record.args[i]))
+                    return false;
+            }
+            return node1->record.arg_count == node2->record.arg_count;
+        default:
+            return false;
+    }
+}
+
+static bool run_benchmark(
+    const char* name, node_t (*new_step)(mod_t, node_t, node_t, node_t), uintmax_t arg, size_t min_speedup)
+{
+    mod_t eval_mod = new_mod();
+    clock_t t_begin = clock();
+    node_t eval_res = eval_node(new_program(eval_mod, new_step, arg));
+    clock_t t_end = clock();
+    size_t eval_ms = elapsed_ms(t_begin, t_end);
+
+    mod_t vm_mod = new_mod();
+    struct log log = { .out.buf = NULL };
+    struct bytecode* bytecode = compile_to_bytecode(new_program(vm_mod, new_step, arg), &log);
+    if (!bytecode)
+        return false;
+    t_begin = clock();
+    node_t vm_res = run_bytecode(bytecode);
+    t_end = clock();
+    size_t vm_ms = elapsed_ms(t_begin, t_end);
+    free_bytecode(bytecode);
+
+    mod_t erased_mod = new_mod();
+    struct erased_program* program = erase_program(new_program(erased_mod, new_step, arg));
+    if (!program)
+        return false;
+    t_begin = clock();
+    node_t erased_res = run_erased_program(program);
+    t_end = clock();
+    size_t erased_ms = elapsed_ms(t_begin, t_end);
+    free_erased_program(program);
+
+    mod_t reduce_mod = new_mod();
+    t_begin = clock();
+    node_t reduce_res = reduce_node(new_program(reduce_mod, new_step, arg));
+    t_end = clock();
+    size_t reduce_ms = elapsed_ms(t_begin, t_end);
+
+    bool ok =
+        is_same_value(eval_res, reduce_res) &&
+        is_same_value(vm_res, reduce_res) &&
+        is_same_value(erased_res, reduce_res);
+    printf("%s(%ju): eval_node %zums, run_bytecode %zums, run_erased_program %zums, reduce_node %zums%s\n",
+        name, arg, eval_ms, vm_ms, erased_ms, reduce_ms, ok ? "" : " (results differ)");
+    if (min_speedup > 0) {
+        ok &= check_speedup("eval_node", eval_ms, reduce_ms, min_speedup);
+        ok &= check_speedup("run_erased_program", erased_ms, reduce_ms, min_speedup);
+    }
+    free_mod(eval_mod);
+    free_mod(vm_mod);
+    free_mod(erased_mod);
+    free_mod(reduce_mod);
+    return ok;
+}
+
+static bool run_deep_benchmark(const char* name, node_t (*new_deep_program)(mod_t, uintmax_t), uintmax_t arg) {
+    // Long loops must run in constant stack space. Reductions are not compared,
+    // since `reduce_node` is recursive.
+    mod_t eval_mod = new_mod();
+    clock_t t_begin = clock();
+    node_t eval_res = eval_node(new_deep_program(eval_mod, arg));
+    clock_t t_end = clock();
+    size_t eval_ms = elapsed_ms(t_begin, t_end);
+
+    mod_t vm_mod = new_mod();
+    struct log log = { .out.buf = NULL };
+    struct bytecode* bytecode = compile_to_bytecode(new_deep_program(vm_mod, arg), &log);
+    if (!bytecode)
+        return false;
+    t_begin = clock();
+    node_t vm_res = run_bytecode(bytecode);
+    t_end = clock();
+    size_t vm_ms = elapsed_ms(t_begin, t_end);
+    free_bytecode(bytecode);
+
+    mod_t erased_mod = new_mod();
+    struct erased_program* program = erase_program(new_deep_program(erased_mod, arg));
+    if (!program)
+        return false;
+    t_begin = clock();
+    node_t erased_res = run_erased_program(program);
+    t_end = clock();
+    size_t erased_ms = elapsed_ms(t_begin, t_end);
+    free_erased_program(program);
+
+    bool ok = is_same_value(eval_res, vm_res) && is_same_value(erased_res, vm_res);
+    printf("%s(%ju): eval_node %zums, run_bytecode %zums, run_erased_program %zums%s\n",
+        name, arg, eval_ms, vm_ms, erased_ms, ok ? "" : " (results differ)");
+    free_mod(eval_mod);
+    free_mod(vm_mod);
+    free_mod(erased_mod);
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    // The evaluators are several times faster than reduction. On the tree step, reduce_node
+    // memoizes the shared recursive calls, and is too fast to compare against.
+    ok &= run_benchmark("swap", new_swap_step, MAX_PRED, 4);
+    ok &= run_benchmark("tree", new_tree_step, 16, 0);
+    ok &= run_deep_benchmark("acc", new_acc_program, DEEP_ARG);
+    ok &= run_deep_benchmark("swap", new_deep_swap_program, DEEP_ARG);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
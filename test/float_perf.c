@@ -0,0 +1,87 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/eval.h"
+#include "ir/float_lets.h"
+#include "helpers.h"
+
+#define SUM_ARG    1000
+#define ITERATIONS 1000
+
+// A function that computes a sum that does not depend on its argument is applied in
+// a loop. Once the sum is floated out of the function, it is only computed once.
+
+static node_t new_sum_fun(mod_t mod, node_t sum) {
+    // \(n : Nat) -> match n with 0 => 0 | _ => n + sum (n - 1)
+    node_t n = new_var(mod, new_nat(mod), new_label(mod, "n", NULL), NULL);
+    node_t rec_call = new_app(mod, sum, new_binary_prim(mod, PRIM_SUB, n, new_nat_lit(mod, 1)), NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, new_nat(mod), NULL) };
+    node_t vals[] = { new_nat_lit(mod, 0), new_binary_prim(mod, PRIM_ADD, n, rec_call) };
+    return new_abs(mod, n, new_match(mod, pats, vals, 2, n, NULL), NULL);
+}
+
+static node_t new_iter(mod_t mod, node_t iter) {
+    // \(f : Nat -> Nat) -> \(k : Nat) -> \(acc : Nat) ->
+    //     match k with 0 => acc | _ => iter f (k - 1) (f acc)
+    node_t f = new_var(mod, new_nat_fun_type(mod, new_nat(mod)), new_label(mod, "f", NULL), NULL);
+    node_t k = new_var(mod, new_nat(mod), new_label(mod, "k", NULL), NULL);
+    node_t acc = new_var(mod, new_nat(mod), new_label(mod, "acc", NULL), NULL);
+    node_t rec_call = new_app(mod,
+        new_app(mod, new_app(mod, iter, f, NULL), new_binary_prim(mod, PRIM_SUB, k, new_nat_lit(mod, 1)), NULL),
+        new_app(mod, f, acc, NULL), NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, new_nat(mod), NULL) };
+    node_t vals[] = { acc, rec_call };
+    node_t match = new_match(mod, pats, vals, 2, k, NULL);
+    return new_abs(mod, f, new_abs(mod, k, new_abs(mod, acc, match, NULL), NULL), NULL);
+}
+
+static node_t new_program(mod_t mod) {
+    // letrec sum = ..., iter = ... in
+    //     iter (\(x : Nat) -> let c = sum SUM_ARG in x + c) ITERATIONS 0
+    node_t sum = new_var(mod, new_nat_fun_type(mod, new_nat(mod)), new_label(mod, "sum", NULL), NULL);
+    node_t iter_type = new_arrow(mod, new_unbound_var(mod, new_nat_fun_type(mod, new_nat(mod)), NULL),
+        new_arrow(mod, new_unbound_var(mod, new_nat(mod), NULL), new_nat_fun_type(mod, new_nat(mod)), NULL), NULL);
+    node_t iter = new_var(mod, iter_type, new_label(mod, "iter", NULL), NULL);
+    node_t x = new_var(mod, new_nat(mod), new_label(mod, "x", NULL), NULL);
+    node_t c = new_var(mod, new_nat(mod), new_label(mod, "c", NULL), NULL);
+    node_t c_val = new_app(mod, sum, new_nat_lit(mod, SUM_ARG), NULL);
+    node_t f = new_abs(mod, x, new_let(mod, &c, &c_val, 1, new_binary_prim(mod, PRIM_ADD, x, c), NULL), NULL);
+    node_t body = new_app(mod, new_app(mod, new_app(mod, iter, f, NULL), new_nat_lit(mod, ITERATIONS), NULL), new_nat_lit(mod, 0), NULL);
+    node_t vars[] = { sum, iter };
+    node_t vals[] = { new_sum_fun(mod, sum), new_iter(mod, iter) };
+    return new_letrec(mod, vars, vals, 2, body, NULL);
+}
+
+static bool is_expected(node_t node) {
+    return
+        node->tag == NODE_LIT &&
+        node->lit.int_val == (uintmax_t)ITERATIONS * SUM_ARG * (SUM_ARG + 1) / 2;
+}
+
+int main(void) {
+    mod_t mod = new_mod();
+    node_t program = new_program(mod);
+    node_t floated = float_lets(program, false);
+
+    clock_t t_begin = clock();
+    node_t res = eval_node(program);
+    clock_t t_end = clock();
+    size_t original_ms = elapsed_ms(t_begin, t_end);
+
+    t_begin = clock();
+    node_t floated_res = eval_node(floated);
+    t_end = clock();
+    size_t floated_ms = elapsed_ms(t_begin, t_end);
+
+    // Under strict evaluation, the sum stays in the function, since it might not terminate
+    bool ok =
+        floated != program && float_lets(program, true) == program &&
+        is_expected(res) && is_expected(floated_res);
+    printf("float_lets: eval_node %zums, with floated lets %zums%s\n",
+        original_ms, floated_ms, ok ? "" : " (results differ)");
+    ok &= check_speedup("float_lets", floated_ms, original_ms, 4);
+    free_mod(mod);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
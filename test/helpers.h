@@ -0,0 +1,58 @@
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+
+#include <time.h>
+#include <stdio.h>
+
+#include "ir/node.h"
+
+// Helpers shared by the tests that build programs directly in the IR.
+
+static inline node_t new_nat_lit(mod_t mod, uintmax_t i) {
+    return new_lit(mod, new_nat(mod), &(struct lit) { .tag = LIT_INT, .int_val = i }, NULL);
+}
+
+static inline node_t new_nat_var(mod_t mod, const char* name) {
+    return new_var(mod, new_nat(mod), new_label(mod, name, NULL), NULL);
+}
+
+static inline node_t new_binary_prim(mod_t mod, enum prim_op op, node_t left, node_t right) {
+    node_t args[] = { left, right };
+    return new_prim(mod, op, new_nat(mod), args, 2, NULL);
+}
+
+static inline node_t new_add(mod_t mod, node_t left, node_t right) {
+    return new_binary_prim(mod, PRIM_ADD, left, right);
+}
+
+static inline node_t new_nat_fun_type(mod_t mod, node_t codom) {
+    // Nat -> codom
+    return new_arrow(mod, new_unbound_var(mod, new_nat(mod), NULL), codom, NULL);
+}
+
+static inline size_t elapsed_ms(clock_t t_begin, clock_t t_end) {
+    return ((size_t)t_end - (size_t)t_begin) * 1000 / CLOCKS_PER_SEC;
+}
+
+#define MIN_MEASURED_MS 20
+
+static inline bool check_speedup(const char* name, size_t fast_ms, size_t slow_ms, size_t ratio) {
+    // The slow run must take long enough for the timer to resolve a `ratio` times
+    // speedup, so that the check does not fail on noise.
+    bool ok = slow_ms >= MIN_MEASURED_MS && fast_ms * ratio < slow_ms;
+    if (!ok)
+        printf("%s: %zums is not %zu times faster than %zums\n", name, fast_ms, ratio, slow_ms);
+    return ok;
+}
+
+static inline bool check_scaling(const char* name, size_t small_ms, size_t large_ms, size_t scale) {
+    // An input `scale` times larger may take up to twice `scale` times longer, which
+    // leaves room for noise but rules out quadratic algorithms. Runs that are too short
+    // to measure pass.
+    bool ok = large_ms < MIN_MEASURED_MS || large_ms < 2 * scale * small_ms;
+    if (!ok)
+        printf("%s: %zums for an input %zu times larger than one taking %zums\n", name, large_ms, scale, small_ms);
+    return ok;
+}
+
+#endif
@@ -6,11 +6,16 @@
 
 SET(int_set, size_t)
 
+static size_t get_key(size_t i) {
+    // Keys are scattered, so that collision chains are formed
+    return i * 2654435761u;
+}
+
 int main() {
     struct int_set int_set = new_int_set();
     int status = EXIT_SUCCESS;
     for (size_t i = 0; i < 1000; ++i) {
-        if (!insert_in_int_set(&int_set, i)) {
+        if (!insert_in_int_set(&int_set, get_key(i))) {
             printf("failed after %zu insertion(s)\n", i);
             status = EXIT_FAILURE;
             goto cleanup;
@@ -27,15 +32,30 @@ int main() {
         goto cleanup;
     }
     for (size_t i = 0; i < 1000; ++i) {
-        if (!find_in_int_set(&int_set, i)) {
+        if (!find_in_int_set(&int_set, get_key(i))) {
             printf("failed after %zu lookup(s)\n", i);
             status = EXIT_FAILURE;
             goto cleanup;
         }
     }
-    for (size_t i = 0; i < 1000; ++i) {
-        if (!remove_from_int_set(&int_set, i)) {
-            printf("failed after %zu removal(s)\n", i);
+    // Removing an element must not make the following elements of its collision chain unreachable
+    for (size_t i = 0; i < 1000; i += 2) {
+        if (!remove_from_int_set(&int_set, get_key(i))) {
+            printf("failed after %zu removal(s)\n", i / 2);
+            status = EXIT_FAILURE;
+            goto cleanup;
+        }
+    }
+    for (size_t i = 1; i < 1000; i += 2) {
+        if (!find_in_int_set(&int_set, get_key(i))) {
+            printf("failed after %zu lookup(s) following removals\n", i / 2);
+            status = EXIT_FAILURE;
+            goto cleanup;
+        }
+    }
+    for (size_t i = 1; i < 1000; i += 2) {
+        if (!remove_from_int_set(&int_set, get_key(i))) {
+            printf("failed after %zu removal(s)\n", 500 + i / 2);
             status = EXIT_FAILURE;
             goto cleanup;
         }
@@ -0,0 +1,104 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "utils/buf.h"
+#include "ir/node.h"
+#include "helpers.h"
+
+#define BINDING_COUNT 10000
+#define LABEL_SIZE    32
+#define SCALE         4
+
+// Letrec-expressions with many bindings are built directly in the IR, and are split
+// into let- and letrec-expressions when they are created.
+
+static void new_vars_with_type(mod_t mod, node_t type, const char* prefix, node_t* vars, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        char name[LABEL_SIZE];
+        snprintf(name, sizeof(name), "%s%zu", prefix, i);
+        vars[i] = new_var(mod, type, new_label(mod, name, NULL), NULL);
+    }
+}
+
+static node_t new_chain(mod_t mod, size_t count) {
+    // letrec v0 = 0, v1 = v0 + 1, ... in v(n-1), with the bindings in reverse order
+    node_t* vars = new_buf(node_t, count);
+    node_t* vals = new_buf(node_t, count);
+    new_vars_with_type(mod, new_nat(mod), "v", vars, count);
+    for (size_t i = 0; i < count; ++i) {
+        vals[count - i - 1] = i == 0
+            ? new_nat_lit(mod, 0)
+            : new_binary_prim(mod, PRIM_ADD, vars[i - 1], new_nat_lit(mod, 1));
+    }
+    for (size_t i = 0; i < count / 2; ++i) {
+        node_t var = vars[i];
+        vars[i] = vars[count - i - 1];
+        vars[count - i - 1] = var;
+    }
+    node_t res = new_letrec(mod, vars, vals, count, vars[0], NULL);
+    free_buf(vars);
+    free_buf(vals);
+    return res;
+}
+
+static node_t new_cycle(mod_t mod, size_t count) {
+    // letrec f0 = \(x : Nat) -> f1 (x + 1), ..., f(n-1) = \(x : Nat) -> f0 (x + 1) in f0 0
+    node_t nat = new_nat(mod);
+    node_t fn_type = new_arrow(mod, new_unbound_var(mod, nat, NULL), nat, NULL);
+    node_t* vars = new_buf(node_t, count);
+    node_t* params = new_buf(node_t, count);
+    node_t* vals = new_buf(node_t, count);
+    new_vars_with_type(mod, fn_type, "f", vars, count);
+    new_vars_with_type(mod, nat, "x", params, count);
+    for (size_t i = 0; i < count; ++i) {
+        node_t arg = new_binary_prim(mod, PRIM_ADD, params[i], new_nat_lit(mod, 1));
+        vals[i] = new_abs(mod, params[i], new_app(mod, vars[(i + 1) % count], arg, NULL), NULL);
+    }
+    node_t res = new_letrec(mod, vars, vals, count, new_app(mod, vars[0], new_nat_lit(mod, 0), NULL), NULL);
+    free_buf(vars);
+    free_buf(params);
+    free_buf(vals);
+    return res;
+}
+
+static bool check_chain(node_t node, size_t count) {
+    // Every binding depends on the previous one, so each must end up in its own let-expression
+    size_t let_count = 0;
+    while (node->tag == NODE_LET && node->let.var_count == 1) {
+        node = node->let.body;
+        let_count++;
+    }
+    return let_count == count && node->tag == NODE_VAR;
+}
+
+static bool check_cycle(node_t node, size_t count) {
+    return node->tag == NODE_LETREC && node->letrec.var_count == count;
+}
+
+static bool run_benchmark(const char* name, node_t (*new_program)(mod_t, size_t), bool (*check)(node_t, size_t), size_t count, size_t* ms) {
+    mod_t mod = new_mod();
+    clock_t t_begin = clock();
+    node_t program = new_program(mod, count);
+    clock_t t_end = clock();
+    bool ok = check(program, count);
+    *ms = elapsed_ms(t_begin, t_end);
+    printf("%s(%zu): %zums%s\n", name, count, *ms, ok ? "" : " (wrong result)");
+    free_mod(mod);
+    return ok;
+}
+
+static bool run_scaling_benchmark(const char* name, node_t (*new_program)(mod_t, size_t), bool (*check)(node_t, size_t)) {
+    // Splitting is linear in the number of bindings
+    size_t small_ms = 0, large_ms = 0;
+    bool ok = run_benchmark(name, new_program, check, BINDING_COUNT / SCALE, &small_ms);
+    ok &= run_benchmark(name, new_program, check, BINDING_COUNT, &large_ms);
+    return ok && check_scaling(name, small_ms, large_ms, SCALE);
+}
+
+int main(void) {
+    bool ok = true;
+    ok &= run_scaling_benchmark("chain", new_chain, check_chain);
+    ok &= run_scaling_benchmark("cycle", new_cycle, check_cycle);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "helpers.h"
+
+#define CASE_COUNT 1000
+
+// Match expressions are executed by the simplifier when their argument is known.
+
+static bool check_result(const char* name, node_t res, node_t expected) {
+    if (res == expected)
+        return true;
+    printf("%s: got ", name);
+    dump_node(res);
+    return false;
+}
+
+static bool test_nested(void) {
+    // match x with
+    // | { a = 0, b = l y } => y
+    // | { a = 1, b = _ } => 100
+    // | { a = z, b = r w } => z + w
+    // | _ => 7
+    mod_t mod = new_mod();
+    node_t nat = new_nat(mod);
+    label_t a = new_label(mod, "a", NULL), b = new_label(mod, "b", NULL);
+    label_t l = new_label(mod, "l", NULL), r = new_label(mod, "r", NULL);
+    node_t sum = new_sum(mod, (node_t[]) { nat, nat }, (label_t[]) { l, r }, 2, NULL);
+    node_t prod = new_prod(mod, (node_t[]) { nat, sum }, (label_t[]) { a, b }, 2, NULL);
+    node_t x = new_var(mod, prod, new_label(mod, "x", NULL), NULL);
+    node_t y = new_var(mod, nat, new_label(mod, "y", NULL), NULL);
+    node_t z = new_var(mod, nat, new_label(mod, "z", NULL), NULL);
+    node_t w = new_var(mod, nat, new_label(mod, "w", NULL), NULL);
+    node_t pats[] = {
+        new_record(mod, (node_t[]) { new_nat_lit(mod, 0), new_inj(mod, sum, l, y, NULL) }, (label_t[]) { a, b }, 2, NULL),
+        new_record(mod, (node_t[]) { new_nat_lit(mod, 1), new_unbound_var(mod, sum, NULL) }, (label_t[]) { a, b }, 2, NULL),
+        new_record(mod, (node_t[]) { z, new_inj(mod, sum, r, w, NULL) }, (label_t[]) { a, b }, 2, NULL),
+        new_unbound_var(mod, prod, NULL)
+    };
+    node_t vals[] = { y, new_nat_lit(mod, 100), new_add(mod, z, w), new_nat_lit(mod, 7) };
+    node_t match = new_match(mod, pats, vals, 4, x, NULL);
+
+    struct {
+        uintmax_t a;
+        label_t b;
+        uintmax_t b_arg;
+        uintmax_t expected;
+    } tests[] = {
+        { 0, l, 5, 5 },
+        { 1, r, 3, 100 },
+        { 2, r, 3, 5 },
+        { 2, l, 3, 7 },
+        { 0, r, 4, 4 }
+    };
+    bool ok = match->tag == NODE_MATCH;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+        node_t arg = new_record(mod, (node_t[]) {
+            new_nat_lit(mod, tests[i].a),
+            new_inj(mod, sum, tests[i].b, new_nat_lit(mod, tests[i].b_arg), NULL)
+        }, (label_t[]) { a, b }, 2, NULL);
+        ok &= check_result("nested", replace_var(match, x, arg), new_nat_lit(mod, tests[i].expected));
+    }
+
+    // The first field is unknown, so no case can be picked
+    node_t n = new_var(mod, nat, new_label(mod, "n", NULL), NULL);
+    node_t arg = new_record(mod, (node_t[]) { n, new_inj(mod, sum, l, new_nat_lit(mod, 5), NULL) }, (label_t[]) { a, b }, 2, NULL);
+    ok &= replace_var(match, x, arg)->tag == NODE_MATCH;
+    free_mod(mod);
+    return ok;
+}
+
+static bool test_wide(void) {
+    // match n with | 0 => 0 | 1 => 2 | ... | _ => 0
+    mod_t mod = new_mod();
+    node_t nat = new_nat(mod);
+    node_t n = new_var(mod, nat, new_label(mod, "n", NULL), NULL);
+    node_t pats[CASE_COUNT + 1];
+    node_t vals[CASE_COUNT + 1];
+    for (size_t i = 0; i < CASE_COUNT; ++i) {
+        pats[i] = new_nat_lit(mod, i);
+        vals[i] = new_nat_lit(mod, 2 * i);
+    }
+    pats[CASE_COUNT] = new_unbound_var(mod, nat, NULL);
+    vals[CASE_COUNT] = new_nat_lit(mod, 0);
+    node_t match = new_match(mod, pats, vals, CASE_COUNT + 1, n, NULL);
+
+    bool ok = true;
+    for (size_t i = 0; i < 2 * CASE_COUNT && ok; i += 7) {
+        node_t expected = new_nat_lit(mod, i < CASE_COUNT ? 2 * i : 0);
+        ok &= check_result("wide", replace_var(match, n, new_nat_lit(mod, i)), expected);
+    }
+    free_mod(mod);
+    return ok;
+}
+
+int main(void) {
+    bool ok = true;
+    ok &= test_nested();
+    ok &= test_wide();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "utils/thread_pool.h"
+#include "ir/node.h"
+#include "ir/print.h"
+#include "helpers.h"
+
+#define FIELD_COUNT  64
+#define TERM_COUNT   100
+#define THREAD_COUNT 4
+#define LABEL_SIZE   32
+
+// A wide record, where each field is an application that needs to be reduced, is
+// reduced with a thread pool. Every field must end up as a literal. The time taken
+// is compared with a sequential reduction, but only printed, since the speedup
+// depends on the number of cores of the machine running the test.
+
+static node_t new_field(mod_t mod, size_t i) {
+    // (\(x : Nat) -> x + (x + (... + 0))) i
+    node_t x = new_var(mod, new_nat(mod), new_label(mod, "x", NULL), NULL);
+    node_t body = new_nat_lit(mod, 0);
+    for (size_t j = 0; j < TERM_COUNT; ++j)
+        body = new_add(mod, x, body);
+    return new_app(mod, new_abs(mod, x, body, NULL), new_nat_lit(mod, i), NULL);
+}
+
+static node_t new_program(mod_t mod) {
+    node_t args[FIELD_COUNT];
+    label_t labels[FIELD_COUNT];
+    for (size_t i = 0; i < FIELD_COUNT; ++i) {
+        char name[LABEL_SIZE];
+        snprintf(name, sizeof(name), "f%zu", i);
+        args[i] = new_field(mod, i);
+        labels[i] = new_label(mod, name, NULL);
+    }
+    return new_record(mod, args, labels, FIELD_COUNT, NULL);
+}
+
+static bool check_result(node_t res) {
+    if (res->tag != NODE_RECORD || res->record.arg_count != FIELD_COUNT)
+        return false;
+    for (size_t i = 0; i < FIELD_COUNT; ++i) {
+        size_t index = find_label_in_node(res, res->record.labels[i]);
+        node_t field = res->record.args[index];
+        uintmax_t expected = 0;
+        sscanf(res->record.labels[i]->name, "f%ju", &expected);
+        if (field->tag != NODE_LIT || field->lit.int_val != expected * TERM_COUNT)
+            return false;
+    }
+    return true;
+}
+
+static size_t wall_ms(void) {
+    // Parallel reduction is timed with the wall clock, since clock() adds up the time of all threads
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (size_t)ts.tv_sec * 1000 + (size_t)ts.tv_nsec / 1000000;
+}
+
+static bool run_reduction(const char* name, struct thread_pool* pool) {
+    // Each run has its own module, so that it does not benefit from the caches of the other
+    mod_t mod = new_mod_with_flags(MOD_THREAD_SAFE);
+    node_t program = new_program(mod);
+    size_t t_begin = wall_ms();
+    node_t res = pool ? reduce_node_in_parallel(program, pool) : reduce_node(program);
+    size_t t_end = wall_ms();
+    bool ok = check_result(res);
+    printf("%s: reduce %zums%s\n", name, t_end - t_begin, ok ? "" : " (wrong result)");
+    if (!ok) {
+        printf("%s: got ", name);
+        dump_node(res);
+    }
+    free_mod(mod);
+    return ok;
+}
+
+int main(void) {
+    struct thread_pool* pool = new_thread_pool(THREAD_COUNT);
+    bool ok = run_reduction("sequential", NULL);
+    ok &= run_reduction("parallel", pool);
+    free_thread_pool(pool);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/prim.h"
+
+#define NAT       ((struct num_type) { .tag = NUM_NAT,   .bitwidth = 64 })
+#define INT(n)    ((struct num_type) { .tag = NUM_INT,   .bitwidth = n })
+#define FLOAT(n)  ((struct num_type) { .tag = NUM_FLOAT, .bitwidth = n })
+#define INT_LIT(i)   { .tag = LIT_INT,   .int_val = i }
+#define FLOAT_LIT(f) { .tag = LIT_FLOAT, .float_val = f }
+
+static bool check_int(
+    enum prim_op op, struct num_type arg_type, struct num_type res_type,
+    uintmax_t a, uintmax_t b, uintmax_t expected)
+{
+    struct lit args[] = { INT_LIT(a), INT_LIT(b) };
+    struct lit res = eval_prim(op, arg_type, res_type, args);
+    if (res.tag == LIT_INT && res.int_val == expected)
+        return true;
+    fprintf(stderr, "%ju %s %ju: expected %ju, got %ju\n",
+        a, get_prim_symbol(op), b, expected, res.int_val);
+    return false;
+}
+
+static bool check_float_to_int(struct num_type res_type, double a, uintmax_t expected) {
+    struct lit args[] = { FLOAT_LIT(a) };
+    struct lit res = eval_prim(PRIM_CONV, FLOAT(64), res_type, args);
+    if (res.tag == LIT_INT && res.int_val == expected)
+        return true;
+    fprintf(stderr, "%g as int: expected %ju, got %ju\n", a, expected, res.int_val);
+    return false;
+}
+
+static bool check_folding(void) {
+    // (3 + 4) * 5 must be folded into a literal when the node is created
+    mod_t mod = new_mod();
+    node_t nat = new_nat(mod);
+    node_t add_args[] = {
+        new_lit(mod, nat, &(struct lit) INT_LIT(3), NULL),
+        new_lit(mod, nat, &(struct lit) INT_LIT(4), NULL)
+    };
+    node_t mul_args[] = {
+        new_prim(mod, PRIM_ADD, nat, add_args, 2, NULL),
+        new_lit(mod, nat, &(struct lit) INT_LIT(5), NULL)
+    };
+    node_t res = new_prim(mod, PRIM_MUL, nat, mul_args, 2, NULL);
+    bool ok = res->tag == NODE_LIT && res->lit.int_val == 35;
+    free_mod(mod);
+    if (!ok)
+        fprintf(stderr, "constant expression was not folded\n");
+    return ok;
+}
+
+int main(void) {
+    bool ok = true;
+    ok &= check_int(PRIM_SUB, NAT, NAT, 3, 5, 0);
+    ok &= check_int(PRIM_DIV, NAT, NAT, 7, 0, 0);
+    ok &= check_int(PRIM_REM, NAT, NAT, 7, 0, 7);
+    ok &= check_int(PRIM_SHL, NAT, NAT, 1, 64, 0);
+    ok &= check_int(PRIM_ADD, INT(8), INT(8), 200, 100, 44);
+    ok &= check_int(PRIM_DIV, INT(8), INT(8), 0x80, 0xFF, 0x80);
+    ok &= check_int(PRIM_REM, INT(8), INT(8), 0x80, 0xFF, 0);
+    ok &= check_int(PRIM_DIV, INT(8), INT(8), 0xF9, 2, 0xFD);
+    ok &= check_int(PRIM_SHR, INT(8), INT(8), 0x80, 100, 0xFF);
+    ok &= check_int(PRIM_LT,  INT(8), NAT, 0xFF, 1, 1);
+    ok &= check_int(PRIM_LT,  NAT, NAT, 0xFF, 1, 0);
+    ok &= check_int(PRIM_CONV, INT(8), INT(16), 0xFE, 0, 0xFFFE);
+    ok &= check_float_to_int(INT(8), 1000.0, 0x7F);
+    ok &= check_float_to_int(INT(8), -1000.0, 0x80);
+    ok &= check_float_to_int(NAT, -3.0, 0);
+    ok &= check_folding();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,163 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "utils/buf.h"
+#include "ir/node.h"
+#include "helpers.h"
+
+#define FIELD_COUNT 20000
+#define LABEL_SIZE  32
+#define SCALE       4
+
+// Programs are built directly in the IR, and operate on records with many fields.
+
+static void new_field_labels(mod_t mod, label_t* labels, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        char name[LABEL_SIZE];
+        snprintf(name, sizeof(name), "f%zu", i);
+        labels[i] = new_label(mod, name, NULL);
+    }
+}
+
+static node_t new_program(mod_t mod, const label_t* labels, size_t count) {
+    // let r = { f0 = 0, f1 = 1, ... } in { f0 = r.f(n-1), f1 = r.f(n-2), ... }.{ f0 = n }
+    node_t* args = new_buf(node_t, count);
+    for (size_t i = 0; i < count; ++i)
+        args[i] = new_nat_lit(mod, i);
+    node_t val = new_record(mod, args, labels, count, NULL);
+    node_t r = new_var(mod, val->type, new_label(mod, "r", NULL), NULL);
+    for (size_t i = 0; i < count; ++i)
+        args[i] = new_ext(mod, r, labels[count - i - 1], NULL);
+    node_t body = new_ins(mod, new_record(mod, args, labels, count, NULL), &(node_t) { new_nat_lit(mod, count) }, labels, 1, NULL);
+    free_buf(args);
+    return new_let(mod, &r, &val, 1, body, NULL);
+}
+
+static bool check_result(node_t res, const label_t* labels, size_t count) {
+    if (res->tag != NODE_RECORD || res->record.arg_count != count)
+        return false;
+    for (size_t i = 0; i < count; ++i) {
+        uintmax_t expected = i == 0 ? count : count - i - 1;
+        node_t arg = res->record.args[find_label_in_node(res, labels[i])];
+        if (arg->tag != NODE_LIT || arg->lit.int_val != expected)
+            return false;
+    }
+    return true;
+}
+
+static bool check_label_sensitivity(void) {
+    // Products that only differ by their labels must be different nodes
+    mod_t mod = new_mod();
+    node_t nat = new_nat(mod);
+    label_t a = new_label(mod, "a", NULL), b = new_label(mod, "b", NULL);
+    bool ok = new_prod(mod, &nat, &a, 1, NULL) != new_prod(mod, &nat, &b, 1, NULL);
+    free_mod(mod);
+    if (!ok)
+        fprintf(stderr, "products with different labels are equal\n");
+    return ok;
+}
+
+static bool run_benchmark(size_t count, size_t* total_ms) {
+    mod_t mod = new_mod();
+    label_t* labels = new_buf(label_t, count);
+    new_field_labels(mod, labels, count);
+    clock_t t_begin = clock();
+    node_t program = new_program(mod, labels, count);
+    clock_t t_end = clock();
+    size_t build_ms = elapsed_ms(t_begin, t_end);
+
+    t_begin = clock();
+    node_t res = reduce_node(program);
+    t_end = clock();
+    size_t reduce_ms = elapsed_ms(t_begin, t_end);
+
+    bool ok = check_result(res, labels, count);
+    *total_ms = build_ms + reduce_ms;
+    printf("record(%zu): build %zums, reduce_node %zums%s\n",
+        count, build_ms, reduce_ms, ok ? "" : " (wrong result)");
+    free_buf(labels);
+    free_mod(mod);
+    return ok;
+}
+
+static bool check_sum_alias(void) {
+    // Inserting into a value of type (\(t : *) -> t) <a : Nat, b : Nat> gives an injection
+    mod_t mod = new_mod();
+    node_t nat_args[] = { new_nat(mod), new_nat(mod) };
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL) };
+    node_t sum = new_sum(mod, nat_args, labels, 2, NULL);
+    node_t t = new_var(mod, new_star(mod), new_label(mod, "t", NULL), NULL);
+    node_t alias = new_app(mod, new_abs(mod, t, t, NULL), sum, NULL);
+    node_t s = new_var(mod, alias, new_label(mod, "s", NULL), NULL);
+    node_t ins = new_ins(mod, s, &(node_t) { new_nat_lit(mod, 1) }, &labels[1], 1, NULL);
+    bool ok = ins->tag == NODE_INJ && ins->inj.label == labels[1];
+    free_mod(mod);
+    if (!ok)
+        fprintf(stderr, "insertion into an aliased sum is not an injection\n");
+    return ok;
+}
+
+static node_t new_nested_ins(mod_t mod, const label_t* labels, size_t count) {
+    // r.{ f0 = 0, f1 = 1, ... }.{ f0 = n, f2 = n, ... }, on a variable r of record type
+    node_t* args = new_buf(node_t, count);
+    for (size_t i = 0; i < count; ++i)
+        args[i] = new_nat(mod);
+    node_t r = new_var(mod, new_prod(mod, args, labels, count, NULL), new_label(mod, "r", NULL), NULL);
+    for (size_t i = 0; i < count; ++i)
+        args[i] = new_nat_lit(mod, i);
+    node_t inner = new_ins(mod, r, args, labels, count, NULL);
+    label_t* outer_labels = new_buf(label_t, count / 2);
+    for (size_t i = 0; i < count / 2; ++i) {
+        args[i] = new_nat_lit(mod, count);
+        outer_labels[i] = labels[2 * i];
+    }
+    node_t res = new_ins(mod, inner, args, outer_labels, count / 2, NULL);
+    free_buf(outer_labels);
+    free_buf(args);
+    return res;
+}
+
+static bool check_nested_ins(node_t res, const label_t* labels, size_t count) {
+    // Nested insertions are merged, and the outer elements take precedence
+    if (res->tag != NODE_INS || res->ins.elem_count != count || res->ins.val->tag != NODE_VAR)
+        return false;
+    for (size_t i = 0; i < count; ++i) {
+        size_t j = 0;
+        while (j < count && res->ins.labels[j] != labels[i])
+            j++;
+        uintmax_t expected = i % 2 == 0 ? count : i;
+        if (j == count || res->ins.elems[j]->tag != NODE_LIT || res->ins.elems[j]->lit.int_val != expected)
+            return false;
+    }
+    return true;
+}
+
+static bool run_ins_benchmark(size_t count, size_t* ms) {
+    mod_t mod = new_mod();
+    label_t* labels = new_buf(label_t, count);
+    new_field_labels(mod, labels, count);
+    clock_t t_begin = clock();
+    node_t res = new_nested_ins(mod, labels, count);
+    clock_t t_end = clock();
+    *ms = elapsed_ms(t_begin, t_end);
+    bool ok = check_nested_ins(res, labels, count);
+    printf("ins(%zu): merge %zums%s\n", count, *ms, ok ? "" : " (wrong result)");
+    free_buf(labels);
+    free_mod(mod);
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    ok &= check_label_sensitivity();
+    ok &= check_sum_alias();
+    size_t small_ms = 0, large_ms = 0;
+    ok &= run_benchmark(FIELD_COUNT / SCALE, &small_ms);
+    ok &= run_benchmark(FIELD_COUNT, &large_ms);
+    ok &= check_scaling("record", small_ms, large_ms, SCALE);
+    ok &= run_ins_benchmark(FIELD_COUNT / SCALE, &small_ms);
+    ok &= run_ins_benchmark(FIELD_COUNT, &large_ms);
+    ok &= check_scaling("ins", small_ms, large_ms, SCALE);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
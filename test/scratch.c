@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "utils/log.h"
+#include "helpers.h"
+
+#define SUM_ARG     500
+#define DEEP_COUNT  100000
+#define OUTPUT_SIZE 1024
+
+// Reducing a program in a scratch module gives the same normal form as reducing it
+// in place, but the intermediate terms of the reduction do not stay in the module.
+
+static node_t new_program(mod_t mod) {
+    // letrec sum = \(n : Nat) -> match n with 0 => 0 | _ => n + sum (n - 1) in
+    //     { a = sum SUM_ARG, f = \(x : Nat) -> x + sum 10 }
+    node_t nat = new_nat(mod);
+    node_t sum_type = new_arrow(mod, new_unbound_var(mod, nat, NULL), nat, NULL);
+    node_t sum = new_var(mod, sum_type, new_label(mod, "sum", NULL), NULL);
+    node_t n = new_var(mod, nat, new_label(mod, "n", NULL), NULL);
+    node_t x = new_var(mod, nat, new_label(mod, "x", NULL), NULL);
+    node_t rec_call = new_app(mod, sum, new_binary_prim(mod, PRIM_SUB, n, new_nat_lit(mod, 1)), NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, nat, NULL) };
+    node_t vals[] = { new_nat_lit(mod, 0), new_binary_prim(mod, PRIM_ADD, n, rec_call) };
+    node_t sum_fun = new_abs(mod, n, new_match(mod, pats, vals, 2, n, NULL), NULL);
+    node_t args[] = {
+        new_app(mod, sum, new_nat_lit(mod, SUM_ARG), NULL),
+        new_abs(mod, x, new_binary_prim(mod, PRIM_ADD, x, new_app(mod, sum, new_nat_lit(mod, 10), NULL)), NULL)
+    };
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "f", NULL) };
+    node_t body = new_record(mod, args, labels, 2, NULL);
+    return new_letrec(mod, &sum, &sum_fun, 1, body, NULL);
+}
+
+static node_t new_deep_program(mod_t mod) {
+    // \(x : Nat) -> fold (\(acc : Nat) -> \(e : Nat) -> acc + x) x [0, 1, ..., DEEP_COUNT - 1]
+    node_t nat = new_nat(mod);
+    node_t x = new_var(mod, nat, new_label(mod, "x", NULL), NULL);
+    node_t acc = new_var(mod, nat, new_label(mod, "acc", NULL), NULL);
+    node_t e = new_var(mod, nat, new_label(mod, "e", NULL), NULL);
+    node_t fn = new_abs(mod, acc, new_abs(mod, e, new_binary_prim(mod, PRIM_ADD, acc, x), NULL), NULL);
+    node_t* elems = malloc(sizeof(node_t) * DEEP_COUNT);
+    for (size_t i = 0; i < DEEP_COUNT; ++i)
+        elems[i] = new_nat_lit(mod, i);
+    node_t array = new_elems(mod, nat, elems, DEEP_COUNT, NULL);
+    free(elems);
+    return new_abs(mod, x, new_fold(mod, fn, x, array, NULL), NULL);
+}
+
+static node_t new_deep_loop(mod_t mod) {
+    // letrec go = \(n : Nat) -> \(acc : Nat) -> match n with 0 => acc | _ => go (n - 1) (acc + n) in go DEEP_COUNT 0
+    node_t nat = new_nat(mod);
+    node_t go = new_var(mod, new_nat_fun_type(mod, new_nat_fun_type(mod, nat)), new_label(mod, "go", NULL), NULL);
+    node_t n = new_nat_var(mod, "n");
+    node_t acc = new_nat_var(mod, "acc");
+    node_t rec_call = new_app(mod,
+        new_app(mod, go, new_binary_prim(mod, PRIM_SUB, n, new_nat_lit(mod, 1)), NULL),
+        new_add(mod, acc, n), NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, nat, NULL) };
+    node_t vals[] = { acc, rec_call };
+    node_t go_fun = new_abs(mod, n, new_abs(mod, acc, new_match(mod, pats, vals, 2, n, NULL), NULL), NULL);
+    node_t body = new_app(mod, new_app(mod, go, new_nat_lit(mod, DEEP_COUNT), NULL), new_nat_lit(mod, 0), NULL);
+    return new_letrec(mod, &go, &go_fun, 1, body, NULL);
+}
+
+static node_t reduce_in_scratch(node_t node, size_t* errors) {
+    char err_data[OUTPUT_SIZE];
+    struct format_buf err_buf = { .data = err_data, .cap = sizeof(err_data) };
+    struct log log = { .out = { .buf = &err_buf, .tab = "  " } };
+    node_t res = reduce_node_in_scratch(node, &(struct budget) { 0 }, &log);
+    free_format_buf(err_buf.next);
+    *errors = log.errors;
+    return res;
+}
+
+static bool check_deep_loop(void) {
+    // The reduction of the loop nests once per iteration, and must report an error
+    // instead of overflowing the stack. The module is left untouched.
+    mod_t mod = new_mod();
+    node_t program = new_deep_loop(mod);
+    size_t errors = 0;
+    node_t res = reduce_in_scratch(program, &errors);
+    bool ok = !res && errors == 1;
+    printf("scratch: deep loop %s\n", ok ? "stopped with an error" : "(expected an error)");
+    free_mod(mod);
+    return ok;
+}
+
+static bool check_deep_program(void) {
+    // The result `\(x : Nat) -> x + x + ... + x` is as deep as the array is long, and
+    // must be copied back from the scratch module without exhausting the stack
+    mod_t mod = new_mod();
+    size_t errors = 0;
+    node_t res = reduce_in_scratch(new_deep_program(mod), &errors);
+    if (!res) {
+        printf("scratch: deep result could not be reduced\n");
+        free_mod(mod);
+        return false;
+    }
+    size_t depth = 0;
+    node_t node = res->abs.body;
+    for (; node->tag == NODE_PRIM; node = node->prim.args[0])
+        depth++;
+    bool ok = depth == DEEP_COUNT && node == res->abs.var;
+    printf("scratch: deep result of depth %zu%s\n", depth, ok ? "" : " (expected different result)");
+    free_mod(mod);
+    return ok;
+}
+
+int main(void) {
+    mod_t mod = new_mod();
+    node_t program = new_program(mod);
+    size_t node_count = get_mod_stats(mod)->node_count;
+    size_t errors = 0;
+    node_t scratch_res = reduce_in_scratch(program, &errors);
+    size_t scratch_node_count = get_mod_stats(mod)->node_count - node_count;
+
+    mod_t other_mod = new_mod();
+    node_t other_program = new_program(other_mod);
+    node_count = get_mod_stats(other_mod)->node_count;
+    node_t res = reduce_node(other_program);
+    size_t reduce_node_count = get_mod_stats(other_mod)->node_count - node_count;
+
+    // Both results are `{ a = 125250, f = \(x : Nat) -> x + 55 }`
+    bool ok =
+        scratch_res && errors == 0 &&
+        scratch_res->tag == NODE_RECORD &&
+        scratch_res->record.args[0]->tag == NODE_LIT &&
+        scratch_res->record.args[0]->lit.int_val == res->record.args[0]->lit.int_val &&
+        scratch_res->record.args[1]->tag == NODE_ABS &&
+        scratch_res->record.args[1]->abs.body->tag == NODE_PRIM &&
+        scratch_res->record.args[1]->abs.body->prim.args[1]->lit.int_val == 55 &&
+        reduce_node(program) == scratch_res &&
+        scratch_node_count < reduce_node_count;
+    printf("scratch: %zu new node(s) with reduce_node_in_scratch, %zu with reduce_node%s\n",
+        scratch_node_count, reduce_node_count, ok ? "" : " (results differ)");
+    if (!ok && scratch_res)
+        dump_node(scratch_res);
+    free_mod(mod);
+    free_mod(other_mod);
+    ok &= check_deep_program();
+    ok &= check_deep_loop();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "ir/specialize.h"
+#include "helpers.h"
+
+#define MAX_EXPONENT 8
+
+// A generic power function is specialized for a known exponent. Applying the
+// specialized program must give the same results as the original one.
+
+static node_t new_program(mod_t mod, uintmax_t exponent) {
+    // letrec pow : Nat -> Nat -> Nat = \(n : Nat) -> \(x : Nat) ->
+    //     match n with 0 => 1 | _ => x * pow (n - 1) x
+    // in \(y : Nat) -> pow exponent y
+    node_t nat = new_nat(mod);
+    node_t n = new_var(mod, nat, new_label(mod, "n", NULL), NULL);
+    node_t x = new_var(mod, nat, new_label(mod, "x", NULL), NULL);
+    node_t y = new_var(mod, nat, new_label(mod, "y", NULL), NULL);
+    node_t pow_type = new_arrow(mod, new_unbound_var(mod, nat, NULL),
+        new_arrow(mod, new_unbound_var(mod, nat, NULL), nat, NULL), NULL);
+    node_t pow = new_var(mod, pow_type, new_label(mod, "pow", NULL), NULL);
+    node_t rec_call = new_app(mod, new_app(mod, pow, new_binary_prim(mod, PRIM_SUB, n, new_nat_lit(mod, 1)), NULL), x, NULL);
+    node_t pats[] = { new_nat_lit(mod, 0), new_unbound_var(mod, nat, NULL) };
+    node_t vals[] = { new_nat_lit(mod, 1), new_binary_prim(mod, PRIM_MUL, x, rec_call) };
+    node_t pow_val = new_abs(mod, n, new_abs(mod, x, new_match(mod, pats, vals, 2, n, NULL), NULL), NULL);
+    node_t body = new_abs(mod, y, new_app(mod, new_app(mod, pow, new_nat_lit(mod, exponent), NULL), y, NULL), NULL);
+    return new_letrec(mod, &pow, &pow_val, 1, body, NULL);
+}
+
+int main(void) {
+    mod_t mod = new_mod();
+    bool ok = true;
+    for (uintmax_t i = 0; i <= MAX_EXPONENT && ok; ++i) {
+        node_t program = new_program(mod, i);
+        node_t specialized = specialize_node(program);
+        ok &= specialized != program;
+        for (uintmax_t j = 0; j < 4 && ok; ++j) {
+            node_t expected = reduce_node(new_app(mod, program, new_nat_lit(mod, j), NULL));
+            node_t res = reduce_node(new_app(mod, specialized, new_nat_lit(mod, j), NULL));
+            if (res != expected) {
+                printf("specialize: got ");
+                dump_node(res);
+                ok = false;
+            }
+        }
+    }
+    free_mod(mod);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir/node.h"
+#include "ir/print.h"
+#include "utils/log.h"
+#include "helpers.h"
+
+// Reductions that only need the head of a term do not reduce its operands, which
+// may be expensive, or may not terminate at all.
+
+static node_t new_loop(mod_t mod) {
+    // letrec loop = \(n : Nat) -> loop (n + 1) in loop 0
+    node_t nat = new_nat(mod);
+    node_t loop = new_var(mod, new_arrow(mod, new_unbound_var(mod, nat, NULL), nat, NULL), new_label(mod, "loop", NULL), NULL);
+    node_t n = new_var(mod, nat, new_label(mod, "n", NULL), NULL);
+    node_t args[] = { n, new_nat_lit(mod, 1) };
+    node_t loop_fun = new_abs(mod, n, new_app(mod, loop, new_prim(mod, PRIM_ADD, nat, args, 2, NULL), NULL), NULL);
+    return new_letrec(mod, &loop, &loop_fun, 1, new_app(mod, loop, new_nat_lit(mod, 0), NULL), NULL);
+}
+
+static node_t new_record_with_loop(mod_t mod) {
+    // { a = loop 0, b = (\(x : Nat) -> x) 2 }
+    node_t x = new_var(mod, new_nat(mod), new_label(mod, "x", NULL), NULL);
+    node_t args[] = { new_loop(mod), new_app(mod, new_abs(mod, x, x, NULL), new_nat_lit(mod, 2), NULL) };
+    label_t labels[] = { new_label(mod, "a", NULL), new_label(mod, "b", NULL) };
+    return new_record(mod, args, labels, 2, NULL);
+}
+
+static node_t new_nested_abs(mod_t mod) {
+    // \(x : Nat) -> (\(y : Nat) -> y) x
+    node_t x = new_var(mod, new_nat(mod), new_label(mod, "x", NULL), NULL);
+    node_t y = new_var(mod, new_nat(mod), new_label(mod, "y", NULL), NULL);
+    return new_abs(mod, x, new_app(mod, new_abs(mod, y, y, NULL), x, NULL), NULL);
+}
+
+static node_t new_alias(mod_t mod, node_t type) {
+    // (\(u : *) -> u) type
+    node_t u = new_var(mod, new_star(mod), new_label(mod, "u", NULL), NULL);
+    return new_app(mod, new_abs(mod, u, u, NULL), type, NULL);
+}
+
+static bool check_normal_types(mod_t mod) {
+    // Types are compared by address, so the types of extractions and applications must be
+    // in normal form, even when the type they come from only substitutes its argument
+    // in weak head normal form
+    node_t nat = new_nat(mod);
+    label_t a = new_label(mod, "a", NULL);
+    node_t t = new_var(mod, new_star(mod), new_label(mod, "t", NULL), NULL);
+
+    // (\(t : *) -> { a : t }) ((\(u : *) -> u) Nat)
+    node_t prod = new_app(mod, new_abs(mod, t, new_prod(mod, &t, &a, 1, NULL), NULL), new_alias(mod, nat), NULL);
+    node_t r = new_var(mod, prod, new_label(mod, "r", NULL), NULL);
+
+    // (\(t : *) -> Nat -> t) ((\(u : *) -> u) Nat)
+    node_t arrow = new_arrow(mod, new_unbound_var(mod, nat, NULL), t, NULL);
+    node_t fun_type = new_app(mod, new_abs(mod, t, arrow, NULL), new_alias(mod, nat), NULL);
+    node_t f = new_var(mod, fun_type, new_label(mod, "f", NULL), NULL);
+    return
+        new_ext(mod, r, a, NULL)->type == nat &&
+        new_app(mod, f, new_nat_lit(mod, 1), NULL)->type == nat;
+}
+
+int main(void) {
+    mod_t mod = new_mod();
+    struct log log = { .out.buf = NULL };
+    struct budget budget = { .max_steps = 10000 };
+
+    // The head of the record is known without reducing its fields
+    node_t record = new_record_with_loop(mod);
+    node_t whnf = reduce_to_whnf(record);
+    bool ok = whnf == record;
+
+    // Extracting a field only reduces that field
+    node_t ext = new_ext(mod, record, new_label(mod, "b", NULL), NULL);
+    node_t res = reduce_node_with_budget(ext, &budget, &log);
+    ok &= res && res->tag == NODE_LIT && res->lit.int_val == 2;
+
+    // Head normal forms reduce under abstractions, weak head normal forms do not
+    node_t abs = new_nested_abs(mod);
+    ok &= reduce_node_with_strategy(abs, REDUCE_WHNF) == abs;
+    node_t hnf = reduce_node_with_strategy(abs, REDUCE_HNF);
+    ok &= hnf->tag == NODE_ABS && hnf->abs.body == hnf->abs.var;
+    ok &= reduce_node_with_strategy(abs, REDUCE_NF) == hnf;
+    ok &= check_normal_types(mod);
+
+    if (!ok) {
+        printf("whnf: got ");
+        dump_node(res ? res : whnf);
+    }
+    free_mod(mod);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}